@@ -0,0 +1,751 @@
+// Micro-benchmarks for the storage and index layers.
+//
+//   make bench                       run every benchmark
+//   ./nyotadb_bench point-lookup     run the named benchmarks
+//
+// Each benchmark works on a scratch database file that is removed when it
+// finishes. Page counts come from the storage manager's cache counters.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "rdbms/storage.h"
+#include "rdbms/btree.h"
+#include "rdbms/hashindex.h"
+#include "rdbms/extsort.h"
+#include "rdbms/executor.h"
+#include "rdbms/vectorfilter.h"
+#include "rdbms/main.h"
+
+#define BENCH_DB "bench.db"
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Deterministic xorshift so that runs are comparable
+static uint32_t bench_rand(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static StorageManager* open_scratch(void) {
+    unlink(BENCH_DB);
+    return sm_open(BENCH_DB);
+}
+
+static void close_scratch(StorageManager* sm) {
+    sm_close(sm);
+    unlink(BENCH_DB);
+}
+
+// Registers an index on a single INT column of a made-up table
+static void register_index(StorageManager* sm, const char* name, IndexMethod method) {
+    IndexDef def;
+    memset(&def, 0, sizeof(IndexDef));
+    strncpy(def.name, name, MAX_INDEX_NAME - 1);
+    strcpy(def.table_name, "bench");
+    def.key_column_count = 1;
+    def.fill_factor = BTREE_DEFAULT_FILL_FACTOR;
+    def.method = method;
+    if (method == INDEX_HASH) def.root_page = hash_create_storage(sm);
+    index_catalog_save(sm, &def);
+}
+
+static void report(const char* label, double build_ms, uint32_t lookups, double lookup_ms,
+                   uint64_t requests, uint64_t reads, uint32_t found) {
+    printf("  %-6s build %8.1f ms | lookups %7.0f ns/op, %5.2f pages/op, %5.2f disk reads/op (%u found)\n",
+           label, build_ms, lookup_ms * 1e6 / lookups, (double)requests / lookups,
+           (double)reads / lookups, found);
+}
+
+// Point lookups on unique INT keys: B+tree versus linear hash index
+static void bench_point_lookup(void) {
+    const uint32_t key_count = 200000;
+    const uint32_t lookup_count = 200000;
+
+    TableSchema schema;
+    memset(&schema, 0, sizeof(TableSchema));
+    strcpy(schema.name, "bench");
+    schema.column_count = 1;
+    schema.columns[0].type = DT_INT;
+
+    printf("point-lookup: %u unique INT keys, %u random lookups, %d-page cache\n",
+           key_count, lookup_count, MAX_CACHE_PAGES);
+
+    StorageManager* sm = open_scratch();
+    register_index(sm, "bench_btree", INDEX_BTREE);
+    register_index(sm, "bench_hash", INDEX_HASH);
+    BTreeIndex* btree = btree_create_index(sm, &schema, "bench_btree");
+    HashIndex* hash = hash_open_index(sm, &schema, "bench_hash");
+
+    uint8_t key[BTREE_MAX_KEY_SIZE];
+
+    // B+tree: bulk build from sorted keys, as CREATE INDEX does
+    double start = now_ms();
+    BTreeBuilder* builder = btree_build_begin(sm, btree, BTREE_DEFAULT_FILL_FACTOR);
+    for (uint32_t i = 0; i < key_count; i++) {
+        int value = (int)i;
+        RID rid = { i / 100 + 1, i % 100 };
+        btree_encode_value(&schema.columns[0], &value, key);
+        btree_build_add(builder, key, rid);
+    }
+    btree_build_finish(builder);
+    double btree_build = now_ms() - start;
+
+    // Hash: one insert per key, buckets split as it grows
+    start = now_ms();
+    for (uint32_t i = 0; i < key_count; i++) {
+        int value = (int)i;
+        RID rid = { i / 100 + 1, i % 100 };
+        btree_encode_value(&schema.columns[0], &value, key);
+        hash_insert(sm, hash, key, rid);
+    }
+    double hash_build = now_ms() - start;
+
+    for (int method = 0; method < 2; method++) {
+        uint32_t seed = 12345, found = 0;
+        uint64_t requests = sm->page_requests, reads = sm->page_reads;
+
+        start = now_ms();
+        for (uint32_t i = 0; i < lookup_count; i++) {
+            int value = (int)(bench_rand(&seed) % key_count);
+            btree_encode_value(&schema.columns[0], &value, key);
+
+            RID rid;
+            bool hit = method == 0 ? btree_search(sm, btree, key, &rid) : hash_search(sm, hash, key, &rid);
+            if (hit && rid.page_id == (uint32_t)value / 100 + 1 && rid.slot == (uint32_t)value % 100) {
+                found++;
+            }
+        }
+        double elapsed = now_ms() - start;
+
+        report(method == 0 ? "btree" : "hash", method == 0 ? btree_build : hash_build, lookup_count,
+               elapsed, sm->page_requests - requests, sm->page_reads - reads, found);
+    }
+
+    HashStats stats;
+    if (hash_stats(sm, hash, &stats)) {
+        printf("  hash: %u buckets (level %u, split pointer %u), %u bucket pages\n",
+               stats.bucket_count, stats.level, stats.next_split, stats.page_count);
+    }
+
+    btree_free_index(btree);
+    hash_free_index(hash);
+    close_scratch(sm);
+}
+
+// Email-like keys in a STRING(255) column, zero padded to 255 bytes once
+// encoded, so the node format rather than the key width decides fanout
+static void bench_string_keys(void) {
+    const uint32_t key_count = 100000;
+    const uint32_t lookup_count = 100000;
+
+    TableSchema schema;
+    memset(&schema, 0, sizeof(TableSchema));
+    strcpy(schema.name, "bench");
+    schema.column_count = 1;
+    schema.columns[0].type = DT_STRING;
+    schema.columns[0].length = 255;
+
+    printf("string-keys: %u unique STRING(255) email keys, %u random lookups, %d-page cache\n",
+           key_count, lookup_count, MAX_CACHE_PAGES);
+
+    StorageManager* sm = open_scratch();
+    register_index(sm, "bench_bulk", INDEX_BTREE);
+    register_index(sm, "bench_insert", INDEX_BTREE);
+    BTreeIndex* bulk = btree_create_index(sm, &schema, "bench_bulk");
+    BTreeIndex* inserted = btree_create_index(sm, &schema, "bench_insert");
+
+    char value[256];
+    uint8_t key[BTREE_MAX_KEY_SIZE];
+
+    // Zero padded numbers keep the keys in the order they are generated
+    double start = now_ms();
+    uint32_t pages = sm->header.page_count;
+    BTreeBuilder* builder = btree_build_begin(sm, bulk, BTREE_DEFAULT_FILL_FACTOR);
+    for (uint32_t i = 0; i < key_count; i++) {
+        memset(value, 0, sizeof(value));
+        snprintf(value, sizeof(value), "customer%07u@mail%u.example.com", i, i % 7);
+        btree_encode_value(&schema.columns[0], value, key);
+        btree_build_add(builder, key, (RID){ i + 1, 0 });
+    }
+    btree_build_finish(builder);
+    double bulk_build = now_ms() - start;
+    uint32_t bulk_pages = sm->header.page_count - pages;
+
+    // 7919 is prime, so this visits every key once in a scattered order
+    start = now_ms();
+    pages = sm->header.page_count;
+    for (uint32_t j = 0; j < key_count; j++) {
+        uint32_t i = (uint32_t)((uint64_t)j * 7919 % key_count);
+        memset(value, 0, sizeof(value));
+        snprintf(value, sizeof(value), "customer%07u@mail%u.example.com", i, i % 7);
+        btree_encode_value(&schema.columns[0], value, key);
+        btree_insert(sm, inserted, key, (RID){ i + 1, 0 });
+    }
+    double insert_build = now_ms() - start;
+    uint32_t insert_pages = sm->header.page_count - pages;
+
+    for (int method = 0; method < 2; method++) {
+        BTreeIndex* index = method == 0 ? bulk : inserted;
+        uint32_t seed = 12345, found = 0;
+        uint64_t requests = sm->page_requests, reads = sm->page_reads;
+
+        start = now_ms();
+        for (uint32_t j = 0; j < lookup_count; j++) {
+            uint32_t i = bench_rand(&seed) % key_count;
+            memset(value, 0, sizeof(value));
+            snprintf(value, sizeof(value), "customer%07u@mail%u.example.com", i, i % 7);
+            btree_encode_value(&schema.columns[0], value, key);
+
+            RID rid;
+            if (btree_search(sm, index, key, &rid) && rid.page_id == i + 1) found++;
+        }
+        double elapsed = now_ms() - start;
+
+        report(method == 0 ? "bulk" : "insert", method == 0 ? bulk_build : insert_build, lookup_count,
+               elapsed, sm->page_requests - requests, sm->page_reads - reads, found);
+    }
+    printf("  index pages: %u bulk built, %u from inserts\n", bulk_pages, insert_pages);
+
+    btree_free_index(bulk);
+    btree_free_index(inserted);
+    close_scratch(sm);
+}
+
+#define CONCURRENT_MAX_THREADS 8
+
+typedef struct {
+    StorageManager* sm;
+    BTreeIndex* index;
+    ColumnDef* column;
+    uint32_t thread;
+    uint32_t thread_count;
+    uint32_t key_count;      // existing keys are 0, 2, 4, ...
+    uint32_t ops;
+    uint32_t insert_percent; // the rest are lookups
+    uint32_t lookups;
+    uint32_t found;
+    uint32_t inserted;
+} ConcurrentWorker;
+
+static void* concurrent_worker(void* arg) {
+    ConcurrentWorker* worker = arg;
+    uint32_t seed = 12345 + worker->thread * 7919;
+    uint8_t key[BTREE_MAX_KEY_SIZE];
+
+    for (uint32_t i = 0; i < worker->ops; i++) {
+        if (bench_rand(&seed) % 100 < worker->insert_percent) {
+            // Odd keys, each thread its own
+            int value = (int)(2 * (worker->inserted * worker->thread_count + worker->thread) + 1);
+            btree_encode_value(worker->column, &value, key);
+            if (btree_insert(worker->sm, worker->index, key, (RID){ (uint32_t)value, 0 })) worker->inserted++;
+        } else {
+            worker->lookups++;
+            int value = (int)(2 * (bench_rand(&seed) % worker->key_count));
+            btree_encode_value(worker->column, &value, key);
+            RID rid;
+            if (btree_search(worker->sm, worker->index, key, &rid) && rid.page_id == (uint32_t)value) {
+                worker->found++;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Runs the workload on a fresh index with 1, 2, 4, ... threads, printing
+// ops/s for each thread count, and checks that every key made it in
+static void run_concurrent(const char* label, uint32_t key_count, uint32_t ops, uint32_t insert_percent) {
+    TableSchema schema;
+    memset(&schema, 0, sizeof(TableSchema));
+    strcpy(schema.name, "bench");
+    schema.column_count = 1;
+    schema.columns[0].type = DT_INT;
+
+    double single = 0;
+    for (uint32_t thread_count = 1; thread_count <= CONCURRENT_MAX_THREADS; thread_count *= 2) {
+        StorageManager* sm = open_scratch();
+        register_index(sm, "bench_btree", INDEX_BTREE);
+        BTreeIndex* index = btree_create_index(sm, &schema, "bench_btree");
+
+        uint8_t key[BTREE_MAX_KEY_SIZE];
+        BTreeBuilder* builder = btree_build_begin(sm, index, BTREE_DEFAULT_FILL_FACTOR);
+        for (uint32_t i = 0; i < key_count; i++) {
+            int value = (int)(2 * i);
+            btree_encode_value(&schema.columns[0], &value, key);
+            btree_build_add(builder, key, (RID){ 2 * i, 0 });
+        }
+        btree_build_finish(builder);
+
+        pthread_t threads[CONCURRENT_MAX_THREADS];
+        ConcurrentWorker workers[CONCURRENT_MAX_THREADS];
+        double start = now_ms();
+        for (uint32_t t = 0; t < thread_count; t++) {
+            workers[t] = (ConcurrentWorker){ sm, index, &schema.columns[0], t, thread_count, key_count,
+                                             ops / thread_count, insert_percent, 0, 0, 0 };
+            pthread_create(&threads[t], NULL, concurrent_worker, &workers[t]);
+        }
+        uint32_t found = 0, inserted = 0, lookups = 0;
+        for (uint32_t t = 0; t < thread_count; t++) {
+            pthread_join(threads[t], NULL);
+            found += workers[t].found;
+            inserted += workers[t].inserted;
+            lookups += workers[t].lookups;
+        }
+        double elapsed = now_ms() - start;
+
+        // Every key, old or new, has to come out of a scan exactly once and in order
+        uint32_t scanned = 0;
+        bool ordered = true;
+        int previous = -1;
+        BTreeCursor* cursor = btree_seek(sm, index, NULL, 0);
+        RID rid;
+        while (btree_next(cursor, key, &rid)) {
+            int value;
+            btree_decode_value(&schema.columns[0], key, &value);
+            if (value <= previous || rid.page_id != (uint32_t)value) ordered = false;
+            previous = value;
+            scanned++;
+        }
+        btree_close(cursor);
+
+        double throughput = (thread_count * (ops / thread_count)) / elapsed * 1000.0;
+        if (thread_count == 1) single = throughput;
+        printf("  %-6s %u thread%s %9.0f ops/s (%4.2fx) | %u/%u lookups hit, %u inserts, scan %u keys%s\n",
+               label, thread_count, thread_count == 1 ? " " : "s", throughput, throughput / single, found,
+               lookups, inserted, scanned, scanned == key_count + inserted && ordered ? "" : " MISMATCH");
+
+        btree_free_index(index);
+        close_scratch(sm);
+    }
+}
+
+// Lookups and inserts from several threads on one B+tree. The tree is kept
+// small enough to stay cached, so the numbers show latching rather than I/O.
+static void bench_concurrent(void) {
+    const uint32_t key_count = 5000;
+    const uint32_t ops = 160000;
+
+    printf("concurrent: %u INT keys, %u ops split over the threads, %ld online cores\n", key_count, ops,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    run_concurrent("lookup", key_count, ops, 0);
+    run_concurrent("mixed", key_count, ops, 5);
+}
+
+static void run_sql(StorageManager* sm, const char* sql) {
+    SQLStatement* stmt = parse_sql(sql);
+    QueryResult* result;
+    switch (stmt->type) {
+        case STMT_CREATE_TABLE: result = execute_create_table(sm, stmt); break;
+        case STMT_SELECT: result = execute_select(sm, stmt); break;
+        case STMT_UPDATE: result = execute_update(sm, stmt); break;
+        case STMT_DELETE: result = execute_delete(sm, stmt); break;
+        case STMT_CREATE_INDEX: result = execute_create_index(sm, stmt); break;
+        case STMT_ANALYZE: result = execute_analyze(sm, stmt); break;
+        default: result = execute_insert(sm, stmt); break;
+    }
+    free_result(result);
+    free_sql_statement(stmt);
+}
+
+// Filtered scans of a table that fits in the page cache, so the numbers
+// are CPU time per row. Every filter kernel level the CPU supports runs
+// the same queries.
+static void bench_scan_filter(void) {
+    const uint32_t row_count = 15000;
+    const uint32_t repeats = 200;
+    const char* queries[] = {
+        "SELECT COUNT(*) FROM scan WHERE grp = 7",
+        "SELECT COUNT(*) FROM scan WHERE grp < 50 AND score > 0.5 AND flag = TRUE",
+    };
+
+    printf("scan-filter: %u rows (INT, INT, FLOAT, BOOL), each query %u times, %d-page cache\n", row_count,
+           repeats, MAX_CACHE_PAGES);
+
+    StorageManager* sm = open_scratch();
+    run_sql(sm, "CREATE TABLE scan (id INT, grp INT, score FLOAT, flag BOOL)");
+
+    char sql[128];
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < row_count; i++) {
+        uint32_t grp = bench_rand(&seed) % 100;
+        uint32_t score = bench_rand(&seed) % 1000;
+        snprintf(sql, sizeof(sql), "INSERT INTO scan VALUES (%u, %u, 0.%03u, %s)", i, grp, score,
+                 bench_rand(&seed) % 2 ? "TRUE" : "FALSE");
+        run_sql(sm, sql);
+    }
+
+    VectorLevel supported = vector_level();
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        printf("  %s\n", queries[q]);
+        SQLStatement* stmt = parse_sql(queries[q]);
+
+        for (int level = VECTOR_SCALAR; level <= (int)supported; level++) {
+            vector_set_level((VectorLevel)level);
+            double start = now_ms();
+            for (uint32_t r = 0; r < repeats; r++) {
+                QueryStream* stream = query_open(sm, stmt);
+                while (query_next(stream)) snprintf(sql, sizeof(sql), "%s", stream->values[0]);
+                query_close(stream);
+            }
+            double elapsed = now_ms() - start;
+            printf("    %-6s %6.2f ns/row (%s rows match)\n", vector_level_name((VectorLevel)level),
+                   elapsed * 1e6 / ((double)row_count * repeats), sql);
+        }
+        free_sql_statement(stmt);
+    }
+
+    vector_set_level(supported);
+    close_scratch(sm);
+}
+
+// Runs `count` statements made from `format` with keys drawn from `seed`;
+// returns microseconds per statement
+static double time_statements(StorageManager* sm, const char* format, uint32_t count, uint32_t key_count,
+                              uint32_t seed) {
+    char sql[128];
+    double start = now_ms();
+    for (uint32_t i = 0; i < count; i++) {
+        snprintf(sql, sizeof(sql), format, bench_rand(&seed) % key_count);
+        run_sql(sm, sql);
+    }
+    return (now_ms() - start) * 1000.0 / count;
+}
+
+// SELECT, UPDATE and DELETE of single rows, once by primary key and once
+// by an unindexed column holding the same value
+static void bench_pk_lookup(void) {
+    const uint32_t row_count = 20000;
+    const uint32_t statements = 200;
+
+    printf("pk-lookup: %u rows, %u statements each, %d-page cache\n", row_count, statements, MAX_CACHE_PAGES);
+
+    StorageManager* sm = open_scratch();
+    run_sql(sm, "CREATE TABLE users (id INT PRIMARY KEY, val INT, name VARCHAR(24))");
+
+    // val is a permutation of id that zone maps cannot narrow down
+    char sql[128];
+    for (uint32_t i = 0; i < row_count; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO users VALUES (%u, %u, 'user-%u')", i,
+                 (uint32_t)((uint64_t)i * 7919 % row_count), i);
+        run_sql(sm, sql);
+    }
+
+    static const char* statement_kinds[][3] = {
+        { "SELECT", "SELECT * FROM users WHERE id = %u", "SELECT * FROM users WHERE val = %u" },
+        { "UPDATE", "UPDATE users SET name = 'renamed' WHERE id = %u",
+          "UPDATE users SET name = 'renamed' WHERE val = %u" },
+        { "DELETE", "DELETE FROM users WHERE id = %u", "DELETE FROM users WHERE val = %u" },
+    };
+
+    for (size_t k = 0; k < sizeof(statement_kinds) / sizeof(statement_kinds[0]); k++) {
+        // Both runs draw the same values; DELETE by val removes other rows
+        // than DELETE by id did, or scans in vain for ones already gone
+        double key_us = time_statements(sm, statement_kinds[k][1], statements, row_count, 99);
+        double scan_us = time_statements(sm, statement_kinds[k][2], statements, row_count, 99);
+        printf("  %-6s by primary key %9.1f us   by unindexed column %9.1f us\n", statement_kinds[k][0],
+               key_us, scan_us);
+    }
+
+    close_scratch(sm);
+}
+
+// SELECTs that materialize large results with execute_select, counting
+// the allocator calls made while building and freeing each result
+static void bench_large_select(void) {
+    const uint32_t row_count = 50000;
+    const uint32_t repeats = 5;
+    const char* queries[] = {
+        "SELECT * FROM wide",
+        "SELECT id, name FROM wide WHERE grp < 50",
+    };
+
+    printf("large-select: %u rows (INT, INT, VARCHAR(32), FLOAT), each query %u times\n", row_count, repeats);
+
+    StorageManager* sm = open_scratch();
+    run_sql(sm, "CREATE TABLE wide (id INT, grp INT, name VARCHAR(32), score FLOAT)");
+
+    char sql[160];
+    uint32_t seed = 777;
+    for (uint32_t i = 0; i < row_count; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO wide VALUES (%u, %u, 'customer-%08u', %u.%02u)", i,
+                 bench_rand(&seed) % 100, bench_rand(&seed), bench_rand(&seed) % 1000, bench_rand(&seed) % 100);
+        run_sql(sm, sql);
+    }
+
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        SQLStatement* stmt = parse_sql(queries[q]);
+        uint32_t rows = 0;
+        size_t allocations = 0;
+        double start = now_ms();
+        for (uint32_t r = 0; r < repeats; r++) {
+            size_t before = safe_allocation_count();
+            QueryResult* result = execute_select(sm, stmt);
+            rows = result->row_count;
+            free_result(result);
+            allocations += safe_allocation_count() - before;
+        }
+        double elapsed = now_ms() - start;
+        printf("  %-42s %7u rows %8.2f ms %10zu allocations\n", queries[q], rows, elapsed / repeats,
+               allocations / repeats);
+        free_sql_statement(stmt);
+    }
+
+    close_scratch(sm);
+}
+
+// Times a query and writes the access path its plan reads the table with
+static double time_query(StorageManager* sm, const char* sql, uint32_t repeats, char* access, size_t size) {
+    char explain[160];
+    snprintf(explain, sizeof(explain), "EXPLAIN %s", sql);
+    SQLStatement* stmt = parse_sql(explain);
+    QueryStream* stream = query_open(sm, stmt);
+    while (query_next(stream)) {
+        // The table access is the last line; keep the words before "on"
+        const char* line = stream->values[0];
+        while (*line == ' ' || *line == '-' || *line == '>') line++;
+        const char* end = strstr(line, " on ");
+        snprintf(access, size, "%.*s", end ? (int)(end - line) : (int)strlen(line), line);
+    }
+    query_close(stream);
+    free_sql_statement(stmt);
+
+    double start = now_ms();
+    for (uint32_t r = 0; r < repeats; r++) run_sql(sm, sql);
+    return (now_ms() - start) / repeats;
+}
+
+// Range queries of growing selectivity on an indexed column whose order
+// has nothing to do with the heap order, on a table four times the page
+// cache. Without statistics the planner always takes the index; after
+// ANALYZE it compares the cost of fetching the rows one by one with a
+// heap scan.
+static void bench_analyze(void) {
+    const uint32_t row_count = 40000;
+    const uint32_t repeats = 5;
+    const double selectivities[] = { 0.001, 0.01, 0.05, 0.2, 0.6 };
+
+    printf("analyze: %u rows, range on an uncorrelated B-tree column, %d-page cache\n", row_count,
+           MAX_CACHE_PAGES);
+
+    StorageManager* sm = open_scratch();
+    run_sql(sm, "CREATE TABLE facts (id INT, val INT, score FLOAT, note VARCHAR(40))");
+    char sql[160];
+    for (uint32_t i = 0; i < row_count; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO facts VALUES (%u, %u, %u.5, 'note')", i,
+                 (uint32_t)((uint64_t)i * 7919 % row_count), i % 100);
+        run_sql(sm, sql);
+    }
+    run_sql(sm, "CREATE INDEX facts_val ON facts (val)");
+
+    char queries[sizeof(selectivities) / sizeof(selectivities[0])][96];
+    double rule_ms[sizeof(selectivities) / sizeof(selectivities[0])];
+    char rule_access[sizeof(selectivities) / sizeof(selectivities[0])][32];
+    size_t count = sizeof(selectivities) / sizeof(selectivities[0]);
+    for (size_t q = 0; q < count; q++) {
+        snprintf(queries[q], sizeof(queries[q]), "SELECT SUM(score) FROM facts WHERE val < %u",
+                 (uint32_t)(selectivities[q] * row_count));
+        rule_ms[q] = time_query(sm, queries[q], repeats, rule_access[q], sizeof(rule_access[q]));
+    }
+
+    run_sql(sm, "ANALYZE facts");
+    for (size_t q = 0; q < count; q++) {
+        char access[32];
+        double cost_ms = time_query(sm, queries[q], repeats, access, sizeof(access));
+        printf("  %5.1f%% of rows   rules: %-10s %8.2f ms   costs: %-10s %8.2f ms\n", selectivities[q] * 100,
+               rule_access[q], rule_ms[q], access, cost_ms);
+    }
+
+    close_scratch(sm);
+}
+
+// An equi-join whose inner table takes about 3MB as hash join records,
+// under shrinking memory budgets: from all in memory to a grace hash join
+// over many partitions. Temporary pages go back to the free list, so the
+// file only grows by the largest spill.
+static void bench_hash_join(void) {
+    const uint32_t row_count = 20000;
+    const size_t budgets[] = { 64 << 20, 2 << 20, 512 << 10, 128 << 10 };
+
+    printf("hash-join: %u x %u rows, %d-page cache\n", row_count, row_count, MAX_CACHE_PAGES);
+
+    StorageManager* sm = open_scratch();
+    run_sql(sm, "CREATE TABLE orders (id INT, customer INT, note VARCHAR(100))");
+    run_sql(sm, "CREATE TABLE customers (id INT, region INT, name VARCHAR(100))");
+    char sql[160];
+    uint32_t seed = 42;
+    for (uint32_t i = 0; i < row_count; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO orders VALUES (%u, %u, 'order note')", i,
+                 bench_rand(&seed) % row_count);
+        run_sql(sm, sql);
+        snprintf(sql, sizeof(sql), "INSERT INTO customers VALUES (%u, %u, 'customer name')", i, i % 50);
+        run_sql(sm, sql);
+    }
+
+    for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+        query_set_memory_budget(budgets[b]);
+        uint32_t pages = sm->header.page_count;
+        uint64_t reads = sm->page_reads;
+        char access[32];
+        double ms = time_query(sm, "SELECT COUNT(*) FROM orders JOIN customers ON orders.customer = customers.id",
+                               1, access, sizeof(access));
+        printf("  budget %6zu KB   %8.1f ms   %7llu pages read   file +%u pages\n", budgets[b] >> 10, ms,
+               (unsigned long long)(sm->page_reads - reads), sm->header.page_count - pages);
+    }
+    query_set_memory_budget(DEFAULT_QUERY_MEMORY);
+
+    close_scratch(sm);
+}
+
+// The strategy of a join query's plan, as EXPLAIN names it
+static void join_strategy(StorageManager* sm, const char* sql, char* strategy, size_t size) {
+    char explain[216];
+    snprintf(explain, sizeof(explain), "EXPLAIN %s", sql);
+    SQLStatement* stmt = parse_sql(explain);
+    QueryStream* stream = query_open(sm, stmt);
+    strategy[0] = '\0';
+    while (query_next(stream)) {
+        // "<strategy> <type> join on ...", maybe below an aggregate
+        const char* line = stream->values[0];
+        while (*line == ' ' || *line == '-' || *line == '>') line++;
+        const char* end = strstr(line, " join on ");
+        if (!end) continue;
+        while (end > line && end[-1] != ' ') end--; // drop the join type
+        snprintf(strategy, size, "%.*s", end > line ? (int)(end - line - 1) : 0, line);
+    }
+    query_close(stream);
+    free_sql_statement(stmt);
+}
+
+// Equi-joins of a growing share of a probe table against a table with a
+// B+tree on the join column, with every strategy forced by a hint, then as
+// the planner picks after ANALYZE. A few probe rows favor index lookups,
+// as many as the big table favor hashing or merging; the merge join runs
+// without sorts when both sides come from an index in key order.
+static void bench_join_strategies(void) {
+    const uint32_t row_count = 20000;
+    const uint32_t probe_counts[] = { 20, 2000, 20000 };
+    const uint32_t loop_limit = 2000; // nested loops past this take minutes
+    const char* hints[] = { "LOOP", "HASH", "MERGE", "INDEX" };
+    const size_t hint_count = sizeof(hints) / sizeof(hints[0]);
+    const size_t probe_sizes = sizeof(probe_counts) / sizeof(probe_counts[0]);
+
+    printf("join-strategies: probe rows x %u indexed rows, %d-page cache\n", row_count, MAX_CACHE_PAGES);
+
+    StorageManager* sm = open_scratch();
+    run_sql(sm, "CREATE TABLE items (id INT, price INT, name VARCHAR(40))");
+    run_sql(sm, "CREATE TABLE probes (id INT, item INT)");
+    char sql[200];
+    uint32_t seed = 7;
+    for (uint32_t i = 0; i < row_count; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO items VALUES (%u, %u, 'item name')", i, i % 1000);
+        run_sql(sm, sql);
+        snprintf(sql, sizeof(sql), "INSERT INTO probes VALUES (%u, %u)", i, bench_rand(&seed) % row_count);
+        run_sql(sm, sql);
+    }
+    run_sql(sm, "CREATE INDEX items_id ON items (id)");
+    run_sql(sm, "CREATE INDEX probes_id ON probes (id)");
+    run_sql(sm, "CREATE INDEX probes_item ON probes (item)");
+
+    double hinted_ms[sizeof(probe_counts) / sizeof(probe_counts[0])][sizeof(hints) / sizeof(hints[0])];
+    for (size_t p = 0; p < probe_sizes; p++) {
+        for (size_t h = 0; h < hint_count; h++) {
+            hinted_ms[p][h] = -1;
+            if (strcmp(hints[h], "LOOP") == 0 && probe_counts[p] > loop_limit) continue;
+            snprintf(sql, sizeof(sql),
+                     "SELECT COUNT(*) FROM probes JOIN items ON probes.item = items.id USING %s WHERE probes.id < %u",
+                     hints[h], probe_counts[p]);
+            double start = now_ms();
+            run_sql(sm, sql);
+            hinted_ms[p][h] = now_ms() - start;
+        }
+    }
+
+    // Key ranges both indexes answer, so that both sides arrive in key order
+    double sorted_ms[2];
+    for (size_t h = 0; h < 2; h++) {
+        snprintf(sql, sizeof(sql),
+                 "SELECT COUNT(*) FROM probes JOIN items ON probes.item = items.id USING %s "
+                 "WHERE probes.item < %u AND items.id < %u",
+                 hints[h + 1], row_count / 2, row_count / 2);
+        double start = now_ms();
+        run_sql(sm, sql);
+        sorted_ms[h] = now_ms() - start;
+    }
+
+    run_sql(sm, "ANALYZE");
+    printf("  %-10s", "probe rows");
+    for (size_t h = 0; h < hint_count; h++) printf("%11s", hints[h]);
+    printf("    planner after ANALYZE\n");
+    for (size_t p = 0; p < probe_sizes; p++) {
+        char strategy[40];
+        snprintf(sql, sizeof(sql), "SELECT COUNT(*) FROM probes JOIN items ON probes.item = items.id WHERE probes.id < %u",
+                 probe_counts[p]);
+        join_strategy(sm, sql, strategy, sizeof(strategy));
+        double start = now_ms();
+        run_sql(sm, sql);
+        double planned_ms = now_ms() - start;
+
+        printf("  %-10u", probe_counts[p]);
+        for (size_t h = 0; h < hint_count; h++) {
+            if (hinted_ms[p][h] < 0) printf("%11s", "-");
+            else printf("%8.1f ms", hinted_ms[p][h]);
+        }
+        printf("    %-18s %7.1f ms\n", strategy, planned_ms);
+    }
+    printf("  both inputs in key order (%u x %u rows): HASH %.1f ms, MERGE %.1f ms\n", row_count / 2,
+           row_count / 2, sorted_ms[0], sorted_ms[1]);
+
+    close_scratch(sm);
+}
+
+typedef struct {
+    const char* name;
+    void (*run)(void);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    { "point-lookup", bench_point_lookup },
+    { "string-keys", bench_string_keys },
+    { "concurrent", bench_concurrent },
+    { "scan-filter", bench_scan_filter },
+    { "large-select", bench_large_select },
+    { "pk-lookup", bench_pk_lookup },
+    { "analyze", bench_analyze },
+    { "hash-join", bench_hash_join },
+    { "join-strategies", bench_join_strategies },
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+int main(int argc, char* argv[]) {
+    if (argc == 1) {
+        for (size_t i = 0; i < BENCHMARK_COUNT; i++) {
+            benchmarks[i].run();
+        }
+        return 0;
+    }
+
+    for (int arg = 1; arg < argc; arg++) {
+        size_t i = 0;
+        while (i < BENCHMARK_COUNT && strcmp(argv[arg], benchmarks[i].name) != 0) i++;
+
+        if (i == BENCHMARK_COUNT) {
+            fprintf(stderr, "Unknown benchmark '%s'. Available:", argv[arg]);
+            for (i = 0; i < BENCHMARK_COUNT; i++) fprintf(stderr, " %s", benchmarks[i].name);
+            fprintf(stderr, "\n");
+            return 1;
+        }
+        benchmarks[i].run();
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include "arena.h"
+#include "main.h"
+
+size_t arena_alloc(Arena* arena, size_t size) {
+    size_t offset = (arena->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (offset + size > arena->capacity) {
+        size_t capacity = arena->capacity ? arena->capacity : ARENA_MIN_CAPACITY;
+        while (offset + size > capacity) capacity *= 2;
+        arena->data = SAFE_REALLOC(arena->data, uint8_t, capacity);
+        arena->capacity = capacity;
+    }
+    arena->used = offset + size;
+    return offset;
+}
+
+void arena_reset(Arena* arena) {
+    arena->used = 0;
+}
+
+void arena_release(Arena* arena) {
+    SAFE_FREE(arena->data);
+    arena->used = arena->capacity = 0;
+}
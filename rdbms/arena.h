@@ -0,0 +1,33 @@
+// arena.h
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_MIN_CAPACITY 256
+#define ARENA_ALIGNMENT 8
+
+// Growable buffer that many small objects are carved out of. Objects are
+// addressed by their offset, which stays valid when the buffer grows and
+// moves; a pointer from arena_at is only good until the next allocation.
+// The buffer doubles as it fills, so n allocations cost O(log n) calls to
+// the allocator, and everything is released at once: arena_reset keeps the
+// buffer for reuse, arena_release frees it. A zeroed Arena is empty.
+typedef struct {
+    uint8_t* data;
+    size_t used;
+    size_t capacity;
+} Arena;
+
+// Reserves `size` bytes aligned to ARENA_ALIGNMENT; returns their offset
+size_t arena_alloc(Arena* arena, size_t size);
+void arena_reset(Arena* arena);
+void arena_release(Arena* arena);
+
+static inline void* arena_at(const Arena* arena, size_t offset) {
+    return arena->data + offset;
+}
+
+#endif // ARENA_H
@@ -0,0 +1,591 @@
+#include "bitmapindex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+
+#define CHUNK_SIZE (1u << BITMAP_CHUNK_BITS)
+#define CHUNK_WORDS (CHUNK_SIZE / 64)
+
+// Meta page layout: header | (value, directory page) * value_count, sorted
+// by value. Each page's values sort before the next page's; a full page
+// splits, moving its upper half to a new page linked after it.
+typedef struct {
+    uint32_t value_count; // on this page
+    uint32_t next;        // next meta page, 0 at the end
+} BitmapMeta;
+
+// Directory page layout: header | DirEntry * count
+typedef struct {
+    uint32_t count;
+    uint32_t next; // next directory page of the same value, 0 at the end
+} DirHeader;
+
+typedef struct {
+    uint32_t chunk;
+    uint32_t page_id; // container page
+    uint32_t cardinality;
+} DirEntry;
+
+#define DIR_ENTRIES ((PAGE_SIZE - sizeof(DirHeader)) / sizeof(DirEntry))
+
+static uint32_t meta_stride(BitmapIndex* index) {
+    return index->key_size + sizeof(uint32_t);
+}
+
+static uint8_t* meta_value(BitmapIndex* index, uint8_t* meta, uint32_t i) {
+    return meta + sizeof(BitmapMeta) + i * meta_stride(index);
+}
+
+static uint32_t meta_dir_page(BitmapIndex* index, uint8_t* meta, uint32_t i) {
+    uint32_t page_id;
+    memcpy(&page_id, meta_value(index, meta, i) + index->key_size, sizeof(uint32_t));
+    return page_id;
+}
+
+static bool read_meta(StorageManager* sm, uint32_t page_id, uint8_t* meta) {
+    Page* page = sm_get_page(sm, page_id);
+    if (!page) return false;
+
+    memcpy(meta, page->data, PAGE_SIZE);
+    return true;
+}
+
+static bool write_meta(StorageManager* sm, uint32_t page_id, const uint8_t* meta) {
+    Page* page = sm_get_page(sm, page_id);
+    if (!page) return false;
+
+    memcpy(page->data, meta, PAGE_SIZE);
+    page->is_dirty = true;
+    return true;
+}
+
+// Reads the meta page that holds the key, or would: the first whose last
+// value is not below it, else the last page
+static bool find_meta_page(StorageManager* sm, BitmapIndex* index, const uint8_t* key,
+                           uint32_t* page_id, uint8_t* meta) {
+    *page_id = index->meta_page;
+    while (read_meta(sm, *page_id, meta)) {
+        BitmapMeta* header = (BitmapMeta*)meta;
+        if (header->next == 0 || header->value_count == 0 ||
+            memcmp(meta_value(index, meta, header->value_count - 1), key, index->key_size) >= 0) {
+            return true;
+        }
+        *page_id = header->next;
+    }
+    return false;
+}
+
+// Binary search over the sorted values of one meta page. Returns true
+// when found; *at is the value's position or where it would be inserted.
+static bool find_value(BitmapIndex* index, uint8_t* meta, const uint8_t* key, uint32_t* at) {
+    uint32_t low = 0, high = ((BitmapMeta*)meta)->value_count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        int cmp = memcmp(meta_value(index, meta, mid), key, index->key_size);
+        if (cmp == 0) {
+            *at = mid;
+            return true;
+        }
+        if (cmp < 0) low = mid + 1;
+        else high = mid;
+    }
+    *at = low;
+    return false;
+}
+
+uint32_t bitmap_create_storage(StorageManager* sm) {
+    // A zeroed page is a meta page without values
+    return sm ? sm_allocate_page(sm) : 0;
+}
+
+BitmapIndex* bitmap_open_index(StorageManager* sm, TableSchema* schema, const char* index_name) {
+    IndexDef def;
+    if (!index_catalog_load(sm, index_name, &def)) return NULL;
+    if (def.method != INDEX_BITMAP || def.root_page == 0 || def.key_column_count != 1) return NULL;
+
+    BitmapIndex* index = SAFE_CALLOC(BitmapIndex, 1);
+    strncpy(index->name, def.name, MAX_INDEX_NAME - 1);
+    index->meta_page = def.root_page;
+    index->schema = schema;
+    index->column = def.key_columns[0];
+    index->key_size = btree_key_width(&schema->columns[index->column]);
+
+    index->values_per_page = (PAGE_SIZE - sizeof(BitmapMeta)) / meta_stride(index);
+    return index;
+}
+
+uint32_t bitmap_value_count(StorageManager* sm, BitmapIndex* index) {
+    uint8_t meta[PAGE_SIZE];
+    uint32_t count = 0;
+    for (uint32_t page_id = index->meta_page; page_id != 0 && read_meta(sm, page_id, meta);
+         page_id = ((BitmapMeta*)meta)->next) {
+        count += ((BitmapMeta*)meta)->value_count;
+    }
+    return count;
+}
+
+void bitmap_free_index(BitmapIndex* index) {
+    SAFE_FREE(index);
+}
+
+// Returns the directory page of a value, registering the value when
+// `create` is set. 0 when absent.
+static uint32_t value_directory(StorageManager* sm, BitmapIndex* index, const uint8_t* key, bool create) {
+    uint8_t meta[PAGE_SIZE];
+    uint32_t meta_page, at;
+    if (!find_meta_page(sm, index, key, &meta_page, meta)) return 0;
+    if (find_value(index, meta, key, &at)) return meta_dir_page(index, meta, at);
+    if (!create) return 0;
+
+    BitmapMeta* header = (BitmapMeta*)meta;
+    if (header->value_count >= index->values_per_page) {
+        // Split: the upper half moves to a new page after this one
+        uint8_t upper[PAGE_SIZE];
+        uint32_t keep = header->value_count / 2;
+        memset(upper, 0, PAGE_SIZE);
+        ((BitmapMeta*)upper)->value_count = header->value_count - keep;
+        ((BitmapMeta*)upper)->next = header->next;
+        memcpy(meta_value(index, upper, 0), meta_value(index, meta, keep),
+               (header->value_count - keep) * meta_stride(index));
+
+        uint32_t upper_page = sm_allocate_page(sm);
+        if (!write_meta(sm, upper_page, upper)) return 0;
+        memset(meta_value(index, meta, keep), 0, (header->value_count - keep) * meta_stride(index));
+        header->value_count = keep;
+        header->next = upper_page;
+        if (!write_meta(sm, meta_page, meta)) return 0;
+
+        if (at > keep) {
+            meta_page = upper_page;
+            memcpy(meta, upper, PAGE_SIZE);
+            at -= keep;
+        }
+    }
+
+    uint32_t dir_page = sm_allocate_page(sm);
+    uint8_t* slot = meta_value(index, meta, at);
+    memmove(slot + meta_stride(index), slot, (header->value_count - at) * meta_stride(index));
+    memcpy(slot, key, index->key_size);
+    memcpy(slot + index->key_size, &dir_page, sizeof(uint32_t));
+    header->value_count++;
+
+    return write_meta(sm, meta_page, meta) ? dir_page : 0;
+}
+
+// Finds the directory entry of a chunk. Sets *dir_page/*slot to it, or to
+// the last directory page when absent.
+static bool find_chunk(StorageManager* sm, uint32_t dir_page, uint32_t chunk,
+                       uint32_t* found_page, uint32_t* slot, DirEntry* entry) {
+    while (dir_page != 0) {
+        Page* page = sm_get_page(sm, dir_page);
+        if (!page) return false;
+
+        DirHeader* header = (DirHeader*)page->data;
+        DirEntry* entries = (DirEntry*)(page->data + sizeof(DirHeader));
+        for (uint32_t i = 0; i < header->count; i++) {
+            if (entries[i].chunk == chunk) {
+                *found_page = dir_page;
+                *slot = i;
+                *entry = entries[i];
+                return true;
+            }
+        }
+
+        *found_page = dir_page;
+        dir_page = header->next;
+    }
+    return false;
+}
+
+static void save_dir_entry(StorageManager* sm, uint32_t dir_page, uint32_t slot, DirEntry* entry) {
+    Page* page = sm_get_page(sm, dir_page);
+    if (!page) return;
+
+    memcpy(page->data + sizeof(DirHeader) + slot * sizeof(DirEntry), entry, sizeof(DirEntry));
+    page->is_dirty = true;
+}
+
+// Appends a container for a new chunk after the last directory page
+static bool add_chunk(StorageManager* sm, uint32_t last_dir_page, uint32_t chunk,
+                      uint32_t* dir_page, uint32_t* slot, DirEntry* entry) {
+    Page* page = sm_get_page(sm, last_dir_page);
+    if (!page) return false;
+
+    if (((DirHeader*)page->data)->count >= DIR_ENTRIES) {
+        uint32_t next = sm_allocate_page(sm);
+        page = sm_get_page(sm, last_dir_page);
+        ((DirHeader*)page->data)->next = next;
+        page->is_dirty = true;
+        last_dir_page = next;
+    }
+
+    entry->chunk = chunk;
+    entry->page_id = sm_allocate_page(sm);
+    entry->cardinality = 0;
+
+    page = sm_get_page(sm, last_dir_page);
+    if (!page) return false;
+    *dir_page = last_dir_page;
+    *slot = ((DirHeader*)page->data)->count++;
+    page->is_dirty = true;
+
+    save_dir_entry(sm, *dir_page, *slot, entry);
+    return true;
+}
+
+// Array containers hold the sorted offsets, bitmap containers the bits
+static bool container_is_array(uint32_t cardinality) {
+    return cardinality <= BITMAP_ARRAY_MAX;
+}
+
+// Index of the first array value >= offset
+static uint32_t array_lower_bound(const uint16_t* values, uint32_t count, uint16_t offset) {
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (values[mid] < offset) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// Sets or clears one offset in a container page; returns the new
+// cardinality. Crossing BITMAP_ARRAY_MAX converts the page.
+static uint32_t container_update(StorageManager* sm, uint32_t page_id, uint32_t cardinality,
+                                 uint16_t offset, bool set) {
+    Page* page = sm_get_page(sm, page_id);
+    if (!page) return cardinality;
+
+    if (container_is_array(cardinality)) {
+        uint16_t* values = (uint16_t*)page->data;
+        uint32_t at = array_lower_bound(values, cardinality, offset);
+        bool present = at < cardinality && values[at] == offset;
+        if (present == set) return cardinality;
+
+        if (!set) {
+            memmove(values + at, values + at + 1, (cardinality - at - 1) * sizeof(uint16_t));
+            values[cardinality - 1] = 0;
+            page->is_dirty = true;
+            return cardinality - 1;
+        }
+        if (cardinality < BITMAP_ARRAY_MAX) {
+            memmove(values + at + 1, values + at, (cardinality - at) * sizeof(uint16_t));
+            values[at] = offset;
+            page->is_dirty = true;
+            return cardinality + 1;
+        }
+
+        // Full array: switch the page to a bit array
+        uint16_t old_values[BITMAP_ARRAY_MAX];
+        memcpy(old_values, values, sizeof(old_values));
+        memset(page->data, 0, PAGE_SIZE);
+        uint64_t* words = (uint64_t*)page->data;
+        for (uint32_t i = 0; i < cardinality; i++) {
+            words[old_values[i] / 64] |= 1ULL << (old_values[i] % 64);
+        }
+        words[offset / 64] |= 1ULL << (offset % 64);
+        page->is_dirty = true;
+        return cardinality + 1;
+    }
+
+    uint64_t* words = (uint64_t*)page->data;
+    uint64_t mask = 1ULL << (offset % 64);
+    bool present = (words[offset / 64] & mask) != 0;
+    if (present == set) return cardinality;
+
+    page->is_dirty = true;
+    if (set) {
+        words[offset / 64] |= mask;
+        return cardinality + 1;
+    }
+
+    words[offset / 64] &= ~mask;
+    if (cardinality - 1 > BITMAP_ARRAY_MAX) return cardinality - 1;
+
+    // Back down to array size: switch the page to a sorted array
+    uint16_t values[BITMAP_ARRAY_MAX];
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < CHUNK_WORDS; w++) {
+        for (uint64_t bits = words[w]; bits; bits &= bits - 1) {
+            values[count++] = (uint16_t)(w * 64 + __builtin_ctzll(bits));
+        }
+    }
+    memset(page->data, 0, PAGE_SIZE);
+    memcpy(page->data, values, count * sizeof(uint16_t));
+    return count;
+}
+
+static bool update_position(StorageManager* sm, BitmapIndex* index, const uint8_t* key,
+                            uint32_t position, bool set) {
+    uint32_t dir_root = value_directory(sm, index, key, set);
+    if (dir_root == 0) return false;
+
+    uint32_t chunk = position >> BITMAP_CHUNK_BITS;
+    uint32_t dir_page = dir_root, slot = 0;
+    DirEntry entry;
+    if (!find_chunk(sm, dir_root, chunk, &dir_page, &slot, &entry)) {
+        if (!set) return false;
+        if (!add_chunk(sm, dir_page, chunk, &dir_page, &slot, &entry)) return false;
+    }
+
+    entry.cardinality = container_update(sm, entry.page_id, entry.cardinality,
+                                         (uint16_t)(position & (CHUNK_SIZE - 1)), set);
+    save_dir_entry(sm, dir_page, slot, &entry);
+    return true;
+}
+
+bool bitmap_insert(StorageManager* sm, BitmapIndex* index, const uint8_t* key, uint32_t position) {
+    if (!sm || !index) return false;
+    return update_position(sm, index, key, position, true);
+}
+
+bool bitmap_delete(StorageManager* sm, BitmapIndex* index, const uint8_t* key, uint32_t position) {
+    if (!sm || !index) return false;
+    return update_position(sm, index, key, position, false);
+}
+
+static Bitmap* bitmap_new(void) {
+    return SAFE_CALLOC(Bitmap, 1);
+}
+
+static void bitmap_append(Bitmap* bitmap, BitmapContainer* container, uint32_t* capacity) {
+    if (bitmap->count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 8;
+        bitmap->containers = SAFE_REALLOC(bitmap->containers, BitmapContainer, *capacity);
+    }
+    bitmap->containers[bitmap->count++] = *container;
+}
+
+static int compare_containers(const void* a, const void* b) {
+    uint32_t x = ((const BitmapContainer*)a)->chunk;
+    uint32_t y = ((const BitmapContainer*)b)->chunk;
+    return x < y ? -1 : x > y;
+}
+
+// Reads every non-empty container of one value
+static Bitmap* load_value(StorageManager* sm, uint32_t dir_page) {
+    Bitmap* bitmap = bitmap_new();
+    uint32_t capacity = 0;
+
+    while (dir_page != 0) {
+        Page* page = sm_get_page(sm, dir_page);
+        if (!page) break;
+
+        DirHeader header;
+        DirEntry entries[DIR_ENTRIES];
+        memcpy(&header, page->data, sizeof(DirHeader));
+        memcpy(entries, page->data + sizeof(DirHeader), header.count * sizeof(DirEntry));
+
+        for (uint32_t i = 0; i < header.count; i++) {
+            if (entries[i].cardinality == 0) continue;
+            Page* data = sm_get_page(sm, entries[i].page_id);
+            if (!data) continue;
+
+            BitmapContainer container = { entries[i].chunk, entries[i].cardinality, NULL, NULL };
+            if (container_is_array(container.cardinality)) {
+                container.values = SAFE_MALLOC(uint16_t, container.cardinality);
+                memcpy(container.values, data->data, container.cardinality * sizeof(uint16_t));
+            } else {
+                container.words = SAFE_MALLOC(uint64_t, CHUNK_WORDS);
+                memcpy(container.words, data->data, CHUNK_WORDS * sizeof(uint64_t));
+            }
+            bitmap_append(bitmap, &container, &capacity);
+        }
+
+        dir_page = header.next;
+    }
+
+    // An empty bitmap has no container array, and qsort needs a valid base
+    if (bitmap->count > 1) {
+        qsort(bitmap->containers, bitmap->count, sizeof(BitmapContainer), compare_containers);
+    }
+    return bitmap;
+}
+
+Bitmap* bitmap_range(StorageManager* sm, BitmapIndex* index, const uint8_t* low, bool low_inclusive,
+                     const uint8_t* high, bool high_inclusive) {
+    Bitmap* result = bitmap_new();
+    uint8_t meta[PAGE_SIZE];
+    if (!sm || !index) return result;
+
+    // Start at the page that holds the low bound
+    uint32_t meta_page = index->meta_page;
+    if (low && !find_meta_page(sm, index, low, &meta_page, meta)) return result;
+
+    for (; meta_page != 0 && read_meta(sm, meta_page, meta); meta_page = ((BitmapMeta*)meta)->next) {
+        uint32_t value_count = ((BitmapMeta*)meta)->value_count;
+        for (uint32_t i = 0; i < value_count; i++) {
+            uint8_t* value = meta_value(index, meta, i);
+            if (low) {
+                int cmp = memcmp(value, low, index->key_size);
+                if (cmp < 0 || (cmp == 0 && !low_inclusive)) continue;
+            }
+            if (high) {
+                int cmp = memcmp(value, high, index->key_size);
+                if (cmp > 0 || (cmp == 0 && !high_inclusive)) return result;
+            }
+
+            Bitmap* rows = load_value(sm, meta_dir_page(index, meta, i));
+            Bitmap* merged = bitmap_or(result, rows);
+            bitmap_free(rows);
+            bitmap_free(result);
+            result = merged;
+        }
+    }
+    return result;
+}
+
+static void expand(const BitmapContainer* container, uint64_t* words) {
+    if (container->words) {
+        memcpy(words, container->words, CHUNK_WORDS * sizeof(uint64_t));
+        return;
+    }
+    memset(words, 0, CHUNK_WORDS * sizeof(uint64_t));
+    for (uint32_t i = 0; i < container->cardinality; i++) {
+        words[container->values[i] / 64] |= 1ULL << (container->values[i] % 64);
+    }
+}
+
+// Builds a container from a bit array in the smaller representation;
+// returns false when it is empty
+static bool compact(uint32_t chunk, const uint64_t* words, BitmapContainer* out) {
+    uint32_t cardinality = 0;
+    for (uint32_t w = 0; w < CHUNK_WORDS; w++) {
+        cardinality += (uint32_t)__builtin_popcountll(words[w]);
+    }
+    if (cardinality == 0) return false;
+
+    out->chunk = chunk;
+    out->cardinality = cardinality;
+    out->values = NULL;
+    out->words = NULL;
+    if (!container_is_array(cardinality)) {
+        out->words = SAFE_MALLOC(uint64_t, CHUNK_WORDS);
+        memcpy(out->words, words, CHUNK_WORDS * sizeof(uint64_t));
+        return true;
+    }
+
+    out->values = SAFE_MALLOC(uint16_t, cardinality);
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < CHUNK_WORDS; w++) {
+        for (uint64_t bits = words[w]; bits; bits &= bits - 1) {
+            out->values[count++] = (uint16_t)(w * 64 + __builtin_ctzll(bits));
+        }
+    }
+    return true;
+}
+
+static void copy_container(const BitmapContainer* container, BitmapContainer* out) {
+    *out = *container;
+    if (container->values) {
+        out->values = SAFE_MALLOC(uint16_t, container->cardinality);
+        memcpy(out->values, container->values, container->cardinality * sizeof(uint16_t));
+    } else {
+        out->words = SAFE_MALLOC(uint64_t, CHUNK_WORDS);
+        memcpy(out->words, container->words, CHUNK_WORDS * sizeof(uint64_t));
+    }
+}
+
+typedef enum { BITMAP_AND, BITMAP_OR, BITMAP_ANDNOT } BitmapOp;
+
+// Merges the two sorted container lists chunk by chunk
+static Bitmap* combine(const Bitmap* a, const Bitmap* b, BitmapOp op) {
+    Bitmap* result = bitmap_new();
+    uint32_t capacity = 0;
+    uint32_t i = 0, j = 0;
+    uint64_t left[CHUNK_WORDS], right[CHUNK_WORDS];
+    BitmapContainer container;
+
+    while (i < a->count || j < b->count) {
+        const BitmapContainer* x = i < a->count ? &a->containers[i] : NULL;
+        const BitmapContainer* y = j < b->count ? &b->containers[j] : NULL;
+
+        if (x && (!y || x->chunk < y->chunk)) {
+            // Only in a
+            if (op != BITMAP_AND) {
+                copy_container(x, &container);
+                bitmap_append(result, &container, &capacity);
+            }
+            i++;
+        } else if (y && (!x || y->chunk < x->chunk)) {
+            // Only in b
+            if (op == BITMAP_OR) {
+                copy_container(y, &container);
+                bitmap_append(result, &container, &capacity);
+            }
+            j++;
+        } else {
+            expand(x, left);
+            expand(y, right);
+            for (uint32_t w = 0; w < CHUNK_WORDS; w++) {
+                switch (op) {
+                    case BITMAP_AND: left[w] &= right[w]; break;
+                    case BITMAP_OR: left[w] |= right[w]; break;
+                    case BITMAP_ANDNOT: left[w] &= ~right[w]; break;
+                }
+            }
+            if (compact(x->chunk, left, &container)) {
+                bitmap_append(result, &container, &capacity);
+            }
+            i++;
+            j++;
+        }
+    }
+    return result;
+}
+
+Bitmap* bitmap_and(const Bitmap* a, const Bitmap* b) {
+    return combine(a, b, BITMAP_AND);
+}
+
+Bitmap* bitmap_or(const Bitmap* a, const Bitmap* b) {
+    return combine(a, b, BITMAP_OR);
+}
+
+Bitmap* bitmap_andnot(const Bitmap* a, const Bitmap* b) {
+    return combine(a, b, BITMAP_ANDNOT);
+}
+
+uint32_t bitmap_cardinality(const Bitmap* bitmap) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; bitmap && i < bitmap->count; i++) {
+        total += bitmap->containers[i].cardinality;
+    }
+    return total;
+}
+
+uint32_t bitmap_positions(const Bitmap* bitmap, uint32_t** out) {
+    uint32_t total = bitmap_cardinality(bitmap);
+    *out = total ? SAFE_MALLOC(uint32_t, total) : NULL;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < bitmap->count; i++) {
+        const BitmapContainer* container = &bitmap->containers[i];
+        uint32_t base = container->chunk << BITMAP_CHUNK_BITS;
+
+        if (container->values) {
+            for (uint32_t v = 0; v < container->cardinality; v++) {
+                (*out)[count++] = base + container->values[v];
+            }
+            continue;
+        }
+        for (uint32_t w = 0; w < CHUNK_WORDS; w++) {
+            for (uint64_t bits = container->words[w]; bits; bits &= bits - 1) {
+                (*out)[count++] = base + w * 64 + (uint32_t)__builtin_ctzll(bits);
+            }
+        }
+    }
+    return count;
+}
+
+void bitmap_free(Bitmap* bitmap) {
+    if (!bitmap) return;
+
+    for (uint32_t i = 0; i < bitmap->count; i++) {
+        SAFE_FREE(bitmap->containers[i].values);
+        SAFE_FREE(bitmap->containers[i].words);
+    }
+    SAFE_FREE(bitmap->containers);
+    SAFE_FREE(bitmap);
+}
@@ -0,0 +1,68 @@
+// bitmapindex.h
+
+#ifndef BITMAPINDEX_H
+#define BITMAPINDEX_H
+
+#include "storage.h"
+#include "btree.h"
+
+#define BITMAP_CHUNK_BITS 15        // positions per container: 1 << 15
+#define BITMAP_ARRAY_MAX 2048       // an array container fills a page at this size
+
+// Bitmap index over one low-cardinality column. Every distinct value owns
+// a roaring-style compressed bitmap of row positions (page_id * rows per
+// page + slot). The position space is cut into chunks of
+// 1 << BITMAP_CHUNK_BITS; each non-empty chunk is a container page holding
+// either a sorted array of 16-bit offsets (up to BITMAP_ARRAY_MAX) or a
+// plain bit array, whichever is smaller.
+//
+// The index root page heads a chain of meta pages listing the values in
+// encoded (btree_encode_value) order, each with the first page of its
+// container directory. Directory pages list (chunk, container page,
+// cardinality).
+typedef struct {
+    char name[MAX_INDEX_NAME];
+    uint32_t meta_page;
+    TableSchema* schema;
+    uint32_t column;
+    uint32_t key_size;
+    uint32_t values_per_page; // values one meta page holds
+} BitmapIndex;
+
+// In-memory bitmap, containers sorted by chunk. Exactly one of values and
+// words is set on a container.
+typedef struct {
+    uint32_t chunk;
+    uint32_t cardinality;
+    uint16_t* values;
+    uint64_t* words;
+} BitmapContainer;
+
+typedef struct {
+    BitmapContainer* containers;
+    uint32_t count;
+} Bitmap;
+
+// Allocates the meta page of an empty index; returns it
+uint32_t bitmap_create_storage(StorageManager* sm);
+
+BitmapIndex* bitmap_open_index(StorageManager* sm, TableSchema* schema, const char* index_name);
+bool bitmap_insert(StorageManager* sm, BitmapIndex* index, const uint8_t* key, uint32_t position);
+bool bitmap_delete(StorageManager* sm, BitmapIndex* index, const uint8_t* key, uint32_t position);
+uint32_t bitmap_value_count(StorageManager* sm, BitmapIndex* index);
+void bitmap_free_index(BitmapIndex* index);
+
+// Positions of the rows whose value is in [low, high]; a NULL bound is
+// open, an exclusive bound leaves out rows equal to it
+Bitmap* bitmap_range(StorageManager* sm, BitmapIndex* index, const uint8_t* low, bool low_inclusive,
+                     const uint8_t* high, bool high_inclusive);
+
+Bitmap* bitmap_and(const Bitmap* a, const Bitmap* b);
+Bitmap* bitmap_or(const Bitmap* a, const Bitmap* b);
+Bitmap* bitmap_andnot(const Bitmap* a, const Bitmap* b);
+uint32_t bitmap_cardinality(const Bitmap* bitmap);
+// Writes the positions in ascending order; returns how many
+uint32_t bitmap_positions(const Bitmap* bitmap, uint32_t** out);
+void bitmap_free(Bitmap* bitmap);
+
+#endif // BITMAPINDEX_H
@@ -0,0 +1,162 @@
+#include "bloom.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+
+#define BLOOM_BITS_PER_PAGE (PAGE_SIZE * 8)
+#define BLOOM_MAX_PAGES ((PAGE_SIZE - 5 * sizeof(uint32_t)) / sizeof(uint32_t))
+
+// Meta page layout
+typedef struct {
+    uint32_t bit_count;
+    uint32_t hash_count;
+    uint32_t key_count;
+    uint32_t capacity;
+    uint32_t page_count;
+    uint32_t bit_pages[BLOOM_MAX_PAGES];
+} BloomMeta;
+
+// 64-bit FNV-1a with a final avalanche; the two halves seed the probe
+// sequence (h1 + i * h2)
+static uint64_t hash_key(const uint8_t* key, uint32_t key_len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (uint32_t i = 0; i < key_len; i++) {
+        h ^= key[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint32_t probe(BloomFilter* filter, uint64_t hash, uint32_t i) {
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    return (uint32_t)(((uint64_t)h1 + (uint64_t)i * h2) % filter->bit_count);
+}
+
+uint32_t bloom_create(StorageManager* sm, uint32_t expected_keys) {
+    if (!sm) return 0;
+
+    uint64_t bits = (uint64_t)expected_keys * BLOOM_BITS_PER_KEY;
+    uint32_t page_count = (uint32_t)((bits + BLOOM_BITS_PER_PAGE - 1) / BLOOM_BITS_PER_PAGE);
+    if (page_count == 0) page_count = 1;
+    if (page_count > BLOOM_MAX_PAGES) page_count = BLOOM_MAX_PAGES;
+
+    BloomMeta meta;
+    memset(&meta, 0, sizeof(BloomMeta));
+    meta.bit_count = page_count * BLOOM_BITS_PER_PAGE;
+    meta.hash_count = BLOOM_HASH_COUNT;
+    meta.capacity = meta.bit_count / BLOOM_BITS_PER_KEY;
+    meta.page_count = page_count;
+
+    // New pages come back zeroed, which is an empty filter
+    uint32_t meta_page = sm_allocate_page(sm);
+    for (uint32_t i = 0; i < page_count; i++) {
+        meta.bit_pages[i] = sm_allocate_page(sm);
+    }
+
+    Page* page = sm_get_page(sm, meta_page);
+    if (!page) return 0;
+    memcpy(page->data, &meta, sizeof(BloomMeta));
+    page->is_dirty = true;
+
+    return meta_page;
+}
+
+BloomFilter* bloom_open(StorageManager* sm, uint32_t meta_page) {
+    if (!sm || meta_page == 0) return NULL;
+
+    for (BloomFilter* filter = sm->bloom_filters; filter; filter = filter->next) {
+        if (filter->meta_page == meta_page) return filter;
+    }
+
+    Page* page = sm_get_page(sm, meta_page);
+    if (!page) return NULL;
+
+    BloomMeta meta;
+    memcpy(&meta, page->data, sizeof(BloomMeta));
+    if (meta.bit_count == 0 || meta.page_count == 0 || meta.page_count > BLOOM_MAX_PAGES) return NULL;
+
+    BloomFilter* filter = SAFE_MALLOC(BloomFilter, 1);
+    filter->meta_page = meta_page;
+    filter->bit_count = meta.bit_count;
+    filter->hash_count = meta.hash_count;
+    filter->key_count = meta.key_count;
+    filter->capacity = meta.capacity;
+    filter->page_count = meta.page_count;
+    filter->bit_pages = SAFE_MALLOC(uint32_t, meta.page_count);
+    memcpy(filter->bit_pages, meta.bit_pages, sizeof(uint32_t) * meta.page_count);
+    filter->bits = SAFE_MALLOC(uint8_t, (size_t)meta.page_count * PAGE_SIZE);
+
+    for (uint32_t i = 0; i < meta.page_count; i++) {
+        page = sm_get_page(sm, meta.bit_pages[i]);
+        if (page) {
+            memcpy(filter->bits + (size_t)i * PAGE_SIZE, page->data, PAGE_SIZE);
+        } else {
+            // Unreadable page: claim every key may be present
+            memset(filter->bits + (size_t)i * PAGE_SIZE, 0xFF, PAGE_SIZE);
+        }
+    }
+
+    filter->next = sm->bloom_filters;
+    sm->bloom_filters = filter;
+    return filter;
+}
+
+void bloom_add(StorageManager* sm, BloomFilter* filter, const uint8_t* key, uint32_t key_len) {
+    if (!sm || !filter) return;
+
+    uint64_t hash = hash_key(key, key_len);
+    for (uint32_t i = 0; i < filter->hash_count; i++) {
+        uint32_t bit = probe(filter, hash, i);
+        uint8_t mask = (uint8_t)(1 << (bit % 8));
+        if (filter->bits[bit / 8] & mask) continue;
+
+        filter->bits[bit / 8] |= mask;
+        Page* page = sm_get_page(sm, filter->bit_pages[bit / BLOOM_BITS_PER_PAGE]);
+        if (page) {
+            page->data[(bit % BLOOM_BITS_PER_PAGE) / 8] |= mask;
+            page->is_dirty = true;
+        }
+    }
+
+    filter->key_count++;
+    Page* page = sm_get_page(sm, filter->meta_page);
+    if (page) {
+        ((BloomMeta*)page->data)->key_count = filter->key_count;
+        page->is_dirty = true;
+    }
+}
+
+bool bloom_may_contain(BloomFilter* filter, const uint8_t* key, uint32_t key_len) {
+    if (!filter) return true;
+
+    uint64_t hash = hash_key(key, key_len);
+    for (uint32_t i = 0; i < filter->hash_count; i++) {
+        uint32_t bit = probe(filter, hash, i);
+        if (!(filter->bits[bit / 8] & (1 << (bit % 8)))) return false;
+    }
+    return true;
+}
+
+bool bloom_is_full(BloomFilter* filter) {
+    // A filter at the page limit cannot grow, it only gets less selective
+    return filter && filter->key_count > filter->capacity && filter->page_count < BLOOM_MAX_PAGES;
+}
+
+void bloom_release_all(StorageManager* sm) {
+    BloomFilter* filter = sm->bloom_filters;
+    while (filter) {
+        BloomFilter* next = filter->next;
+        SAFE_FREE(filter->bit_pages);
+        SAFE_FREE(filter->bits);
+        SAFE_FREE(filter);
+        filter = next;
+    }
+    sm->bloom_filters = NULL;
+}
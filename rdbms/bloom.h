@@ -0,0 +1,44 @@
+// bloom.h
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "storage.h"
+
+#define BLOOM_BITS_PER_KEY 10 // about 1% false positives at capacity
+#define BLOOM_HASH_COUNT 7
+
+// Bloom filter over the encoded keys of an index, answering "definitely
+// absent" or "maybe present". A filter is stored as a meta page listing
+// its bit pages, and is loaded into memory the first time it is used; the
+// loaded copy stays cached on the storage manager until sm_close. Every
+// bit set is written through to its page, so the in-memory copy and the
+// pages never disagree.
+//
+// Keys cannot be removed, so deletes leave stale bits behind. Once more
+// keys were added than the filter was sized for (bloom_is_full) the owner
+// should build a larger filter.
+struct BloomFilter {
+    uint32_t meta_page;
+    uint32_t bit_count;
+    uint32_t hash_count;
+    uint32_t key_count; // keys added since the filter was created
+    uint32_t capacity;  // keys the filter was sized for
+    uint32_t page_count;
+    uint32_t* bit_pages;
+    uint8_t* bits;
+    BloomFilter* next; // next filter cached on the storage manager
+};
+
+// Allocates an empty filter sized for expected_keys; returns its meta page
+uint32_t bloom_create(StorageManager* sm, uint32_t expected_keys);
+
+BloomFilter* bloom_open(StorageManager* sm, uint32_t meta_page);
+void bloom_add(StorageManager* sm, BloomFilter* filter, const uint8_t* key, uint32_t key_len);
+bool bloom_may_contain(BloomFilter* filter, const uint8_t* key, uint32_t key_len);
+bool bloom_is_full(BloomFilter* filter);
+
+// Frees every filter cached on the storage manager
+void bloom_release_all(StorageManager* sm);
+
+#endif // BLOOM_H
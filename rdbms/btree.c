@@ -3,296 +3,1587 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sched.h>
 #include "main.h"
 
-static void node_to_page(BTreeNode* node, Page* page);
-static void page_to_node(Page* page, BTreeNode* node);
-static uint32_t create_new_node(StorageManager* sm, bool is_leaf);
-static uint32_t key_to_hash(DataType type, void* key);
-static int compare_hashes(uint32_t hash1, uint32_t hash2);
+// Node page layout: a header, the key prefix shared by every key of the
+// node, a slot array of entry offsets, then the entries packed in key order
+//   leaf:     (key suffix, included values, RID) * num_keys
+//   internal: (key suffix, child[i + 1]) * num_keys
+// There is one more slot than entries, so entry i ends where entry i + 1
+// starts. Internal nodes keep child[0] in the header.
+//
+// Keys are stored compacted (see compact_key) rather than at their padded
+// width, minus the node prefix. Separators are cut to the shortest prefix
+// that still divides the two children, and compare as plain byte strings.
+// Separator key[i] obeys keys(child[i]) <= key[i] <= keys(child[i + 1]).
+//
+// Concurrency follows optimistic lock coupling. Every node starts with a
+// version word that is odd while a writer latches the node and moves on
+// when the writer lets go. Readers never latch: they copy a node and keep
+// the copy if the version was even and unchanged across it (read_node).
+// Splits only move entries to new right siblings and nodes are never
+// merged, so a reader acting on an outdated copy lands at or left of the
+// leaf it wants and finds the rest by walking right, like in a B-link tree.
+// Writers validate every step of their descent against the parent's
+// version, latch the leaf if it is unchanged since they copied it, and
+// usually latch nothing else. Splits, the only writes to internal nodes,
+// are serialized per index and latch the nodes they rewrite until the
+// whole split is in place.
+typedef struct {
+    uint32_t version;     // optimistic latch, see above; write_node leaves it alone
+    uint32_t num_keys;
+    uint32_t is_leaf;
+    uint32_t next_leaf;   // 0 for the rightmost leaf
+    uint32_t prev_leaf;   // 0 for the leftmost leaf
+    uint32_t first_child; // internal nodes: child[0]
+    uint16_t prefix_len;
+    uint16_t reserved;
+} NodeHeader;
+
+// Decoded node, used to rewrite node pages. A record is the stored key
+// length, the stored key (room for key_size bytes), then the included
+// values and RID (leaf) or the child (internal).
+typedef struct {
+    bool is_leaf;
+    uint32_t next_leaf;
+    uint32_t prev_leaf;
+    uint32_t first_child;
+    uint32_t count;
+    uint32_t width; // bytes per record
+    uint8_t* records;
+} NodeImage;
+
+#define NODE_HEADER(node) ((NodeHeader*)(node)->data)
+#define INDEX_DEFS_PER_PAGE ((PAGE_SIZE - sizeof(uint32_t)) / sizeof(IndexDef))
+#define BTREE_MAX_HEIGHT 32
+#define SLOT_SIZE sizeof(uint16_t)
+// The smallest entry is an internal one with an empty suffix
+#define NODE_MAX_ENTRIES (PAGE_SIZE / (SLOT_SIZE + sizeof(uint32_t)))
+
+struct BTreeBuilder {
+    StorageManager* sm;
+    BTreeIndex* index;
+    uint32_t fill_bytes;                  // node bytes filled before a level starts a new node
+    NodeImage levels[BTREE_MAX_HEIGHT];   // rightmost node of each level
+    uint32_t pages[BTREE_MAX_HEIGHT];
+    uint32_t key_bytes[BTREE_MAX_HEIGHT]; // stored key bytes of each open node
+    uint32_t height;
+    uint32_t count;
+    uint8_t last_key[BTREE_MAX_KEY_SIZE]; // stored form
+    uint32_t last_len;
+};
+
+// Root-to-leaf path of a writer's descent
+typedef struct {
+    uint32_t pages[BTREE_MAX_HEIGHT]; // internal nodes, root first
+    uint32_t slots[BTREE_MAX_HEIGHT]; // child taken in each
+    uint32_t depth;
+    BTreeNode leaf;                   // copy of the leaf, version included
+} TreePath;
+
+typedef enum {
+    DESCENT_OK,
+    DESCENT_RETRY,  // a concurrent split got in the way
+    DESCENT_FAILED  // empty tree or unreadable page
+} Descent;
+
+static bool read_node(StorageManager* sm, uint32_t page_id, BTreeNode* node);
+static void write_node(StorageManager* sm, BTreeNode* node);
+static uint32_t node_version(StorageManager* sm, uint32_t page_id);
+static bool lock_node(StorageManager* sm, BTreeNode* node);
+static bool latch_node(StorageManager* sm, uint32_t page_id, BTreeNode* node);
+static void unlock_node(StorageManager* sm, uint32_t page_id, bool changed);
+static uint32_t find_leaf(StorageManager* sm, BTreeIndex* index, const uint8_t* key, uint32_t key_len,
+                          BTreeNode* leaf);
+static void save_root(StorageManager* sm, BTreeIndex* index);
+
+static uint16_t load_u16(const uint8_t* in) {
+    uint16_t value;
+    memcpy(&value, in, sizeof(uint16_t));
+    return value;
+}
+
+static void store_u16(uint8_t* out, uint16_t value) {
+    memcpy(out, &value, sizeof(uint16_t));
+}
+
+// Bytes stored after an entry's key suffix
+static uint32_t tail_size(BTreeIndex* index, bool is_leaf) {
+    return is_leaf ? index->payload_size + sizeof(RID) : sizeof(uint32_t);
+}
+
+// Stored form of the leading key_len bytes of an encoded key: each STRING
+// column is cut after its value and closed with a zero byte (unless it
+// fills the column), other columns are kept. Strings hold no zero bytes,
+// so this keeps memcmp order (a shorter byte string first) while dropping
+// the padding. key_len covers whole columns. Returns the stored length.
+static uint32_t compact_key(BTreeIndex* index, const uint8_t* key, uint32_t key_len, uint8_t* out) {
+    uint32_t in = 0, len = 0;
+
+    for (uint32_t i = 0; i < index->key_column_count && in < key_len; i++) {
+        ColumnDef* column = &index->schema->columns[index->key_columns[i]];
+        uint32_t width = btree_key_width(column);
+
+        if (column->type == DT_STRING) {
+            uint32_t value_len = (uint32_t)strnlen((const char*)key + in, width);
+            memcpy(out + len, key + in, value_len);
+            len += value_len;
+            if (value_len < width) out[len++] = 0;
+        } else {
+            memcpy(out + len, key + in, width);
+            len += width;
+        }
+        in += width;
+    }
+    return len;
+}
+
+// Reverses compact_key for a whole key, writing key_size bytes
+static void expand_key(BTreeIndex* index, const uint8_t* stored, uint8_t* out) {
+    uint32_t in = 0, written = 0;
+
+    for (uint32_t i = 0; i < index->key_column_count; i++) {
+        ColumnDef* column = &index->schema->columns[index->key_columns[i]];
+        uint32_t width = btree_key_width(column);
+
+        if (column->type == DT_STRING) {
+            uint32_t value_len = (uint32_t)strnlen((const char*)stored + in, width);
+            memcpy(out + written, stored + in, value_len);
+            memset(out + written + value_len, 0, width - value_len);
+            in += value_len + (value_len < width ? 1 : 0);
+        } else {
+            memcpy(out + written, stored + in, width);
+            in += width;
+        }
+        written += width;
+    }
+}
+
+// Byte string order of stored keys
+static int compare_stored(const uint8_t* a, uint32_t a_len, const uint8_t* b, uint32_t b_len) {
+    int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (cmp != 0) return cmp;
+    return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+static const uint8_t* node_prefix(BTreeNode* node) {
+    return node->data + sizeof(NodeHeader);
+}
+
+static uint8_t* node_slots(BTreeNode* node) {
+    return node->data + sizeof(NodeHeader) + NODE_HEADER(node)->prefix_len;
+}
+
+static uint32_t slot_at(BTreeNode* node, uint32_t i) {
+    return load_u16(node_slots(node) + i * SLOT_SIZE);
+}
+
+static uint32_t suffix_len(BTreeIndex* index, BTreeNode* node, uint32_t i) {
+    return slot_at(node, i + 1) - slot_at(node, i) - tail_size(index, NODE_HEADER(node)->is_leaf);
+}
+
+static const uint8_t* entry_tail(BTreeIndex* index, BTreeNode* node, uint32_t i) {
+    return node->data + slot_at(node, i + 1) - tail_size(index, NODE_HEADER(node)->is_leaf);
+}
+
+// Writes the stored key of entry i to `out`; returns its length
+static uint32_t copy_key(BTreeIndex* index, BTreeNode* node, uint32_t i, uint8_t* out) {
+    uint32_t prefix_len = NODE_HEADER(node)->prefix_len;
+    uint32_t len = suffix_len(index, node, i);
+
+    memcpy(out, node_prefix(node), prefix_len);
+    memcpy(out + prefix_len, node->data + slot_at(node, i), len);
+    return prefix_len + len;
+}
+
+// Copies out a leaf entry: the key at its full width, then the included
+// values
+static void copy_leaf_entry(BTreeIndex* index, BTreeNode* node, uint32_t i, uint8_t* out) {
+    uint8_t stored[BTREE_MAX_KEY_SIZE];
+    copy_key(index, node, i, stored);
+    expand_key(index, stored, out);
+    memcpy(out + index->key_size, entry_tail(index, node, i), index->payload_size);
+}
+
+static RID leaf_rid(BTreeIndex* index, BTreeNode* node, uint32_t i) {
+    RID rid;
+    memcpy(&rid, entry_tail(index, node, i) + index->payload_size, sizeof(RID));
+    return rid;
+}
+
+static uint32_t child_at(BTreeIndex* index, BTreeNode* node, uint32_t i) {
+    if (i == 0) return NODE_HEADER(node)->first_child;
+
+    uint32_t child;
+    memcpy(&child, entry_tail(index, node, i - 1), sizeof(uint32_t));
+    return child;
+}
+
+// Compares the node prefix with the leading bytes of a stored key
+static int compare_prefix(BTreeNode* node, const uint8_t* key, uint32_t key_len) {
+    uint32_t prefix_len = NODE_HEADER(node)->prefix_len;
+    return memcmp(node_prefix(node), key, prefix_len < key_len ? prefix_len : key_len);
+}
+
+// Compares key i with a stored key once the node prefix is known to
+// match; a key starting with `key` compares equal
+static int compare_suffix(BTreeIndex* index, BTreeNode* node, uint32_t i, const uint8_t* key, uint32_t key_len) {
+    uint32_t prefix_len = NODE_HEADER(node)->prefix_len;
+    if (key_len <= prefix_len) return 0;
+
+    uint32_t len = suffix_len(index, node, i);
+    uint32_t rest = key_len - prefix_len;
+
+    int cmp = memcmp(node->data + slot_at(node, i), key + prefix_len, len < rest ? len : rest);
+    if (cmp != 0) return cmp;
+    return len >= rest ? 0 : -1;
+}
+
+// First slot whose key does not sort before `key` (a stored key, possibly
+// covering only the leading key columns)
+static uint32_t lower_bound(BTreeIndex* index, BTreeNode* node, const uint8_t* key, uint32_t key_len) {
+    uint32_t lo = 0, hi = NODE_HEADER(node)->num_keys;
+
+    // A key outside the node prefix sorts before or after the whole node
+    int cmp = compare_prefix(node, key, key_len);
+    if (cmp != 0) return cmp < 0 ? hi : 0;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (compare_suffix(index, node, mid, key, key_len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// First slot whose key is > key (a whole stored key)
+static uint32_t upper_bound(BTreeIndex* index, BTreeNode* node, const uint8_t* key, uint32_t key_len) {
+    uint32_t lo = 0, hi = NODE_HEADER(node)->num_keys;
+
+    int cmp = compare_prefix(node, key, key_len);
+    if (cmp != 0) return cmp < 0 ? hi : 0;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (compare_suffix(index, node, mid, key, key_len) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Node images
+
+static void image_init(BTreeIndex* index, NodeImage* image, bool is_leaf, uint32_t capacity) {
+    memset(image, 0, sizeof(NodeImage));
+    image->is_leaf = is_leaf;
+    image->width = sizeof(uint16_t) + index->key_size + tail_size(index, is_leaf);
+    image->records = SAFE_MALLOC(uint8_t, (size_t)capacity * image->width);
+}
+
+static void image_free(NodeImage* image) {
+    SAFE_FREE(image->records);
+}
+
+static uint8_t* image_record(NodeImage* image, uint32_t i) {
+    return image->records + (size_t)i * image->width;
+}
+
+static uint32_t record_len(const uint8_t* record) {
+    return load_u16(record);
+}
+
+static uint8_t* record_key(uint8_t* record) {
+    return record + sizeof(uint16_t);
+}
+
+static uint8_t* record_tail(BTreeIndex* index, uint8_t* record) {
+    return record + sizeof(uint16_t) + index->key_size;
+}
+
+// Fills a record from a stored key and the bytes that follow it
+static void make_record(BTreeIndex* index, uint8_t* record, const uint8_t* key, uint32_t key_len,
+                        const void* tail, uint32_t tail_len) {
+    store_u16(record, (uint16_t)key_len);
+    memcpy(record_key(record), key, key_len);
+    memcpy(record_tail(index, record), tail, tail_len);
+}
+
+// Decodes a node, leaving room for `extra` more records
+static void image_load(BTreeIndex* index, BTreeNode* node, NodeImage* image, uint32_t extra) {
+    NodeHeader* header = NODE_HEADER(node);
+    image_init(index, image, header->is_leaf, header->num_keys + extra);
+    image->next_leaf = header->next_leaf;
+    image->prev_leaf = header->prev_leaf;
+    image->first_child = header->first_child;
+    image->count = header->num_keys;
+
+    uint32_t tail = tail_size(index, image->is_leaf);
+    for (uint32_t i = 0; i < header->num_keys; i++) {
+        uint8_t* record = image_record(image, i);
+        store_u16(record, (uint16_t)copy_key(index, node, i, record_key(record)));
+        memcpy(record_tail(index, record), entry_tail(index, node, i), tail);
+    }
+}
+
+static void image_insert(NodeImage* image, uint32_t pos, const uint8_t* record) {
+    memmove(image_record(image, pos + 1), image_record(image, pos), (size_t)(image->count - pos) * image->width);
+    memcpy(image_record(image, pos), record, image->width);
+    image->count++;
+}
+
+static uint32_t common_prefix(const uint8_t* a, uint32_t a_len, const uint8_t* b, uint32_t b_len) {
+    uint32_t len = a_len < b_len ? a_len : b_len;
+    uint32_t i = 0;
+    while (i < len && a[i] == b[i]) i++;
+    return i;
+}
+
+// Prefix shared by records [lo, hi): as they are sorted, that of the first
+// and the last one
+static uint32_t image_prefix(NodeImage* image, uint32_t lo, uint32_t hi) {
+    if (lo >= hi) return 0;
+
+    uint8_t* first = image_record(image, lo);
+    uint8_t* last = image_record(image, hi - 1);
+    return common_prefix(record_key(first), record_len(first), record_key(last), record_len(last));
+}
+
+// Bytes taken by a node of `count` entries whose stored keys add up to
+// key_bytes and share prefix_len bytes
+static uint32_t encoded_size(BTreeIndex* index, bool is_leaf, uint32_t count, uint32_t key_bytes,
+                             uint32_t prefix_len) {
+    return sizeof(NodeHeader) + prefix_len + (count + 1) * SLOT_SIZE + key_bytes - count * prefix_len +
+           count * tail_size(index, is_leaf);
+}
+
+static uint32_t image_size(BTreeIndex* index, NodeImage* image, uint32_t lo, uint32_t hi) {
+    uint32_t key_bytes = 0;
+    for (uint32_t i = lo; i < hi; i++) {
+        key_bytes += record_len(image_record(image, i));
+    }
+    return encoded_size(index, image->is_leaf, hi - lo, key_bytes, image_prefix(image, lo, hi));
+}
+
+// Encodes records [lo, hi) into `node`, which keeps its page id. Leaf
+// links and the first child are left to the caller.
+static void image_store(BTreeIndex* index, NodeImage* image, uint32_t lo, uint32_t hi, BTreeNode* node) {
+    uint32_t prefix_len = image_prefix(image, lo, hi);
+
+    memset(node->data, 0, PAGE_SIZE);
+    NodeHeader* header = NODE_HEADER(node);
+    header->num_keys = hi - lo;
+    header->is_leaf = image->is_leaf;
+    header->prefix_len = (uint16_t)prefix_len;
+    if (lo < hi) memcpy(node->data + sizeof(NodeHeader), record_key(image_record(image, lo)), prefix_len);
+
+    uint8_t* slots = node_slots(node);
+    uint32_t offset = (uint32_t)(slots - node->data) + (hi - lo + 1) * SLOT_SIZE;
+    uint32_t tail = tail_size(index, image->is_leaf);
+
+    for (uint32_t i = lo; i < hi; i++) {
+        uint8_t* record = image_record(image, i);
+        uint32_t len = record_len(record) - prefix_len;
+
+        store_u16(slots + (i - lo) * SLOT_SIZE, (uint16_t)offset);
+        memcpy(node->data + offset, record_key(record) + prefix_len, len);
+        memcpy(node->data + offset + len, record_tail(index, record), tail);
+        offset += len + tail;
+    }
+    store_u16(slots + (hi - lo) * SLOT_SIZE, (uint16_t)offset);
+}
+
+static uint32_t record_child(BTreeIndex* index, uint8_t* record) {
+    uint32_t child;
+    memcpy(&child, record_tail(index, record), sizeof(uint32_t));
+    return child;
+}
+
+// Shortest separator for a split between stored keys left < right: right
+// cut just past the first byte where the two differ. Returns its length.
+static uint32_t shortest_separator(const uint8_t* left, uint32_t left_len, const uint8_t* right,
+                                   uint32_t right_len, uint8_t* out) {
+    uint32_t len = common_prefix(left, left_len, right, right_len);
+    if (len < right_len) len++;
+
+    memcpy(out, right, len);
+    return len;
+}
+
+// Loads an index's root page, key and included columns from the catalog
+BTreeIndex* btree_create_index(StorageManager* sm, TableSchema* schema, const char* index_name) {
+    IndexDef def;
+    if (!index_catalog_load(sm, index_name, &def)) return NULL;
+    if (def.method != INDEX_BTREE) return NULL;
+
+    uint32_t key_size = 0;
+    for (uint32_t i = 0; i < def.key_column_count; i++) {
+        key_size += btree_key_width(&schema->columns[def.key_columns[i]]);
+    }
+    uint32_t payload_size = 0;
+    for (uint32_t i = 0; i < def.include_column_count; i++) {
+        payload_size += btree_key_width(&schema->columns[def.include_columns[i]]);
+    }
+    if (key_size == 0 || key_size + payload_size > BTREE_MAX_KEY_SIZE) return NULL;
 
-BTreeIndex* btree_create_index(TableSchema* schema, uint32_t key_column) {
     BTreeIndex* index = SAFE_MALLOC(BTreeIndex, 1);
-    
+
+    strncpy(index->name, def.name, MAX_INDEX_NAME);
+    index->root_page = def.root_page;
     index->schema = schema;
-    index->key_column = key_column;
-    
+    memcpy(index->key_columns, def.key_columns, sizeof(def.key_columns));
+    index->key_column_count = def.key_column_count;
+    index->key_size = key_size;
+    memcpy(index->include_columns, def.include_columns, sizeof(def.include_columns));
+    index->include_column_count = def.include_column_count;
+    index->payload_size = payload_size;
+    index->is_primary = def.is_primary;
+    index->is_unique = def.is_unique;
+    index->fill_factor = def.fill_factor ? def.fill_factor : BTREE_DEFAULT_FILL_FACTOR;
+    index->bloom_page = def.bloom_page;
+    pthread_mutex_init(&index->smo_latch, NULL);
+
     return index;
 }
 
-uint32_t btree_search(StorageManager* sm, BTreeIndex* index, void* key) {
-    if (sm->header.root_page == 0) return 0;
+uint32_t btree_key_width(ColumnDef* column) {
+    switch (column->type) {
+        case DT_INT: return sizeof(int32_t);
+        case DT_FLOAT: return sizeof(float);
+        case DT_BOOL: return 1;
+        case DT_STRING: return column->length;
+        default: return 0;
+    }
+}
 
-    // 1. Hash the key once at the start
-    DataType key_type = index->schema->columns[index->key_column].type;
-    uint32_t search_hash = key_to_hash(key_type, key);
+static void store_be32(uint8_t* out, uint32_t value) {
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+}
 
-    uint32_t current_page_id = sm->header.root_page;
+// Encodes a column value so that memcmp order matches the value order:
+// numbers become big-endian with the sign handled, strings are zero
+// padded to the column width. Returns the bytes written.
+uint32_t btree_encode_value(ColumnDef* column, const void* value, uint8_t* out) {
+    uint32_t bits;
 
-    while (true) {
-        Page* page = sm_get_page(sm, current_page_id);
-        if (!page) return 0;
+    switch (column->type) {
+        case DT_INT:
+            memcpy(&bits, value, sizeof(uint32_t));
+            store_be32(out, bits ^ 0x80000000u); // flip the sign bit
+            break;
+        case DT_FLOAT: {
+            float number;
+            memcpy(&number, value, sizeof(float));
+            if (number == 0.0f) number = 0.0f; // -0 equals 0, so it gets its key
+            memcpy(&bits, &number, sizeof(uint32_t));
+            // Negative floats order backwards, so flip all of their bits
+            store_be32(out, (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u));
+            break;
+        }
+        case DT_BOOL:
+            out[0] = *(const bool*)value ? 1 : 0;
+            break;
+        case DT_STRING: {
+            size_t len = strnlen((const char*)value, column->length);
+            memcpy(out, value, len);
+            memset(out + len, 0, column->length - len);
+            break;
+        }
+    }
+
+    return btree_key_width(column);
+}
+
+static uint32_t load_be32(const uint8_t* in) {
+    return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+// Reverses btree_encode_value into the row representation of the column.
+// Returns the bytes consumed.
+uint32_t btree_decode_value(ColumnDef* column, const uint8_t* in, void* value) {
+    uint32_t bits;
+
+    switch (column->type) {
+        case DT_INT:
+            bits = load_be32(in) ^ 0x80000000u;
+            memcpy(value, &bits, sizeof(uint32_t));
+            break;
+        case DT_FLOAT:
+            bits = load_be32(in);
+            bits = (bits & 0x80000000u) ? (bits & 0x7FFFFFFFu) : ~bits;
+            memcpy(value, &bits, sizeof(uint32_t));
+            break;
+        case DT_BOOL:
+            *(bool*)value = in[0] != 0;
+            break;
+        case DT_STRING:
+            memcpy(value, in, column->length);
+            break;
+    }
 
-        BTreeNode node;
-        page_to_node(page, &node);
+    return btree_key_width(column);
+}
+
+bool btree_search(StorageManager* sm, BTreeIndex* index, const uint8_t* key, RID* rid) {
+    BTreeCursor* cursor = btree_seek(sm, index, key, index->key_size);
+    if (!cursor) return false;
+
+    uint8_t found_key[BTREE_MAX_KEY_SIZE];
+    RID found_rid;
+
+    // The cursor is positioned at the first entry >= key
+    bool found = btree_next(cursor, found_key, &found_rid) &&
+                 memcmp(found_key, key, index->key_size) == 0;
+    if (found && rid) {
+        *rid = found_rid;
+    }
+
+    btree_close(cursor);
+    return found;
+}
+
+// Descends to the leftmost leaf that can hold a key starting with the
+// stored key `key`; duplicates of a separator may sit on both sides of it.
+// Nodes are not validated against their parents: while splits run the
+// leaf reached may be left of the right one, and the caller has to walk
+// right from there.
+static uint32_t find_leaf(StorageManager* sm, BTreeIndex* index, const uint8_t* key, uint32_t key_len,
+                          BTreeNode* leaf) {
+    uint32_t page_id = __atomic_load_n(&index->root_page, __ATOMIC_ACQUIRE);
+
+    while (page_id != 0) {
+        if (!read_node(sm, page_id, leaf)) return 0;
+        if (NODE_HEADER(leaf)->is_leaf) return page_id;
+
+        page_id = key ? child_at(index, leaf, lower_bound(index, leaf, key, key_len)) : child_at(index, leaf, 0);
+    }
+    return 0;
+}
 
-        int i =  0;
-        while (i < (int)node.num_keys && search_hash > node.keys[i]) {
-            i++;
+// Descends to the leaf a writer has to change for the stored key: the
+// leftmost one that can hold it, or with `after` the one it goes after its
+// duplicates in. Every step is checked against the parent's version, so
+// the path is exact as of the leaf copy.
+static Descent descend(StorageManager* sm, BTreeIndex* index, const uint8_t* key, uint32_t key_len, bool after,
+                       TreePath* path) {
+    uint32_t page_id = __atomic_load_n(&index->root_page, __ATOMIC_ACQUIRE);
+    BTreeNode* node = &path->leaf;
+    path->depth = 0;
+
+    if (page_id == 0 || !read_node(sm, page_id, node)) return DESCENT_FAILED;
+    // A root split publishes the new root before it releases the old one
+    if (__atomic_load_n(&index->root_page, __ATOMIC_ACQUIRE) != page_id) return DESCENT_RETRY;
+
+    while (!NODE_HEADER(node)->is_leaf) {
+        if (path->depth == BTREE_MAX_HEIGHT) return DESCENT_FAILED;
+
+        uint32_t i = after ? upper_bound(index, node, key, key_len) : lower_bound(index, node, key, key_len);
+        uint32_t parent_version = NODE_HEADER(node)->version;
+        path->pages[path->depth] = page_id;
+        path->slots[path->depth++] = i;
+
+        page_id = child_at(index, node, i);
+        if (!read_node(sm, page_id, node)) return DESCENT_FAILED;
+        if (node_version(sm, path->pages[path->depth - 1]) != parent_version) return DESCENT_RETRY;
+    }
+    return DESCENT_OK;
+}
+
+// Writes an image back to page_id, splitting it into new right siblings
+// when it no longer fits a page. Records [pos, pos + added) are the ones
+// just inserted. Returns how many siblings were added; their pages go to
+// new_pages, and the separators to insert before them in the parent to
+// separators (key_size apart) and separator_lens.
+static uint32_t store_image(StorageManager* sm, BTreeIndex* index, NodeImage* image, uint32_t page_id,
+                            uint32_t pos, uint32_t added, uint8_t* separators, uint32_t* separator_lens,
+                            uint32_t* new_pages) {
+    BTreeNode* node = SAFE_MALLOC(BTreeNode, 1);
+    uint32_t n = image->count;
+    uint32_t cuts[2];
+    uint32_t cut_count = 0;
+
+    if (image_size(index, image, 0, n) > PAGE_SIZE) {
+        // A leaf splits between records [0, cut) and [cut, n); an internal
+        // node pushes record `cut` up and keeps its child as the right
+        // node's child[0]. Look for a single cut from the middle outwards.
+        uint32_t skip = image->is_leaf ? 0 : 1;
+        for (uint32_t step = 0; step <= n && cut_count == 0; step++) {
+            uint32_t offset = (step + 1) / 2;
+            uint32_t cut = step % 2 ? n / 2 + offset : n / 2 - offset; // wraps past 0
+            if (cut >= n || (image->is_leaf && cut == 0)) continue;
+            if (image_size(index, image, 0, cut) <= PAGE_SIZE &&
+                image_size(index, image, cut + skip, n) <= PAGE_SIZE) {
+                cuts[cut_count++] = cut;
+            }
         }
 
-        if (i < (int)node.num_keys && search_hash == node.keys[i]) {
-            return node.values[i];
+        if (cut_count == 0) {
+            // The new records broke a long shared prefix. The records on
+            // either side of them fit before, so isolate the new ones.
+            if (image->is_leaf) {
+                if (pos > 0) cuts[cut_count++] = pos;
+                if (pos + added < n) cuts[cut_count++] = pos + added;
+            } else {
+                for (uint32_t i = 0; i < added; i++) cuts[cut_count++] = pos + i;
+            }
         }
+    }
+
+    uint32_t pages[3] = {page_id, 0, 0};
+    for (uint32_t i = 0; i < cut_count; i++) {
+        pages[i + 1] = new_pages[i] = sm_allocate_page(sm);
+    }
 
-        if (node.is_leaf) {
-            return 0;
+    for (uint32_t i = 0; i <= cut_count; i++) {
+        uint32_t lo = i == 0 ? 0 : cuts[i - 1] + (image->is_leaf ? 0 : 1);
+        uint32_t hi = i == cut_count ? n : cuts[i];
+
+        node->page_id = pages[i];
+        image_store(index, image, lo, hi, node);
+        NodeHeader* header = NODE_HEADER(node);
+
+        if (image->is_leaf) {
+            header->prev_leaf = i == 0 ? image->prev_leaf : pages[i - 1];
+            header->next_leaf = i == cut_count ? image->next_leaf : pages[i + 1];
+            if (i < cut_count) {
+                uint8_t* left = image_record(image, hi - 1);
+                uint8_t* right = image_record(image, hi);
+                separator_lens[i] = shortest_separator(record_key(left), record_len(left), record_key(right),
+                                                       record_len(right), separators + i * index->key_size);
+            }
+        } else {
+            header->first_child = i == 0 ? image->first_child : record_child(index, image_record(image, lo - 1));
+            if (i < cut_count) {
+                uint8_t* record = image_record(image, hi);
+                separator_lens[i] = record_len(record);
+                memcpy(separators + i * index->key_size, record_key(record), record_len(record));
+            }
         }
+        write_node(sm, node);
+    }
 
-        current_page_id = node.children[i];
+    // Splice the new leaves into the sibling chain. The next leaf may have
+    // a writer of its own, which never waits on another latch.
+    if (image->is_leaf && cut_count > 0 && image->next_leaf != 0 && latch_node(sm, image->next_leaf, node)) {
+        NODE_HEADER(node)->prev_leaf = pages[cut_count];
+        write_node(sm, node);
+        unlock_node(sm, image->next_leaf, true);
     }
+
+    SAFE_FREE(node);
+    return cut_count;
 }
 
-static void btree_split_child(StorageManager* sm, BTreeNode* parent, int i, BTreeNode* child) {
-    uint32_t new_node_id = create_new_node(sm, child->is_leaf);
-    Page* new_page = sm_get_page(sm, new_node_id);
-    BTreeNode new_node;
-    page_to_node(new_page, &new_node);
-    
-    int t = BTREE_ORDER / 2; // Midpoint
-    new_node.num_keys = t - 1;
-    
-    // Copyseond half of keys/values to new node
-    for (int j = 0; j < t - 1; j++) {
-        new_node.keys[j] = child->keys[j + t];
-        new_node.values[j] = child->values[j + t];
+// Inserts a record into a copy of a latched leaf and writes it back,
+// splitting it if need be. Returns how many siblings the split added, or
+// -1 if the leaf is full and may not split.
+static int insert_record(StorageManager* sm, BTreeIndex* index, BTreeNode* leaf, const uint8_t* record,
+                         bool may_split, uint8_t* separators, uint32_t* separator_lens, uint32_t* new_pages) {
+    // Insert after any duplicates
+    NodeImage image;
+    image_load(index, leaf, &image, 1);
+    uint32_t pos = upper_bound(index, leaf, record_key((uint8_t*)record), record_len(record));
+    image_insert(&image, pos, record);
+
+    int split = -1;
+    if (may_split || image_size(index, &image, 0, image.count) <= PAGE_SIZE) {
+        split = (int)store_image(sm, index, &image, leaf->page_id, pos, 1, separators, separator_lens, new_pages);
     }
-    
-    // Copy children if not leaf
-    if (!child->is_leaf) {
-        for (int j = 0; j < t; j++) {
-            new_node.children[j] = child->children[j + t];
+    image_free(&image);
+    return split;
+}
+
+bool btree_insert(StorageManager* sm, BTreeIndex* index, const uint8_t* key, RID rid) {
+    if (!sm || !index || !key) return false;
+
+    // Initial Tree Creation
+    if (__atomic_load_n(&index->root_page, __ATOMIC_ACQUIRE) == 0) {
+        pthread_mutex_lock(&index->smo_latch);
+        if (index->root_page == 0) {
+            BTreeNode root;
+            memset(&root, 0, sizeof(BTreeNode));
+            root.page_id = sm_allocate_page(sm);
+            NODE_HEADER(&root)->is_leaf = true;
+            write_node(sm, &root);
+            __atomic_store_n(&index->root_page, root.page_id, __ATOMIC_RELEASE);
+            save_root(sm, index);
         }
+        pthread_mutex_unlock(&index->smo_latch);
     }
-    
-    child->num_keys = t - 1;
-    
-    // Shift parent children to make room for the new node
-    for (int j = parent->num_keys; j >= i + 1; j--) {
-        parent->children[j + 1] = parent->children[j];
+
+    uint8_t stored[BTREE_MAX_KEY_SIZE];
+    uint32_t stored_len = compact_key(index, key, index->key_size, stored);
+
+    uint8_t record[sizeof(uint16_t) + BTREE_MAX_KEY_SIZE + sizeof(RID)];
+    make_record(index, record, stored, stored_len, key + index->key_size, index->payload_size);
+    memcpy(record_tail(index, record) + index->payload_size, &rid, sizeof(RID));
+
+    uint8_t separators[2 * BTREE_MAX_KEY_SIZE];
+    uint32_t separator_lens[2];
+    uint32_t new_pages[2];
+    TreePath path;
+
+    // Most inserts fit their leaf and only latch that
+    while (true) {
+        Descent descent = descend(sm, index, stored, stored_len, true, &path);
+        if (descent == DESCENT_FAILED) {
+            return false;
+        }
+        if (descent == DESCENT_RETRY || !lock_node(sm, &path.leaf)) {
+            sched_yield();
+            continue;
+        }
+
+        bool fits = insert_record(sm, index, &path.leaf, record, false, separators, separator_lens, new_pages) == 0;
+        unlock_node(sm, path.leaf.page_id, fits);
+        if (fits) {
+            return true;
+        }
+        break;
     }
 
-    parent->children[i + 1] = new_node_id;
-    
-    // Shift parent keys to move the median key up
-    for (int j = parent->num_keys - 1; j >= i; j--) {
-        parent->keys[j + 1] = parent->keys[j];
-        parent->values[j + 1] = parent->values[j];
+    // The leaf has to split. Splits are serialized, so the internal nodes
+    // stay put from the descent on; leaves may still see other writers.
+    pthread_mutex_lock(&index->smo_latch);
+
+    Descent descent;
+    while ((descent = descend(sm, index, stored, stored_len, true, &path)) != DESCENT_FAILED) {
+        if (descent == DESCENT_OK && lock_node(sm, &path.leaf)) break;
+        sched_yield();
     }
-    parent->keys[i] = child->keys[t - 1];
-    parent->values[i] = child->values[t - 1];
-    parent->num_keys++;
-    
-    // Persist all changes
-    node_to_page(&new_node, new_page);
-    new_page->is_dirty = true;
-    
-    Page* child_page = sm_get_page(sm, child->page_id);
-    node_to_page(child, child_page);
-    child_page->is_dirty = true;
-}
+    if (descent == DESCENT_FAILED) {
+        pthread_mutex_unlock(&index->smo_latch);
+        return false;
+    }
+
+    // Every node the split rewrites stays latched until the parents point
+    // at the new siblings
+    uint32_t latched[BTREE_MAX_HEIGHT + 1];
+    uint32_t latched_count = 0;
+    latched[latched_count++] = path.leaf.page_id;
+
+    uint32_t page_id = path.leaf.page_id;
+    uint32_t depth = path.depth;
+    uint32_t split = (uint32_t)insert_record(sm, index, &path.leaf, record, true, separators, separator_lens,
+                                             new_pages);
 
-static void btree_insert_nonfull(StorageManager* sm, uint32_t page_id, uint32_t key, uint32_t value) {
-    Page* p = sm_get_page(sm, page_id);
+    // Each split adds (separator, new page) entries right after the split
+    // child in its parent; splitting the root grows the tree by a level
+    bool ok = true;
     BTreeNode node;
-    page_to_node(p, &node);
-    
-    int i = node.num_keys - 1;
-    
-    if (node.is_leaf) {
-        // Shift keys to the right to insert new key
-        while (i >= 0 && compare_hashes(key, node.keys[i]) < 0) {
-            node.keys[i + 1] = node.keys[i];
-            node.values[i + 1] = node.values[i];
-            i--;
-        }
-        node.keys[i + 1] = key;
-        node.values[i + 1] = value;
-        node.num_keys++;
-        
-        node_to_page(&node, p);
-        p->is_dirty = true;
-    } else {
-        // Find child to descend into
-        while (i >= 0 && key < node.keys[i]) {
-            i--;
-        }
-        i++;
-        
-        Page* child_p = sm_get_page(sm, node.children[i]);
-        BTreeNode child;
-        page_to_node(child_p, &child);
-        
-        if (child.num_keys == BTREE_ORDER - 1) {
-            btree_split_child(sm, &node, i, &child);
-            // After split, check which child to go to
-            if (compare_hashes(key, node.keys[i]) > 0) {
-                i++;
+    NodeImage image;
+    while (split > 0) {
+        bool new_root = depth == 0;
+        uint32_t pos;
+        if (new_root) {
+            image_init(index, &image, false, split);
+            image.first_child = page_id;
+            page_id = sm_allocate_page(sm);
+            pos = 0;
+        } else {
+            page_id = path.pages[--depth];
+            if (!latch_node(sm, page_id, &node)) {
+                ok = false;
+                break;
             }
+            latched[latched_count++] = page_id;
+            image_load(index, &node, &image, split);
+            pos = path.slots[depth];
+        }
+
+        for (uint32_t i = 0; i < split; i++) {
+            make_record(index, record, separators + i * index->key_size, separator_lens[i], &new_pages[i],
+                        sizeof(uint32_t));
+            image_insert(&image, pos + i, record);
+        }
+
+        split = store_image(sm, index, &image, page_id, pos, split, separators, separator_lens, new_pages);
+        image_free(&image);
+
+        if (new_root) {
+            // Update both the index and its catalog entry
+            __atomic_store_n(&index->root_page, page_id, __ATOMIC_RELEASE);
+            save_root(sm, index);
         }
-        btree_insert_nonfull(sm, node.children[i], key, value);
-        
-        // Parent might have been modified by split
-        node_to_page(&node, p);
-        p->is_dirty = true;
     }
+
+    for (uint32_t i = 0; i < latched_count; i++) {
+        unlock_node(sm, latched[i], true);
+    }
+    pthread_mutex_unlock(&index->smo_latch);
+    return ok;
 }
 
-bool btree_insert(StorageManager* sm, BTreeIndex* index, void* key, uint32_t value_page) {
+// Removes the entry for `key` pointing at `rid` (or the first entry for
+// `key` when rid is NULL) from its leaf. Leaves are allowed to underflow
+// (and even become empty); they stay linked so cursors simply step over
+// them. Space is reclaimed when the index is rebuilt. Only the leaf being
+// changed is latched.
+bool btree_delete(StorageManager* sm, BTreeIndex* index, const uint8_t* key, const RID* rid) {
     if (!sm || !index || !key) return false;
 
-    DataType key_type = index->schema->columns[index->key_column].type;
-    uint32_t key_hash = key_to_hash(key_type, key);
+    uint8_t stored[BTREE_MAX_KEY_SIZE];
+    uint32_t stored_len = compact_key(index, key, index->key_size, stored);
 
-    // Initial Tree Creation
-    if (sm->header.root_page == 0) {
-        sm->header.root_page = create_new_node(sm, true);
-        index->root_page = sm->header.root_page;
-    }
-
-    Page* root_p = sm_get_page(sm, index->root_page);
-    BTreeNode root;
-    page_to_node(root_p, &root);
-    
-    if (root.num_keys == BTREE_ORDER - 1) {
-        // Root is full, need to split and increase height
-        uint32_t new_root_id = create_new_node(sm, false);
-        Page* new_root_p = sm_get_page(sm, new_root_id);
-        BTreeNode new_root;
-        page_to_node(new_root_p, &new_root);
-        
-        new_root.children[0] = index->root_page;
-        btree_split_child(sm, &new_root, 0, &root);
-
-        // Update both the index and the storage header
-        sm->header.root_page = new_root_id;
-        index->root_page = new_root_id;
-
-        btree_insert_nonfull(sm, new_root_id, key_hash, value_page);
-        
-        node_to_page(&new_root, new_root_p);
-        new_root_p->is_dirty = true;
-    } else {
-        btree_insert_nonfull(sm, sm->header.root_page, key_hash, value_page);
+    TreePath path;
+    BTreeNode* leaf = &path.leaf;
+    int result = -1; // -1 while a concurrent writer forces a retry
+
+    while (result < 0) {
+        Descent descent = descend(sm, index, stored, stored_len, false, &path);
+        if (descent == DESCENT_FAILED) {
+            result = 0;
+            break;
+        }
+        if (descent == DESCENT_RETRY) {
+            sched_yield();
+            continue;
+        }
+
+        bool first = true;
+        while (result < 0) {
+            if (!lock_node(sm, leaf)) {
+                sched_yield();
+                break;
+            }
+            NodeHeader* header = NODE_HEADER(leaf);
+
+            uint32_t i = first ? lower_bound(index, leaf, stored, stored_len) : 0;
+            first = false;
+
+            for (; i < header->num_keys; i++) {
+                int cmp = compare_prefix(leaf, stored, stored_len);
+                if (cmp == 0) cmp = compare_suffix(index, leaf, i, stored, stored_len);
+                if (cmp > 0) {
+                    result = 0;
+                    break;
+                }
+
+                RID found = leaf_rid(index, leaf, i);
+                if (!rid || (found.page_id == rid->page_id && found.slot == rid->slot)) {
+                    // Close the gap left by the entry; the node prefix still holds
+                    uint8_t* slots = node_slots(leaf);
+                    uint32_t start = slot_at(leaf, i);
+                    uint32_t end = slot_at(leaf, i + 1);
+                    memmove(leaf->data + start, leaf->data + end, slot_at(leaf, header->num_keys) - end);
+                    for (uint32_t j = i + 1; j <= header->num_keys; j++) {
+                        store_u16(slots + (j - 1) * SLOT_SIZE, (uint16_t)(slot_at(leaf, j) - (end - start)));
+                    }
+                    header->num_keys--;
+                    write_node(sm, leaf);
+                    result = 1;
+                    break;
+                }
+            }
+
+            uint32_t next_leaf = header->next_leaf;
+            unlock_node(sm, leaf->page_id, result == 1);
+            if (result >= 0) break;
+
+            // Duplicates may continue in the next leaf
+            if (next_leaf == 0 || !read_node(sm, next_leaf, leaf)) result = 0;
+        }
     }
-    
-    return true;
-}
 
-bool btree_delete(StorageManager* sm, BTreeIndex* index, void* key) {
-    if (!sm || !index || !key) return false;
-    
-    DataType key_type = index->schema->columns[index->key_column].type;
-    uint32_t key_hash = key_to_hash(key_type, key);
-    
-    printf("B-Tree delete for key_hash %u (not fully implemented)\n", key_hash);
-    
-    // TODO: Implement proper B-Tree deletion
-    // This is complex and includes:
-    // 1. Find the node containing the key
-    // 2. If leaf: remove key, handle underflow
-    // 3. If internal: replace with predecessor/successor
-    // 4. Handle merging/redistribution
-    
-    return true;
+    return result == 1;
 }
 
 void btree_free_index(BTreeIndex* index) {
     if (!index) return;
-    
+
     printf("Freeing B-Tree index\n");
+    pthread_mutex_destroy(&index->smo_latch);
     SAFE_FREE(index);
 }
 
+BTreeCursor* btree_seek(StorageManager* sm, BTreeIndex* index, const uint8_t* key, uint32_t key_len) {
+    if (!sm || !index) return NULL;
 
-static inline uint32_t fnv1a_hash(const void *data, size_t len) {
-    const uint8_t *bytes = (const uint8_t *)data;
-    uint32_t hash = 2166136261u;
+    BTreeCursor* cursor = SAFE_MALLOC(BTreeCursor, 1);
+    cursor->sm = sm;
+    cursor->index = index;
+    cursor->position = 0;
 
-    for (size_t i = 0; i < len; i++) {
-        hash ^= bytes[i];
-        hash *= 16777619u;
+    if (!key || key_len == 0) {
+        // No key: position before the very first entry
+        cursor->leaf_page = find_leaf(sm, index, NULL, 0, &cursor->leaf);
+        return cursor;
     }
 
-    return hash;
+    uint8_t stored[BTREE_MAX_KEY_SIZE];
+    uint32_t stored_len = compact_key(index, key, key_len, stored);
+    cursor->leaf_page = find_leaf(sm, index, stored, stored_len, &cursor->leaf);
+
+    // The leaf reached may be several left of the right one if splits ran
+    // meanwhile, so step right until the cursor has an entry after it
+    while (cursor->leaf_page != 0) {
+        cursor->position = lower_bound(index, &cursor->leaf, stored, stored_len);
+        uint32_t next_leaf = NODE_HEADER(&cursor->leaf)->next_leaf;
+        if (cursor->position < NODE_HEADER(&cursor->leaf)->num_keys || next_leaf == 0) break;
+
+        if (!read_node(sm, next_leaf, &cursor->leaf)) {
+            cursor->leaf_page = 0;
+            break;
+        }
+        cursor->leaf_page = next_leaf;
+    }
+
+    return cursor;
 }
 
-static uint32_t key_to_hash(DataType type, void* key){
-    switch (type) {
-        case DT_INT:
-            return fnv1a_hash(key, sizeof(int));
-        case DT_FLOAT:
-            return fnv1a_hash(key, sizeof(float));
-        case DT_STRING:
-            return fnv1a_hash(key, strlen((char*)key));
-        default:
-            return 0;
+BTreeCursor* btree_seek_last(StorageManager* sm, BTreeIndex* index) {
+    if (!sm || !index) return NULL;
+
+    BTreeCursor* cursor = SAFE_MALLOC(BTreeCursor, 1);
+    cursor->sm = sm;
+    cursor->index = index;
+    cursor->leaf_page = 0;
+    cursor->position = 0;
+
+    uint32_t page_id = __atomic_load_n(&index->root_page, __ATOMIC_ACQUIRE);
+    BTreeNode* node = &cursor->leaf;
+    while (page_id != 0 && read_node(sm, page_id, node)) {
+        NodeHeader* header = NODE_HEADER(node);
+        if (header->is_leaf) {
+            // A split may have moved entries further right meanwhile
+            if (header->next_leaf != 0) {
+                page_id = header->next_leaf;
+                continue;
+            }
+            cursor->leaf_page = page_id;
+            cursor->position = header->num_keys;
+            break;
+        }
+        page_id = child_at(index, node, header->num_keys);
     }
+
+    return cursor;
 }
 
-static int compare_hashes(uint32_t hash1, uint32_t hash2) {
-    if (hash1 < hash2) return -1;
-    if (hash1 > hash2) return 1;
+bool btree_next(BTreeCursor* cursor, uint8_t* key, RID* rid) {
+    if (!cursor) return false;
+
+    BTreeIndex* index = cursor->index;
+    BTreeNode* leaf = &cursor->leaf;
+    while (cursor->leaf_page != 0) {
+        NodeHeader* header = NODE_HEADER(leaf);
+
+        if (cursor->position < header->num_keys) {
+            if (key) copy_leaf_entry(index, leaf, cursor->position, key);
+            if (rid) *rid = leaf_rid(index, leaf, cursor->position);
+            cursor->position++;
+            return true;
+        }
+
+        // Exhausted this leaf, stay put if it is the last one. The copy's
+        // link skips leaves split off after it was taken; their entries
+        // were past the cursor's already.
+        uint32_t next_leaf = header->next_leaf;
+        if (next_leaf == 0) return false;
+
+        if (!read_node(cursor->sm, next_leaf, leaf)) {
+            cursor->leaf_page = 0;
+            return false;
+        }
+        cursor->leaf_page = next_leaf;
+        cursor->position = 0;
+    }
+
+    return false;
+}
+
+bool btree_prev(BTreeCursor* cursor, uint8_t* key, RID* rid) {
+    if (!cursor) return false;
+
+    BTreeIndex* index = cursor->index;
+    BTreeNode* leaf = &cursor->leaf;
+    while (cursor->leaf_page != 0) {
+        NodeHeader* header = NODE_HEADER(leaf);
+
+        if (cursor->position > 0) {
+            cursor->position--;
+            if (key) copy_leaf_entry(index, leaf, cursor->position, key);
+            if (rid) *rid = leaf_rid(index, leaf, cursor->position);
+            return true;
+        }
+
+        // Exhausted this leaf, stay put if it is the first one
+        if (header->prev_leaf == 0) return false;
+
+        // Leaves split off the previous one sit between it and this one;
+        // walk right up to this leaf's neighbour
+        uint32_t current = cursor->leaf_page;
+        uint32_t page_id = header->prev_leaf;
+        while (true) {
+            if (!read_node(cursor->sm, page_id, leaf)) {
+                cursor->leaf_page = 0;
+                return false;
+            }
+            uint32_t next_leaf = NODE_HEADER(leaf)->next_leaf;
+            if (next_leaf == current || next_leaf == 0) break;
+            page_id = next_leaf;
+        }
+        cursor->leaf_page = page_id;
+        cursor->position = NODE_HEADER(leaf)->num_keys;
+    }
+
+    return false;
+}
+
+void btree_close(BTreeCursor* cursor) {
+    if (!cursor) return;
+
+    SAFE_FREE(cursor);
+}
+
+int btree_entry_compare(const void* a, const void* b, void* index) {
+    uint32_t key_size = ((BTreeIndex*)index)->key_size;
+
+    int cmp = memcmp(a, b, key_size);
+    if (cmp != 0) return cmp;
+
+    // Keep duplicates in heap order
+    uint32_t rid_offset = key_size + ((BTreeIndex*)index)->payload_size;
+    RID left, right;
+    memcpy(&left, (const uint8_t*)a + rid_offset, sizeof(RID));
+    memcpy(&right, (const uint8_t*)b + rid_offset, sizeof(RID));
+    if (left.page_id != right.page_id) return left.page_id < right.page_id ? -1 : 1;
+    if (left.slot != right.slot) return left.slot < right.slot ? -1 : 1;
     return 0;
 }
 
-static void node_to_page(BTreeNode* node, Page* page) {
-    uint8_t* cursor = page->data;
-
-    memcpy(cursor, &node->num_keys, sizeof(uint32_t));
-    cursor += sizeof(uint32_t);
-
-    memcpy(cursor, &node->is_leaf, sizeof(bool));
-    cursor += sizeof(bool);
-
-    memcpy(cursor, node->keys, sizeof(uint32_t) * (BTREE_ORDER - 1));
-    cursor += sizeof(uint32_t) * (BTREE_ORDER - 1);
-    
-    memcpy(cursor, node->values, sizeof(uint32_t) * (BTREE_ORDER - 1));
-    cursor += sizeof(uint32_t) * (BTREE_ORDER - 1);
-    
-    memcpy(cursor, node->children, sizeof(uint32_t) * BTREE_ORDER);
-}
-
-static void page_to_node(Page* page, BTreeNode* node) {
-    uint8_t* cursor = page->data;
-    node->page_id = page->page_id;
-    
-    memcpy(&node->num_keys, cursor, sizeof(uint32_t)); cursor += sizeof(uint32_t);
-    memcpy(&node->is_leaf, cursor, sizeof(bool));      cursor += sizeof(bool);
-    
-    memcpy(node->keys, cursor, sizeof(uint32_t) * (BTREE_ORDER - 1));
-    cursor += sizeof(uint32_t) * (BTREE_ORDER - 1);
-    
-    memcpy(node->values, cursor, sizeof(uint32_t) * (BTREE_ORDER - 1));
-    cursor += sizeof(uint32_t) * (BTREE_ORDER - 1);
-    
-    memcpy(node->children, cursor, sizeof(uint32_t) * BTREE_ORDER);
-}
-
-static uint32_t create_new_node(StorageManager* sm, bool is_leaf) {
-    uint32_t page_id = sm_allocate_page(sm);
-    Page* page = sm_get_page(sm, page_id);
-    
-    BTreeNode node;
-    memset(&node, 0, sizeof(BTreeNode));
-    node.page_id = page_id;
-    node.is_leaf = is_leaf;
-    node.num_keys = 0;
-    
-    node_to_page(&node, page);
+static BTreeBuilder* build_begin(StorageManager* sm, BTreeIndex* index, uint32_t fill_factor) {
+    if (fill_factor == 0 || fill_factor > 100) fill_factor = BTREE_DEFAULT_FILL_FACTOR;
+
+    BTreeBuilder* builder = SAFE_CALLOC(BTreeBuilder, 1);
+    builder->sm = sm;
+    builder->index = index;
+    // A node always takes at least one entry, so this never stalls
+    builder->fill_bytes = PAGE_SIZE * fill_factor / 100;
+
+    return builder;
+}
+
+BTreeBuilder* btree_build_begin(StorageManager* sm, BTreeIndex* index, uint32_t fill_factor) {
+    if (!sm || !index || index->root_page != 0) return NULL;
+
+    return build_begin(sm, index, fill_factor);
+}
+
+// Starts an empty node on `level` at page_id
+static void build_open(BTreeBuilder* builder, uint32_t level, bool is_leaf, uint32_t page_id) {
+    NodeImage* image = &builder->levels[level];
+    if (!image->records) image_init(builder->index, image, is_leaf, NODE_MAX_ENTRIES);
+
+    image->count = 0;
+    image->next_leaf = image->prev_leaf = image->first_child = 0;
+    builder->pages[level] = page_id;
+    builder->key_bytes[level] = 0;
+}
+
+// Whether the open node of `level` stays within the fill factor with
+// `record` added
+static bool build_fits(BTreeBuilder* builder, uint32_t level, uint8_t* record) {
+    NodeImage* image = &builder->levels[level];
+    if (image->count == 0) return true;
+
+    uint8_t* first = image_record(image, 0);
+    uint32_t prefix_len = common_prefix(record_key(first), record_len(first), record_key(record), record_len(record));
+    uint32_t size = encoded_size(builder->index, image->is_leaf, image->count + 1,
+                                 builder->key_bytes[level] + record_len(record), prefix_len);
+    return size <= builder->fill_bytes;
+}
+
+static void build_append(BTreeBuilder* builder, uint32_t level, const uint8_t* record) {
+    NodeImage* image = &builder->levels[level];
+    memcpy(image_record(image, image->count++), record, image->width);
+    builder->key_bytes[level] += record_len(record);
+}
+
+static void build_write(BTreeBuilder* builder, uint32_t level) {
+    NodeImage* image = &builder->levels[level];
+    BTreeNode* node = SAFE_MALLOC(BTreeNode, 1);
+
+    node->page_id = builder->pages[level];
+    image_store(builder->index, image, 0, image->count, node);
+    NODE_HEADER(node)->next_leaf = image->next_leaf;
+    NODE_HEADER(node)->prev_leaf = image->prev_leaf;
+    NODE_HEADER(node)->first_child = image->first_child;
+    write_node(builder->sm, node);
+
+    SAFE_FREE(node);
+}
+
+// Adds `right` as the next child of `level`, with `separator` between it
+// and its left neighbour `left`. A full node is closed and a new one
+// started, pushing the separator up a level.
+static bool build_add_child(BTreeBuilder* builder, uint32_t level, const uint8_t* separator,
+                            uint32_t separator_len, uint32_t left, uint32_t right) {
+    BTreeIndex* index = builder->index;
+
+    if (level == builder->height) {
+        if (level == BTREE_MAX_HEIGHT) return false;
+
+        build_open(builder, level, false, sm_allocate_page(builder->sm));
+        builder->levels[level].first_child = left;
+        builder->height++;
+    }
+
+    uint8_t record[sizeof(uint16_t) + BTREE_MAX_KEY_SIZE + sizeof(uint32_t)];
+    make_record(index, record, separator, separator_len, &right, sizeof(uint32_t));
+
+    if (!build_fits(builder, level, record)) {
+        uint32_t closed = builder->pages[level];
+        uint32_t next = sm_allocate_page(builder->sm);
+
+        build_write(builder, level);
+        build_open(builder, level, false, next);
+        builder->levels[level].first_child = right;
+        return build_add_child(builder, level + 1, separator, separator_len, closed, next);
+    }
+
+    build_append(builder, level, record);
+    return true;
+}
+
+bool btree_build_add(BTreeBuilder* builder, const uint8_t* key, RID rid) {
+    if (!builder) return false;
+
+    BTreeIndex* index = builder->index;
+    uint8_t record[sizeof(uint16_t) + BTREE_MAX_KEY_SIZE + sizeof(RID)];
+    uint8_t stored[BTREE_MAX_KEY_SIZE];
+    uint32_t stored_len = compact_key(index, key, index->key_size, stored);
+
+    if (builder->count > 0 && compare_stored(stored, stored_len, builder->last_key, builder->last_len) < 0) {
+        return false;
+    }
+
+    if (builder->height == 0) {
+        build_open(builder, 0, true, sm_allocate_page(builder->sm));
+        builder->height = 1;
+    }
+
+    make_record(index, record, stored, stored_len, key + index->key_size, index->payload_size);
+    memcpy(record_tail(index, record) + index->payload_size, &rid, sizeof(RID));
+
+    if (!build_fits(builder, 0, record)) {
+        uint32_t closed = builder->pages[0];
+        uint32_t next = sm_allocate_page(builder->sm);
+
+        builder->levels[0].next_leaf = next;
+        build_write(builder, 0);
+        build_open(builder, 0, true, next);
+        builder->levels[0].prev_leaf = closed;
+
+        uint8_t separator[BTREE_MAX_KEY_SIZE];
+        uint32_t separator_len =
+            shortest_separator(builder->last_key, builder->last_len, stored, stored_len, separator);
+        if (!build_add_child(builder, 1, separator, separator_len, closed, next)) return false;
+    }
+
+    build_append(builder, 0, record);
+
+    memcpy(builder->last_key, stored, stored_len);
+    builder->last_len = stored_len;
+    builder->count++;
+    return true;
+}
+
+bool btree_build_finish(BTreeBuilder* builder) {
+    if (!builder) return false;
+
+    // The rightmost node of each level is still open; the topmost one is
+    // the root. Those nodes may be underfull, which lookups tolerate.
+    for (uint32_t level = 0; level < builder->height; level++) {
+        build_write(builder, level);
+        image_free(&builder->levels[level]);
+    }
+
+    if (builder->height > 0) {
+        __atomic_store_n(&builder->index->root_page, builder->pages[builder->height - 1], __ATOMIC_RELEASE);
+        save_root(builder->sm, builder->index);
+    }
+
+    SAFE_FREE(builder);
+    return true;
+}
+
+// Rebuilds the tree next to the old one from the old one's leaves, which
+// are already in key order, then switches the index over by publishing the
+// new root. Readers keep using the old tree until then. Writers must stay
+// away for the duration: the executor runs one statement at a time, so
+// nothing else writes the index meanwhile. The old pages are not reused.
+bool btree_rebuild(StorageManager* sm, BTreeIndex* index) {
+    if (!sm || !index) return false;
+    if (__atomic_load_n(&index->root_page, __ATOMIC_ACQUIRE) == 0) return true;
+
+    BTreeBuilder* builder = build_begin(sm, index, index->fill_factor);
+    BTreeCursor* cursor = btree_seek(sm, index, NULL, 0);
+    uint8_t entry[BTREE_MAX_KEY_SIZE];
+    RID rid;
+    bool ok = true;
+    while (ok && btree_next(cursor, entry, &rid)) {
+        ok = btree_build_add(builder, entry, rid);
+    }
+    btree_close(cursor);
+
+    if (!ok) {
+        for (uint32_t level = 0; level < builder->height; level++) {
+            image_free(&builder->levels[level]);
+        }
+        SAFE_FREE(builder);
+        return false;
+    }
+
+    // Deletes may have emptied the tree altogether
+    bool empty = builder->count == 0;
+    btree_build_finish(builder);
+    if (empty) {
+        __atomic_store_n(&index->root_page, 0, __ATOMIC_RELEASE);
+        save_root(sm, index);
+    }
+    return true;
+}
+
+bool btree_stats(StorageManager* sm, BTreeIndex* index, BTreeStats* stats) {
+    if (!sm || !index || !stats) return false;
+
+    memset(stats, 0, sizeof(BTreeStats));
+    uint32_t root = __atomic_load_n(&index->root_page, __ATOMIC_ACQUIRE);
+    if (root == 0) return true;
+
+    // Walk the tree a level at a time; each level lists its pages in key
+    // order, so the leaf level sees the keys sorted
+    uint32_t* level = SAFE_MALLOC(uint32_t, 1);
+    uint32_t level_count = 1;
+    level[0] = root;
+
+    BTreeNode* node = SAFE_MALLOC(BTreeNode, 1);
+    uint8_t key[BTREE_MAX_KEY_SIZE];
+    uint8_t last_key[BTREE_MAX_KEY_SIZE];
+    uint32_t last_len = 0;
+    uint32_t duplicates = 0;
+    bool ok = true;
+
+    while (ok && level_count > 0) {
+        uint32_t* children = NULL;
+        uint32_t child_count = 0, child_capacity = 0;
+        stats->height++;
+
+        for (uint32_t i = 0; i < level_count; i++) {
+            if (!read_node(sm, level[i], node)) {
+                ok = false;
+                break;
+            }
+            NodeHeader* header = NODE_HEADER(node);
+            uint32_t used = slot_at(node, header->num_keys);
+
+            if (!header->is_leaf) {
+                stats->internal_pages++;
+                stats->internal_bytes += used;
+                if (child_count + header->num_keys + 1 > child_capacity) {
+                    child_capacity = (child_count + header->num_keys + 1) * 2;
+                    children = SAFE_REALLOC(children, uint32_t, child_capacity);
+                }
+                for (uint32_t c = 0; c <= header->num_keys; c++) {
+                    children[child_count++] = child_at(index, node, c);
+                }
+                continue;
+            }
+
+            stats->leaf_pages++;
+            stats->leaf_bytes += used;
+            stats->entries += header->num_keys;
+            stats->key_bytes += header->prefix_len;
+            if (header->num_keys == 0) stats->empty_leaves++;
+            if (stats->leaf_pages == 1 || header->num_keys < stats->min_leaf_entries) {
+                stats->min_leaf_entries = header->num_keys;
+            }
+            if (header->num_keys > stats->max_leaf_entries) stats->max_leaf_entries = header->num_keys;
+            if (header->next_leaf != 0 && header->next_leaf != level[i] + 1) stats->leaf_jumps++;
+
+            for (uint32_t k = 0; k < header->num_keys; k++) {
+                uint32_t len = copy_key(index, node, k, key);
+                stats->key_bytes += suffix_len(index, node, k);
+
+                if (stats->distinct_keys > 0 && compare_stored(key, len, last_key, last_len) == 0) {
+                    duplicates++;
+                } else {
+                    stats->distinct_keys++;
+                    duplicates = 1;
+                    memcpy(last_key, key, len);
+                    last_len = len;
+                }
+                if (duplicates > stats->max_duplicates) stats->max_duplicates = duplicates;
+            }
+        }
+
+        SAFE_FREE(level);
+        level = children;
+        level_count = child_count;
+    }
+
+    SAFE_FREE(level);
+    SAFE_FREE(node);
+    return ok;
+}
+
+static void save_root(StorageManager* sm, BTreeIndex* index) {
+    IndexDef def;
+    if (index_catalog_load(sm, index->name, &def)) {
+        def.root_page = index->root_page;
+        index_catalog_save(sm, &def);
+    }
+}
+
+static uint32_t next_catalog_page(Page* page) {
+    return *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
+}
+
+// Inserts the entry, or overwrites the existing one with the same name.
+// Splits save new roots while other threads use the cache, so pages are
+// pinned here and in index_catalog_load.
+bool index_catalog_save(StorageManager* sm, IndexDef* def) {
+    if (!sm || !def || def->name[0] == '\0') return false;
+
+    if (sm->header.index_page == 0) {
+        sm->header.index_page = sm_allocate_page(sm);
+    }
+
+    uint32_t free_page = 0, free_slot = 0;
+    uint32_t last_page = sm->header.index_page;
+    uint32_t page_id = sm->header.index_page;
+
+    while (page_id != 0) {
+        Page* page = sm_pin_page(sm, page_id);
+        if (!page) return false;
+
+        for (uint32_t i = 0; i < INDEX_DEFS_PER_PAGE; i++) {
+            char* stored_name = (char*)(page->data + i * sizeof(IndexDef));
+
+            if (stored_name[0] == '\0') {
+                if (free_page == 0) {
+                    free_page = page_id;
+                    free_slot = i;
+                }
+            } else if (strncmp(stored_name, def->name, MAX_INDEX_NAME) == 0) {
+                memcpy(page->data + i * sizeof(IndexDef), def, sizeof(IndexDef));
+                page->is_dirty = true;
+                sm_unpin_page(sm, page);
+                return true;
+            }
+        }
+
+        last_page = page_id;
+        page_id = next_catalog_page(page);
+        sm_unpin_page(sm, page);
+    }
+
+    if (free_page == 0) {
+        // Every catalog page is full, chain a new one
+        free_page = sm_allocate_page(sm);
+        free_slot = 0;
+
+        Page* last = sm_pin_page(sm, last_page);
+        if (!last) return false;
+        *(uint32_t*)(last->data + PAGE_SIZE - sizeof(uint32_t)) = free_page;
+        last->is_dirty = true;
+        sm_unpin_page(sm, last);
+    }
+
+    Page* page = sm_pin_page(sm, free_page);
+    if (!page) return false;
+
+    memcpy(page->data + free_slot * sizeof(IndexDef), def, sizeof(IndexDef));
+    page->is_dirty = true;
+    sm_unpin_page(sm, page);
+    return true;
+}
+
+bool index_catalog_load(StorageManager* sm, const char* index_name, IndexDef* def) {
+    if (!sm || !index_name) return false;
+
+    uint32_t page_id = sm->header.index_page;
+    while (page_id != 0) {
+        Page* page = sm_pin_page(sm, page_id);
+        if (!page) return false;
+
+        for (uint32_t i = 0; i < INDEX_DEFS_PER_PAGE; i++) {
+            char* stored_name = (char*)(page->data + i * sizeof(IndexDef));
+            if (stored_name[0] != '\0' && strncmp(stored_name, index_name, MAX_INDEX_NAME) == 0) {
+                memcpy(def, page->data + i * sizeof(IndexDef), sizeof(IndexDef));
+                sm_unpin_page(sm, page);
+                return true;
+            }
+        }
+
+        page_id = next_catalog_page(page);
+        sm_unpin_page(sm, page);
+    }
+
+    return false;
+}
+
+bool index_catalog_delete(StorageManager* sm, const char* index_name) {
+    if (!sm || !index_name) return false;
+
+    uint32_t page_id = sm->header.index_page;
+    while (page_id != 0) {
+        Page* page = sm_get_page(sm, page_id);
+        if (!page) return false;
+
+        for (uint32_t i = 0; i < INDEX_DEFS_PER_PAGE; i++) {
+            char* stored_name = (char*)(page->data + i * sizeof(IndexDef));
+            if (stored_name[0] != '\0' && strncmp(stored_name, index_name, MAX_INDEX_NAME) == 0) {
+                memset(page->data + i * sizeof(IndexDef), 0, sizeof(IndexDef));
+                page->is_dirty = true;
+                return true;
+            }
+        }
+
+        page_id = next_catalog_page(page);
+    }
+
+    return false;
+}
+
+// Lists the indexes of `table_name` (every index when it is NULL)
+uint32_t index_catalog_list(StorageManager* sm, const char* table_name, IndexDef* defs, uint32_t max_defs) {
+    if (!sm) return 0;
+
+    uint32_t count = 0;
+    uint32_t page_id = sm->header.index_page;
+
+    while (page_id != 0 && count < max_defs) {
+        Page* page = sm_get_page(sm, page_id);
+        if (!page) break;
+
+        for (uint32_t i = 0; i < INDEX_DEFS_PER_PAGE && count < max_defs; i++) {
+            IndexDef* stored = (IndexDef*)(page->data + i * sizeof(IndexDef));
+            if (stored->name[0] == '\0') continue;
+            if (table_name && strncmp(stored->table_name, table_name, MAX_TABLE_NAME) != 0) continue;
+
+            memcpy(&defs[count++], stored, sizeof(IndexDef));
+        }
+
+        page_id = next_catalog_page(page);
+    }
+
+    return count;
+}
+
+
+// Page pointers are only valid until the next cache miss, so nodes are
+// always copied in and out instead of holding on to a Page*. Pages are
+// pinned while they are accessed, as another thread's miss may evict them.
+static uint32_t* page_version(Page* page) {
+    return (uint32_t*)page->data;
+}
+
+// Copies a consistent image of a node, waiting out any writer holding it.
+// The copy keeps the version it was taken at.
+static bool read_node(StorageManager* sm, uint32_t page_id, BTreeNode* node) {
+    Page* page = sm_pin_page(sm, page_id);
+    if (!page) return false;
+
+    while (true) {
+        uint32_t version = __atomic_load_n(page_version(page), __ATOMIC_ACQUIRE);
+        if (version & 1) {
+            sched_yield();
+            continue;
+        }
+
+        memcpy(node->data, page->data, PAGE_SIZE);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(page_version(page), __ATOMIC_RELAXED) == version) {
+            NODE_HEADER(node)->version = version;
+            break;
+        }
+    }
+
+    sm_unpin_page(sm, page);
+    node->page_id = page_id;
+    return true;
+}
+
+// Writes a node the caller has latched (or that nobody can reach yet); the
+// version word is left alone
+static void write_node(StorageManager* sm, BTreeNode* node) {
+    Page* page = sm_pin_page(sm, node->page_id);
+    if (!page) return;
+
+    memcpy(page->data + sizeof(uint32_t), node->data + sizeof(uint32_t), PAGE_SIZE - sizeof(uint32_t));
     page->is_dirty = true;
-    
-    return page_id;
+    sm_unpin_page(sm, page);
+}
+
+// Current version of a node; an unreadable page gets an odd one, which no
+// copy has
+static uint32_t node_version(StorageManager* sm, uint32_t page_id) {
+    Page* page = sm_pin_page(sm, page_id);
+    if (!page) return UINT32_MAX;
+
+    uint32_t version = __atomic_load_n(page_version(page), __ATOMIC_ACQUIRE);
+    sm_unpin_page(sm, page);
+    return version;
+}
+
+// Latches the node if it is still at the version of the copy, which makes
+// the copy current. A latched page stays pinned until it is unlocked, so
+// the latch never goes to disk.
+static bool lock_node(StorageManager* sm, BTreeNode* node) {
+    Page* page = sm_pin_page(sm, node->page_id);
+    if (!page) return false;
+
+    uint32_t expected = NODE_HEADER(node)->version;
+    if (!__atomic_compare_exchange_n(page_version(page), &expected, expected + 1, false, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED)) {
+        sm_unpin_page(sm, page);
+        return false;
+    }
+    return true;
+}
+
+// Latches the node whatever its version, then copies it
+static bool latch_node(StorageManager* sm, uint32_t page_id, BTreeNode* node) {
+    Page* page = sm_pin_page(sm, page_id);
+    if (!page) return false;
+
+    while (true) {
+        uint32_t version = __atomic_load_n(page_version(page), __ATOMIC_RELAXED);
+        if (!(version & 1) && __atomic_compare_exchange_n(page_version(page), &version, version + 1, false,
+                                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        sched_yield();
+    }
 
+    node->page_id = page_id;
+    memcpy(node->data, page->data, PAGE_SIZE);
+    return true;
+}
+
+// Releases a latch. A changed node gets a new version so that optimistic
+// copies taken before are rejected; an unchanged one gets its old version
+// back.
+static void unlock_node(StorageManager* sm, uint32_t page_id, bool changed) {
+    Page* page = sm_pin_page(sm, page_id);
+    if (!page) return;
+
+    if (changed) {
+        __atomic_add_fetch(page_version(page), 1, __ATOMIC_RELEASE);
+    } else {
+        __atomic_sub_fetch(page_version(page), 1, __ATOMIC_RELEASE);
+    }
+    sm_unpin_page(sm, page);
+    sm_unpin_page(sm, page); // the latch's pin
 }
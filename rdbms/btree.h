@@ -5,27 +5,136 @@
 
 #include "storage.h"
 
-#define BTREE_ORDER 4
+#define MAX_TABLE_INDEXES 16
+#define BTREE_MAX_KEY_SIZE 1024
+#define BTREE_DEFAULT_FILL_FACTOR 90 // percent of a node filled by bulk builds
 
+// Index catalog entry. Entries live in the page chain starting at
+// header.index_page; an empty name marks a free slot.
+typedef struct {
+    char name[MAX_INDEX_NAME];
+    char table_name[MAX_TABLE_NAME];
+    uint32_t key_columns[MAX_INDEX_COLUMNS];
+    uint32_t key_column_count;
+    uint32_t include_columns[MAX_INDEX_COLUMNS]; // stored in leaves, not part of the key
+    uint32_t include_column_count;
+    uint32_t root_page; // 0 until the first entry is inserted
+    bool is_primary;
+    bool is_unique;
+    bool is_constraint;   // created for a UNIQUE column, dropped with the table only
+    uint32_t fill_factor; // used when the index is (re)built in bulk
+    uint32_t method;      // IndexMethod; a hash index's root_page is its meta page
+    uint32_t bloom_page;  // meta page of the key Bloom filter, 0 if none
+} IndexDef;
+
+// In-memory copy of a B+tree node page. Internal nodes only hold separator
+// keys and child pointers; every (key, RID) pair lives in a leaf, and
+// leaves are doubly linked so that a cursor can walk the index in key
+// order. The page layout is private to btree.c.
 typedef struct BTreeNode {
-    uint32_t keys[BTREE_ORDER - 1];
-    uint32_t children[BTREE_ORDER];
-    uint32_t values[BTREE_ORDER - 1];
-    uint32_t num_keys;
-    bool is_leaf;
     uint32_t page_id;
+    uint8_t data[PAGE_SIZE];
 } BTreeNode;
 
+// Keys are the concatenation of the key columns, each encoded to a fixed
+// width so that memcmp order is the column value order (see
+// btree_encode_value). A prefix of a key covers a prefix of the columns.
+// Leaf entries carry the included columns right after the key, encoded the
+// same way, so an entry is key_size + payload_size bytes; only the key
+// part takes part in comparisons. Node pages store keys compressed (see
+// btree.c), so the number of entries per node depends on the keys.
 typedef struct {
+    char name[MAX_INDEX_NAME]; // catalog entry the root page is saved to
     uint32_t root_page;
     TableSchema* schema;
-    uint32_t key_column; // which column we are indexing on
+    uint32_t key_columns[MAX_INDEX_COLUMNS];
+    uint32_t key_column_count;
+    uint32_t key_size;          // bytes in an encoded key
+    uint32_t include_columns[MAX_INDEX_COLUMNS];
+    uint32_t include_column_count;
+    uint32_t payload_size;      // bytes of included values after the key
+    bool is_primary;
+    bool is_unique;
+    uint32_t fill_factor;
+    uint32_t bloom_page; // 0 when the index has no Bloom filter
+    pthread_mutex_t smo_latch; // serializes splits; see btree.c for latching
 } BTreeIndex;
 
-BTreeIndex* btree_create_index(TableSchema* schema, uint32_t key_column);
-bool btree_insert(StorageManager* sm, BTreeIndex* index, void* key, uint32_t value_page);
-uint32_t btree_search(StorageManager* sm, BTreeIndex* index, void* key);
-bool btree_delete(StorageManager* sm, BTreeIndex* index, void* key);
+// Range cursor over the leaf level. The cursor sits *between* two entries:
+// btree_next returns the entry after it and moves forward, btree_prev
+// returns the entry before it and moves backward. It reads from a copy of
+// its current leaf; entries other threads add to a leaf after the cursor
+// copied it may or may not be seen, but no entry is seen twice.
+typedef struct {
+    StorageManager* sm;
+    BTreeIndex* index;
+    uint32_t leaf_page; // 0 when the tree is empty
+    uint32_t position;  // number of entries of leaf_page before the cursor
+    BTreeNode leaf;     // copy of leaf_page
+} BTreeCursor;
+
+// Builds an empty index bottom-up from entries added in ascending key
+// order. Leaves and internal nodes are written left to right, each filled
+// to the fill factor, so a build allocates pages sequentially and never
+// splits.
+typedef struct BTreeBuilder BTreeBuilder;
+
+// Shape of a tree, gathered by reading every node (btree_stats). Byte
+// counts cover what a node's header, slots and entries take of its page.
+typedef struct {
+    uint32_t height;           // levels, 0 for an empty tree
+    uint32_t internal_pages;
+    uint32_t leaf_pages;
+    uint32_t empty_leaves;     // emptied by deletes, still linked
+    uint32_t min_leaf_entries;
+    uint32_t max_leaf_entries;
+    uint32_t leaf_jumps;       // leaf links to any page but the next one in the file
+    uint64_t entries;
+    uint64_t distinct_keys;
+    uint64_t max_duplicates;   // entries sharing the most common key
+    uint64_t leaf_bytes;
+    uint64_t internal_bytes;
+    uint64_t key_bytes;        // stored key bytes in leaves, after compression
+} BTreeStats;
+
+// btree_insert and btree_build_add take a whole entry (key followed by the
+// included values); search and delete only look at the key.
+BTreeIndex* btree_create_index(StorageManager* sm, TableSchema* schema, const char* index_name);
+bool btree_insert(StorageManager* sm, BTreeIndex* index, const uint8_t* key, RID rid);
+bool btree_search(StorageManager* sm, BTreeIndex* index, const uint8_t* key, RID* rid);
+bool btree_delete(StorageManager* sm, BTreeIndex* index, const uint8_t* key, const RID* rid);
 void btree_free_index(BTreeIndex* index);
 
-#endif // BTREE_H
\ No newline at end of file
+// Key encoding
+uint32_t btree_key_width(ColumnDef* column);
+uint32_t btree_encode_value(ColumnDef* column, const void* value, uint8_t* out);
+uint32_t btree_decode_value(ColumnDef* column, const uint8_t* in, void* value);
+
+// Cursor API. btree_seek positions before the first entry whose first
+// key_len bytes are >= key (NULL key: before the very first entry).
+// btree_next and btree_prev copy out the whole entry.
+BTreeCursor* btree_seek(StorageManager* sm, BTreeIndex* index, const uint8_t* key, uint32_t key_len);
+BTreeCursor* btree_seek_last(StorageManager* sm, BTreeIndex* index);
+bool btree_next(BTreeCursor* cursor, uint8_t* key, RID* rid);
+bool btree_prev(BTreeCursor* cursor, uint8_t* key, RID* rid);
+void btree_close(BTreeCursor* cursor);
+
+// Bulk build. Sort records are an entry followed by the RID;
+// btree_entry_compare orders them (pass the index as context).
+BTreeBuilder* btree_build_begin(StorageManager* sm, BTreeIndex* index, uint32_t fill_factor);
+bool btree_build_add(BTreeBuilder* builder, const uint8_t* key, RID rid);
+bool btree_build_finish(BTreeBuilder* builder); // frees the builder
+int btree_entry_compare(const void* a, const void* b, void* index);
+
+// Maintenance. btree_rebuild repacks the entries into a fresh tree at the
+// index fill factor and switches the index (and its catalog entry) to it.
+bool btree_stats(StorageManager* sm, BTreeIndex* index, BTreeStats* stats);
+bool btree_rebuild(StorageManager* sm, BTreeIndex* index);
+
+// Index catalog
+bool index_catalog_save(StorageManager* sm, IndexDef* def);
+bool index_catalog_load(StorageManager* sm, const char* index_name, IndexDef* def);
+bool index_catalog_delete(StorageManager* sm, const char* index_name);
+uint32_t index_catalog_list(StorageManager* sm, const char* table_name, IndexDef* defs, uint32_t max_defs);
+
+#endif // BTREE_H
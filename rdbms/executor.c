@@ -1,5 +1,15 @@
 #include "executor.h"
 #include "btree.h"
+#include "hashindex.h"
+#include "bitmapindex.h"
+#include "bloom.h"
+#include "zonemap.h"
+#include "extsort.h"
+#include "spill.h"
+#include "vectorfilter.h"
+#include "stats.h"
+#include "math.h"
+#include "stdarg.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
@@ -15,739 +25,5066 @@ static uint32_t get_column_size(ColumnDef* column) {
     }
 }
 
-static uint32_t get_column_offset(TableSchema* schema, uint32_t column_index) {
-    uint32_t offset = sizeof(bool) + sizeof(uint32_t) + sizeof(uint32_t);
+// Deleted flag, row id and next-row link in front of the column values
+#define ROW_HEADER_SIZE (sizeof(bool) + 2 * sizeof(uint32_t))
+
+void compute_column_layout(TableSchema* schema) {
+    uint32_t offset = ROW_HEADER_SIZE;
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        schema->column_offsets[i] = offset;
+        schema->column_sizes[i] = get_column_size(&schema->columns[i]);
+        offset += schema->column_sizes[i];
+    }
+    schema->row_size = offset;
+}
+
+// Rows never straddle the page trailer (zone map locator and next-page link)
+static uint32_t rows_per_page(TableSchema* schema) {
+    return (PAGE_SIZE - HEAP_TRAILER_SIZE) / schema->row_size;
+}
+
+// A slot that has never held a row starts with an all-zero header
+static bool slot_is_empty(Page* page, uint32_t row_offset) {
+    for (uint32_t i = 0; i < 8 && row_offset + i < PAGE_SIZE; i++) {
+        if (page->data[row_offset + i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every index defined on a table, grouped by access method
+typedef struct {
+    BTreeIndex* btrees[MAX_TABLE_INDEXES];
+    uint32_t btree_count;
+    HashIndex* hashes[MAX_TABLE_INDEXES];
+    uint32_t hash_count;
+    BitmapIndex* bitmaps[MAX_TABLE_INDEXES];
+    uint32_t bitmap_count;
+} TableIndexes;
+
+static void open_table_indexes(StorageManager* sm, TableSchema* schema, TableIndexes* indexes) {
+    IndexDef defs[MAX_TABLE_INDEXES];
+    uint32_t def_count = index_catalog_list(sm, schema->name, defs, MAX_TABLE_INDEXES);
+
+    indexes->btree_count = indexes->hash_count = indexes->bitmap_count = 0;
+    for (uint32_t i = 0; i < def_count; i++) {
+        if (defs[i].method == INDEX_HASH) {
+            HashIndex* index = hash_open_index(sm, schema, defs[i].name);
+            if (index) indexes->hashes[indexes->hash_count++] = index;
+        } else if (defs[i].method == INDEX_BITMAP) {
+            BitmapIndex* index = bitmap_open_index(sm, schema, defs[i].name);
+            if (index) indexes->bitmaps[indexes->bitmap_count++] = index;
+        } else {
+            BTreeIndex* index = btree_create_index(sm, schema, defs[i].name);
+            if (index) indexes->btrees[indexes->btree_count++] = index;
+        }
+    }
+}
+
+static void close_table_indexes(TableIndexes* indexes) {
+    for (uint32_t i = 0; i < indexes->btree_count; i++) {
+        btree_free_index(indexes->btrees[i]);
+    }
+    for (uint32_t i = 0; i < indexes->hash_count; i++) {
+        hash_free_index(indexes->hashes[i]);
+    }
+    for (uint32_t i = 0; i < indexes->bitmap_count; i++) {
+        bitmap_free_index(indexes->bitmaps[i]);
+    }
+}
+
+static int find_column(TableSchema* schema, const char* column_name) {
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        if (strcmp(schema->columns[i].name, column_name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Encodes the given columns of a row back to back; returns the bytes written
+static uint32_t encode_columns(TableSchema* schema, const uint32_t* columns, uint32_t count,
+                               uint8_t* row, uint8_t* out) {
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t col = columns[i];
+        written += btree_encode_value(&schema->columns[col], row + schema->column_offsets[col], out + written);
+    }
+    return written;
+}
+
+// Encodes the index entry of a row into `out`: the key followed by the
+// included columns (index->key_size + index->payload_size bytes)
+static void index_entry(TableSchema* schema, BTreeIndex* index, uint8_t* row, uint8_t* out) {
+    uint32_t key_size = encode_columns(schema, index->key_columns, index->key_column_count, row, out);
+    encode_columns(schema, index->include_columns, index->include_column_count, row, out + key_size);
+}
+
+static void hash_index_key(TableSchema* schema, HashIndex* index, uint8_t* row, uint8_t* out) {
+    encode_columns(schema, index->key_columns, index->key_column_count, row, out);
+}
+
+static void bitmap_index_key(TableSchema* schema, BitmapIndex* index, uint8_t* row, uint8_t* out) {
+    encode_columns(schema, &index->column, 1, row, out);
+}
+
+// Bitmap indexes address a row by its heap page id times the rows per
+// page, plus its slot
+static uint32_t row_position(TableSchema* schema, RID rid) {
+    return rid.page_id * rows_per_page(schema) + rid.slot;
+}
+
+static RID position_rid(TableSchema* schema, uint32_t position) {
+    RID rid = { position / rows_per_page(schema), position % rows_per_page(schema) };
+    return rid;
+}
+
+// Returns true when every column flagged in `needed` is stored in the index
+static bool index_covers(TableSchema* schema, BTreeIndex* index, const bool* needed) {
+    for (uint32_t col = 0; col < schema->column_count; col++) {
+        if (!needed[col]) continue;
+
+        bool found = false;
+        for (uint32_t i = 0; i < index->key_column_count && !found; i++) {
+            found = index->key_columns[i] == col;
+        }
+        for (uint32_t i = 0; i < index->include_column_count && !found; i++) {
+            found = index->include_columns[i] == col;
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+// Rebuilds the indexed columns of a row from an index entry. Columns the
+// index does not store are left zeroed.
+static void entry_to_row(TableSchema* schema, BTreeIndex* index, const uint8_t* entry, uint8_t* row) {
+    memset(row, 0, schema->row_size);
+    for (uint32_t i = 0; i < index->key_column_count; i++) {
+        uint32_t col = index->key_columns[i];
+        entry += btree_decode_value(&schema->columns[col], entry, row + schema->column_offsets[col]);
+    }
+    for (uint32_t i = 0; i < index->include_column_count; i++) {
+        uint32_t col = index->include_columns[i];
+        entry += btree_decode_value(&schema->columns[col], entry, row + schema->column_offsets[col]);
+    }
+}
+
+// SQL LIKE: '%' matches any run of characters, '_' any single one. The
+// text is at most `len` bytes and may not be NUL terminated.
+static bool like_match(const char* text, size_t len, const char* pattern) {
+    if (*pattern == '\0') return len == 0 || *text == '\0';
+
+    if (*pattern == '%') {
+        for (size_t i = 0;; i++) {
+            if (like_match(text + i, len - i, pattern + 1)) return true;
+            if (i == len || text[i] == '\0') return false;
+        }
+    }
+
+    if (len == 0 || *text == '\0') return false;
+    if (*pattern != '_' && *pattern != *text) return false;
+    return like_match(text + 1, len - 1, pattern + 1);
+}
+
+static int compare_doubles(double a, double b) {
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+// How batch_filter evaluates a condition on a whole column vector: an INT
+// or BOOL column against an integer, or a FLOAT column against a float.
+// BOOL values compare as 0 and 1, and an INT literal on a FLOAT column is
+// only taken when the float holds it exactly. Other conditions go row by
+// row.
+typedef enum {
+    KERNEL_NONE,
+    KERNEL_INT,
+    KERNEL_BOOL,
+    KERNEL_FLOAT
+} KernelType;
+
+// A WHERE condition compiled against its column once per query: where the
+// value sits in the row, a comparison specialised for the column and
+// literal types, and which comparison outcomes satisfy the operator. Rows
+// are then matched without name lookups or type dispatch. Comparisons
+// between incompatible types never match.
+typedef struct CompiledCondition CompiledCondition;
+struct CompiledCondition {
+    bool (*match)(const CompiledCondition* cond, const uint8_t* value);
+    uint32_t offset;
+    uint32_t length;   // of the column, for strings
+    bool accept[3];    // by comparison result + 1: below, equal, above the literal
+    OperatorType op;
+    KernelType kernel;
+    int32_t int_literal;
+    float float_literal;
+    double number;     // literal of a comparison made in doubles
+    const char* text;  // string literal or LIKE pattern
+    size_t text_length;
+};
+
+static bool match_never(const CompiledCondition* cond, const uint8_t* value) {
+    (void)cond;
+    (void)value;
+    return false;
+}
+
+static bool match_int(const CompiledCondition* cond, const uint8_t* value) {
+    int32_t v;
+    memcpy(&v, value, sizeof(int32_t));
+    return cond->accept[(v > cond->int_literal) - (v < cond->int_literal) + 1];
+}
+
+static bool match_int_number(const CompiledCondition* cond, const uint8_t* value) {
+    int32_t v;
+    memcpy(&v, value, sizeof(int32_t));
+    return cond->accept[compare_doubles(v, cond->number) + 1];
+}
+
+static bool match_float(const CompiledCondition* cond, const uint8_t* value) {
+    float v;
+    memcpy(&v, value, sizeof(float));
+    return cond->accept[compare_doubles(v, cond->number) + 1];
+}
+
+static bool match_bool(const CompiledCondition* cond, const uint8_t* value) {
+    int32_t v = *(const bool*)value ? 1 : 0;
+    return cond->accept[(v > cond->int_literal) - (v < cond->int_literal) + 1];
+}
+
+// Orders like strcmp of the NUL terminated value; stored strings are zero
+// padded to the column length rather than terminated
+static bool match_string(const CompiledCondition* cond, const uint8_t* value) {
+    size_t len = strnlen((const char*)value, cond->length);
+    int cmp = memcmp(value, cond->text, len < cond->text_length ? len : cond->text_length);
+    if (cmp == 0) cmp = (len > cond->text_length) - (len < cond->text_length);
+    return cond->accept[(cmp > 0) - (cmp < 0) + 1];
+}
+
+static bool match_like(const CompiledCondition* cond, const uint8_t* value) {
+    return like_match((const char*)value, cond->length, cond->text);
+}
+
+static void compile_condition(TableSchema* schema, int column_index, WhereClause* cond,
+                              CompiledCondition* out) {
+    ColumnDef* column = &schema->columns[column_index];
+    memset(out, 0, sizeof(CompiledCondition));
+    out->offset = schema->column_offsets[column_index];
+    out->length = column->length;
+    out->op = cond->op;
+    out->match = match_never;
+    out->kernel = KERNEL_NONE;
+
+    switch (cond->op) {
+        case OP_EQUALS: out->accept[1] = true; break;
+        case OP_NOT_EQUALS: out->accept[0] = out->accept[2] = true; break;
+        case OP_LESS: out->accept[0] = true; break;
+        case OP_GREATER: out->accept[2] = true; break;
+        case OP_LESS_EQUAL: out->accept[0] = out->accept[1] = true; break;
+        case OP_GREATER_EQUAL: out->accept[1] = out->accept[2] = true; break;
+        case OP_LIKE:
+            if (column->type == DT_STRING && cond->value_type == DT_STRING) {
+                out->text = (const char*)cond->value;
+                out->match = match_like;
+            }
+            return;
+    }
+
+    switch (column->type) {
+        case DT_INT:
+            if (cond->value_type == DT_INT) {
+                out->int_literal = *(int*)cond->value;
+                out->match = match_int;
+                out->kernel = KERNEL_INT;
+            } else if (cond->value_type == DT_FLOAT) {
+                out->number = *(float*)cond->value;
+                out->match = match_int_number;
+            }
+            break;
+        case DT_FLOAT:
+            if (cond->value_type == DT_FLOAT) {
+                out->float_literal = *(float*)cond->value;
+                out->number = out->float_literal;
+                out->match = match_float;
+                out->kernel = KERNEL_FLOAT;
+            } else if (cond->value_type == DT_INT) {
+                int literal = *(int*)cond->value;
+                out->number = literal;
+                out->match = match_float;
+                if (literal >= -(1 << 24) && literal <= (1 << 24)) {
+                    out->float_literal = (float)literal;
+                    out->kernel = KERNEL_FLOAT;
+                }
+            }
+            break;
+        case DT_STRING:
+            if (cond->value_type == DT_STRING) {
+                out->text = (const char*)cond->value;
+                out->text_length = strlen(out->text);
+                out->match = match_string;
+            }
+            break;
+        case DT_BOOL:
+            if (cond->value_type == DT_BOOL || cond->value_type == DT_INT) {
+                if (cond->value_type == DT_BOOL) out->int_literal = *(bool*)cond->value ? 1 : 0;
+                else out->int_literal = *(int*)cond->value;
+                out->match = match_bool;
+                out->kernel = KERNEL_BOOL;
+            }
+            break;
+    }
+}
+
+// WHERE conditions resolved against a table's columns
+typedef struct {
+    WhereClause* conditions;
+    int columns[MAX_WHERE_CONDITIONS];
+    CompiledCondition compiled[MAX_WHERE_CONDITIONS];
+    uint32_t count;
+} RowFilter;
+
+// Compiles the conditions once their columns are resolved
+static void compile_filter(TableSchema* schema, RowFilter* filter) {
+    for (uint32_t i = 0; i < filter->count; i++) {
+        compile_condition(schema, filter->columns[i], &filter->conditions[i], &filter->compiled[i]);
+    }
+}
+
+// Resolves and compiles the WHERE conditions. Returns an error message, or NULL.
+static char* bind_filter(TableSchema* schema, SQLStatement* stmt, RowFilter* filter) {
+    filter->conditions = stmt->where_conditions;
+    filter->count = stmt->where_condition_count;
+
+    for (uint32_t i = 0; i < filter->count; i++) {
+        filter->columns[i] = find_column(schema, stmt->where_conditions[i].column);
+        if (filter->columns[i] < 0) {
+            char* msg = SAFE_MALLOC(char, 100);
+            snprintf(msg, 100, "Column '%s' not found", stmt->where_conditions[i].column);
+            return msg;
+        }
+    }
+    compile_filter(schema, filter);
+    return NULL;
+}
+
+// Evaluates the AND of the WHERE conditions against a row
+static bool row_matches(RowFilter* filter, const uint8_t* row) {
+    for (uint32_t i = 0; i < filter->count; i++) {
+        CompiledCondition* cond = &filter->compiled[i];
+        if (!cond->match(cond, row + cond->offset)) return false;
+    }
+    return true;
+}
+
+// Encodes a WHERE literal as a key column value. Fails when the literal
+// cannot be represented exactly in the column's key encoding.
+static bool encode_literal(ColumnDef* column, WhereClause* cond, uint8_t* out) {
+    switch (column->type) {
+        case DT_INT:
+            if (cond->value_type != DT_INT) return false;
+            btree_encode_value(column, cond->value, out);
+            return true;
+        case DT_FLOAT: {
+            float value;
+            if (cond->value_type == DT_INT) value = (float)*(int*)cond->value;
+            else if (cond->value_type == DT_FLOAT) value = *(float*)cond->value;
+            else return false;
+            btree_encode_value(column, &value, out);
+            return true;
+        }
+        case DT_STRING:
+            if (cond->value_type != DT_STRING) return false;
+            if (strlen((char*)cond->value) > column->length) return false;
+            btree_encode_value(column, cond->value, out);
+            return true;
+        case DT_BOOL:
+            if (cond->value_type != DT_BOOL) return false;
+            btree_encode_value(column, cond->value, out);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Encodes every column of a row into its zone map value
+static void zone_row_values(TableSchema* schema, uint8_t* row, uint8_t* out) {
+    uint8_t encoded[BTREE_MAX_KEY_SIZE];
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        uint32_t width = btree_encode_value(&schema->columns[i], row + schema->column_offsets[i], encoded);
+        memset(out + i * ZONE_VALUE_SIZE, 0, ZONE_VALUE_SIZE);
+        memcpy(out + i * ZONE_VALUE_SIZE, encoded, width < ZONE_VALUE_SIZE ? width : ZONE_VALUE_SIZE);
+    }
+}
+
+// Turns the equality and range conditions of the WHERE clause into zone
+// map bounds. Bounds are inclusive: with truncated values a strict
+// comparison cannot rule out a page whose bound equals the literal.
+static void zone_bounds(TableSchema* schema, RowFilter* filter, ZoneBounds* bounds) {
+    memset(bounds, 0, sizeof(ZoneBounds));
+
+    for (uint32_t i = 0; i < filter->count; i++) {
+        WhereClause* cond = &filter->conditions[i];
+        uint32_t col = (uint32_t)filter->columns[i];
+        bool lower = cond->op == OP_EQUALS || cond->op == OP_GREATER || cond->op == OP_GREATER_EQUAL;
+        bool upper = cond->op == OP_EQUALS || cond->op == OP_LESS || cond->op == OP_LESS_EQUAL;
+        if (!lower && !upper) continue;
+
+        uint8_t encoded[BTREE_MAX_KEY_SIZE];
+        if (!encode_literal(&schema->columns[col], cond, encoded)) continue;
+
+        uint8_t value[ZONE_VALUE_SIZE] = { 0 };
+        uint32_t width = btree_key_width(&schema->columns[col]);
+        memcpy(value, encoded, width < ZONE_VALUE_SIZE ? width : ZONE_VALUE_SIZE);
+
+        // Keep the tightest bound when a column is constrained twice
+        if (lower && (!bounds->has_low[col] || memcmp(value, bounds->low[col], ZONE_VALUE_SIZE) > 0)) {
+            memcpy(bounds->low[col], value, ZONE_VALUE_SIZE);
+            bounds->has_low[col] = true;
+        }
+        if (upper && (!bounds->has_high[col] || memcmp(value, bounds->high[col], ZONE_VALUE_SIZE) < 0)) {
+            memcpy(bounds->high[col], value, ZONE_VALUE_SIZE);
+            bounds->has_high[col] = true;
+        }
+    }
+}
+
+// Estimated share of the rows satisfying the conditions of the filter
+// flagged in `mask` (bit i: condition i), taking them as independent.
+// Without statistics (stats NULL) every condition gets a fixed guess.
+static double filter_selectivity(TableSchema* schema, const TableStats* stats, RowFilter* filter, uint32_t mask) {
+    double selectivity = 1.0;
+    for (uint32_t i = 0; i < filter->count; i++) {
+        if (!(mask & (1u << i))) continue;
+
+        uint32_t col = (uint32_t)filter->columns[i];
+        uint8_t encoded[BTREE_MAX_KEY_SIZE];
+        uint8_t value[STATS_VALUE_SIZE] = { 0 };
+        bool known = encode_literal(&schema->columns[col], &filter->conditions[i], encoded);
+        if (known) {
+            uint32_t width = btree_key_width(&schema->columns[col]);
+            memcpy(value, encoded, width < STATS_VALUE_SIZE ? width : STATS_VALUE_SIZE);
+        }
+        selectivity *= stats_selectivity(stats, col, filter->conditions[i].op, known ? value : NULL);
+    }
+    return selectivity;
+}
+
+// Recomputes a heap page's zone map entry from its live rows
+static void refresh_zone(StorageManager* sm, TableSchema* schema, uint32_t page_id) {
+    Page* page = sm_get_page(sm, page_id);
+    if (!page) return;
+
+    ZoneSummary summary;
+    uint8_t values[MAX_COLUMNS * ZONE_VALUE_SIZE];
+    uint32_t slots = rows_per_page(schema);
+
+    summary.row_count = 0;
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        uint32_t row_offset = slot * schema->row_size;
+        if (slot_is_empty(page, row_offset) || *(bool*)(page->data + row_offset)) continue;
+
+        zone_row_values(schema, page->data + row_offset, values);
+        zone_summary_add(&summary, schema->column_count, values);
+    }
+    zone_map_store(sm, schema, page_id, &summary);
+}
+
+// An index range answering (part of) the WHERE clause: equality
+// conditions on a prefix of the key columns, optionally followed by a
+// range on the next key column. A hash index scan is an equality on every
+// key column (eq_len is the whole key).
+typedef struct {
+    BTreeIndex* index; // exactly one of index and hash is set
+    HashIndex* hash;
+    BTreeCursor* cursor;
+    HashCursor* hash_cursor;
+    uint8_t low[BTREE_MAX_KEY_SIZE];  // equality prefix + lower bound
+    uint8_t high[BTREE_MAX_KEY_SIZE]; // equality prefix + upper bound
+    uint32_t eq_len;   // key bytes fixed by equality conditions
+    uint32_t low_len;  // > eq_len when there is a lower bound
+    uint32_t high_len; // > eq_len when there is an upper bound
+    bool low_inclusive;
+    bool high_inclusive;
+    bool descending; // B+tree only: walk the range from its upper end
+} IndexScan;
+
+// Matches the WHERE conditions against the index's key columns. Returns
+// the number of equality columns times two, plus one for a range; 0 when
+// the index cannot help.
+static uint32_t plan_index_scan(TableSchema* schema, BTreeIndex* index, RowFilter* filter, IndexScan* scan) {
+    uint32_t eq_columns = 0;
+    bool has_range = false;
+
+    memset(scan, 0, sizeof(IndexScan));
+    scan->index = index;
+
+    for (uint32_t k = 0; k < index->key_column_count && !has_range; k++) {
+        uint32_t col = index->key_columns[k];
+        ColumnDef* column = &schema->columns[col];
+        uint32_t width = btree_key_width(column);
+        bool found_eq = false;
+
+        for (uint32_t i = 0; i < filter->count && !found_eq; i++) {
+            if (filter->columns[i] != (int)col || filter->conditions[i].op != OP_EQUALS) continue;
+            if (encode_literal(column, &filter->conditions[i], scan->low + scan->eq_len)) {
+                memcpy(scan->high + scan->eq_len, scan->low + scan->eq_len, width);
+                found_eq = true;
+            }
+        }
+        if (found_eq) {
+            scan->eq_len += width;
+            eq_columns++;
+            continue;
+        }
+
+        // No equality on this column: take one lower and one upper bound
+        for (uint32_t i = 0; i < filter->count; i++) {
+            WhereClause* cond = &filter->conditions[i];
+            if (filter->columns[i] != (int)col) continue;
+
+            bool lower = cond->op == OP_GREATER || cond->op == OP_GREATER_EQUAL;
+            bool upper = cond->op == OP_LESS || cond->op == OP_LESS_EQUAL;
+            if (lower && scan->low_len == 0 && encode_literal(column, cond, scan->low + scan->eq_len)) {
+                scan->low_len = scan->eq_len + width;
+                scan->low_inclusive = cond->op == OP_GREATER_EQUAL;
+                has_range = true;
+            } else if (upper && scan->high_len == 0 &&
+                       encode_literal(column, cond, scan->high + scan->eq_len)) {
+                scan->high_len = scan->eq_len + width;
+                scan->high_inclusive = cond->op == OP_LESS_EQUAL;
+                has_range = true;
+            }
+        }
+        break;
+    }
+
+    return eq_columns * 2 + (has_range ? 1 : 0);
+}
+
+// A hash index only helps when every key column has an equality
+// condition. Scored like plan_index_scan.
+static uint32_t plan_hash_scan(TableSchema* schema, HashIndex* hash, RowFilter* filter, IndexScan* scan) {
+    memset(scan, 0, sizeof(IndexScan));
+    scan->hash = hash;
+
+    for (uint32_t k = 0; k < hash->key_column_count; k++) {
+        uint32_t col = hash->key_columns[k];
+        ColumnDef* column = &schema->columns[col];
+        bool found_eq = false;
+
+        for (uint32_t i = 0; i < filter->count && !found_eq; i++) {
+            if (filter->columns[i] != (int)col || filter->conditions[i].op != OP_EQUALS) continue;
+            found_eq = encode_literal(column, &filter->conditions[i], scan->low + scan->eq_len);
+        }
+        if (!found_eq) return 0;
+        scan->eq_len += btree_key_width(column);
+    }
+
+    return hash->key_column_count * 2;
+}
+
+// Flags the conditions of the filter (bit i: condition i) that an index
+// scan planned by plan_index_scan or plan_hash_scan answers with its key
+// range
+static uint32_t scan_conditions(TableSchema* schema, const IndexScan* scan, RowFilter* filter) {
+    const uint32_t* key_columns = scan->index ? scan->index->key_columns : scan->hash->key_columns;
+    uint32_t key_count = scan->index ? scan->index->key_column_count : scan->hash->key_column_count;
+    bool has_range = scan->low_len > scan->eq_len || scan->high_len > scan->eq_len;
+    uint32_t mask = 0;
+    uint32_t offset = 0;
+
+    for (uint32_t k = 0; k < key_count; k++) {
+        uint32_t col = key_columns[k];
+        bool equality = offset < scan->eq_len;
+        if (!equality && !has_range) break;
+
+        for (uint32_t i = 0; i < filter->count; i++) {
+            OperatorType op = filter->conditions[i].op;
+            if (filter->columns[i] != (int)col) continue;
+            if (equality ? op == OP_EQUALS : (op == OP_GREATER || op == OP_GREATER_EQUAL ||
+                                              op == OP_LESS || op == OP_LESS_EQUAL)) {
+                mask |= 1u << i;
+            }
+        }
+        if (!equality) break;
+        offset += btree_key_width(&schema->columns[col]);
+    }
+    return mask;
+}
+
+// Picks the index that pins down the most leading key columns. Between
+// equally selective indexes, a B+tree that stores every `needed` column
+// wins (it never reads the heap), then a hash index (a fixed number of
+// page reads), then any B+tree. Pass needed = NULL when the rows are
+// fetched from the heap anyway.
+static bool choose_index(TableSchema* schema, TableIndexes* indexes, RowFilter* filter,
+                         const bool* needed, IndexScan* scan) {
+    uint32_t best_score = 0;
+    IndexScan candidate;
+
+    for (uint32_t i = 0; i < indexes->btree_count; i++) {
+        BTreeIndex* index = indexes->btrees[i];
+        uint32_t score = plan_index_scan(schema, index, filter, &candidate) * 4;
+        if (score > 0 && needed && index_covers(schema, index, needed)) score += 2;
+        if (score > best_score) {
+            best_score = score;
+            *scan = candidate;
+        }
+    }
+
+    for (uint32_t i = 0; i < indexes->hash_count; i++) {
+        uint32_t score = plan_hash_scan(schema, indexes->hashes[i], filter, &candidate) * 4;
+        if (score > 0) score += 1;
+        if (score > best_score) {
+            best_score = score;
+            *scan = candidate;
+        }
+    }
+    return best_score > 0;
+}
+
+static void append_rid(RID** rids, uint32_t* count, uint32_t* capacity, RID rid) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 16;
+        *rids = SAFE_REALLOC(*rids, RID, *capacity);
+    }
+    (*rids)[(*count)++] = rid;
+}
+
+// Bloom filter of a unique B+tree index; NULL when the index has none
+static BloomFilter* index_bloom(StorageManager* sm, BTreeIndex* index) {
+    return index->bloom_page ? bloom_open(sm, index->bloom_page) : NULL;
+}
+
+// Gives the index a new Bloom filter with room for twice key_count keys,
+// filled from the index entries. The pages of a replaced filter are not
+// reclaimed.
+static void rebuild_bloom(StorageManager* sm, BTreeIndex* index, uint32_t key_count) {
+    uint32_t meta_page = bloom_create(sm, key_count * 2);
+    BloomFilter* filter = bloom_open(sm, meta_page);
+    if (!filter) return;
+
+    BTreeCursor* cursor = btree_seek(sm, index, NULL, 0);
+    uint8_t entry[BTREE_MAX_KEY_SIZE];
+    RID rid;
+    while (btree_next(cursor, entry, &rid)) {
+        bloom_add(sm, filter, entry, index->key_size);
+    }
+    btree_close(cursor);
+
+    IndexDef def;
+    if (index_catalog_load(sm, index->name, &def)) {
+        def.bloom_page = meta_page;
+        index_catalog_save(sm, &def);
+    }
+    index->bloom_page = meta_page;
+}
+
+static void index_scan_open(StorageManager* sm, IndexScan* scan) {
+    if (scan->hash) {
+        scan->hash_cursor = hash_seek(sm, scan->hash, scan->low);
+        return;
+    }
+
+    // A whole-key equality the Bloom filter rules out matches nothing
+    if (scan->eq_len == scan->index->key_size &&
+        !bloom_may_contain(index_bloom(sm, scan->index), scan->low, scan->eq_len)) {
+        scan->cursor = NULL;
+        return;
+    }
+
+    if (scan->descending) {
+        // Start past the upper end: seek to the upper bound (or the
+        // equality prefix) and step over the entries equal to it
+        uint32_t upper_len = scan->high_len > scan->eq_len ? scan->high_len : scan->eq_len;
+        if (upper_len == 0) {
+            scan->cursor = btree_seek_last(sm, scan->index);
+            return;
+        }
+        scan->cursor = btree_seek(sm, scan->index, scan->high, upper_len);
+        uint8_t entry[BTREE_MAX_KEY_SIZE];
+        while (btree_next(scan->cursor, entry, NULL) && memcmp(entry, scan->high, upper_len) == 0) {
+        }
+        return;
+    }
+
+    uint32_t seek_len = scan->low_len > scan->eq_len ? scan->low_len : scan->eq_len;
+    scan->cursor = btree_seek(sm, scan->index, scan->low, seek_len);
+}
+
+// Returns the next index entry inside the scan's range. Hash scans only
+// return the key.
+static bool index_scan_next(IndexScan* scan, uint8_t* entry, RID* rid) {
+    if (scan->hash) {
+        if (!hash_next(scan->hash_cursor, rid)) return false;
+        memcpy(entry, scan->low, scan->eq_len);
+        return true;
+    }
+
+    if (scan->descending) {
+        while (btree_prev(scan->cursor, entry, rid)) {
+            // The cursor starts just past the range, so a few entries
+            // above it may come first
+            int cmp = memcmp(entry, scan->low, scan->eq_len);
+            if (cmp < 0) return false;
+            if (cmp > 0) continue;
+            if (scan->high_len > scan->eq_len) {
+                cmp = memcmp(entry, scan->high, scan->high_len);
+                if (cmp > 0 || (cmp == 0 && !scan->high_inclusive)) continue;
+            }
+            if (scan->low_len > scan->eq_len) {
+                cmp = memcmp(entry, scan->low, scan->low_len);
+                if (cmp < 0 || (cmp == 0 && !scan->low_inclusive)) return false;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    while (btree_next(scan->cursor, entry, rid)) {
+        if (memcmp(entry, scan->low, scan->eq_len) != 0) return false;
+
+        if (scan->high_len > scan->eq_len) {
+            int cmp = memcmp(entry, scan->high, scan->high_len);
+            if (cmp > 0 || (cmp == 0 && !scan->high_inclusive)) return false;
+        }
+        if (scan->low_len > scan->eq_len && !scan->low_inclusive &&
+            memcmp(entry, scan->low, scan->low_len) == 0) {
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+static void index_scan_close(IndexScan* scan) {
+    btree_close(scan->cursor);
+    hash_close(scan->hash_cursor);
+    scan->cursor = NULL;
+    scan->hash_cursor = NULL;
+}
+
+// Collects the RIDs of live rows matching the WHERE clause by walking the
+// index range. Every row is rechecked against the full filter.
+static uint32_t index_matching_rids(StorageManager* sm, TableSchema* schema, IndexScan* scan,
+                                    RowFilter* filter, RID** out) {
+    uint32_t count = 0, capacity = 0;
+
+    *out = NULL;
+    index_scan_open(sm, scan);
+
+    uint8_t entry[BTREE_MAX_KEY_SIZE];
+    RID rid;
+    while (index_scan_next(scan, entry, &rid)) {
+        uint8_t* row = fetch_row(sm, schema, rid);
+        if (row && row_matches(filter, row)) {
+            append_rid(out, &count, &capacity, rid);
+        }
+    }
+
+    index_scan_close(scan);
+    return count;
+}
+
+// Collects the RIDs of live rows matching the WHERE clause by scanning the
+// heap pages the zone map cannot rule out
+static uint32_t scan_matching_rids(StorageManager* sm, TableSchema* schema, RowFilter* filter, RID** out) {
+    uint32_t count = 0, capacity = 0;
+    uint32_t slots = rows_per_page(schema);
+
+    ZoneBounds bounds;
+    ZoneScan zones;
+    zone_bounds(schema, filter, &bounds);
+    zone_scan_begin(&zones, sm, schema, &bounds);
+
+    *out = NULL;
+    uint32_t current_page;
+    while ((current_page = zone_scan_next(&zones)) != 0) {
+        Page* page = sm_get_page(sm, current_page);
+        if (!page) break;
+
+        for (uint32_t slot = 0; slot < slots; slot++) {
+            uint32_t row_offset = slot * schema->row_size;
+            if (slot_is_empty(page, row_offset) || *(bool*)(page->data + row_offset)) continue;
+
+            if (row_matches(filter, page->data + row_offset)) {
+                RID rid = { current_page, slot };
+                append_rid(out, &count, &capacity, rid);
+            }
+        }
+    }
+
+    return count;
+}
+
+static BitmapIndex* bitmap_index_on(TableIndexes* indexes, uint32_t column) {
+    for (uint32_t i = 0; i < indexes->bitmap_count; i++) {
+        if (indexes->bitmaps[i]->column == column) return indexes->bitmaps[i];
+    }
+    return NULL;
+}
+
+// Returns the bitmap index that can evaluate condition i of the filter,
+// with the condition's literal encoded into `key`; NULL when there is none
+static BitmapIndex* bitmap_condition(TableSchema* schema, TableIndexes* indexes, RowFilter* filter,
+                                     uint32_t i, uint8_t* key) {
+    WhereClause* cond = &filter->conditions[i];
+    BitmapIndex* index = bitmap_index_on(indexes, (uint32_t)filter->columns[i]);
+    if (!index || cond->op == OP_LIKE) return NULL;
+    if (!encode_literal(&schema->columns[index->column], cond, key)) return NULL;
+    return index;
+}
+
+static bool has_bitmap_condition(TableSchema* schema, TableIndexes* indexes, RowFilter* filter) {
+    uint8_t key[BTREE_MAX_KEY_SIZE];
+    for (uint32_t i = 0; i < filter->count; i++) {
+        if (bitmap_condition(schema, indexes, filter, i, key)) return true;
+    }
+    return false;
+}
+
+// Resolves the conditions on bitmap indexed columns before touching the
+// heap: = reads one value's bitmap, a range ORs the bitmaps of the values
+// inside it, != takes every row AND NOT the value's bitmap, and all of
+// them are ANDed. Writes the row positions that survive, which still have
+// to be checked against the whole filter. Returns false when no condition
+// has a bitmap index.
+static bool bitmap_candidates(StorageManager* sm, TableSchema* schema, TableIndexes* indexes,
+                              RowFilter* filter, uint32_t** positions, uint32_t* count) {
+    Bitmap* result = NULL;
+
+    for (uint32_t i = 0; i < filter->count; i++) {
+        uint8_t key[BTREE_MAX_KEY_SIZE];
+        BitmapIndex* index = bitmap_condition(schema, indexes, filter, i, key);
+        if (!index) continue;
+
+        Bitmap* rows;
+        switch (filter->conditions[i].op) {
+            case OP_EQUALS: rows = bitmap_range(sm, index, key, true, key, true); break;
+            case OP_LESS: rows = bitmap_range(sm, index, NULL, false, key, false); break;
+            case OP_LESS_EQUAL: rows = bitmap_range(sm, index, NULL, false, key, true); break;
+            case OP_GREATER: rows = bitmap_range(sm, index, key, false, NULL, false); break;
+            case OP_GREATER_EQUAL: rows = bitmap_range(sm, index, key, true, NULL, false); break;
+            case OP_NOT_EQUALS: {
+                Bitmap* all = bitmap_range(sm, index, NULL, false, NULL, false);
+                Bitmap* equal = bitmap_range(sm, index, key, true, key, true);
+                rows = bitmap_andnot(all, equal);
+                bitmap_free(all);
+                bitmap_free(equal);
+                break;
+            }
+            default: continue;
+        }
+
+        if (result) {
+            Bitmap* both = bitmap_and(result, rows);
+            bitmap_free(result);
+            bitmap_free(rows);
+            rows = both;
+        }
+        result = rows;
+    }
+    if (!result) return false;
+
+    *count = bitmap_positions(result, positions);
+    bitmap_free(result);
+    return true;
+}
+
+// Collects the RIDs of the live rows matching the filter through the
+// bitmap indexes. Returns false when no condition has a bitmap index.
+static bool bitmap_matching_rids(StorageManager* sm, TableSchema* schema, TableIndexes* indexes,
+                                 RowFilter* filter, RID** out, uint32_t* out_count) {
+    uint32_t* positions;
+    uint32_t position_count;
+    if (!bitmap_candidates(sm, schema, indexes, filter, &positions, &position_count)) return false;
+
+    uint32_t capacity = 0;
+    *out = NULL;
+    *out_count = 0;
+    for (uint32_t i = 0; i < position_count; i++) {
+        RID rid = position_rid(schema, positions[i]);
+        uint8_t* row = fetch_row(sm, schema, rid);
+        if (row && row_matches(filter, row)) {
+            append_rid(out, out_count, &capacity, rid);
+        }
+    }
+    SAFE_FREE(positions);
+    return true;
+}
+
+// Finds the matching rows through the indexes: an equality on a B+tree or
+// hash index first, then bitmap operations, then a B+tree range. Returns
+// false when only a table scan can answer the filter.
+static bool indexed_matching_rids(StorageManager* sm, TableSchema* schema, TableIndexes* indexes,
+                                  IndexScan* scan, bool use_index, RowFilter* filter,
+                                  RID** out, uint32_t* count) {
+    if (use_index && scan->eq_len > 0) {
+        *count = index_matching_rids(sm, schema, scan, filter, out);
+        return true;
+    }
+    if (bitmap_matching_rids(sm, schema, indexes, filter, out, count)) return true;
+    if (use_index) {
+        *count = index_matching_rids(sm, schema, scan, filter, out);
+        return true;
+    }
+    return false;
+}
+
+static uint32_t matching_rids(StorageManager* sm, TableSchema* schema, TableIndexes* indexes,
+                              RowFilter* filter, RID** out) {
+    IndexScan scan;
+    uint32_t count;
+    bool use_index = choose_index(schema, indexes, filter, NULL, &scan);
+    if (indexed_matching_rids(sm, schema, indexes, &scan, use_index, filter, out, &count)) {
+        return count;
+    }
+    return scan_matching_rids(sm, schema, filter, out);
+}
+
+// Returns true when a unique index already holds `key` for a live row
+// other than `self` (pass NULL when inserting)
+static bool unique_violation(StorageManager* sm, TableSchema* schema, BTreeIndex* index,
+                             const uint8_t* key, const RID* self) {
+    BTreeCursor* cursor = btree_seek(sm, index, key, index->key_size);
+    bool violation = false;
+
+    uint8_t found_key[BTREE_MAX_KEY_SIZE];
+    RID rid;
+    while (!violation && btree_next(cursor, found_key, &rid) &&
+           memcmp(found_key, key, index->key_size) == 0) {
+        if (self && rid.page_id == self->page_id && rid.slot == self->slot) continue;
+        violation = fetch_row(sm, schema, rid) != NULL;
+    }
+
+    btree_close(cursor);
+    return violation;
+}
+
+static bool hash_unique_violation(StorageManager* sm, TableSchema* schema, HashIndex* index,
+                                  const uint8_t* key, const RID* self) {
+    HashCursor* cursor = hash_seek(sm, index, key);
+    bool violation = false;
+
+    RID rid;
+    while (!violation && hash_next(cursor, &rid)) {
+        if (self && rid.page_id == self->page_id && rid.slot == self->slot) continue;
+        violation = fetch_row(sm, schema, rid) != NULL;
+    }
+
+    hash_close(cursor);
+    return violation;
+}
+
+// Formats the error for a duplicate key in a unique index
+static char* unique_violation_message(const char* index_name, bool is_primary) {
+    if (is_primary) {
+        return SAFE_STRDUP("Primary key violation - duplicate value");
+    }
+
+    char* msg = SAFE_MALLOC(char, 128);
+    snprintf(msg, 128, "Unique index '%s' violation - duplicate value", index_name);
+    return msg;
+}
+
+// Checks that writing `new_row` (replacing `old_row`, NULL when inserting)
+// keeps every unique index unique. Returns an error message, or NULL.
+static char* check_index_constraints(StorageManager* sm, TableSchema* schema, TableIndexes* indexes,
+                          uint8_t* old_row, uint8_t* new_row, const RID* self) {
+    uint8_t old_key[BTREE_MAX_KEY_SIZE];
+    uint8_t new_key[BTREE_MAX_KEY_SIZE];
+
+    for (uint32_t i = 0; i < indexes->btree_count; i++) {
+        BTreeIndex* index = indexes->btrees[i];
+        if (!index->is_unique) continue;
+
+        index_entry(schema, index, new_row, new_key);
+        if (old_row) {
+            index_entry(schema, index, old_row, old_key);
+            if (memcmp(old_key, new_key, index->key_size) == 0) continue;
+        }
+        if (!bloom_may_contain(index_bloom(sm, index), new_key, index->key_size)) continue;
+        if (unique_violation(sm, schema, index, new_key, self)) {
+            return unique_violation_message(index->name, index->is_primary);
+        }
+    }
+
+    for (uint32_t i = 0; i < indexes->hash_count; i++) {
+        HashIndex* index = indexes->hashes[i];
+        if (!index->is_unique) continue;
+
+        hash_index_key(schema, index, new_row, new_key);
+        if (old_row) {
+            hash_index_key(schema, index, old_row, old_key);
+            if (memcmp(old_key, new_key, index->key_size) == 0) continue;
+        }
+        if (hash_unique_violation(sm, schema, index, new_key, self)) {
+            return unique_violation_message(index->name, false);
+        }
+    }
+    return NULL;
+}
+
+// Brings every index up to date with a row change: old_row is NULL for an
+// insert, new_row is NULL for a delete. On update only the indexes whose
+// entry changed are touched.
+static void update_row_indexes(StorageManager* sm, TableSchema* schema, TableIndexes* indexes,
+                               uint8_t* old_row, uint8_t* new_row, RID rid) {
+    uint8_t old_key[BTREE_MAX_KEY_SIZE];
+    uint8_t new_key[BTREE_MAX_KEY_SIZE];
+
+    for (uint32_t i = 0; i < indexes->btree_count; i++) {
+        BTreeIndex* index = indexes->btrees[i];
+        if (old_row) index_entry(schema, index, old_row, old_key);
+        if (new_row) index_entry(schema, index, new_row, new_key);
+
+        if (old_row && new_row &&
+            memcmp(old_key, new_key, index->key_size + index->payload_size) == 0) {
+            continue;
+        }
+        if (old_row) btree_delete(sm, index, old_key, &rid);
+        if (!new_row) continue;
+        btree_insert(sm, index, new_key, rid);
+
+        // Deleted keys stay in the filter; it is rebuilt once it has seen
+        // more keys than it was sized for
+        BloomFilter* filter = index_bloom(sm, index);
+        if (filter) {
+            bloom_add(sm, filter, new_key, index->key_size);
+            if (bloom_is_full(filter)) rebuild_bloom(sm, index, filter->key_count);
+        }
+    }
+
+    for (uint32_t i = 0; i < indexes->hash_count; i++) {
+        HashIndex* index = indexes->hashes[i];
+        if (old_row) hash_index_key(schema, index, old_row, old_key);
+        if (new_row) hash_index_key(schema, index, new_row, new_key);
+
+        if (old_row && new_row && memcmp(old_key, new_key, index->key_size) == 0) continue;
+        if (old_row) hash_delete(sm, index, old_key, &rid);
+        if (new_row) hash_insert(sm, index, new_key, rid);
+    }
+
+    uint32_t position = row_position(schema, rid);
+    for (uint32_t i = 0; i < indexes->bitmap_count; i++) {
+        BitmapIndex* index = indexes->bitmaps[i];
+        if (old_row) bitmap_index_key(schema, index, old_row, old_key);
+        if (new_row) bitmap_index_key(schema, index, new_row, new_key);
+
+        if (old_row && new_row && memcmp(old_key, new_key, index->key_size) == 0) continue;
+        if (old_row) bitmap_delete(sm, index, old_key, position);
+        if (new_row) bitmap_insert(sm, index, new_key, position);
+    }
+}
+
+QueryResult* execute_create_table(StorageManager* sm, SQLStatement* stmt) {
+    QueryResult* result = SAFE_MALLOC(QueryResult, 1);
+    memset(result, 0, sizeof(QueryResult));
+    
+    // Calculate row size
+    compute_column_layout(&stmt->create_schema);
+    if (rows_per_page(&stmt->create_schema) == 0) {
+        result->error_message = SAFE_MALLOC(char, 128);
+        snprintf(result->error_message, 128, "Row size %u exceeds the %u bytes a page holds",
+                 stmt->create_schema.row_size, (uint32_t)(PAGE_SIZE - HEAP_TRAILER_SIZE));
+        return result;
+    }
+
+    TableSchema* schema = &stmt->create_schema;
+
+    // Re-creating a table would orphan its heap chain and reset its indexes
+    TableSchema* existing_table = load_schema(sm, schema->name);
+    if (existing_table) {
+        SAFE_FREE(existing_table);
+        result->error_message = SAFE_MALLOC(char, 128);
+        snprintf(result->error_message, 128, "Table '%s' already exists", schema->name);
+        return result;
+    }
+
+    // Every UNIQUE column is enforced by its own unique index, named like
+    // the primary key index
+    IndexDef unique_defs[MAX_TABLE_INDEXES];
+    uint32_t unique_count = 0;
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        if (!schema->columns[i].is_unique || i == schema->primary_key_index) continue;
+
+        if (unique_count + 1 >= MAX_TABLE_INDEXES) {
+            result->error_message = SAFE_STRDUP("Too many UNIQUE columns");
+            return result;
+        }
+
+        IndexDef* def = &unique_defs[unique_count++];
+        memset(def, 0, sizeof(IndexDef));
+        snprintf(def->name, MAX_INDEX_NAME, "%.30s_%.27s_key", schema->name, schema->columns[i].name);
+        strncpy(def->table_name, schema->name, MAX_TABLE_NAME - 1);
+        def->key_columns[0] = i;
+        def->key_column_count = 1;
+        def->is_unique = true;
+        def->is_constraint = true;
+        def->fill_factor = BTREE_DEFAULT_FILL_FACTOR;
+
+        IndexDef existing;
+        if (index_catalog_load(sm, def->name, &existing)) {
+            result->error_message = SAFE_MALLOC(char, 128);
+            snprintf(result->error_message, 128, "Index '%s' already exists", def->name);
+            return result;
+        }
+    }
+
+    // Every table gets its own heap page chain, summarised by a zone map
+    stmt->create_schema.first_page = sm_allocate_page(sm);
+    stmt->create_schema.insert_page = stmt->create_schema.first_page;
+    stmt->create_schema.zone_map_page = zone_map_create(sm, &stmt->create_schema,
+                                                        stmt->create_schema.first_page);
+
+    // Save the schema to disk
+    if (!save_schema(sm, &stmt->create_schema)) {
+        result->error_message = SAFE_STRDUP("Failed to save schema");
+        return result;
+    }
+
+    // Register the primary key index; its root is created on first insert
+    if (stmt->create_schema.primary_key_index < stmt->create_schema.column_count) {
+        IndexDef pk_def;
+        memset(&pk_def, 0, sizeof(IndexDef));
+        snprintf(pk_def.name, MAX_INDEX_NAME, "%.58s_pkey", stmt->create_schema.name);
+        strncpy(pk_def.table_name, stmt->create_schema.name, MAX_TABLE_NAME - 1);
+        pk_def.key_columns[0] = stmt->create_schema.primary_key_index;
+        pk_def.key_column_count = 1;
+        pk_def.is_primary = true;
+        pk_def.is_unique = true;
+        pk_def.bloom_page = bloom_create(sm, 0);
+
+        if (!index_catalog_save(sm, &pk_def)) {
+            result->error_message = SAFE_STRDUP("Failed to save primary key index");
+            return result;
+        }
+    }
+
+    // The table is empty, so the unique indexes start empty too
+    for (uint32_t i = 0; i < unique_count; i++) {
+        unique_defs[i].bloom_page = bloom_create(sm, 0);
+        if (!index_catalog_save(sm, &unique_defs[i])) {
+            result->error_message = SAFE_STRDUP("Failed to save unique index");
+            return result;
+        }
+    }
+
+    result->column_count = 1;
+    strcpy(result->column_names[0], "status");
+    
+    char* msg = SAFE_MALLOC(char, 256);
+    snprintf(msg, 100, "Table '%s' created successfully (Row size: %u bytes)", 
+             stmt->create_schema.name, stmt->create_schema.row_size);
+    result->success_message = msg;
+    result_add_row(result, (const char*[]){ msg });
+    
+    return result;
+}
+
+// SELECT runs as a tree of pull-based operators (the Volcano model): each
+// operator has open/next/close, and next() hands out one row per call,
+// pulling from its children as it needs input. Rows therefore flow from
+// the scans to the client one at a time and memory does not grow with the
+// result; sorts spill to temporary files (extsort.h) and aggregation works
+// on sorted input.
+//
+// Scans and filters also work a batch at a time (next_batch): up to
+// VECTOR_SIZE rows with a selection vector of those still qualifying, so
+// the per-row checks of a scan run as tight loops over the batch and WHERE
+// conditions on INT, FLOAT and BOOL columns as SIMD kernels
+// (vectorfilter.h). Operators that only produce rows are read into batches
+// by pull_batch, and batches are handed out as rows again at the top of
+// the vectorized part of the plan.
+
+// A row passed between operators, laid out like a heap row of the
+// producing operator's schema. `data` is only valid until the next call
+// into the plan, so an operator that holds on to a row copies it.
+typedef struct {
+    uint8_t* data;
+    uint32_t nulls; // bit i set: column i is NULL (outer join padding, empty aggregates)
+} Tuple;
+
+typedef struct {
+    StorageManager* sm;
+    char* error_message; // first error raised while running
+    size_t memory_budget; // what a sort or hash join may buffer before spilling
+} ExecContext;
+
+// Heap pages a batch may keep pinned, well below the cache size
+#define BATCH_MAX_PAGES 16
+
+// Rows exchanged a batch at a time. Rows stay in their heap layout and the
+// columns a filter reads are gathered into vectors as it runs; only the
+// positions in `selection` are still part of the result. The rows are valid
+// until the batch is refilled or reset.
+typedef struct {
+    uint32_t count;
+    uint8_t* rows[VECTOR_SIZE];
+    uint32_t nulls[VECTOR_SIZE];
+    uint16_t selection[VECTOR_SIZE]; // ascending
+    uint32_t selected;
+    Page* pages[BATCH_MAX_PAGES]; // pinned heap pages the rows point into
+    uint32_t page_count;
+    uint8_t* storage; // copies of rows read from a row-at-a-time operator
+    uint32_t storage_row_size;
+    uint32_t cursor; // next selected row to hand out as a tuple
+} Batch;
+
+typedef struct Operator Operator;
+struct Operator {
+    TableSchema* schema; // layout of the rows it returns, owned
+    ExecContext* ctx;
+    void (*open)(Operator* op);
+    bool (*next)(Operator* op, Tuple* out);
+    // Optional: fills `out` with the next rows, at least one selected.
+    // Operators without it are read through pull_batch.
+    bool (*next_batch)(Operator* op, Batch* out);
+    void (*close)(Operator* op);
+    void (*destroy)(Operator* op); // frees the operator and its children
+    // Adds the operator's EXPLAIN line, then its inputs' one level deeper
+    void (*explain)(Operator* op, QueryResult* plan, uint32_t depth);
+    // Planner estimates of the rows returned and the cost of returning all
+    // of them (see COST_*); negative when a table was never analyzed
+    double rows;
+    double cost;
+};
+
+struct QueryPlan {
+    ExecContext ctx;
+    Operator* root;
+    bool opened;
+    QueryResult* explain; // EXPLAIN: the plan's lines, served instead of rows
+    uint32_t explain_row;
+    char text[MAX_COLUMNS][MAX_STRING_LEN + 1]; // the current row, formatted
+};
+
+// Planner cost units: reading one page in sequence costs 1
+#define COST_RANDOM_PAGE 4.0   // reading a page out of order
+#define COST_ROW 0.01          // producing one row
+#define COST_INDEX_ENTRY 0.005 // reading one index entry
+#define COST_CONDITION 0.0025  // evaluating one condition or comparison
+
+#define EXPLAIN_LINE_SIZE 512
+
+static void fail(ExecContext* ctx, const char* message) {
+    if (!ctx->error_message) ctx->error_message = SAFE_STRDUP(message);
+}
+
+static void operator_free(Operator* op) {
+    if (op) op->destroy(op);
+}
+
+static bool has_estimates(const Operator* op) {
+    return op && op->rows >= 0;
+}
+
+// Adds a line to an EXPLAIN, indented by its depth in the plan and
+// followed by the estimates of `op` when there are any (none for NULL)
+static void explain_line(QueryResult* plan, uint32_t depth, const Operator* op, const char* format, ...) {
+    char line[EXPLAIN_LINE_SIZE];
+    size_t length = (size_t)snprintf(line, sizeof(line), "%*s%s", (int)(depth * 4), "", depth > 0 ? "-> " : "");
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(line + length, sizeof(line) - length, format, args);
+    va_end(args);
+    if (written > 0) length += (size_t)written;
+
+    if (length < sizeof(line) && has_estimates(op)) {
+        snprintf(line + length, sizeof(line) - length, "  (cost=%.1f rows=%.0f)", op->cost, op->rows);
+    }
+    result_add_row(plan, (const char*[]){ line });
+}
+
+// Renders WHERE conditions as "column op literal", joined by AND
+static void format_conditions(const WhereClause* conditions, uint32_t count, char* out, size_t size) {
+    size_t length = 0;
+    out[0] = '\0';
+    for (uint32_t i = 0; i < count && length < size; i++) {
+        const WhereClause* cond = &conditions[i];
+        char literal[MAX_STRING_LEN + 3];
+        if (!cond->value) {
+            strcpy(literal, "NULL");
+        } else if (cond->value_type == DT_INT) {
+            snprintf(literal, sizeof(literal), "%d", *(int*)cond->value);
+        } else if (cond->value_type == DT_FLOAT) {
+            snprintf(literal, sizeof(literal), "%g", *(float*)cond->value);
+        } else if (cond->value_type == DT_BOOL) {
+            strcpy(literal, *(bool*)cond->value ? "true" : "false");
+        } else {
+            snprintf(literal, sizeof(literal), "'%s'", (char*)cond->value);
+        }
+        length += (size_t)snprintf(out + length, size - length, "%s%s %s %s", i > 0 ? " AND " : "",
+                                   cond->column, operator_to_string(cond->op), literal);
+    }
+}
+
+static TableSchema* copy_schema(const TableSchema* schema) {
+    TableSchema* copy = SAFE_MALLOC(TableSchema, 1);
+    memcpy(copy, schema, sizeof(TableSchema));
+    return copy;
+}
+
+// Appends a column to the schema of an operator's output rows; the row
+// size has to be recomputed once all columns are in
+static void add_column(TableSchema* schema, const ColumnDef* column, const char* name) {
+    ColumnDef* added = &schema->columns[schema->column_count++];
+    *added = *column;
+    snprintf(added->name, MAX_COLUMN_NAME, "%s", name);
+}
+
+static uint32_t null_mask(uint32_t column_count) {
+    return column_count >= 32 ? 0xFFFFFFFFu : (1u << column_count) - 1;
+}
+
+// Finds a column by name. In the output of a join, whose columns are named
+// table.column, an unqualified name matches when only one table has such a
+// column; a qualified name also matches the columns of its own base table.
+// Returns -1 when nothing matches and -2 when the name is ambiguous.
+static int resolve_column(TableSchema* schema, const char* name) {
+    int exact = find_column(schema, name);
+    if (exact >= 0) return exact;
+
+    const char* dot = strchr(name, '.');
+    if (dot) {
+        size_t table_len = (size_t)(dot - name);
+        if (strlen(schema->name) == table_len && strncmp(schema->name, name, table_len) == 0) {
+            return find_column(schema, dot + 1);
+        }
+        return -1;
+    }
+
+    int found = -1;
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        const char* column_dot = strchr(schema->columns[i].name, '.');
+        if (column_dot && strcmp(column_dot + 1, name) == 0) {
+            if (found >= 0) return -2;
+            found = (int)i;
+        }
+    }
+    return found;
+}
+
+static char* column_error(const char* name, int resolved) {
+    char* msg = SAFE_MALLOC(char, 100);
+    snprintf(msg, 100, resolved == -2 ? "Column '%s' is ambiguous" : "Column '%s' not found", name);
+    return msg;
+}
+
+// Orders two values of the same column type. Strings compare up to the
+// column length, as they are zero padded rather than terminated.
+static int compare_column_values(ColumnDef* column, const uint8_t* a, const uint8_t* b) {
+    switch (column->type) {
+        case DT_INT: {
+            int x, y;
+            memcpy(&x, a, sizeof(int));
+            memcpy(&y, b, sizeof(int));
+            return x < y ? -1 : (x > y ? 1 : 0);
+        }
+        case DT_FLOAT: {
+            float x, y;
+            memcpy(&x, a, sizeof(float));
+            memcpy(&y, b, sizeof(float));
+            return compare_doubles(x, y);
+        }
+        case DT_STRING:
+            return strncmp((const char*)a, (const char*)b, column->length);
+        case DT_BOOL:
+            return (int)*(const bool*)a - (int)*(const bool*)b;
+        default:
+            return 0;
+    }
+}
+
+static double numeric_value(ColumnDef* column, const uint8_t* value) {
+    if (column->type == DT_FLOAT) {
+        float f;
+        memcpy(&f, value, sizeof(float));
+        return f;
+    }
+    if (column->type == DT_BOOL) return *(const bool*)value ? 1 : 0;
+    int i;
+    memcpy(&i, value, sizeof(int));
+    return i;
+}
+
+// Join keys may come from columns of different types: numbers compare by
+// value, strings only with strings. Returns false when they cannot be equal.
+static bool join_keys_equal(ColumnDef* a_column, const uint8_t* a, ColumnDef* b_column, const uint8_t* b) {
+    bool a_string = a_column->type == DT_STRING;
+    bool b_string = b_column->type == DT_STRING;
+    if (a_string != b_string) return false;
+
+    if (a_string) {
+        size_t a_len = strnlen((const char*)a, a_column->length);
+        size_t b_len = strnlen((const char*)b, b_column->length);
+        return a_len == b_len && memcmp(a, b, a_len) == 0;
+    }
+    if (a_column->type == b_column->type) {
+        return compare_column_values(a_column, a, b) == 0;
+    }
+    return numeric_value(a_column, a) == numeric_value(b_column, b);
+}
+
+// Orders join keys the way join_keys_equal matches them, for a merge join:
+// numbers by value, strings by their bytes then their length (the order
+// of sorts and B+tree keys), and every number before every string
+static int join_keys_compare(ColumnDef* a_column, const uint8_t* a, ColumnDef* b_column, const uint8_t* b) {
+    bool a_string = a_column->type == DT_STRING;
+    bool b_string = b_column->type == DT_STRING;
+    if (a_string != b_string) return a_string ? 1 : -1;
+
+    if (a_string) {
+        size_t a_len = strnlen((const char*)a, a_column->length);
+        size_t b_len = strnlen((const char*)b, b_column->length);
+        int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+        if (cmp != 0) return cmp;
+        return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+    }
+    if (a_column->type == b_column->type) {
+        return compare_column_values(a_column, a, b);
+    }
+    return compare_doubles(numeric_value(a_column, a), numeric_value(b_column, b));
+}
+
+// Encodes a join key as a B+tree key of `column`, for an index lookup.
+// False when no value of the column can equal it: a string against a
+// number, a string longer than the column, or a number the column type
+// cannot hold exactly.
+static bool encode_join_key(ColumnDef* column, ColumnDef* key_column, const uint8_t* key, uint8_t* out) {
+    if ((column->type == DT_STRING) != (key_column->type == DT_STRING)) return false;
+
+    if (column->type == DT_STRING) {
+        char text[MAX_STRING_LEN + 1] = { 0 };
+        size_t len = strnlen((const char*)key, key_column->length);
+        if (len > column->length) return false;
+        memcpy(text, key, len);
+        btree_encode_value(column, text, out);
+        return true;
+    }
+
+    double number = numeric_value(key_column, key);
+    switch (column->type) {
+        case DT_INT: {
+            if (number != floor(number) || number < INT32_MIN || number > INT32_MAX) return false;
+            int value = (int)number;
+            btree_encode_value(column, &value, out);
+            return true;
+        }
+        case DT_FLOAT: {
+            float value = (float)number;
+            if ((double)value != number) return false;
+            btree_encode_value(column, &value, out);
+            return true;
+        }
+        case DT_BOOL: {
+            if (number != 0 && number != 1) return false;
+            bool value = number == 1;
+            btree_encode_value(column, &value, out);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// 64-bit FNV-1a, for distinct counts and join keys
+static uint64_t value_hash(const uint8_t* bytes, uint32_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Hashes a join key so that keys join_keys_equal finds equal hash alike:
+// a string by its bytes up to the terminator, a number of any type by its
+// value as a double (-0 as 0). The final mix spreads the FNV state into
+// the low bits that pick a bucket.
+static uint64_t join_key_hash(ColumnDef* column, const uint8_t* value) {
+    uint64_t hash;
+    if (column->type == DT_STRING) {
+        hash = value_hash(value, (uint32_t)strnlen((const char*)value, column->length));
+    } else {
+        double number = numeric_value(column, value);
+        if (number == 0) number = 0;
+        uint8_t bytes[sizeof(double)];
+        memcpy(bytes, &number, sizeof(double));
+        hash = value_hash(bytes, sizeof(double));
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Drops the rows of a batch and unpins the pages they were on
+static void batch_reset(StorageManager* sm, Batch* batch) {
+    for (uint32_t i = 0; i < batch->page_count; i++) sm_unpin_page(sm, batch->pages[i]);
+    batch->page_count = 0;
+    batch->count = batch->selected = batch->cursor = 0;
+}
+
+static void batch_free(StorageManager* sm, Batch* batch) {
+    if (!batch) return;
+    batch_reset(sm, batch);
+    SAFE_FREE(batch->storage);
+    SAFE_FREE(batch);
+}
+
+static void batch_select_all(Batch* batch) {
+    for (uint32_t i = 0; i < batch->count; i++) batch->selection[i] = (uint16_t)i;
+    batch->selected = batch->count;
+}
+
+// Hands out the selected rows of a batch one at a time, refilling it from
+// `op` when they run out
+static bool batch_next_tuple(Operator* op, Batch* batch, Tuple* out) {
+    if (batch->cursor == batch->selected) {
+        if (!op->next_batch(op, batch)) return false;
+        batch->cursor = 0;
+    }
+    uint16_t row = batch->selection[batch->cursor++];
+    out->data = batch->rows[row];
+    out->nulls = batch->nulls[row];
+    return true;
+}
+
+// Reads the next batch from any operator; rows of operators without
+// next_batch are copied, as a tuple only lives until the next call
+static bool pull_batch(Operator* child, Batch* batch) {
+    if (child->next_batch) return child->next_batch(child, batch);
+
+    batch_reset(child->ctx->sm, batch);
+    uint32_t row_size = child->schema->row_size;
+    if (!batch->storage || batch->storage_row_size != row_size) {
+        SAFE_FREE(batch->storage);
+        batch->storage = SAFE_MALLOC(uint8_t, (size_t)row_size * VECTOR_SIZE);
+        batch->storage_row_size = row_size;
+    }
+
+    Tuple tuple;
+    while (batch->count < VECTOR_SIZE && child->next(child, &tuple)) {
+        uint8_t* row = batch->storage + (size_t)batch->count * row_size;
+        memcpy(row, tuple.data, row_size);
+        batch->rows[batch->count] = row;
+        batch->nulls[batch->count++] = tuple.nulls;
+    }
+    batch_select_all(batch);
+    return batch->count > 0;
+}
+
+// Narrows the selection of a batch to the rows matching every condition.
+// A condition with a kernel gathers its column from the selected rows into
+// a vector and runs the kernel over it; the others match row by row.
+static void batch_filter(RowFilter* filter, Batch* batch) {
+    int32_t ints[VECTOR_SIZE];
+    float floats[VECTOR_SIZE];
+
+    for (uint32_t c = 0; c < filter->count && batch->selected > 0; c++) {
+        CompiledCondition* cond = &filter->compiled[c];
+        uint16_t* selection = batch->selection;
+        uint32_t selected = batch->selected;
+
+        switch (cond->kernel) {
+            case KERNEL_INT:
+                for (uint32_t i = 0; i < selected; i++) {
+                    memcpy(&ints[i], batch->rows[selection[i]] + cond->offset, sizeof(int32_t));
+                }
+                batch->selected = vector_select_int(ints, selection, selected, cond->op,
+                                                    cond->int_literal, selection);
+                break;
+            case KERNEL_BOOL:
+                for (uint32_t i = 0; i < selected; i++) {
+                    ints[i] = *(bool*)(batch->rows[selection[i]] + cond->offset) ? 1 : 0;
+                }
+                batch->selected = vector_select_int(ints, selection, selected, cond->op,
+                                                    cond->int_literal, selection);
+                break;
+            case KERNEL_FLOAT:
+                for (uint32_t i = 0; i < selected; i++) {
+                    memcpy(&floats[i], batch->rows[selection[i]] + cond->offset, sizeof(float));
+                }
+                batch->selected = vector_select_float(floats, selection, selected, cond->op,
+                                                      cond->float_literal, selection);
+                break;
+            case KERNEL_NONE: {
+                uint32_t kept = 0;
+                for (uint32_t i = 0; i < selected; i++) {
+                    if (cond->match(cond, batch->rows[selection[i]] + cond->offset)) {
+                        selection[kept++] = selection[i];
+                    }
+                }
+                batch->selected = kept;
+                break;
+            }
+        }
+    }
+}
+
+// Drops the selected rows with a NULL in any of the `columns` bits
+static void batch_drop_nulls(Batch* batch, uint32_t columns) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < batch->selected; i++) {
+        uint16_t row = batch->selection[i];
+        batch->selection[kept] = row;
+        kept += (batch->nulls[row] & columns) == 0;
+    }
+    batch->selected = kept;
+}
+
+// Table access: the leaf of every plan. Picks one of the access paths the
+// old fully materialized SELECT used, but walks it lazily.
+typedef enum {
+    ACCESS_HEAP,       // heap pages the zone map cannot rule out
+    ACCESS_INDEX_ONLY, // B+tree entries alone, the heap is never read
+    ACCESS_INDEX,      // B+tree or hash range, rows fetched from the heap
+    ACCESS_BITMAP      // row positions from the bitmap indexes
+} AccessMethod;
+
+typedef struct {
+    Operator base;
+    WhereClause conditions[MAX_WHERE_CONDITIONS];
+    RowFilter filter;
+    TableIndexes indexes;
+    AccessMethod method;
+    IndexScan scan;
+    ZoneBounds bounds;
+    ZoneScan zones;
+    uint32_t page_id; // heap page being read, 0 to take the next one
+    uint32_t slot;
+    Batch* batch; // heap rows handed out by next()
+    uint32_t* positions; // bitmap candidates: 4 bytes per candidate row
+    uint32_t position_count;
+    uint32_t next_position;
+    uint8_t* row; // index-only rows are rebuilt here
+    TableStats stats; // from the last ANALYZE, when has_stats
+    bool has_stats;
+} TableAccess;
+
+static void access_open(Operator* op) {
+    TableAccess* access = (TableAccess*)op;
+    TableSchema* schema = op->schema;
+
+    switch (access->method) {
+        case ACCESS_HEAP:
+            zone_scan_begin(&access->zones, op->ctx->sm, schema, &access->bounds);
+            access->page_id = 0;
+            batch_reset(op->ctx->sm, access->batch);
+            break;
+        case ACCESS_INDEX_ONLY:
+        case ACCESS_INDEX:
+            index_scan_open(op->ctx->sm, &access->scan);
+            break;
+        case ACCESS_BITMAP:
+            access->position_count = access->next_position = 0;
+            bitmap_candidates(op->ctx->sm, schema, &access->indexes, &access->filter,
+                              &access->positions, &access->position_count);
+            break;
+    }
+}
+
+static bool access_next(Operator* op, Tuple* out) {
+    TableAccess* access = (TableAccess*)op;
+    TableSchema* schema = op->schema;
+    StorageManager* sm = op->ctx->sm;
+    uint8_t entry[BTREE_MAX_KEY_SIZE];
+    RID rid;
+
+    out->nulls = 0;
+    switch (access->method) {
+        case ACCESS_HEAP:
+            return batch_next_tuple(op, access->batch, out);
+        case ACCESS_INDEX_ONLY:
+            while (index_scan_next(&access->scan, entry, &rid)) {
+                entry_to_row(schema, access->scan.index, entry, access->row);
+                if (row_matches(&access->filter, access->row)) {
+                    out->data = access->row;
+                    return true;
+                }
+            }
+            return false;
+        case ACCESS_INDEX:
+            while (index_scan_next(&access->scan, entry, &rid)) {
+                uint8_t* row = fetch_row(sm, schema, rid);
+                if (row && row_matches(&access->filter, row)) {
+                    out->data = row;
+                    return true;
+                }
+            }
+            return false;
+        case ACCESS_BITMAP:
+            while (access->next_position < access->position_count) {
+                uint8_t* row = fetch_row(sm, schema, position_rid(schema, access->positions[access->next_position++]));
+                if (row && row_matches(&access->filter, row)) {
+                    out->data = row;
+                    return true;
+                }
+            }
+            return false;
+    }
+    return false;
+}
+
+// Heap scans fill batches with the live rows of the pages the zone map
+// cannot rule out, then filter them. The pages stay pinned while the batch
+// points into them.
+static bool access_next_batch(Operator* op, Batch* out) {
+    TableAccess* access = (TableAccess*)op;
+    TableSchema* schema = op->schema;
+    StorageManager* sm = op->ctx->sm;
+    uint32_t slots = rows_per_page(schema);
+
+    while (true) {
+        batch_reset(sm, out);
+        while (out->count < VECTOR_SIZE && out->page_count < BATCH_MAX_PAGES) {
+            if (access->page_id == 0) {
+                access->page_id = zone_scan_next(&access->zones);
+                access->slot = 0;
+                if (access->page_id == 0) break;
+            }
+
+            Page* page = sm_pin_page(sm, access->page_id);
+            if (!page) {
+                access->page_id = 0;
+                break;
+            }
+            out->pages[out->page_count++] = page;
+
+            // A slot holds a live row when its header is not all zero
+            // (never used) and the deleted flag is clear
+            uint32_t end = access->slot + (VECTOR_SIZE - out->count);
+            if (end > slots) end = slots;
+            for (uint32_t slot = access->slot; slot < end; slot++) {
+                uint8_t* row = page->data + slot * schema->row_size;
+                uint64_t header;
+                memcpy(&header, row, sizeof(header));
+                out->rows[out->count] = row;
+                out->nulls[out->count] = 0;
+                out->count += header != 0 && !*(bool*)row;
+            }
+            access->slot = end;
+            if (access->slot == slots) access->page_id = 0;
+        }
+        if (out->count == 0) return false;
+
+        batch_select_all(out);
+        batch_filter(&access->filter, out);
+        if (out->selected > 0) return true;
+    }
+}
+
+static void access_close(Operator* op) {
+    TableAccess* access = (TableAccess*)op;
+    if (access->batch) batch_reset(op->ctx->sm, access->batch);
+    if (access->method == ACCESS_INDEX_ONLY || access->method == ACCESS_INDEX) {
+        index_scan_close(&access->scan);
+    }
+    SAFE_FREE(access->positions);
+}
+
+// " where <conditions>" of an access with conditions, else ""
+static void format_access_where(TableAccess* access, char* out, size_t size) {
+    out[0] = '\0';
+    if (access->filter.count > 0) {
+        char conditions[EXPLAIN_LINE_SIZE - 8];
+        format_conditions(access->conditions, access->filter.count, conditions, sizeof(conditions));
+        snprintf(out, size, " where %s", conditions);
+    }
+}
+
+static void access_explain(Operator* op, QueryResult* plan, uint32_t depth) {
+    TableAccess* access = (TableAccess*)op;
+    char where[EXPLAIN_LINE_SIZE];
+    format_access_where(access, where, sizeof(where));
+    const char* index = access->scan.index ? access->scan.index->name :
+                        access->scan.hash ? access->scan.hash->name : "";
+    const char* backward = access->scan.descending ? " backward" : "";
+
+    switch (access->method) {
+        case ACCESS_HEAP:
+            explain_line(plan, depth, op, "Heap scan on %s%s", op->schema->name, where);
+            break;
+        case ACCESS_INDEX_ONLY:
+            explain_line(plan, depth, op, "Index only scan%s on %s using %s%s", backward, op->schema->name, index,
+                         where);
+            break;
+        case ACCESS_INDEX:
+            explain_line(plan, depth, op, "Index scan%s on %s using %s%s", backward, op->schema->name, index, where);
+            break;
+        case ACCESS_BITMAP:
+            explain_line(plan, depth, op, "Bitmap scan on %s%s", op->schema->name, where);
+            break;
+    }
+}
+
+static void access_destroy(Operator* op) {
+    TableAccess* access = (TableAccess*)op;
+    close_table_indexes(&access->indexes);
+    batch_free(op->ctx->sm, access->batch);
+    SAFE_FREE(access->row);
+    SAFE_FREE(op->schema);
+    SAFE_FREE(access);
+}
+
+// Heap page reads to fetch `rows` rows in index order: the pages come in
+// no particular order, but a table that fits in the cache is read once
+static double fetch_cost(const TableStats* stats, double rows) {
+    double reads = rows;
+    if (stats->page_count <= MAX_CACHE_PAGES && reads > stats->page_count) reads = stats->page_count;
+    return reads * COST_RANDOM_PAGE;
+}
+
+// Descends the tree, then reads the leaves holding `entries` entries and,
+// unless the index covers the query, the rows they point to. Leaves are
+// assumed filled like a bulk build.
+static double btree_cost(const TableStats* stats, BTreeIndex* index, double entries, bool covering) {
+    double entry_size = index->key_size + index->payload_size + sizeof(RID);
+    double per_leaf = PAGE_SIZE * BTREE_DEFAULT_FILL_FACTOR / 100.0 / entry_size;
+    if (per_leaf < 2) per_leaf = 2;
+
+    double height = 1 + ceil(log(stats->row_count + 1.0) / log(per_leaf));
+    double cost = height * COST_RANDOM_PAGE + ceil(entries / per_leaf) + entries * COST_INDEX_ENTRY;
+    if (!covering) cost += fetch_cost(stats, entries);
+    return cost;
+}
+
+// Reads the bitmaps of the values each bitmap indexed condition covers,
+// one bit per row, then fetches the candidate rows
+static double bitmap_cost(TableAccess* access, double* candidates) {
+    TableSchema* schema = access->base.schema;
+    const TableStats* stats = &access->stats;
+    double bitmap_pages = ceil(stats->row_count / 8.0 / PAGE_SIZE);
+    double selectivity = 1.0;
+    double cost = 0;
+
+    for (uint32_t i = 0; i < access->filter.count; i++) {
+        uint8_t key[BTREE_MAX_KEY_SIZE];
+        if (!bitmap_condition(schema, &access->indexes, &access->filter, i, key)) continue;
+
+        double share = filter_selectivity(schema, stats, &access->filter, 1u << i);
+        double values = stats->columns[access->filter.columns[i]].distinct;
+        if (access->filter.conditions[i].op != OP_NOT_EQUALS) values *= share;
+        if (values < 1) values = 1;
+        cost += COST_RANDOM_PAGE + values * bitmap_pages;
+        selectivity *= share;
+    }
+
+    *candidates = stats->row_count * selectivity;
+    return cost + fetch_cost(stats, *candidates);
+}
+
+// Picks the access path with the lowest estimated cost and returns the
+// cost. Every path checks the whole filter on the rows it reads.
+static double choose_access_by_cost(TableAccess* access, const bool* needed) {
+    TableSchema* schema = access->base.schema;
+    const TableStats* stats = &access->stats;
+    RowFilter* filter = &access->filter;
+    double checks = filter->count * COST_CONDITION;
+    IndexScan candidate;
+
+    access->method = ACCESS_HEAP;
+    double best = stats->page_count + stats->row_count * checks;
+
+    for (uint32_t i = 0; i < access->indexes.btree_count; i++) {
+        BTreeIndex* index = access->indexes.btrees[i];
+        if (plan_index_scan(schema, index, filter, &candidate) == 0) continue;
+
+        double entries = stats->row_count *
+                         filter_selectivity(schema, stats, filter, scan_conditions(schema, &candidate, filter));
+        bool covering = index_covers(schema, index, needed);
+        double cost = btree_cost(stats, index, entries, covering) + entries * checks;
+        if (cost < best) {
+            best = cost;
+            access->scan = candidate;
+            access->method = covering ? ACCESS_INDEX_ONLY : ACCESS_INDEX;
+        }
+    }
+
+    for (uint32_t i = 0; i < access->indexes.hash_count; i++) {
+        if (plan_hash_scan(schema, access->indexes.hashes[i], filter, &candidate) == 0) continue;
+
+        double entries = stats->row_count *
+                         filter_selectivity(schema, stats, filter, scan_conditions(schema, &candidate, filter));
+        double cost = 2 * COST_RANDOM_PAGE + entries * COST_INDEX_ENTRY + fetch_cost(stats, entries) +
+                      entries * checks;
+        if (cost < best) {
+            best = cost;
+            access->scan = candidate;
+            access->method = ACCESS_INDEX;
+        }
+    }
+
+    if (has_bitmap_condition(schema, &access->indexes, filter)) {
+        double candidates;
+        double cost = bitmap_cost(access, &candidates) + candidates * checks;
+        if (cost < best) {
+            best = cost;
+            access->method = ACCESS_BITMAP;
+        }
+    }
+    return best;
+}
+
+// Scans a table for the rows matching `conditions`, whose columns are
+// named as in the table. `needed` flags the columns the rest of the plan
+// reads, which decides whether an index-only scan is possible; NULL means
+// all of them. Takes ownership of the schema.
+static Operator* table_access_create(ExecContext* ctx, TableSchema* schema, const WhereClause* conditions,
+                                     uint32_t condition_count, const bool* needed, char** error) {
+    TableAccess* access = SAFE_CALLOC(TableAccess, 1);
+    Operator* op = &access->base;
+    op->schema = schema;
+    op->ctx = ctx;
+    op->open = access_open;
+    op->next = access_next;
+    op->close = access_close;
+    op->destroy = access_destroy;
+    op->explain = access_explain;
+    op->rows = op->cost = -1;
+
+    memcpy(access->conditions, conditions, condition_count * sizeof(WhereClause));
+    access->filter.conditions = access->conditions;
+    access->filter.count = condition_count;
+    for (uint32_t i = 0; i < condition_count; i++) {
+        access->filter.columns[i] = find_column(schema, conditions[i].column);
+        if (access->filter.columns[i] < 0) {
+            *error = column_error(conditions[i].column, -1);
+            SAFE_FREE(op->schema);
+            SAFE_FREE(access);
+            return NULL;
+        }
+    }
+    compile_filter(schema, &access->filter);
+
+    bool all_columns[MAX_COLUMNS];
+    if (!needed) {
+        for (uint32_t i = 0; i < MAX_COLUMNS; i++) all_columns[i] = true;
+        needed = all_columns;
+    }
+
+    open_table_indexes(ctx->sm, schema, &access->indexes);
+    access->has_stats = stats_load(ctx->sm, schema->name, &access->stats) &&
+                        access->stats.column_count == schema->column_count;
+
+    if (access->has_stats) {
+        double cost = choose_access_by_cost(access, needed);
+        uint32_t all = (1u << condition_count) - 1;
+        op->rows = access->stats.row_count * filter_selectivity(schema, &access->stats, &access->filter, all);
+        op->cost = cost + op->rows * COST_ROW;
+    } else {
+        // Never analyzed: same order of preference as UPDATE and DELETE,
+        // an index equality, then the bitmap indexes, then an index
+        // range, then the heap
+        bool use_index = choose_index(schema, &access->indexes, &access->filter, needed, &access->scan);
+        if (use_index && access->scan.index && index_covers(schema, access->scan.index, needed)) {
+            access->method = ACCESS_INDEX_ONLY;
+        } else if (use_index && access->scan.eq_len > 0) {
+            access->method = ACCESS_INDEX;
+        } else if (has_bitmap_condition(schema, &access->indexes, &access->filter)) {
+            access->method = ACCESS_BITMAP;
+        } else if (use_index) {
+            access->method = ACCESS_INDEX;
+        } else {
+            access->method = ACCESS_HEAP;
+        }
+    }
+
+    if (access->method == ACCESS_INDEX_ONLY) {
+        access->row = SAFE_MALLOC(uint8_t, schema->row_size);
+    } else if (access->method == ACCESS_HEAP) {
+        zone_bounds(schema, &access->filter, &access->bounds);
+        op->next_batch = access_next_batch;
+        access->batch = SAFE_CALLOC(Batch, 1);
+    }
+    return op;
+}
+
+// Plans the index lookups of an index nested loop join on `column`: a
+// B+tree led by the column, the fewer key columns the better, else a hash
+// index on the column alone. False when the table has neither.
+static bool join_index_scan(TableAccess* access, uint32_t column, IndexScan* scan) {
+    TableIndexes* indexes = &access->indexes;
+    memset(scan, 0, sizeof(IndexScan));
+    for (uint32_t i = 0; i < indexes->btree_count; i++) {
+        BTreeIndex* index = indexes->btrees[i];
+        if (index->key_columns[0] != column) continue;
+        if (!scan->index || index->key_column_count < scan->index->key_column_count) scan->index = index;
+    }
+    for (uint32_t i = 0; i < indexes->hash_count && !scan->index; i++) {
+        HashIndex* hash = indexes->hashes[i];
+        if (hash->key_column_count == 1 && hash->key_columns[0] == column) scan->hash = hash;
+    }
+    scan->eq_len = btree_key_width(&access->base.schema->columns[column]);
+    return scan->index || scan->hash;
+}
+
+// Whether a B+tree scan returns its entries ordered on `keys` in turn:
+// the key columns come in that order, and any key column before or
+// between them is fixed by an equality
+static bool scan_ordered_by(TableSchema* schema, const IndexScan* scan, const uint32_t* keys, uint32_t key_count) {
+    BTreeIndex* index = scan->index;
+    if (!index) return false;
+
+    uint32_t matched = 0, offset = 0;
+    for (uint32_t k = 0; k < index->key_column_count && matched < key_count; k++) {
+        offset += btree_key_width(&schema->columns[index->key_columns[k]]);
+        if (index->key_columns[k] == keys[matched]) matched++;
+        else if (offset > scan->eq_len) return false;
+    }
+    return matched == key_count;
+}
+
+// Whether a table access returns its rows ordered on `column`: a B+tree
+// scan where the key columns before it are fixed by equalities
+static bool access_ordered_on(Operator* op, uint32_t column) {
+    TableAccess* access = (TableAccess*)op;
+    if (access->method != ACCESS_INDEX && access->method != ACCESS_INDEX_ONLY) return false;
+    return scan_ordered_by(op->schema, &access->scan, &column, 1);
+}
+
+// Cost of sorting the rows of an operator, through temporary pages when
+// they do not fit in the memory budget
+static double sort_cost(Operator* input, uint32_t key_count) {
+    double cost = input->rows * log2(input->rows + 2) * key_count * COST_CONDITION;
+    double bytes = input->rows * (sizeof(uint32_t) + input->schema->row_size);
+    if (bytes > input->ctx->memory_budget) cost += 2 * bytes / PAGE_SIZE;
+    return cost;
+}
+
+// Makes a table access return its rows ordered on `keys`, all ascending
+// or all descending, so no sort is needed. A B+tree scan already ordered
+// on them is walked in that direction. A heap scan becomes a scan of a
+// B+tree led by the keys when that is estimated to cost less than
+// sorting, or, never analyzed, when the index covers the query or only
+// the first `limit` rows are wanted (0: all). False when the rows still
+// need sorting.
+static bool access_order_by(Operator* op, const uint32_t* keys, const bool* descending, uint32_t key_count,
+                            const bool* needed, uint32_t limit) {
+    TableAccess* access = (TableAccess*)op;
+    for (uint32_t k = 1; k < key_count; k++) {
+        if (descending[k] != descending[0]) return false;
+    }
+
+    if (access->method == ACCESS_INDEX || access->method == ACCESS_INDEX_ONLY) {
+        if (!scan_ordered_by(op->schema, &access->scan, keys, key_count)) return false;
+        access->scan.descending = descending[0];
+        return true;
+    }
+    if (access->method != ACCESS_HEAP) return false;
+
+    // The covering index with the fewest key columns, else the narrowest
+    IndexScan scan;
+    bool covering = false;
+    memset(&scan, 0, sizeof(IndexScan));
+    for (uint32_t i = 0; i < access->indexes.btree_count; i++) {
+        IndexScan candidate;
+        memset(&candidate, 0, sizeof(IndexScan));
+        candidate.index = access->indexes.btrees[i];
+        if (!scan_ordered_by(op->schema, &candidate, keys, key_count)) continue;
+
+        bool covers = index_covers(op->schema, candidate.index, needed);
+        if (!scan.index || (covers && !covering) ||
+            (covers == covering && candidate.index->key_column_count < scan.index->key_column_count)) {
+            scan = candidate;
+            covering = covers;
+        }
+    }
+    if (!scan.index) return false;
+
+    double cost = -1;
+    if (access->has_stats) {
+        // A limit stops the scan once enough rows passed the filter
+        const TableStats* stats = &access->stats;
+        double entries = stats->row_count, rows = op->rows;
+        if (limit > 0 && op->rows > 0 && stats->row_count > 0) {
+            double wanted = limit * stats->row_count / op->rows;
+            if (wanted < entries) entries = wanted;
+            if (limit < rows) rows = limit;
+        }
+        cost = btree_cost(stats, scan.index, entries, covering) + entries * access->filter.count * COST_CONDITION +
+               rows * COST_ROW;
+        if (cost >= op->cost + sort_cost(op, key_count)) return false;
+    } else if (!covering && limit == 0) {
+        return false;
+    }
+
+    scan.descending = descending[0];
+    access->scan = scan;
+    access->method = covering ? ACCESS_INDEX_ONLY : ACCESS_INDEX;
+    if (covering) access->row = SAFE_MALLOC(uint8_t, op->schema->row_size);
+    batch_free(op->ctx->sm, access->batch);
+    access->batch = NULL;
+    op->next_batch = NULL;
+    op->cost = cost;
+    return true;
+}
+
+// Filter: passes on the child's rows that satisfy every condition. A
+// condition on a NULL column never holds.
+typedef struct {
+    Operator base;
+    Operator* child;
+    WhereClause conditions[MAX_WHERE_CONDITIONS];
+    RowFilter filter;
+    uint32_t columns_used;
+    Batch* batch; // rows handed out by next()
+} FilterOp;
+
+static void filter_open(Operator* op) {
+    FilterOp* filter = (FilterOp*)op;
+    filter->child->open(filter->child);
+    batch_reset(op->ctx->sm, filter->batch);
+}
+
+static bool filter_next_batch(Operator* op, Batch* out) {
+    FilterOp* filter = (FilterOp*)op;
+    while (pull_batch(filter->child, out)) {
+        batch_drop_nulls(out, filter->columns_used);
+        batch_filter(&filter->filter, out);
+        if (out->selected > 0) return true;
+    }
+    return false;
+}
+
+static bool filter_next(Operator* op, Tuple* out) {
+    FilterOp* filter = (FilterOp*)op;
+    return batch_next_tuple(op, filter->batch, out);
+}
+
+static void filter_close(Operator* op) {
+    FilterOp* filter = (FilterOp*)op;
+    batch_reset(op->ctx->sm, filter->batch);
+    filter->child->close(filter->child);
+}
+
+static void filter_explain(Operator* op, QueryResult* plan, uint32_t depth) {
+    FilterOp* filter = (FilterOp*)op;
+    char conditions[EXPLAIN_LINE_SIZE];
+    format_conditions(filter->conditions, filter->filter.count, conditions, sizeof(conditions));
+    explain_line(plan, depth, op, "Filter %s", conditions);
+    filter->child->explain(filter->child, plan, depth + 1);
+}
+
+static void filter_destroy(Operator* op) {
+    FilterOp* filter = (FilterOp*)op;
+    batch_free(op->ctx->sm, filter->batch);
+    operator_free(filter->child);
+    SAFE_FREE(op->schema);
+    SAFE_FREE(filter);
+}
+
+// `columns` holds the child column of every condition
+static Operator* filter_create(Operator* child, const WhereClause* conditions, const int* columns,
+                               uint32_t count) {
+    FilterOp* filter = SAFE_CALLOC(FilterOp, 1);
+    Operator* op = &filter->base;
+    op->schema = copy_schema(child->schema);
+    op->ctx = child->ctx;
+    op->open = filter_open;
+    op->next = filter_next;
+    op->next_batch = filter_next_batch;
+    op->close = filter_close;
+    op->destroy = filter_destroy;
+    op->explain = filter_explain;
+
+    filter->child = child;
+    filter->batch = SAFE_CALLOC(Batch, 1);
+    memcpy(filter->conditions, conditions, count * sizeof(WhereClause));
+    filter->filter.conditions = filter->conditions;
+    filter->filter.count = count;
+    for (uint32_t i = 0; i < count; i++) {
+        filter->filter.columns[i] = columns[i];
+        filter->columns_used |= 1u << columns[i];
+    }
+    compile_filter(op->schema, &filter->filter);
+
+    op->rows = op->cost = -1;
+    if (has_estimates(child)) {
+        uint32_t all = (1u << count) - 1;
+        op->rows = child->rows * filter_selectivity(op->schema, NULL, &filter->filter, all);
+        op->cost = child->cost + child->rows * count * COST_CONDITION;
+    }
+    return op;
+}
+
+// Project: copies the selected child columns into a row of their own
+typedef struct {
+    Operator base;
+    Operator* child;
+    uint32_t columns[MAX_COLUMNS];
+    uint8_t* row;
+} ProjectOp;
+
+static void project_open(Operator* op) {
+    ProjectOp* project = (ProjectOp*)op;
+    project->child->open(project->child);
+}
+
+static bool project_next(Operator* op, Tuple* out) {
+    ProjectOp* project = (ProjectOp*)op;
+    TableSchema* input = project->child->schema;
+    Tuple in;
+    if (!project->child->next(project->child, &in)) return false;
+
+    out->data = project->row;
+    out->nulls = 0;
+    for (uint32_t i = 0; i < op->schema->column_count; i++) {
+        uint32_t col = project->columns[i];
+        memcpy(project->row + op->schema->column_offsets[i], in.data + input->column_offsets[col],
+               input->column_sizes[col]);
+        if (in.nulls & (1u << col)) out->nulls |= 1u << i;
+    }
+    return true;
+}
+
+static void project_close(Operator* op) {
+    ProjectOp* project = (ProjectOp*)op;
+    project->child->close(project->child);
+}
+
+static void project_explain(Operator* op, QueryResult* plan, uint32_t depth) {
+    ProjectOp* project = (ProjectOp*)op;
+    char columns[EXPLAIN_LINE_SIZE];
+    size_t length = 0;
+    columns[0] = '\0';
+    for (uint32_t i = 0; i < op->schema->column_count && length < sizeof(columns); i++) {
+        length += (size_t)snprintf(columns + length, sizeof(columns) - length, "%s%s", i > 0 ? ", " : "",
+                                   op->schema->columns[i].name);
+    }
+    explain_line(plan, depth, op, "Project %s", columns);
+    project->child->explain(project->child, plan, depth + 1);
+}
+
+static void project_destroy(Operator* op) {
+    ProjectOp* project = (ProjectOp*)op;
+    operator_free(project->child);
+    SAFE_FREE(project->row);
+    SAFE_FREE(op->schema);
+    SAFE_FREE(project);
+}
+
+// Output column i is child column columns[i], renamed to names[i]
+static Operator* project_create(Operator* child, const uint32_t* columns, char names[][MAX_COLUMN_NAME],
+                                uint32_t count) {
+    ProjectOp* project = SAFE_CALLOC(ProjectOp, 1);
+    Operator* op = &project->base;
+    op->schema = SAFE_CALLOC(TableSchema, 1);
+    op->ctx = child->ctx;
+    op->open = project_open;
+    op->next = project_next;
+    op->close = project_close;
+    op->destroy = project_destroy;
+    op->explain = project_explain;
+    op->rows = child->rows;
+    op->cost = child->cost;
+
+    project->child = child;
+    for (uint32_t i = 0; i < count; i++) {
+        project->columns[i] = columns[i];
+        add_column(op->schema, &child->schema->columns[columns[i]], names[i]);
+    }
+    compute_column_layout(op->schema);
+    project->row = SAFE_CALLOC(uint8_t, op->schema->row_size);
+    return op;
+}
+
+// Join on one equality: every outer row is paired with the inner rows
+// whose key is equal, found by one of the strategies below. RIGHT and FULL
+// joins remember which inner rows found a partner, one bit per inner row,
+// and emit the others after the last outer row. The outer input is the
+// left table unless the planner swapped the two.
+typedef enum {
+    JOIN_NESTED_LOOP, // the inner input is read again for every outer row
+    JOIN_HASH,        // the inner input is read once into a hash table on its key
+    JOIN_INDEX,       // every outer key is looked up in an index of the inner table
+    JOIN_MERGE        // both inputs come sorted on the key and are merged
+} JoinStrategy;
+
+typedef struct {
+    Operator base;
+    Operator* outer;
+    Operator* inner;
+    JoinStrategy strategy;
+    JoinType type; // seen from the outer input: LEFT keeps unmatched outer rows
+    bool swapped;  // outer is the right table; its columns still come second
+    uint32_t outer_column;
+    uint32_t inner_column;
+    uint8_t* outer_row;
+    uint32_t outer_nulls;
+    bool have_outer;
+    bool outer_matched;
+    bool finishing; // emitting the inner rows nobody matched
+    uint8_t* matched;
+    uint64_t matched_bytes;
+    uint64_t inner_position; // inner rows read, or records emitted when finishing
+    // Hash join: the inner rows as records (NULL mask, then the row), with
+    // their key hashes and a chain per bucket. A chain lists its records in
+    // input order, so matches come out as a nested loop would find them.
+    uint8_t* records;
+    uint32_t record_size;
+    uint32_t record_count;
+    uint32_t record_capacity;
+    uint64_t* hashes;
+    uint32_t* chain;   // next record in the same bucket + 1, 0 at the end
+    uint32_t* buckets; // first record of the bucket + 1, 0 when empty
+    uint32_t bucket_mask;
+    uint64_t probe_hash; // key hash of the current outer row
+    uint32_t probe_next; // next record of its chain + 1
+    // Grace hash join, once the inner rows outgrow the memory budget: both
+    // inputs are split by key hash into partitions spilled to temporary
+    // pages (spill.h), then each pair of partitions is joined in memory
+    SpillFile** inner_parts;
+    SpillFile** outer_parts;
+    uint32_t partition_count; // 0 while the inner rows fit in memory
+    uint32_t partition;       // pair being joined
+    uint8_t* inner_row;       // an inner row read back from its partition
+    // Index nested loop join (INNER and LEFT only): the inner input is a
+    // table access that is never opened; its index is searched for each
+    // outer key and its conditions are checked on the rows found
+    IndexScan probe;
+    // Merge join: the records hold the inner rows of one key (the group),
+    // and inner_row the inner row after them (the lookahead)
+    bool lookahead;
+    uint32_t lookahead_nulls;
+    bool inner_done;
+    bool positioned; // the inner side is lined up with the current outer row
+    uint8_t* row;
+} JoinOp;
+
+// Memory a hash join record takes besides the row: hash, chain link and
+// up to two bucket slots
+#define HASH_JOIN_RECORD_OVERHEAD (sizeof(uint64_t) + 3 * sizeof(uint32_t))
+#define HASH_JOIN_MIN_PARTITIONS 8
+#define HASH_JOIN_MAX_PARTITIONS 256
+
+static void join_rewind_inner(JoinOp* join) {
+    join->inner->close(join->inner);
+    join->inner->open(join->inner);
+    join->inner_position = 0;
+}
+
+static void join_record(JoinOp* join, uint32_t i, Tuple* out) {
+    uint8_t* record = join->records + (size_t)i * join->record_size;
+    memcpy(&out->nulls, record, sizeof(uint32_t));
+    out->data = record + sizeof(uint32_t);
+}
+
+static uint64_t hash_join_inner_hash(JoinOp* join, const uint8_t* row) {
+    TableSchema* schema = join->inner->schema;
+    return join_key_hash(&schema->columns[join->inner_column], row + schema->column_offsets[join->inner_column]);
+}
+
+// Appends a record. For a hash join the record arrays start at the
+// planner's estimate of the inner rows, within the memory budget; they
+// double as needed.
+static void join_record_add(JoinOp* join, uint32_t nulls, const uint8_t* row) {
+    if (join->record_count == join->record_capacity) {
+        uint32_t capacity = join->record_capacity * 2;
+        if (capacity == 0) {
+            double fits = (double)join->base.ctx->memory_budget / (join->record_size + HASH_JOIN_RECORD_OVERHEAD);
+            double expected = join->strategy == JOIN_HASH && has_estimates(join->inner) ? join->inner->rows : 0;
+            if (expected > fits) expected = fits;
+            capacity = expected > 64 ? (uint32_t)expected + 1 : 64;
+        }
+        join->records = SAFE_REALLOC(join->records, uint8_t, (size_t)capacity * join->record_size);
+        join->hashes = SAFE_REALLOC(join->hashes, uint64_t, capacity);
+        join->chain = SAFE_REALLOC(join->chain, uint32_t, capacity);
+        join->record_capacity = capacity;
+    }
+
+    uint32_t i = join->record_count++;
+    uint8_t* record = join->records + (size_t)i * join->record_size;
+    memcpy(record, &nulls, sizeof(uint32_t));
+    memcpy(record + sizeof(uint32_t), row, join->inner->schema->row_size);
+    join->hashes[i] = hash_join_inner_hash(join, row);
+    join->chain[i] = 0;
+}
+
+// Chains the records into buckets, a power of two at least as many as
+// the records. Pushing the records last to first leaves every chain in
+// input order. A NULL key equals nothing; such rows are only kept for the
+// end of a RIGHT or FULL join.
+static void hash_join_index(JoinOp* join) {
+    uint32_t bucket_count = 16;
+    while (bucket_count < join->record_count) bucket_count *= 2;
+    SAFE_FREE(join->buckets);
+    join->buckets = SAFE_CALLOC(uint32_t, bucket_count);
+    join->bucket_mask = bucket_count - 1;
+
+    for (uint32_t i = join->record_count; i-- > 0;) {
+        uint32_t nulls;
+        memcpy(&nulls, join->records + (size_t)i * join->record_size, sizeof(uint32_t));
+        if (nulls & (1u << join->inner_column)) continue;
+
+        uint32_t* bucket = &join->buckets[join->hashes[i] & join->bucket_mask];
+        join->chain[i] = *bucket;
+        *bucket = i + 1;
+    }
+}
+
+// The partition of a key hash. Buckets use the low bits, partitions the
+// high ones, so the rows of one partition still spread over its buckets.
+static uint32_t hash_join_partition_of(JoinOp* join, uint64_t hash) {
+    return (uint32_t)(hash >> 56) & (join->partition_count - 1);
+}
+
+static bool hash_join_spill(SpillFile* part, uint32_t nulls, const uint8_t* row, uint32_t row_size) {
+    return spill_write(part, &nulls, sizeof(uint32_t)) && spill_write(part, row, row_size);
+}
+
+// Switches to a grace hash join: picks the partition count, enough for the
+// expected inner rows to fit in memory a partition at a time with room to
+// spare, and moves the records read so far into their partitions
+static bool hash_join_start_partitions(JoinOp* join) {
+    ExecContext* ctx = join->base.ctx;
+    double inner_bytes = (double)join->record_count * (join->record_size + HASH_JOIN_RECORD_OVERHEAD);
+    if (has_estimates(join->inner)) {
+        double expected = join->inner->rows * (join->record_size + HASH_JOIN_RECORD_OVERHEAD);
+        if (expected > inner_bytes) inner_bytes = expected;
+    }
+
+    // Every partition of both inputs buffers a page while being written
+    uint32_t max_partitions = (uint32_t)(ctx->memory_budget / (2 * PAGE_SIZE));
+    if (max_partitions > HASH_JOIN_MAX_PARTITIONS) max_partitions = HASH_JOIN_MAX_PARTITIONS;
+    uint32_t count = HASH_JOIN_MIN_PARTITIONS;
+    while (count < max_partitions && count * (double)ctx->memory_budget < 2 * inner_bytes) count *= 2;
+
+    join->partition_count = count;
+    join->inner_parts = SAFE_CALLOC(SpillFile*, count);
+    join->outer_parts = SAFE_CALLOC(SpillFile*, count);
+    for (uint32_t p = 0; p < count; p++) {
+        join->inner_parts[p] = spill_create(ctx->sm);
+        join->outer_parts[p] = spill_create(ctx->sm);
+    }
+
+    for (uint32_t i = 0; i < join->record_count; i++) {
+        Tuple record;
+        join_record(join, i, &record);
+        SpillFile* part = join->inner_parts[hash_join_partition_of(join, join->hashes[i])];
+        if (!hash_join_spill(part, record.nulls, record.data, join->inner->schema->row_size)) return false;
+    }
+    join->record_count = 0;
+    return true;
+}
+
+// Loads the inner rows of the current partition into the hash table and
+// starts reading its outer rows. A partition is loaded whole even past
+// the budget, as when one key holds most of the rows.
+static bool hash_join_load_partition(JoinOp* join) {
+    SpillFile* inner = join->inner_parts[join->partition];
+    uint32_t nulls;
+
+    join->record_count = 0;
+    if (!spill_rewind(inner) || !spill_rewind(join->outer_parts[join->partition])) return false;
+    while (spill_read(inner, &nulls, sizeof(uint32_t))) {
+        if (!spill_read(inner, join->inner_row, join->inner->schema->row_size)) return false;
+        join_record_add(join, nulls, join->inner_row);
+    }
+    hash_join_index(join);
+
+    // The partition's inner pages can go back to the free list now
+    spill_free(inner);
+    join->inner_parts[join->partition] = NULL;
+    return true;
+}
+
+static void hash_join_free(JoinOp* join) {
+    SAFE_FREE(join->records);
+    SAFE_FREE(join->hashes);
+    SAFE_FREE(join->chain);
+    SAFE_FREE(join->buckets);
+    join->record_count = join->record_capacity = 0;
+
+    for (uint32_t p = 0; p < join->partition_count; p++) {
+        spill_free(join->inner_parts[p]);
+        spill_free(join->outer_parts[p]);
+    }
+    SAFE_FREE(join->inner_parts);
+    SAFE_FREE(join->outer_parts);
+    join->partition_count = 0;
+}
+
+// Reads the inner input into the hash table. When it outgrows the memory
+// budget the join turns into a grace hash join: the inner rows, then all
+// outer rows, are written to partitions, and the first pair is loaded.
+static bool hash_join_build(JoinOp* join) {
+    Operator* inner = join->inner;
+    Operator* outer = join->outer;
+    size_t budget = join->base.ctx->memory_budget;
+    bool ok = true;
+    Tuple in;
+
+    hash_join_free(join);
+    inner->open(inner);
+    while (ok && inner->next(inner, &in)) {
+        if (join->partition_count == 0 &&
+            (size_t)(join->record_count + 1) * (join->record_size + HASH_JOIN_RECORD_OVERHEAD) > budget) {
+            ok = hash_join_start_partitions(join);
+        }
+        if (join->partition_count == 0) {
+            join_record_add(join, in.nulls, in.data);
+        } else {
+            SpillFile* part = join->inner_parts[hash_join_partition_of(join, hash_join_inner_hash(join, in.data))];
+            ok = ok && hash_join_spill(part, in.nulls, in.data, inner->schema->row_size);
+        }
+    }
+    inner->close(inner);
+
+    if (join->partition_count == 0) {
+        hash_join_index(join);
+        return ok;
+    }
+
+    TableSchema* schema = outer->schema;
+    ColumnDef* key = &schema->columns[join->outer_column];
+    uint32_t key_offset = schema->column_offsets[join->outer_column];
+    while (ok && outer->next(outer, &in)) {
+        SpillFile* part = join->outer_parts[hash_join_partition_of(join, join_key_hash(key, in.data + key_offset))];
+        ok = hash_join_spill(part, in.nulls, in.data, schema->row_size);
+    }
+
+    // The spill loop leaves the record arrays sized for the budget; they
+    // are reused by every partition
+    join->partition = 0;
+    return ok && hash_join_load_partition(join);
+}
+
+static void join_open(Operator* op) {
+    JoinOp* join = (JoinOp*)op;
+    join->outer->open(join->outer);
+    if (join->strategy == JOIN_HASH) {
+        if (!hash_join_build(join)) fail(op->ctx, "Join: cannot write temporary pages");
+    } else if (join->strategy != JOIN_INDEX) {
+        join->inner->open(join->inner);
+    }
+    join->have_outer = false;
+    join->finishing = false;
+    if (join->matched) memset(join->matched, 0, join->matched_bytes);
+    if (join->strategy == JOIN_MERGE) {
+        join->record_count = 0;
+        join->inner_position = 0;
+        join->lookahead = false;
+        join->inner_done = false;
+    }
+}
+
+// Copies one input's columns into the joined row, starting at `offset`
+// and column `first`; a missing row is padded with NULL columns
+static void join_copy_side(uint8_t* row, TableSchema* schema, const uint8_t* data, uint32_t nulls,
+                           uint32_t offset, uint32_t first, Tuple* out) {
+    uint32_t bytes = schema->row_size - ROW_HEADER_SIZE;
+    if (data) {
+        memcpy(row + offset, data + ROW_HEADER_SIZE, bytes);
+        out->nulls |= nulls << first;
+    } else {
+        memset(row + offset, 0, bytes);
+        out->nulls |= null_mask(schema->column_count) << first;
+    }
+}
+
+// Builds the joined row, left table columns first
+static void join_emit(JoinOp* join, const uint8_t* outer, uint32_t outer_nulls,
+                      const Tuple* inner, Tuple* out) {
+    TableSchema* outer_schema = join->outer->schema;
+    TableSchema* inner_schema = join->inner->schema;
+    const uint8_t* inner_data = inner ? inner->data : NULL;
+    uint32_t inner_nulls = inner ? inner->nulls : 0;
+
+    out->data = join->row;
+    out->nulls = 0;
+    if (join->swapped) {
+        join_copy_side(join->row, inner_schema, inner_data, inner_nulls, ROW_HEADER_SIZE, 0, out);
+        join_copy_side(join->row, outer_schema, outer, outer_nulls, inner_schema->row_size,
+                       inner_schema->column_count, out);
+    } else {
+        join_copy_side(join->row, outer_schema, outer, outer_nulls, ROW_HEADER_SIZE, 0, out);
+        join_copy_side(join->row, inner_schema, inner_data, inner_nulls, outer_schema->row_size,
+                       outer_schema->column_count, out);
+    }
+}
+
+static void join_mark_matched(JoinOp* join, uint64_t position) {
+    if (position / 8 >= join->matched_bytes) {
+        uint64_t bytes = join->matched_bytes ? join->matched_bytes * 2 : 1024;
+        while (position / 8 >= bytes) bytes *= 2;
+        join->matched = SAFE_REALLOC(join->matched, uint8_t, bytes);
+        memset(join->matched + join->matched_bytes, 0, bytes - join->matched_bytes);
+        join->matched_bytes = bytes;
+    }
+    join->matched[position / 8] |= (uint8_t)(1 << (position % 8));
+}
+
+static bool join_was_matched(JoinOp* join, uint64_t position) {
+    return position / 8 < join->matched_bytes && (join->matched[position / 8] & (1 << (position % 8)));
+}
+
+// Starts looking for the partners of a new outer row. A merge join lines
+// up its inner side in join_next, as that may emit unmatched inner rows.
+static void join_start_outer(JoinOp* join) {
+    TableSchema* schema = join->outer->schema;
+    ColumnDef* key = &schema->columns[join->outer_column];
+    const uint8_t* value = join->outer_row + schema->column_offsets[join->outer_column];
+    bool null_key = join->outer_nulls & (1u << join->outer_column);
+
+    switch (join->strategy) {
+        case JOIN_NESTED_LOOP:
+            join_rewind_inner(join);
+            return;
+        case JOIN_HASH:
+            join->probe_next = 0;
+            if (null_key) return;
+            join->probe_hash = join_key_hash(key, value);
+            join->probe_next = join->buckets[join->probe_hash & join->bucket_mask];
+            return;
+        case JOIN_INDEX:
+            index_scan_close(&join->probe);
+            if (null_key) return;
+            if (encode_join_key(&join->inner->schema->columns[join->inner_column], key, value, join->probe.low)) {
+                index_scan_open(join->base.ctx->sm, &join->probe);
+            }
+            return;
+        case JOIN_MERGE:
+            join->positioned = false;
+            return;
+    }
+}
+
+// Reads the inner row after the group into the lookahead, unless it holds
+// one already; false at the end of the inner input
+static bool merge_read_inner(JoinOp* join) {
+    if (join->lookahead) return true;
+    if (join->inner_done) return false;
+
+    Tuple in;
+    if (!join->inner->next(join->inner, &in)) {
+        join->inner_done = true;
+        return false;
+    }
+    memcpy(join->inner_row, in.data, join->inner->schema->row_size);
+    join->lookahead_nulls = in.nulls;
+    join->lookahead = true;
+    return true;
+}
+
+// Lines the inner side of a merge join up with the current outer row: the
+// group becomes the inner rows with its key, read past those with smaller
+// (or NULL) keys. As both inputs are ascending, a group is only dropped for
+// a larger key. Returns true with an inner row nobody matched, when the
+// inner side is kept, before it is done.
+static bool merge_position(JoinOp* join, Tuple* unmatched) {
+    TableSchema* outer_schema = join->outer->schema;
+    TableSchema* inner_schema = join->inner->schema;
+    ColumnDef* outer_key = &outer_schema->columns[join->outer_column];
+    ColumnDef* inner_key = &inner_schema->columns[join->inner_column];
+    const uint8_t* key = join->outer_row + outer_schema->column_offsets[join->outer_column];
+    uint32_t inner_key_offset = inner_schema->column_offsets[join->inner_column];
+    bool keep_inner = join->type == JOIN_RIGHT || join->type == JOIN_FULL;
+
+    join->probe_next = 0;
+    if (join->outer_nulls & (1u << join->outer_column)) {
+        join->positioned = true;
+        return false;
+    }
+
+    if (join->record_count > 0) {
+        Tuple first;
+        join_record(join, 0, &first);
+        if (join_keys_compare(outer_key, key, inner_key, first.data + inner_key_offset) == 0) {
+            join->positioned = true;
+            join->probe_next = 1;
+            return false;
+        }
+        while (join->inner_position < join->record_count) {
+            uint32_t i = (uint32_t)join->inner_position++;
+            if (keep_inner && !join_was_matched(join, i)) {
+                join_record(join, i, unmatched);
+                return true;
+            }
+        }
+        join->record_count = 0;
+        join->inner_position = 0;
+        if (join->matched) memset(join->matched, 0, join->matched_bytes);
+    }
+
+    while (merge_read_inner(join)) {
+        bool null_key = join->lookahead_nulls & (1u << join->inner_column);
+        if (!null_key && join_keys_compare(outer_key, key, inner_key, join->inner_row + inner_key_offset) <= 0) break;
+        join->lookahead = false;
+        if (keep_inner) {
+            unmatched->data = join->inner_row;
+            unmatched->nulls = join->lookahead_nulls;
+            return true;
+        }
+    }
+    while (merge_read_inner(join) &&
+           join_keys_compare(outer_key, key, inner_key, join->inner_row + inner_key_offset) == 0) {
+        join_record_add(join, join->lookahead_nulls, join->inner_row);
+        join->lookahead = false;
+    }
+
+    join->positioned = true;
+    join->probe_next = join->record_count > 0 ? 1 : 0;
+    return false;
+}
+
+// Next inner row that may pair with the current outer row, and its
+// position for the matched bits: a nested loop tries every inner row, a
+// hash join the records of the outer key's bucket with the same hash, an
+// index nested loop the rows the index lookup finds, and a merge join the
+// records of the group
+static bool join_next_candidate(JoinOp* join, Tuple* inner, uint64_t* position) {
+    if (join->strategy == JOIN_NESTED_LOOP) {
+        if (!join->inner->next(join->inner, inner)) return false;
+        *position = join->inner_position++;
+        return true;
+    }
+
+    if (join->strategy == JOIN_INDEX) {
+        TableAccess* access = (TableAccess*)join->inner;
+        uint8_t entry[BTREE_MAX_KEY_SIZE];
+        RID rid;
+        while (index_scan_next(&join->probe, entry, &rid)) {
+            uint8_t* row = fetch_row(join->base.ctx->sm, join->inner->schema, rid);
+            if (row && row_matches(&access->filter, row)) {
+                inner->data = row;
+                inner->nulls = 0;
+                *position = 0; // unmatched inner rows are never kept
+                return true;
+            }
+        }
+        index_scan_close(&join->probe);
+        return false;
+    }
+
+    if (join->strategy == JOIN_MERGE) {
+        if (join->probe_next == 0 || join->probe_next > join->record_count) return false;
+        uint32_t i = join->probe_next++ - 1;
+        join_record(join, i, inner);
+        *position = i;
+        return true;
+    }
+
+    while (join->probe_next != 0) {
+        uint32_t i = join->probe_next - 1;
+        join->probe_next = join->chain[i];
+        if (join->hashes[i] == join->probe_hash) {
+            join_record(join, i, inner);
+            *position = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Next inner row that no outer row matched, for RIGHT and FULL joins. A
+// merge join has the rest of its group, then the inner rows never read
+// into a group.
+static bool join_next_unmatched(JoinOp* join, Tuple* inner) {
+    if (join->strategy == JOIN_MERGE) {
+        while (join->inner_position < join->record_count) {
+            uint32_t i = (uint32_t)join->inner_position++;
+            if (!join_was_matched(join, i)) {
+                join_record(join, i, inner);
+                return true;
+            }
+        }
+        if (!merge_read_inner(join)) return false;
+        join->lookahead = false;
+        inner->data = join->inner_row;
+        inner->nulls = join->lookahead_nulls;
+        return true;
+    }
+
+    while (true) {
+        uint64_t position = join->inner_position;
+        if (join->strategy == JOIN_NESTED_LOOP) {
+            if (!join->inner->next(join->inner, inner)) return false;
+        } else {
+            if (position == join->record_count) return false;
+            join_record(join, (uint32_t)position, inner);
+        }
+        join->inner_position++;
+        if (!join_was_matched(join, position)) return true;
+    }
+}
+
+// Reads the next outer row into outer_row: from the outer input, or in a
+// grace hash join from the current partition
+static bool join_read_outer(JoinOp* join) {
+    uint32_t row_size = join->outer->schema->row_size;
+    if (join->partition_count > 0) {
+        SpillFile* part = join->outer_parts[join->partition];
+        return spill_read(part, &join->outer_nulls, sizeof(uint32_t)) &&
+               spill_read(part, join->outer_row, row_size);
+    }
+
+    Tuple outer;
+    if (!join->outer->next(join->outer, &outer)) return false;
+    memcpy(join->outer_row, outer.data, row_size);
+    join->outer_nulls = outer.nulls;
+    return true;
+}
+
+// Moves a grace hash join to its next pair of partitions; false when
+// there is none
+static bool join_next_partition(JoinOp* join) {
+    if (join->partition + 1 >= join->partition_count) return false;
+
+    spill_free(join->outer_parts[join->partition]);
+    join->outer_parts[join->partition] = NULL;
+    join->partition++;
+    if (!hash_join_load_partition(join)) {
+        fail(join->base.ctx, "Join: cannot read temporary pages");
+        return false;
+    }
+    if (join->matched) memset(join->matched, 0, join->matched_bytes);
+    join->finishing = false;
+    return true;
+}
+
+static bool join_next(Operator* op, Tuple* out) {
+    JoinOp* join = (JoinOp*)op;
+    TableSchema* outer_schema = join->outer->schema;
+    TableSchema* inner_schema = join->inner->schema;
+    ColumnDef* outer_key = &outer_schema->columns[join->outer_column];
+    ColumnDef* inner_key = &inner_schema->columns[join->inner_column];
+    uint32_t outer_key_offset = outer_schema->column_offsets[join->outer_column];
+    uint32_t inner_key_offset = inner_schema->column_offsets[join->inner_column];
+    bool keep_inner = join->type == JOIN_RIGHT || join->type == JOIN_FULL;
+    bool keep_outer = join->type == JOIN_LEFT || join->type == JOIN_FULL;
+    Tuple inner;
+
+    while (true) {
+        if (join->finishing) {
+            if (join_next_unmatched(join, &inner)) {
+                join_emit(join, NULL, 0, &inner, out);
+                return true;
+            }
+            if (!join_next_partition(join)) return false;
+            continue;
+        }
+
+        if (!join->have_outer) {
+            if (!join_read_outer(join)) {
+                if (keep_inner) {
+                    if (join->strategy == JOIN_NESTED_LOOP) join_rewind_inner(join);
+                    if (join->strategy != JOIN_MERGE) join->inner_position = 0;
+                    join->finishing = true;
+                    continue;
+                }
+                if (!join_next_partition(join)) return false;
+                continue;
+            }
+            join->have_outer = true;
+            join->outer_matched = false;
+            join_start_outer(join);
+        }
+        if (join->strategy == JOIN_MERGE && !join->positioned && merge_position(join, &inner)) {
+            join_emit(join, NULL, 0, &inner, out);
+            return true;
+        }
+
+        bool outer_null = join->outer_nulls & (1u << join->outer_column);
+        uint64_t position;
+        while (!outer_null && join_next_candidate(join, &inner, &position)) {
+            if (inner.nulls & (1u << join->inner_column)) continue;
+            if (!join_keys_equal(outer_key, join->outer_row + outer_key_offset,
+                                 inner_key, inner.data + inner_key_offset)) {
+                continue;
+            }
+
+            join->outer_matched = true;
+            if (keep_inner) join_mark_matched(join, position);
+            join_emit(join, join->outer_row, join->outer_nulls, &inner, out);
+            return true;
+        }
+
+        join->have_outer = false;
+        if (!join->outer_matched && keep_outer) {
+            join_emit(join, join->outer_row, join->outer_nulls, NULL, out);
+            return true;
+        }
+    }
+}
+
+static void join_close(Operator* op) {
+    JoinOp* join = (JoinOp*)op;
+    join->outer->close(join->outer);
+    switch (join->strategy) {
+        case JOIN_HASH:
+            hash_join_free(join); // the inner input was closed after the build
+            break;
+        case JOIN_INDEX:
+            index_scan_close(&join->probe);
+            break;
+        case JOIN_MERGE:
+            join->inner->close(join->inner);
+            hash_join_free(join); // the group's records
+            break;
+        default:
+            join->inner->close(join->inner);
+            break;
+    }
+}
+
+static const char* join_type_name(JoinType type) {
+    switch (type) {
+        case JOIN_LEFT: return "LEFT";
+        case JOIN_RIGHT: return "RIGHT";
+        case JOIN_FULL: return "FULL";
+        default: return "INNER";
+    }
+}
+
+static const char* join_strategy_name(JoinStrategy strategy) {
+    switch (strategy) {
+        case JOIN_HASH: return "Hash";
+        case JOIN_INDEX: return "Index nested loop";
+        case JOIN_MERGE: return "Merge";
+        default: return "Nested loop";
+    }
+}
+
+// The inner input is listed second; a hash join builds its table from it.
+// An index nested loop join shows the lookups it makes instead.
+static void join_explain(Operator* op, QueryResult* plan, uint32_t depth) {
+    JoinOp* join = (JoinOp*)op;
+    TableSchema* outer = join->outer->schema;
+    TableSchema* inner = join->inner->schema;
+    explain_line(plan, depth, op, "%s %s join on %s.%s = %s.%s", join_strategy_name(join->strategy),
+                 join_type_name(join->type), outer->name, outer->columns[join->outer_column].name,
+                 inner->name, inner->columns[join->inner_column].name);
+    join->outer->explain(join->outer, plan, depth + 1);
+    if (join->strategy == JOIN_INDEX) {
+        char where[EXPLAIN_LINE_SIZE];
+        format_access_where((TableAccess*)join->inner, where, sizeof(where));
+        explain_line(plan, depth + 1, NULL, "Index lookup on %s using %s%s", inner->name,
+                     join->probe.index ? join->probe.index->name : join->probe.hash->name, where);
+    } else {
+        join->inner->explain(join->inner, plan, depth + 1);
+    }
+}
+
+static void join_destroy(Operator* op) {
+    JoinOp* join = (JoinOp*)op;
+    operator_free(join->outer);
+    operator_free(join->inner);
+    hash_join_free(join);
+    SAFE_FREE(join->outer_row);
+    SAFE_FREE(join->inner_row);
+    SAFE_FREE(join->matched);
+    SAFE_FREE(join->row);
+    SAFE_FREE(op->schema);
+    SAFE_FREE(join);
+}
+
+// Output rows hold the left table's columns, then the right one's, named
+// table.column; the left table is the outer input unless `swapped`. An
+// index nested loop join needs a table access with an index on the join
+// column as its inner input (join_index_scan), a merge join inputs sorted
+// on the join columns.
+static Operator* join_create(Operator* outer, Operator* inner, JoinStrategy strategy, JoinType type,
+                             uint32_t outer_column, uint32_t inner_column, bool swapped) {
+    JoinOp* join = SAFE_CALLOC(JoinOp, 1);
+    Operator* op = &join->base;
+    op->schema = SAFE_CALLOC(TableSchema, 1);
+    op->ctx = outer->ctx;
+    op->open = join_open;
+    op->next = join_next;
+    op->close = join_close;
+    op->destroy = join_destroy;
+    op->explain = join_explain;
+    op->rows = op->cost = -1;
+
+    join->outer = outer;
+    join->inner = inner;
+    join->strategy = strategy;
+    join->type = type;
+    join->swapped = swapped;
+    join->outer_column = outer_column;
+    join->inner_column = inner_column;
+    join->record_size = sizeof(uint32_t) + inner->schema->row_size;
+    if (strategy == JOIN_INDEX) join_index_scan((TableAccess*)inner, inner_column, &join->probe);
+
+    TableSchema* sides[2] = { outer->schema, inner->schema };
+    if (swapped) {
+        sides[0] = inner->schema;
+        sides[1] = outer->schema;
+    }
+    for (uint32_t side = 0; side < 2; side++) {
+        for (uint32_t i = 0; i < sides[side]->column_count; i++) {
+            char name[MAX_TABLE_NAME + MAX_COLUMN_NAME];
+            snprintf(name, sizeof(name), "%s.%s", sides[side]->name, sides[side]->columns[i].name);
+            add_column(op->schema, &sides[side]->columns[i], name);
+        }
+    }
+    compute_column_layout(op->schema);
+    join->outer_row = SAFE_MALLOC(uint8_t, outer->schema->row_size);
+    join->inner_row = SAFE_MALLOC(uint8_t, inner->schema->row_size);
+    join->row = SAFE_CALLOC(uint8_t, op->schema->row_size);
+    return op;
+}
+
+// Sort: drains the child into an external sort. Records are the NULL
+// mask followed by the row. NULLs sort first.
+typedef struct {
+    Operator base;
+    Operator* child;
+    uint32_t key_count;
+    uint32_t keys[MAX_SORT_COLUMNS];
+    bool descending[MAX_SORT_COLUMNS];
+    ExternalSort* sort;
+    uint8_t* record;
+} SortOp;
+
+static int sort_compare(const void* a, const void* b, void* context) {
+    SortOp* sort = (SortOp*)context;
+    TableSchema* schema = sort->base.schema;
+    uint32_t a_nulls, b_nulls;
+    memcpy(&a_nulls, a, sizeof(uint32_t));
+    memcpy(&b_nulls, b, sizeof(uint32_t));
+    const uint8_t* a_row = (const uint8_t*)a + sizeof(uint32_t);
+    const uint8_t* b_row = (const uint8_t*)b + sizeof(uint32_t);
+
+    for (uint32_t k = 0; k < sort->key_count; k++) {
+        uint32_t col = sort->keys[k];
+        bool a_null = a_nulls & (1u << col);
+        bool b_null = b_nulls & (1u << col);
+        int cmp;
+        if (a_null || b_null) {
+            cmp = a_null == b_null ? 0 : (a_null ? -1 : 1);
+        } else {
+            uint32_t offset = schema->column_offsets[col];
+            cmp = compare_column_values(&schema->columns[col], a_row + offset, b_row + offset);
+        }
+        if (cmp != 0) return sort->descending[k] ? -cmp : cmp;
+    }
+    return 0;
+}
+
+static void sort_open(Operator* op) {
+    SortOp* sort = (SortOp*)op;
+    size_t record_size = sizeof(uint32_t) + op->schema->row_size;
+
+    sort->child->open(sort->child);
+    sort->sort = extsort_create(record_size, sort_compare, sort, op->ctx->memory_budget);
+
+    Tuple in;
+    bool ok = sort->sort != NULL;
+    while (ok && sort->child->next(sort->child, &in)) {
+        memcpy(sort->record, &in.nulls, sizeof(uint32_t));
+        memcpy(sort->record + sizeof(uint32_t), in.data, op->schema->row_size);
+        ok = extsort_add(sort->sort, sort->record);
+    }
+    ok = ok && extsort_finish(sort->sort);
+    sort->child->close(sort->child);
+
+    if (!ok) {
+        fail(op->ctx, "Sort failed: cannot write temporary file");
+        extsort_free(sort->sort);
+        sort->sort = NULL;
+    }
+}
+
+static bool sort_next(Operator* op, Tuple* out) {
+    SortOp* sort = (SortOp*)op;
+    if (!sort->sort || !extsort_next(sort->sort, sort->record)) return false;
+
+    memcpy(&out->nulls, sort->record, sizeof(uint32_t));
+    out->data = sort->record + sizeof(uint32_t);
+    return true;
+}
+
+static void sort_close(Operator* op) {
+    SortOp* sort = (SortOp*)op;
+    if (sort->sort) extsort_free(sort->sort);
+    sort->sort = NULL;
+}
+
+// Column names of `count` columns of the schema, with ordering flags
+static void format_columns(TableSchema* schema, const uint32_t* columns, const bool* descending, uint32_t count,
+                           char* out, size_t size) {
+    size_t length = 0;
+    out[0] = '\0';
+    for (uint32_t i = 0; i < count && length < size; i++) {
+        length += (size_t)snprintf(out + length, size - length, "%s%s%s", i > 0 ? ", " : "",
+                                   schema->columns[columns[i]].name, descending && descending[i] ? " DESC" : "");
+    }
+}
+
+static void sort_explain(Operator* op, QueryResult* plan, uint32_t depth) {
+    SortOp* sort = (SortOp*)op;
+    char keys[EXPLAIN_LINE_SIZE];
+    format_columns(op->schema, sort->keys, sort->descending, sort->key_count, keys, sizeof(keys));
+    explain_line(plan, depth, op, "Sort by %s", keys);
+    sort->child->explain(sort->child, plan, depth + 1);
+}
+
+static void sort_destroy(Operator* op) {
+    SortOp* sort = (SortOp*)op;
+    operator_free(sort->child);
+    SAFE_FREE(sort->record);
+    SAFE_FREE(op->schema);
+    SAFE_FREE(sort);
+}
+
+static Operator* sort_create(Operator* child, const uint32_t* keys, const bool* descending, uint32_t key_count) {
+    SortOp* sort = SAFE_CALLOC(SortOp, 1);
+    Operator* op = &sort->base;
+    op->schema = copy_schema(child->schema);
+    op->ctx = child->ctx;
+    op->open = sort_open;
+    op->next = sort_next;
+    op->close = sort_close;
+    op->destroy = sort_destroy;
+    op->explain = sort_explain;
+    op->rows = op->cost = -1;
+    if (has_estimates(child)) {
+        // Comparisons of an in-memory sort; runs spilled to disk are not counted
+        op->rows = child->rows;
+        op->cost = child->cost + child->rows * log2(child->rows + 2) * key_count * COST_CONDITION;
+    }
+
+    sort->child = child;
+    sort->key_count = key_count;
+    for (uint32_t k = 0; k < key_count; k++) {
+        sort->keys[k] = keys[k];
+        sort->descending[k] = descending ? descending[k] : false;
+    }
+    sort->record = SAFE_MALLOC(uint8_t, sizeof(uint32_t) + op->schema->row_size);
+    return op;
+}
+
+// Aggregate over input sorted on the group columns: a group ends where the
+// group columns change, so only the current group's state is kept. Without
+// group columns the whole input is one group, and an empty input still
+// gives one row (COUNT 0, the other aggregates NULL).
+typedef struct {
+    AggregateType type;
+    int column; // input column, -1 for COUNT(*)
+    uint64_t count; // rows (COUNT(*)) or non-NULL values seen
+    int64_t int_sum;
+    double sum;
+} AggregateState;
+
+typedef struct {
+    Operator base;
+    Operator* child;
+    uint32_t group_count;
+    uint32_t groups[MAX_SORT_COLUMNS];
+    uint32_t aggregate_count;
+    AggregateState aggregates[MAX_COLUMNS];
+    uint8_t* pending; // first row of the next group
+    uint32_t pending_nulls;
+    bool has_pending;
+    bool done;
+    bool emitted;
+    uint8_t* row;
+    uint32_t row_nulls;
+} AggregateOp;
+
+static void aggregate_open(Operator* op) {
+    AggregateOp* agg = (AggregateOp*)op;
+    agg->child->open(agg->child);
+    agg->has_pending = agg->done = agg->emitted = false;
+}
+
+static bool same_group(AggregateOp* agg, const Tuple* in) {
+    TableSchema* input = agg->child->schema;
+    for (uint32_t g = 0; g < agg->group_count; g++) {
+        uint32_t col = agg->groups[g];
+        uint32_t bit = 1u << col;
+        if ((agg->pending_nulls & bit) != (in->nulls & bit)) return false;
+        if (in->nulls & bit) continue;
+
+        uint32_t offset = input->column_offsets[col];
+        if (memcmp(agg->pending + offset, in->data + offset, input->column_sizes[col]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Starts a group from the pending row: copies its group columns out and
+// clears the accumulators
+static void aggregate_begin(AggregateOp* agg) {
+    TableSchema* input = agg->child->schema;
+    agg->row_nulls = 0;
+    for (uint32_t g = 0; g < agg->group_count; g++) {
+        uint32_t col = agg->groups[g];
+        memcpy(agg->row + agg->base.schema->column_offsets[g], agg->pending + input->column_offsets[col],
+               input->column_sizes[col]);
+        if (agg->pending_nulls & (1u << col)) agg->row_nulls |= 1u << g;
+    }
+    for (uint32_t a = 0; a < agg->aggregate_count; a++) {
+        agg->aggregates[a].count = 0;
+        agg->aggregates[a].int_sum = 0;
+        agg->aggregates[a].sum = 0;
+    }
+}
+
+static void aggregate_add(AggregateOp* agg, const uint8_t* data, uint32_t nulls) {
+    TableSchema* input = agg->child->schema;
+    TableSchema* output = agg->base.schema;
+
+    for (uint32_t a = 0; a < agg->aggregate_count; a++) {
+        AggregateState* state = &agg->aggregates[a];
+        if (state->column < 0) {
+            state->count++;
+            continue;
+        }
+        if (nulls & (1u << state->column)) continue;
+
+        ColumnDef* column = &input->columns[state->column];
+        const uint8_t* value = data + input->column_offsets[state->column];
+        uint8_t* result = agg->row + output->column_offsets[agg->group_count + a];
+
+        switch (state->type) {
+            case AGG_SUM:
+            case AGG_AVG:
+                if (column->type == DT_INT) {
+                    int i;
+                    memcpy(&i, value, sizeof(int));
+                    state->int_sum += i;
+                }
+                state->sum += numeric_value(column, value);
+                break;
+            case AGG_MIN:
+            case AGG_MAX: {
+                int cmp = state->count == 0 ? 0 : compare_column_values(column, value, result);
+                if (state->count == 0 || (state->type == AGG_MIN ? cmp < 0 : cmp > 0)) {
+                    memcpy(result, value, input->column_sizes[state->column]);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        state->count++;
+    }
+}
+
+// Writes the aggregates of the finished group into the output row
+static void aggregate_finish(AggregateOp* agg, Tuple* out) {
+    TableSchema* output = agg->base.schema;
+
+    for (uint32_t a = 0; a < agg->aggregate_count; a++) {
+        AggregateState* state = &agg->aggregates[a];
+        uint32_t col = agg->group_count + a;
+        uint8_t* result = agg->row + output->column_offsets[col];
+
+        if (state->type == AGG_COUNT) {
+            int count = (int)state->count;
+            memcpy(result, &count, sizeof(int));
+            continue;
+        }
+        if (state->count == 0) {
+            agg->row_nulls |= 1u << col;
+            continue;
+        }
+        if (state->type == AGG_SUM && output->columns[col].type == DT_INT) {
+            int sum = (int)state->int_sum;
+            memcpy(result, &sum, sizeof(int));
+        } else if (state->type == AGG_SUM || state->type == AGG_AVG) {
+            float value = (float)(state->type == AGG_AVG ? state->sum / state->count : state->sum);
+            memcpy(result, &value, sizeof(float));
+        }
+    }
+
+    out->data = agg->row;
+    out->nulls = agg->row_nulls;
+    agg->emitted = true;
+}
+
+static bool aggregate_next(Operator* op, Tuple* out) {
+    AggregateOp* agg = (AggregateOp*)op;
+    TableSchema* input = agg->child->schema;
+    Tuple in;
+
+    if (agg->done) return false;
+    if (!agg->has_pending) {
+        if (!agg->child->next(agg->child, &in)) {
+            agg->done = true;
+            if (agg->group_count > 0 || agg->emitted) return false;
+
+            // Aggregates over no rows at all
+            memset(agg->row, 0, op->schema->row_size);
+            aggregate_begin(agg);
+            aggregate_finish(agg, out);
+            return true;
+        }
+        memcpy(agg->pending, in.data, input->row_size);
+        agg->pending_nulls = in.nulls;
+        agg->has_pending = true;
+    }
+
+    aggregate_begin(agg);
+    aggregate_add(agg, agg->pending, agg->pending_nulls);
+    while (agg->child->next(agg->child, &in)) {
+        if (!same_group(agg, &in)) {
+            aggregate_finish(agg, out);
+            memcpy(agg->pending, in.data, input->row_size);
+            agg->pending_nulls = in.nulls;
+            return true;
+        }
+        aggregate_add(agg, in.data, in.nulls);
+    }
+
+    agg->has_pending = false;
+    agg->done = true;
+    aggregate_finish(agg, out);
+    return true;
+}
+
+static void aggregate_close(Operator* op) {
+    AggregateOp* agg = (AggregateOp*)op;
+    agg->child->close(agg->child);
+}
+
+static void aggregate_explain(Operator* op, QueryResult* plan, uint32_t depth) {
+    AggregateOp* agg = (AggregateOp*)op;
+    uint32_t columns[MAX_COLUMNS];
+    char aggregates[EXPLAIN_LINE_SIZE / 2];
+    char groups[EXPLAIN_LINE_SIZE / 2];
+
+    for (uint32_t a = 0; a < agg->aggregate_count; a++) columns[a] = agg->group_count + a;
+    format_columns(op->schema, columns, NULL, agg->aggregate_count, aggregates, sizeof(aggregates));
+    if (agg->group_count == 0) {
+        explain_line(plan, depth, op, "Aggregate %s", aggregates);
+    } else {
+        format_columns(agg->child->schema, agg->groups, NULL, agg->group_count, groups, sizeof(groups));
+        explain_line(plan, depth, op, "Aggregate %s group by %s", aggregates, groups);
+    }
+    agg->child->explain(agg->child, plan, depth + 1);
+}
+
+static void aggregate_destroy(Operator* op) {
+    AggregateOp* agg = (AggregateOp*)op;
+    operator_free(agg->child);
+    SAFE_FREE(agg->pending);
+    SAFE_FREE(agg->row);
+    SAFE_FREE(op->schema);
+    SAFE_FREE(agg);
+}
+
+#define ESTIMATED_GROUPS 200
+
+// Output rows hold the group columns, then one column per aggregate,
+// named names[a]. COUNT gives an INT, AVG a FLOAT, SUM the column's
+// numeric type and MIN/MAX the column's own type.
+static Operator* aggregate_create(Operator* child, const uint32_t* groups, uint32_t group_count,
+                                  const AggregateType* types, const int* columns,
+                                  char names[][MAX_COLUMN_NAME], uint32_t aggregate_count) {
+    AggregateOp* agg = SAFE_CALLOC(AggregateOp, 1);
+    Operator* op = &agg->base;
+    TableSchema* input = child->schema;
+    op->schema = SAFE_CALLOC(TableSchema, 1);
+    op->ctx = child->ctx;
+    op->open = aggregate_open;
+    op->next = aggregate_next;
+    op->close = aggregate_close;
+    op->destroy = aggregate_destroy;
+    op->explain = aggregate_explain;
+    op->rows = op->cost = -1;
+    if (has_estimates(child)) {
+        // Without per-column statistics above the scan, assume a fixed
+        // number of groups
+        op->rows = group_count == 0 ? 1 : (child->rows < ESTIMATED_GROUPS ? child->rows : ESTIMATED_GROUPS);
+        op->cost = child->cost + child->rows * (group_count + aggregate_count) * COST_CONDITION;
+    }
+
+    agg->child = child;
+    agg->group_count = group_count;
+    for (uint32_t g = 0; g < group_count; g++) {
+        agg->groups[g] = groups[g];
+        add_column(op->schema, &input->columns[groups[g]], input->columns[groups[g]].name);
+    }
+
+    agg->aggregate_count = aggregate_count;
+    for (uint32_t a = 0; a < aggregate_count; a++) {
+        agg->aggregates[a].type = types[a];
+        agg->aggregates[a].column = columns[a];
+
+        ColumnDef column;
+        memset(&column, 0, sizeof(ColumnDef));
+
+        if (types[a] == AGG_MIN || types[a] == AGG_MAX) {
+            column = input->columns[columns[a]];
+        } else if (types[a] == AGG_COUNT) {
+            column.type = DT_INT;
+        } else if (types[a] == AGG_SUM && input->columns[columns[a]].type == DT_INT) {
+            column.type = DT_INT;
+        } else {
+            column.type = DT_FLOAT;
+        }
+        column.is_primary = column.is_unique = false;
+        add_column(op->schema, &column, names[a]);
+    }
+
+    compute_column_layout(op->schema);
+    agg->pending = SAFE_MALLOC(uint8_t, input->row_size);
+    agg->row = SAFE_CALLOC(uint8_t, op->schema->row_size);
+    return op;
+}
+
+// Limit: stops after the first `limit` rows
+typedef struct {
+    Operator base;
+    Operator* child;
+    uint32_t limit;
+    uint32_t returned;
+} LimitOp;
+
+static void limit_open(Operator* op) {
+    LimitOp* limit = (LimitOp*)op;
+    limit->child->open(limit->child);
+    limit->returned = 0;
+}
+
+static bool limit_next(Operator* op, Tuple* out) {
+    LimitOp* limit = (LimitOp*)op;
+    if (limit->returned >= limit->limit) return false;
+    if (!limit->child->next(limit->child, out)) return false;
+    limit->returned++;
+    return true;
+}
+
+static void limit_close(Operator* op) {
+    LimitOp* limit = (LimitOp*)op;
+    limit->child->close(limit->child);
+}
+
+static void limit_explain(Operator* op, QueryResult* plan, uint32_t depth) {
+    LimitOp* limit = (LimitOp*)op;
+    explain_line(plan, depth, op, "Limit %u", limit->limit);
+    limit->child->explain(limit->child, plan, depth + 1);
+}
+
+static void limit_destroy(Operator* op) {
+    LimitOp* limit = (LimitOp*)op;
+    operator_free(limit->child);
+    SAFE_FREE(op->schema);
+    SAFE_FREE(limit);
+}
+
+static Operator* limit_create(Operator* child, uint32_t count) {
+    LimitOp* limit = SAFE_CALLOC(LimitOp, 1);
+    Operator* op = &limit->base;
+    op->schema = copy_schema(child->schema);
+    op->ctx = child->ctx;
+    op->open = limit_open;
+    op->next = limit_next;
+    op->close = limit_close;
+    op->destroy = limit_destroy;
+    op->explain = limit_explain;
+    op->rows = child->rows < count ? child->rows : count;
+    op->cost = child->cost;
+
+    limit->child = child;
+    limit->limit = count;
+    return op;
+}
+
+// Nested loop cost: the inner input is read again for every outer row
+static double nested_loop_cost(const Operator* outer, const Operator* inner) {
+    double loops = outer->rows > 1 ? outer->rows : 1;
+    return outer->cost + loops * inner->cost + outer->rows * inner->rows * COST_CONDITION;
+}
+
+// Hash join cost: both inputs are read once, the inner one into the hash
+// table; every outer row hashes its key and every pair found is compared.
+// When the inner rows do not fit in the memory budget, both inputs are
+// also written to partitions and read back, in sequence.
+static double hash_join_cost(const Operator* outer, const Operator* inner, double rows) {
+    double cost = outer->cost + inner->cost + inner->rows * (COST_ROW + COST_CONDITION) +
+                  outer->rows * COST_CONDITION + rows * COST_CONDITION;
+    double inner_bytes = inner->rows * (sizeof(uint32_t) + inner->schema->row_size);
+    if (inner_bytes + inner->rows * HASH_JOIN_RECORD_OVERHEAD > outer->ctx->memory_budget) {
+        double outer_bytes = outer->rows * (sizeof(uint32_t) + outer->schema->row_size);
+        cost += 2 * (inner_bytes + outer_bytes) / PAGE_SIZE;
+    }
+    return cost;
+}
+
+// Index nested loop cost: the outer input is read once and every outer
+// row makes one index lookup, whose entries point to the rows with its key;
+// those are fetched and checked against the inner conditions
+static double index_join_cost(const Operator* outer, Operator* inner, uint32_t inner_column) {
+    TableAccess* access = (TableAccess*)inner;
+    const TableStats* stats = &access->stats;
+    IndexScan scan;
+    join_index_scan(access, inner_column, &scan);
+
+    double distinct = stats->columns[inner_column].distinct > 1 ? stats->columns[inner_column].distinct : 1;
+    double entries = outer->rows * stats->row_count / distinct;
+    double lookup = scan.index ? btree_cost(stats, scan.index, 0, true) : 2 * COST_RANDOM_PAGE;
+    return outer->cost + outer->rows * (lookup + COST_CONDITION) +
+           entries * (COST_INDEX_ENTRY + (access->filter.count + 1) * COST_CONDITION) + fetch_cost(stats, entries);
+}
+
+// An input of a merge join: a B+tree scan in key order comes as it is,
+// anything else is sorted first, through temporary pages when it does not
+// fit in the memory budget
+static double merge_input_cost(Operator* input, uint32_t column) {
+    if (access_ordered_on(input, column)) return input->cost;
+    return input->cost + sort_cost(input, 1);
+}
+
+// Merge join cost: both inputs in key order, read once side by side
+static double merge_join_cost(Operator* outer, Operator* inner, uint32_t outer_column, uint32_t inner_column,
+                              double rows) {
+    return merge_input_cost(outer, outer_column) + merge_input_cost(inner, inner_column) +
+           (outer->rows + inner->rows) * COST_CONDITION + rows * COST_CONDITION;
+}
+
+// Distinct join key values a table access returns, at most one per row
+static double join_key_distinct(Operator* op, uint32_t column) {
+    TableAccess* access = (TableAccess*)op;
+    double distinct = access->stats.columns[column].distinct;
+    if (distinct > op->rows) distinct = op->rows;
+    return distinct > 1 ? distinct : 1;
+}
+
+// Rows of an equi-join, taking the smaller key set as contained in the
+// larger one: every key of the smaller set finds its partners. Outer
+// joins also return the unmatched rows of the preserved side(s).
+static double join_rows(const Operator* left, const Operator* right, double left_keys, double right_keys,
+                        JoinType type) {
+    double rows = left->rows * right->rows / (left_keys > right_keys ? left_keys : right_keys);
+    double preserved = 0;
+    if (type == JOIN_LEFT || type == JOIN_FULL) preserved = left->rows;
+    if ((type == JOIN_RIGHT || type == JOIN_FULL) && right->rows > preserved) preserved = right->rows;
+    return rows > preserved ? rows : preserved;
+}
+
+// The join type with the two inputs exchanged
+static JoinType mirror_join(JoinType type) {
+    if (type == JOIN_LEFT) return JOIN_RIGHT;
+    if (type == JOIN_RIGHT) return JOIN_LEFT;
+    return type;
+}
+
+static JoinStrategy hinted_strategy(JoinMethod method) {
+    switch (method) {
+        case JOIN_METHOD_LOOP: return JOIN_NESTED_LOOP;
+        case JOIN_METHOD_MERGE: return JOIN_MERGE;
+        case JOIN_METHOD_INDEX: return JOIN_INDEX;
+        default: return JOIN_HASH;
+    }
+}
+
+// An index nested loop join looks every outer key up in the inner table,
+// so it cannot return the inner rows nobody matched
+static bool index_join_possible(Operator* inner, uint32_t inner_column, JoinType type) {
+    IndexScan scan;
+    return (type == JOIN_INNER || type == JOIN_LEFT) &&
+           join_index_scan((TableAccess*)inner, inner_column, &scan);
+}
+
+// Builds the two table accesses of a join and the join itself. WHERE
+// conditions on one table are evaluated by its access (where an index can
+// serve them) unless that side is NULL padded by the join; the others are
+// left in `residual` for a filter above the join. When both tables were
+// analyzed, the cheapest strategy and join order is taken, among those of
+// the strategy asked for with USING if any. Without statistics the right
+// table is hashed, or the hinted strategy runs in the first order it can.
+static Operator* plan_join(ExecContext* ctx, SQLStatement* stmt, WhereClause* residual,
+                           uint32_t* residual_count, char** error) {
+    JoinClause* clause = &stmt->join_clause;
+    TableSchema* left = load_schema(ctx->sm, clause->left_table);
+    TableSchema* right = load_schema(ctx->sm, clause->right_table);
+    if (!left || !right) {
+        *error = SAFE_STRDUP("One or both tables not found");
+        SAFE_FREE(left);
+        SAFE_FREE(right);
+        return NULL;
+    }
+    if (left->column_count + right->column_count > MAX_COLUMNS) {
+        *error = SAFE_STRDUP("Too many columns in join");
+        SAFE_FREE(left);
+        SAFE_FREE(right);
+        return NULL;
+    }
+
+    // The parser drops the table names of the ON columns; accept them in
+    // either order
+    int left_column = find_column(left, clause->on_left);
+    int right_column = find_column(right, clause->on_right);
+    if (left_column < 0 || right_column < 0) {
+        left_column = find_column(left, clause->on_right);
+        right_column = find_column(right, clause->on_left);
+    }
+    if (left_column < 0 || right_column < 0) {
+        *error = SAFE_STRDUP("Join columns not found");
+        SAFE_FREE(left);
+        SAFE_FREE(right);
+        return NULL;
+    }
+
+    bool push_left = clause->type == JOIN_INNER || clause->type == JOIN_LEFT;
+    bool push_right = clause->type == JOIN_INNER || clause->type == JOIN_RIGHT;
+    WhereClause left_conditions[MAX_WHERE_CONDITIONS];
+    WhereClause right_conditions[MAX_WHERE_CONDITIONS];
+    uint32_t left_count = 0, right_count = 0;
+    *residual_count = 0;
+
+    for (uint32_t i = 0; i < stmt->where_condition_count; i++) {
+        WhereClause* cond = &stmt->where_conditions[i];
+        int in_left = resolve_column(left, cond->column);
+        int in_right = resolve_column(right, cond->column);
+        const char* dot = strchr(cond->column, '.');
+
+        if (in_left >= 0 && (in_right < 0 || dot) && push_left) {
+            left_conditions[left_count] = *cond;
+            snprintf(left_conditions[left_count++].column, MAX_COLUMN_NAME, "%s", left->columns[in_left].name);
+        } else if (in_right >= 0 && (in_left < 0 || dot) && push_right) {
+            right_conditions[right_count] = *cond;
+            snprintf(right_conditions[right_count++].column, MAX_COLUMN_NAME, "%s",
+                     right->columns[in_right].name);
+        } else {
+            residual[(*residual_count)++] = *cond;
+        }
+    }
+
+    Operator* left_access = table_access_create(ctx, left, left_conditions, left_count, NULL, error);
+    if (!left_access) {
+        SAFE_FREE(right);
+        return NULL;
+    }
+    Operator* right_access = table_access_create(ctx, right, right_conditions, right_count, NULL, error);
+    if (!right_access) {
+        operator_free(left_access);
+        return NULL;
+    }
+
+    bool estimates = has_estimates(left_access) && has_estimates(right_access);
+    bool hinted = clause->method != JOIN_METHOD_AUTO;
+    double rows = -1;
+    if (estimates) {
+        rows = join_rows(left_access, right_access, join_key_distinct(left_access, (uint32_t)left_column),
+                         join_key_distinct(right_access, (uint32_t)right_column), clause->type);
+    }
+
+    JoinStrategy strategy = JOIN_HASH;
+    bool swapped = false;
+    bool found = false;
+    double cost = -1;
+    // Every strategy and order that can run the join, or only those of the
+    // hint; without estimates the first one is taken
+    for (int s = JOIN_NESTED_LOOP; s <= JOIN_MERGE && !(found && !estimates); s++) {
+        if (hinted ? s != (int)hinted_strategy(clause->method) : !estimates && s != JOIN_HASH) continue;
+
+        for (int swap = 0; swap < 2 && !(found && !estimates); swap++) {
+            Operator* outer = swap ? right_access : left_access;
+            Operator* inner = swap ? left_access : right_access;
+            uint32_t outer_column = (uint32_t)(swap ? right_column : left_column);
+            uint32_t inner_column = (uint32_t)(swap ? left_column : right_column);
+            JoinType type = swap ? mirror_join(clause->type) : clause->type;
+            if (s == JOIN_INDEX && !index_join_possible(inner, inner_column, type)) continue;
+
+            double candidate = 0;
+            if (estimates) {
+                switch ((JoinStrategy)s) {
+                    case JOIN_NESTED_LOOP: candidate = nested_loop_cost(outer, inner); break;
+                    case JOIN_HASH: candidate = hash_join_cost(outer, inner, rows); break;
+                    case JOIN_INDEX: candidate = index_join_cost(outer, inner, inner_column); break;
+                    case JOIN_MERGE:
+                        candidate = merge_join_cost(outer, inner, outer_column, inner_column, rows);
+                        break;
+                }
+            }
+            if (!found || candidate < cost) {
+                strategy = (JoinStrategy)s;
+                swapped = swap;
+                cost = candidate;
+                found = true;
+            }
+        }
+    }
+
+    if (!found) {
+        *error = SAFE_STRDUP("USING INDEX needs an index on the join column of a table whose unmatched "
+                             "rows are not kept");
+        operator_free(left_access);
+        operator_free(right_access);
+        return NULL;
+    }
+
+    Operator* outer = swapped ? right_access : left_access;
+    Operator* inner = swapped ? left_access : right_access;
+    uint32_t outer_column = (uint32_t)(swapped ? right_column : left_column);
+    uint32_t inner_column = (uint32_t)(swapped ? left_column : right_column);
+    if (strategy == JOIN_MERGE) {
+        if (!access_ordered_on(outer, outer_column)) outer = sort_create(outer, &outer_column, NULL, 1);
+        if (!access_ordered_on(inner, inner_column)) inner = sort_create(inner, &inner_column, NULL, 1);
+    }
+
+    Operator* join = join_create(outer, inner, strategy, swapped ? mirror_join(clause->type) : clause->type,
+                                 outer_column, inner_column, swapped);
+    if (estimates) {
+        join->rows = rows;
+        join->cost = cost + rows * COST_ROW;
+    }
+    return join;
+}
+
+static bool is_star(SQLStatement* stmt) {
+    return stmt->select_column_count == 1 && strcmp(stmt->select_columns[0], "*") == 0 &&
+           stmt->select_aggregates[0] == AGG_NONE;
+}
+
+// Builds the operator tree of a SELECT, bottom up:
+//   table access, or join of two accesses -> filter
+//     -> [sort on the group columns -> aggregate] -> [sort] -> [limit] -> project
+// Returns NULL with an error message when the statement does not bind.
+static Operator* plan_select(ExecContext* ctx, SQLStatement* stmt, char** error) {
+    Operator* op;
+    Operator* access = NULL; // the table access of a single-table query
+    bool needed[MAX_COLUMNS] = { false };
+
+    if (stmt->has_join) {
+        WhereClause residual[MAX_WHERE_CONDITIONS];
+        uint32_t residual_count;
+        op = plan_join(ctx, stmt, residual, &residual_count, error);
+        if (!op) return NULL;
+
+        if (residual_count > 0) {
+            int columns[MAX_WHERE_CONDITIONS];
+            for (uint32_t i = 0; i < residual_count; i++) {
+                columns[i] = resolve_column(op->schema, residual[i].column);
+                if (columns[i] < 0) {
+                    *error = column_error(residual[i].column, columns[i]);
+                    operator_free(op);
+                    return NULL;
+                }
+            }
+            op = filter_create(op, residual, columns, residual_count);
+        }
+    } else {
+        TableSchema* schema = load_schema(ctx->sm, stmt->select_table);
+        if (!schema) {
+            *error = SAFE_STRDUP("Table not found");
+            return NULL;
+        }
+
+        // Columns the query reads, to see whether an index alone can answer it
+        const char* names[MAX_COLUMNS + 2 * MAX_SORT_COLUMNS];
+        uint32_t name_count = 0;
+        for (uint32_t i = 0; i < stmt->select_column_count; i++) names[name_count++] = stmt->select_columns[i];
+        for (uint32_t i = 0; i < stmt->group_by_count; i++) names[name_count++] = stmt->group_by[i];
+        for (uint32_t i = 0; i < stmt->order_by_count; i++) names[name_count++] = stmt->order_by[i].column;
+        for (uint32_t i = 0; i < name_count; i++) {
+            if (strcmp(names[i], "*") == 0) {
+                if (is_star(stmt)) memset(needed, true, sizeof(needed));
+                continue;
+            }
+            int col = resolve_column(schema, names[i]);
+            if (col >= 0) needed[col] = true;
+        }
+        for (uint32_t i = 0; i < stmt->where_condition_count; i++) {
+            int col = find_column(schema, stmt->where_conditions[i].column);
+            if (col >= 0) needed[col] = true;
+        }
+
+        op = table_access_create(ctx, schema, stmt->where_conditions, stmt->where_condition_count, needed, error);
+        if (!op) return NULL;
+        access = op;
+    }
+
+    uint32_t columns[MAX_COLUMNS];
+    char names[MAX_COLUMNS][MAX_COLUMN_NAME];
+    uint32_t column_count = 0;
+    bool aggregating = stmt->group_by_count > 0;
+    for (uint32_t i = 0; i < stmt->select_column_count; i++) {
+        aggregating = aggregating || stmt->select_aggregates[i] != AGG_NONE;
+    }
+
+    if (aggregating) {
+        if (is_star(stmt)) {
+            *error = SAFE_STRDUP("SELECT * cannot be used with GROUP BY");
+            operator_free(op);
+            return NULL;
+        }
+
+        uint32_t groups[MAX_SORT_COLUMNS];
+        for (uint32_t g = 0; g < stmt->group_by_count; g++) {
+            int col = resolve_column(op->schema, stmt->group_by[g]);
+            if (col < 0) {
+                *error = column_error(stmt->group_by[g], col);
+                operator_free(op);
+                return NULL;
+            }
+            groups[g] = (uint32_t)col;
+        }
+
+        AggregateType types[MAX_COLUMNS];
+        int arguments[MAX_COLUMNS];
+        char aggregate_names[MAX_COLUMNS][MAX_COLUMN_NAME];
+        uint32_t aggregate_count = 0;
+        for (uint32_t i = 0; i < stmt->select_column_count; i++) {
+            const char* name = stmt->select_columns[i];
+            AggregateType type = stmt->select_aggregates[i];
+            int col = strcmp(name, "*") == 0 ? -1 : resolve_column(op->schema, name);
+            if (col < 0 && !(col == -1 && type == AGG_COUNT && strcmp(name, "*") == 0)) {
+                *error = column_error(name, col);
+                operator_free(op);
+                return NULL;
+            }
+
+            if (type == AGG_NONE) {
+                uint32_t g = 0;
+                while (g < stmt->group_by_count && groups[g] != (uint32_t)col) g++;
+                if (g == stmt->group_by_count) {
+                    *error = SAFE_MALLOC(char, 128);
+                    snprintf(*error, 128, "Column '%s' must appear in GROUP BY or be aggregated", name);
+                    operator_free(op);
+                    return NULL;
+                }
+                columns[column_count] = g;
+                snprintf(names[column_count++], MAX_COLUMN_NAME, "%s", name);
+                continue;
+            }
+
+            if ((type == AGG_SUM || type == AGG_AVG) && op->schema->columns[col].type != DT_INT &&
+                op->schema->columns[col].type != DT_FLOAT) {
+                *error = SAFE_MALLOC(char, 128);
+                snprintf(*error, 128, "%s needs a numeric column, '%s' is not", aggregate_to_string(type), name);
+                operator_free(op);
+                return NULL;
+            }
+            // Named as ORDER BY refers to it
+            char aggregate_name[MAX_COLUMN_NAME + 8];
+            snprintf(aggregate_name, sizeof(aggregate_name), "%s(%s)", aggregate_to_string(type), name);
+            strncpy(aggregate_names[aggregate_count], aggregate_name, MAX_COLUMN_NAME - 1);
+            aggregate_names[aggregate_count][MAX_COLUMN_NAME - 1] = '\0';
+            strcpy(names[column_count], aggregate_names[aggregate_count]);
+            types[aggregate_count] = type;
+            arguments[aggregate_count] = col;
+            columns[column_count++] = stmt->group_by_count + aggregate_count++;
+        }
+
+        bool ascending[MAX_SORT_COLUMNS] = { false };
+        if (stmt->group_by_count > 0 &&
+            !(access && access_order_by(access, groups, ascending, stmt->group_by_count, needed, 0))) {
+            op = sort_create(op, groups, NULL, stmt->group_by_count);
+        }
+
+        // A lone MIN or MAX is the first row of a scan in key order
+        if (access && stmt->group_by_count == 0 && aggregate_count == 1 &&
+            (types[0] == AGG_MIN || types[0] == AGG_MAX)) {
+            uint32_t column = (uint32_t)arguments[0];
+            bool descending = types[0] == AGG_MAX;
+            if (access_order_by(access, &column, &descending, 1, needed, 1)) op = limit_create(op, 1);
+        }
+        op = aggregate_create(op, groups, stmt->group_by_count, types, arguments, aggregate_names,
+                              aggregate_count);
+    } else if (is_star(stmt)) {
+        for (uint32_t i = 0; i < op->schema->column_count; i++) {
+            columns[column_count] = i;
+            snprintf(names[column_count++], MAX_COLUMN_NAME, "%s", op->schema->columns[i].name);
+        }
+    } else {
+        for (uint32_t i = 0; i < stmt->select_column_count; i++) {
+            int col = resolve_column(op->schema, stmt->select_columns[i]);
+            if (col < 0) {
+                *error = column_error(stmt->select_columns[i], col);
+                operator_free(op);
+                return NULL;
+            }
+            columns[column_count] = (uint32_t)col;
+            snprintf(names[column_count++], MAX_COLUMN_NAME, "%s", stmt->select_columns[i]);
+        }
+    }
+
+    if (stmt->order_by_count > 0) {
+        uint32_t keys[MAX_SORT_COLUMNS];
+        bool descending[MAX_SORT_COLUMNS];
+        for (uint32_t k = 0; k < stmt->order_by_count; k++) {
+            int col = resolve_column(op->schema, stmt->order_by[k].column);
+            if (col < 0) {
+                *error = column_error(stmt->order_by[k].column, col);
+                operator_free(op);
+                return NULL;
+            }
+            keys[k] = (uint32_t)col;
+            descending[k] = stmt->order_by[k].descending;
+        }
+
+        // Rows read in index order need no sort
+        uint32_t limit = stmt->has_limit ? stmt->limit : 0;
+        if (aggregating || !access ||
+            !access_order_by(access, keys, descending, stmt->order_by_count, needed, limit)) {
+            op = sort_create(op, keys, descending, stmt->order_by_count);
+        }
+    }
+
+    if (stmt->has_limit) op = limit_create(op, stmt->limit);
+
+    // A projection that keeps every column in order would only copy rows
+    bool identity = column_count == op->schema->column_count;
+    for (uint32_t i = 0; i < column_count && identity; i++) {
+        identity = columns[i] == i && strcmp(names[i], op->schema->columns[i].name) == 0;
+    }
+    if (!identity) op = project_create(op, columns, names, column_count);
+    return op;
+}
+
+// Renders a column value for the client
+static void format_value(ColumnDef* column, const uint8_t* value, char* out) {
+    switch (column->type) {
+        case DT_INT: {
+            int i;
+            memcpy(&i, value, sizeof(int));
+            snprintf(out, MAX_STRING_LEN + 1, "%d", i);
+            break;
+        }
+        case DT_FLOAT: {
+            float f;
+            memcpy(&f, value, sizeof(float));
+            snprintf(out, MAX_STRING_LEN + 1, "%g", f);
+            break;
+        }
+        case DT_BOOL:
+            strcpy(out, *(const bool*)value ? "true" : "false");
+            break;
+        case DT_STRING: {
+            size_t len = strnlen((const char*)value, column->length);
+            memcpy(out, value, len);
+            out[len] = '\0';
+            break;
+        }
+        default:
+            out[0] = '\0';
+            break;
+    }
+}
+
+static size_t memory_budget = DEFAULT_QUERY_MEMORY;
+
+void query_set_memory_budget(size_t bytes) {
+    memory_budget = bytes > 2 * PAGE_SIZE ? bytes : 2 * PAGE_SIZE;
+}
+
+size_t query_memory_budget(void) {
+    return memory_budget;
+}
+
+QueryStream* query_open(StorageManager* sm, SQLStatement* stmt) {
+    QueryStream* stream = SAFE_CALLOC(QueryStream, 1);
+    QueryPlan* plan = SAFE_CALLOC(QueryPlan, 1);
+    stream->plan = plan;
+    plan->ctx.sm = sm;
+    plan->ctx.memory_budget = memory_budget;
+
+    if (stmt->type != STMT_SELECT) {
+        stream->error_message = SAFE_STRDUP("Only SELECT statements can be streamed");
+        return stream;
+    }
+
+    plan->root = plan_select(&plan->ctx, stmt, &stream->error_message);
+    if (!plan->root) return stream;
+
+    // EXPLAIN returns the plan, one line per row, without running it
+    if (stmt->explain) {
+        plan->explain = SAFE_CALLOC(QueryResult, 1);
+        plan->explain->column_count = stream->column_count = 1;
+        strcpy(plan->explain->column_names[0], "QUERY PLAN");
+        strcpy(stream->column_names[0], "QUERY PLAN");
+        plan->root->explain(plan->root, plan->explain, 0);
+        return stream;
+    }
+
+    TableSchema* schema = plan->root->schema;
+    stream->column_count = schema->column_count;
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        strcpy(stream->column_names[i], schema->columns[i].name);
+    }
+    plan->root->open(plan->root);
+    plan->opened = true;
+    return stream;
+}
+
+bool query_next(QueryStream* stream) {
+    QueryPlan* plan = stream->plan;
+    if (stream->error_message || !plan->root) return false;
+
+    if (plan->explain) {
+        if (plan->explain_row == plan->explain->row_count) return false;
+        stream->values[0] = result_value(plan->explain, plan->explain_row++, 0);
+        stream->row_count++;
+        return true;
+    }
+
+    Tuple tuple;
+    if (!plan->root->next(plan->root, &tuple)) {
+        if (plan->ctx.error_message) {
+            stream->error_message = plan->ctx.error_message;
+            plan->ctx.error_message = NULL;
+        }
+        return false;
+    }
+
+    TableSchema* schema = plan->root->schema;
+    for (uint32_t i = 0; i < stream->column_count; i++) {
+        if (tuple.nulls & (1u << i)) {
+            stream->values[i] = NULL;
+            continue;
+        }
+        format_value(&schema->columns[i], tuple.data + schema->column_offsets[i], plan->text[i]);
+        stream->values[i] = plan->text[i];
+    }
+    stream->row_count++;
+    return true;
+}
+
+void query_close(QueryStream* stream) {
+    if (!stream) return;
+
+    QueryPlan* plan = stream->plan;
+    if (plan->root) {
+        if (plan->opened) plan->root->close(plan->root);
+        operator_free(plan->root);
+    }
+    if (plan->explain) free_result(plan->explain);
+    SAFE_FREE(plan->ctx.error_message);
+    SAFE_FREE(plan);
+    SAFE_FREE(stream->error_message);
+    SAFE_FREE(stream);
+}
+
+QueryResult* execute_select(StorageManager* sm, SQLStatement* stmt) {
+    QueryResult* result = SAFE_CALLOC(QueryResult, 1);
+    QueryStream* stream = query_open(sm, stmt);
+
+    if (!stream->error_message) {
+        result->column_count = stream->column_count;
+        memcpy(result->column_names, stream->column_names, sizeof(result->column_names));
+    }
+
+    while (query_next(stream)) {
+        result_add_row(result, stream->values);
+    }
+
+    if (stream->error_message) {
+        result->error_message = stream->error_message;
+        stream->error_message = NULL;
+    }
+    query_close(stream);
+    return result;
+}
+
+QueryResult* execute_join(StorageManager* sm, SQLStatement* stmt) {
+    if (!stmt->has_join) {
+        QueryResult* result = SAFE_CALLOC(QueryResult, 1);
+        result->error_message = SAFE_STRDUP("No JOIN clause found");
+        return result;
+    }
+    return execute_select(sm, stmt);
+}
+
+// Converts a numeric literal to the type of the column it is stored in;
+// returns false when the literal cannot be stored there
+static bool coerce_literal(void** value, DataType* value_type, DataType column_type) {
+    if (*value_type == column_type) return true;
+
+    if (column_type == DT_FLOAT && *value_type == DT_INT) {
+        float* number = SAFE_MALLOC(float, 1);
+        *number = (float)*(int*)*value;
+        SAFE_FREE(*value);
+        *value = number;
+    } else if (column_type == DT_INT && *value_type == DT_FLOAT) {
+        int* number = SAFE_MALLOC(int, 1);
+        *number = (int)*(float*)*value;
+        SAFE_FREE(*value);
+        *value = number;
+    } else {
+        return false;
+    }
+    *value_type = column_type;
+    return true;
+}
+
+// Rewrites the stored copy of a table's schema, found by name
+static bool store_schema(StorageManager* sm, TableSchema* schema) {
+    Page* schema_page = sm->header.schema_page ? sm_get_page(sm, sm->header.schema_page) : NULL;
+    if (!schema_page) return false;
+
+    for (uint32_t offset = 0; offset + TABLE_SCHEMA_DISK_SIZE <= SCHEMA_PAGE_STATS_OFFSET;
+         offset += TABLE_SCHEMA_DISK_SIZE) {
+        if (strncmp((const char*)schema_page->data + offset, schema->name, MAX_TABLE_NAME) == 0) {
+            memcpy(schema_page->data + offset, schema, TABLE_SCHEMA_DISK_SIZE);
+            schema_page->is_dirty = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+QueryResult* execute_insert(StorageManager* sm, SQLStatement* stmt) {
+    QueryResult* result = SAFE_MALLOC(QueryResult, 1);
+    memset(result, 0, sizeof(QueryResult));
     
-    for (uint32_t i = 0; i < column_index; i++) {
-        offset += get_column_size(&schema->columns[i]);
+    // Load schema to validate
+    TableSchema* schema = load_schema(sm, stmt->insert_table);
+    if (!schema) {
+        result->error_message = SAFE_STRDUP("Table not found");
+        return result;
     }
     
-    return offset;
-}
+    // Validate value count matches column count
+    if (stmt->insert_value_count != schema->column_count) {
+        result->error_message = SAFE_STRDUP("Value count doesn't match column count");
+        SAFE_FREE(schema);
+        return result;
+    }
+
+    // Numeric literals take the type of their column
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        if (stmt->insert_values[i]) {
+            coerce_literal(&stmt->insert_values[i], &stmt->insert_value_types[i], schema->columns[i].type);
+        }
+    }
 
-static void* get_column_value(TableSchema* schema, Page* page, uint32_t row_offset, uint32_t col_index) {
-    uint32_t coll_offset = get_column_offset(schema, col_index);
-    uint32_t col_size = get_column_size(&schema->columns[col_index]);
+    void* row_data = serialize_row(schema, stmt->insert_values);
+
+    // Check every unique index (including the primary key) for duplicates
+    TableIndexes indexes;
+    open_table_indexes(sm, schema, &indexes);
+    result->error_message = check_index_constraints(sm, schema, &indexes, NULL, row_data, NULL);
+    if (result->error_message) {
+        close_table_indexes(&indexes);
+        SAFE_FREE(row_data);
+        SAFE_FREE(schema);
+        return result;
+    }
     
-    void* value = SAFE_MALLOC(void, col_size + 1);
-    if (value) {
-        memcpy(value, page->data + row_offset + coll_offset, col_size);
+    // Walk the page chain from the insert page to the first never-used
+    // slot, appending a page at the tail when every page is full. Slots
+    // are used in order and deleted rows keep theirs, so the pages before
+    // the insert page are full.
+    uint32_t slots = rows_per_page(schema);
+    if (slots == 0) {
+        result->error_message = SAFE_STRDUP("Row size exceeds the page size");
+        close_table_indexes(&indexes);
+        SAFE_FREE(row_data);
+        SAFE_FREE(schema);
+        return result;
+    }
+    RID rid = { schema->insert_page, 0 };
+    Page* page = NULL;
+    bool found_space = false;
+
+    while (!found_space) {
+        page = sm_get_page(sm, rid.page_id);
+        if (!page) {
+            result->error_message = SAFE_STRDUP("Failed to read data page");
+            close_table_indexes(&indexes);
+            SAFE_FREE(row_data);
+            SAFE_FREE(schema);
+            return result;
+        }
+
+        for (rid.slot = 0; rid.slot < slots; rid.slot++) {
+            if (slot_is_empty(page, rid.slot * schema->row_size)) {
+                found_space = true;
+                break;
+            }
+        }
+        if (found_space) break;
+
+        uint32_t next_page = *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
+        if (next_page == 0) {
+            next_page = sm_allocate_page(sm);
+            // Allocation may have evicted the tail page
+            page = sm_get_page(sm, rid.page_id);
+            *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t)) = next_page;
+            page->is_dirty = true;
+            zone_map_attach(sm, schema, next_page);
+        }
+        rid.page_id = next_page;
+    }
+    if (rid.page_id != schema->insert_page) {
+        schema->insert_page = rid.page_id;
+        store_schema(sm, schema);
+        page = sm_get_page(sm, rid.page_id); // the schema page may have evicted it
     }
-    return value;
+
+    // Insert the row; the row id doubles as the "slot in use" mark
+    uint32_t row_id = rid.page_id * slots + rid.slot + 1;
+    memcpy((uint8_t*)row_data + sizeof(bool), &row_id, sizeof(uint32_t));
+    memcpy(page->data + rid.slot * schema->row_size, row_data, schema->row_size);
+    page->is_dirty = true;
+
+    uint8_t zone_values[MAX_COLUMNS * ZONE_VALUE_SIZE];
+    zone_row_values(schema, row_data, zone_values);
+    zone_map_add_row(sm, schema, rid.page_id, zone_values);
+
+    // Maintain every index on the table
+    update_row_indexes(sm, schema, &indexes, NULL, row_data, rid);
+    close_table_indexes(&indexes);
+    
+    SAFE_FREE(row_data);
+    SAFE_FREE(schema);
+    
+    result->column_count = 1;
+    strcpy(result->column_names[0], "rows_affected");
+    result_add_row(result, (const char*[]){ "1" });
+    
+    return result;
 }
 
-QueryResult* execute_create_table(StorageManager* sm, SQLStatement* stmt) {
-    QueryResult* result = SAFE_MALLOC(QueryResult, 1);
-    memset(result, 0, sizeof(QueryResult));
+QueryResult* execute_update(StorageManager* sm, SQLStatement* stmt) {
+    QueryResult* result = SAFE_CALLOC(QueryResult, 1);
     
-    // Calculate row size
-    stmt->create_schema.row_size = calculate_row_size(&stmt->create_schema);
+    // Load schema
+    TableSchema* schema = load_schema(sm, stmt->update_table);
+    if (!schema) {
+        result->error_message = SAFE_STRDUP("Table not found");
+        return result;
+    }
+    
+    // Validate that all columns exist
+    int update_cols[MAX_COLUMNS];
+    for (uint32_t i = 0; i < stmt->update_column_count; i++) {
+        update_cols[i] = find_column(schema, stmt->update_columns[i]);
+        if (update_cols[i] < 0) {
+            result->error_message = SAFE_MALLOC(char, 100);
+            snprintf(result->error_message, 100, "Column '%s' not found", stmt->update_columns[i]);
+            SAFE_FREE(schema);
+            return result;
+        }
+        if (stmt->update_values[i] &&
+            !coerce_literal(&stmt->update_values[i], &stmt->update_value_types[i],
+                            schema->columns[update_cols[i]].type)) {
+            result->error_message = SAFE_MALLOC(char, 100);
+            snprintf(result->error_message, 100, "Value for column '%s' has the wrong type",
+                     stmt->update_columns[i]);
+            SAFE_FREE(schema);
+            return result;
+        }
+    }
 
-    // Save the schema to disk
-    if (!save_schema(sm, &stmt->create_schema)) {
-        result->error_message = SAFE_STRDUP("Failed to save schema");
+    RowFilter filter;
+    result->error_message = bind_filter(schema, stmt, &filter);
+    if (result->error_message) {
+        SAFE_FREE(schema);
         return result;
     }
 
-    // Find primary key column index
-    uint32_t pk_index = 0;
-    for (uint32_t i = 0; i < stmt->create_schema.column_count; i++) {
-        if (stmt->create_schema.columns[i].is_primary) {
-            pk_index = i;
-            break;
+    TableIndexes indexes;
+    open_table_indexes(sm, schema, &indexes);
+
+    // Find the rows first so that index maintenance cannot disturb the lookup
+    RID* rids;
+    uint32_t rid_count = matching_rids(sm, schema, &indexes, &filter, &rids);
+    uint32_t rows_updated = 0;
+
+    // The old image of every updated row, kept to undo the statement if a
+    // later row violates a constraint. Updated rows' ids are packed to the
+    // front of rids as they are applied. (+1 keeps the size nonzero.)
+    uint8_t* old_rows = SAFE_MALLOC(uint8_t, (size_t)rid_count * schema->row_size + 1);
+    uint8_t* new_row = SAFE_MALLOC(uint8_t, schema->row_size);
+    uint8_t zone_values[MAX_COLUMNS * ZONE_VALUE_SIZE];
+
+    for (uint32_t r = 0; r < rid_count; r++) {
+        uint8_t* row_data = fetch_row(sm, schema, rids[r]);
+        if (!row_data) continue;
+
+        uint8_t* old_row = old_rows + (size_t)rows_updated * schema->row_size;
+        memcpy(old_row, row_data, schema->row_size);
+        memcpy(new_row, row_data, schema->row_size);
+
+        for (uint32_t i = 0; i < stmt->update_column_count; i++) {
+            if (!stmt->update_values[i]) continue;
+
+            ColumnDef* column = &schema->columns[update_cols[i]];
+            uint8_t* dest = new_row + schema->column_offsets[update_cols[i]];
+            if (column->type == DT_STRING) {
+                memset(dest, 0, column->length);
+                strncpy((char*)dest, (char*)stmt->update_values[i], column->length);
+            } else {
+                memcpy(dest, stmt->update_values[i], schema->column_sizes[update_cols[i]]);
+            }
         }
+
+        // Reject the change if it would duplicate a unique key
+        result->error_message = check_index_constraints(sm, schema, &indexes, old_row, new_row, &rids[r]);
+        if (result->error_message) break;
+
+        // Re-key the indexes whose entry changed
+        update_row_indexes(sm, schema, &indexes, old_row, new_row, rids[r]);
+
+        // Index maintenance may have evicted the heap page
+        Page* page = sm_get_page(sm, rids[r].page_id);
+        memcpy(page->data + rids[r].slot * schema->row_size, new_row, schema->row_size);
+        page->is_dirty = true;
+        rids[rows_updated++] = rids[r];
+
+        // Widen the page's zone; the old values only loosen its bounds
+        zone_row_values(schema, new_row, zone_values);
+        zone_map_widen(sm, schema, rids[r].page_id, zone_values);
     }
 
-    // Create B-Tree index for primary key
-    if (stmt->create_schema.primary_key_index != -1) {
-        BTreeIndex* pk_btree_index = btree_create_index(&stmt->create_schema, 
-                                                  stmt->create_schema.primary_key_index);
-        result->success_message = SAFE_STRDUP("Table created successfully");
-        btree_free_index(pk_btree_index);
+    // Undo the rows already updated, newest first so each index entry is
+    // re-keyed back through the same states. Their zones stay widened,
+    // which only loosens the bounds.
+    if (result->error_message) {
+        while (rows_updated > 0) {
+            rows_updated--;
+            uint8_t* old_row = old_rows + (size_t)rows_updated * schema->row_size;
+            memcpy(new_row, fetch_row(sm, schema, rids[rows_updated]), schema->row_size);
+            update_row_indexes(sm, schema, &indexes, new_row, old_row, rids[rows_updated]);
+
+            Page* page = sm_get_page(sm, rids[rows_updated].page_id);
+            memcpy(page->data + rids[rows_updated].slot * schema->row_size, old_row, schema->row_size);
+            page->is_dirty = true;
+        }
     }
 
+    SAFE_FREE(old_rows);
+    SAFE_FREE(new_row);
+    SAFE_FREE(rids);
+    close_table_indexes(&indexes);
+    SAFE_FREE(schema);
+
+    if (result->error_message) {
+        return result;
+    }
+    
+    // Return result
     result->column_count = 1;
-    strcpy(result->column_names[0], "status");
-    result->row_count = 1;
+    strcpy(result->column_names[0], "rows_updated");
     
-    // Allocate space for the result grid
-    result->rows = SAFE_MALLOC(void**, 1);
-    result->rows[0] = SAFE_MALLOC(void*, 1);
+    char msg[20];
+    snprintf(msg, sizeof(msg), "%u", rows_updated);
+    result_add_row(result, (const char*[]){ msg });
     
-    char* msg = SAFE_MALLOC(char, 256);
-    snprintf(msg, 100, "Table '%s' created successfully (Row size: %u bytes)", 
-             stmt->create_schema.name, stmt->create_schema.row_size);
-    result->success_message = msg;
-    result->rows[0][0] = SAFE_STRDUP(msg);
+    return result;
+}
+
+QueryResult* execute_delete(StorageManager* sm, SQLStatement* stmt) {
+    QueryResult* result = SAFE_MALLOC(QueryResult, 1);
+    memset(result, 0, sizeof(QueryResult));
+    
+    result->column_count = 1;
+    strcpy(result->column_names[0], "rows_affected");
+    
+    // Simple implementation: mark as deleted
+    if (stmt->where_condition_count > 0 && stmt->table_name[0] != '\0') {
+        TableSchema* schema = load_schema(sm, stmt->table_name);
+        if (schema) {
+            RowFilter filter;
+            result->error_message = bind_filter(schema, stmt, &filter);
+            if (result->error_message) {
+                result_add_row(result, (const char*[]){ "0" });
+                SAFE_FREE(schema);
+                return result;
+            }
+
+            TableIndexes indexes;
+            open_table_indexes(sm, schema, &indexes);
+
+            RID* rids;
+            uint32_t rid_count = matching_rids(sm, schema, &indexes, &filter, &rids);
+            uint32_t deleted_count = 0;
+            uint8_t* old_row = SAFE_MALLOC(uint8_t, schema->row_size);
+
+            for (uint32_t r = 0; r < rid_count; r++) {
+                uint8_t* row_data = fetch_row(sm, schema, rids[r]);
+                if (!row_data) continue;
+
+                // Mark as deleted
+                memcpy(old_row, row_data, schema->row_size);
+                *(bool*)row_data = true;
+                sm_get_page(sm, rids[r].page_id)->is_dirty = true;
+                deleted_count++;
+
+                update_row_indexes(sm, schema, &indexes, old_row, NULL, rids[r]);
+            }
+
+            // Tighten the zones of the pages rows were deleted from
+            for (uint32_t r = 0; r < rid_count; r++) {
+                if (r == 0 || rids[r].page_id != rids[r - 1].page_id) {
+                    refresh_zone(sm, schema, rids[r].page_id);
+                }
+            }
+
+            SAFE_FREE(old_row);
+            SAFE_FREE(rids);
+            close_table_indexes(&indexes);
+            SAFE_FREE(schema);
+            
+            char msg[20];
+            snprintf(msg, sizeof(msg), "%u", deleted_count);
+            result_add_row(result, (const char*[]){ msg });
+            return result;
+        }
+    }
     
+    result_add_row(result, (const char*[]){ "0" });
     return result;
 }
 
-QueryResult* execute_select(StorageManager* sm, SQLStatement* stmt) {
+QueryResult* execute_drop_table(StorageManager* sm, SQLStatement* stmt) {
     QueryResult* result = SAFE_CALLOC(QueryResult, 1);
 
-    // Load schema
-    TableSchema* schema = load_schema(sm, stmt->select_table);
+    result->column_count = 1;
+    strcpy(result->column_names[0], "status");
+
+    // Check if table exists
+    TableSchema* schema = load_schema(sm, stmt->drop_table);
     if (!schema) {
-        result->error_message = SAFE_STRDUP("Table not found");
+        result_add_row(result, (const char*[]){ "Table does not exist" });
         return result;
     }
+    SAFE_FREE(schema);
+
+    // Delete the schema
+    // if (delete_schema(sm, stmt->drop_table)) {
+    //     // TODO: Also delete all data pages associated with this table
+    //     // For now, we'll just delete the schema
+    //
+    //     char msg[100];
+    //     snprintf(msg, sizeof(msg), "Table '%s' dropped successfully", stmt->drop_table);
+    //     result_add_row(result, (const char*[]){ msg });
+    // } else {
+    //     result_add_row(result, (const char*[]){ "Failed to drop table" });
+    // }
+
+    return result;
+}
+
+// Fills an empty index from the table: the keys are extracted in one heap
+// scan, sorted (spilling to disk when they do not fit in memory) and
+// loaded bottom-up. Returns false if a unique index meets a duplicate.
+static bool bulk_build_index(StorageManager* sm, TableSchema* schema, BTreeIndex* index, uint32_t* row_count) {
+    uint32_t entry_size = index->key_size + index->payload_size;
+    uint32_t record_size = entry_size + sizeof(RID);
+    ExternalSort* sorter = extsort_create(record_size, btree_entry_compare, index, EXTSORT_DEFAULT_MEMORY);
+    uint32_t slots = rows_per_page(schema);
+    uint32_t current_page = schema->first_page;
+    uint8_t record[BTREE_MAX_KEY_SIZE + sizeof(RID)];
+
+    while (current_page != 0) {
+        Page* page = sm_get_page(sm, current_page);
+        if (!page) break;
+
+        for (uint32_t slot = 0; slot < slots; slot++) {
+            uint32_t row_offset = slot * schema->row_size;
+            if (slot_is_empty(page, row_offset) || *(bool*)(page->data + row_offset)) continue;
 
-    // setup result columns
-    if (stmt->select_column_count == 1 && strcmp(stmt->select_columns[0], "*") == 0) {
-        // Select all columns
-        result->column_count = schema->column_count;
-        for (uint32_t i = 0; i < schema->column_count; i++) {
-            strcpy(result->column_names[i], schema->columns[i].name);
+            RID rid = { current_page, slot };
+            index_entry(schema, index, page->data + row_offset, record);
+            memcpy(record + entry_size, &rid, sizeof(RID));
+            extsort_add(sorter, record);
         }
-    
-    } else {
-        // specific columns
-        result->column_count = stmt->select_column_count;
-        for (uint32_t i = 0; i < stmt->select_column_count; i++) {
-            strcpy(result->column_names[i], stmt->select_columns[i]);
+
+        current_page = *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
+    }
+    extsort_finish(sorter);
+
+    BTreeBuilder* builder = btree_build_begin(sm, index, index->fill_factor);
+    uint8_t previous[BTREE_MAX_KEY_SIZE];
+    bool have_previous = false;
+    bool ok = true;
+
+    while (ok && extsort_next(sorter, record)) {
+        // Sorted input puts duplicates next to each other
+        if (index->is_unique && have_previous && memcmp(previous, record, index->key_size) == 0) {
+            ok = false;
+            break;
         }
+        memcpy(previous, record, index->key_size);
+        have_previous = true;
+
+        RID rid;
+        memcpy(&rid, record + entry_size, sizeof(RID));
+        ok = btree_build_add(builder, record, rid);
     }
 
-    // Simple table scan (no WHERE optimization yet)
-    uint32_t current_page = sm->header.root_page;
-    uint32_t rows_found = 0;
-    uint32_t max_rows = 100; // simple limit
+    *row_count = (uint32_t)extsort_count(sorter);
+    btree_build_finish(builder);
+    extsort_free(sorter);
+    return ok;
+}
 
-    result->rows = SAFE_MALLOC(void**, max_rows);
+// Fills an empty hash index from the table, one insert per row; buckets
+// split as the index grows. Returns false if a unique index meets a
+// duplicate.
+static bool build_hash_index(StorageManager* sm, TableSchema* schema, HashIndex* index, uint32_t* row_count) {
+    uint32_t slots = rows_per_page(schema);
+    uint32_t current_page = schema->first_page;
+    uint8_t* row = SAFE_MALLOC(uint8_t, schema->row_size);
+    uint8_t key[BTREE_MAX_KEY_SIZE];
+    bool ok = true;
 
-    while (current_page != 0 && rows_found < max_rows) {
+    *row_count = 0;
+    while (current_page != 0 && ok) {
         Page* page = sm_get_page(sm, current_page);
         if (!page) break;
+        uint32_t next_page = *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
 
-        // Simple scan: each row is stored sequentially
-        uint32_t row_offset = 0;
-        while (row_offset + schema->row_size <= PAGE_SIZE) {
-            // Check if this is a valid row start (not all zeros)
-            bool all_zeros = true;
-            for (uint32_t i = 0; i < 8 && row_offset + i < PAGE_SIZE; i++) {
-                if (page->data[row_offset + i] != 0) {
-                    all_zeros = false;
-                    break;
-                }
-            }
-            
-            if (all_zeros) {
-                // Skip empty space
-                row_offset += schema->row_size;
-                continue;
+        for (uint32_t slot = 0; slot < slots && ok; slot++) {
+            // Index inserts may evict the heap page
+            page = sm_get_page(sm, current_page);
+            uint32_t row_offset = slot * schema->row_size;
+            if (slot_is_empty(page, row_offset) || *(bool*)(page->data + row_offset)) continue;
+
+            memcpy(row, page->data + row_offset, schema->row_size);
+            hash_index_key(schema, index, row, key);
+            if (index->is_unique && hash_search(sm, index, key, NULL)) {
+                ok = false;
+                break;
             }
 
-            bool deleted = *(bool*)(page->data + row_offset);
-            // uint32_t row_id = *(uint32_t*)(page->data + row_offset + sizeof(bool));
-            
-            if (!deleted) {
-                // Apply WHERE filter if present
-                bool include = true;
-                if (stmt->where_value && stmt->where_column[0] != '\0') {
-                    // Find the column to filter
-                    for (uint32_t i = 0; i < schema->column_count; i++) {
-                        if (strcmp(schema->columns[i].name, stmt->where_column) == 0) {
-                            uint32_t col_offset = get_column_offset(schema, i);
-                            uint32_t col_size = get_column_size(&schema->columns[i]);
-                            
-                            if (col_size == sizeof(int)) {
-                                int row_value;
-                                memcpy(&row_value, page->data + row_offset + col_offset, sizeof(int));
-                                int filter_value = *(int*)stmt->where_value;
-                                if (row_value != filter_value) {
-                                    include = false;
-                                }
-                            }
-                            break;
-                        }
-                    }
-                }
-                
-                if (include) {
-                    // Extract selected columns
-                    void** row = SAFE_MALLOC(void*, result->column_count);
-                    
-                    for (uint32_t col = 0; col < result->column_count; col++) {
-                        // Find column index in schema
-                        for (uint32_t i = 0; i < schema->column_count; i++) {
-                            if (strcmp(schema->columns[i].name, result->column_names[col]) == 0) {
-                                uint32_t col_offset = get_column_offset(schema, i);
-                                uint32_t col_size = get_column_size(&schema->columns[i]);
-                                
-                                row[col] = SAFE_MALLOC(void, col_size + 1);
-                                memcpy(row[col], page->data + row_offset + col_offset, col_size);
-                                
-                                // Null terminate if it's a string
-                                if (schema->columns[i].type == DT_STRING) {
-                                    ((char*)row[col])[col_size] = '\0';
-                                }
-                                break;
-                            }
-                        }
-                    }
-                    
-                    result->rows[rows_found++] = row;
-                    if (rows_found >= max_rows) break;
-                }
+            RID rid = { current_page, slot };
+            ok = hash_insert(sm, index, key, rid);
+            (*row_count)++;
+        }
+
+        current_page = next_page;
+    }
+
+    SAFE_FREE(row);
+    return ok;
+}
+
+// Fills an empty bitmap index from the table in heap order. Returns false
+// when an index page cannot be read.
+static bool build_bitmap_index(StorageManager* sm, TableSchema* schema, BitmapIndex* index, uint32_t* row_count) {
+    uint32_t slots = rows_per_page(schema);
+    uint32_t current_page = schema->first_page;
+    uint8_t* row = SAFE_MALLOC(uint8_t, schema->row_size);
+    uint8_t key[BTREE_MAX_KEY_SIZE];
+    bool ok = true;
+
+    *row_count = 0;
+    while (current_page != 0 && ok) {
+        Page* page = sm_get_page(sm, current_page);
+        if (!page) break;
+        uint32_t next_page = *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
+
+        for (uint32_t slot = 0; slot < slots && ok; slot++) {
+            // Index inserts may evict the heap page
+            page = sm_get_page(sm, current_page);
+            uint32_t row_offset = slot * schema->row_size;
+            if (slot_is_empty(page, row_offset) || *(bool*)(page->data + row_offset)) continue;
+
+            memcpy(row, page->data + row_offset, schema->row_size);
+            bitmap_index_key(schema, index, row, key);
+
+            RID rid = { current_page, slot };
+            ok = bitmap_insert(sm, index, key, row_position(schema, rid));
+            (*row_count)++;
+        }
+
+        current_page = next_page;
+    }
+
+    SAFE_FREE(row);
+    return ok;
+}
+
+QueryResult* execute_create_index(StorageManager* sm, SQLStatement* stmt) {
+    QueryResult* result = SAFE_CALLOC(QueryResult, 1);
+
+    TableSchema* schema = load_schema(sm, stmt->index_table);
+    if (!schema) {
+        result->error_message = SAFE_STRDUP("Table not found");
+        return result;
+    }
+
+    if (stmt->index_column_count == 0 || stmt->index_column_count > MAX_INDEX_COLUMNS) {
+        result->error_message = SAFE_STRDUP("Invalid number of index columns");
+        SAFE_FREE(schema);
+        return result;
+    }
+
+    uint32_t key_cols[MAX_INDEX_COLUMNS];
+    uint32_t key_size = 0;
+    char column_list[MAX_INDEX_COLUMNS * (MAX_COLUMN_NAME + 2)] = "";
+    for (uint32_t i = 0; i < stmt->index_column_count; i++) {
+        int col = find_column(schema, stmt->index_columns[i]);
+        if (col < 0) {
+            result->error_message = SAFE_MALLOC(char, 100);
+            snprintf(result->error_message, 100, "Column '%s' not found", stmt->index_columns[i]);
+            SAFE_FREE(schema);
+            return result;
+        }
+        for (uint32_t j = 0; j < i; j++) {
+            if (key_cols[j] == (uint32_t)col) {
+                result->error_message = SAFE_MALLOC(char, 100);
+                snprintf(result->error_message, 100, "Column '%s' appears twice in index",
+                         stmt->index_columns[i]);
+                SAFE_FREE(schema);
+                return result;
             }
-            
-            row_offset += schema->row_size;
         }
-        
-        // Get next page (simplified linked list)
-        // Look for next page pointer at end of current page
-        if (PAGE_SIZE >= sizeof(uint32_t)) {
-            current_page = *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
-        } else {
-            current_page = 0;
+        key_cols[i] = (uint32_t)col;
+        key_size += btree_key_width(&schema->columns[col]);
+
+        if (i > 0) strcat(column_list, ", ");
+        strcat(column_list, schema->columns[col].name);
+    }
+
+    if (stmt->index_method != INDEX_BTREE && stmt->index_include_count > 0) {
+        result->error_message = SAFE_STRDUP("INCLUDE is only supported for B-tree indexes");
+        SAFE_FREE(schema);
+        return result;
+    }
+
+    if (stmt->index_method == INDEX_BITMAP && (stmt->index_unique || stmt->index_column_count != 1)) {
+        result->error_message = SAFE_STRDUP("Bitmap indexes cover a single column and cannot be unique");
+        SAFE_FREE(schema);
+        return result;
+    }
+
+    // Included columns ride along in the leaves but are not part of the key
+    uint32_t include_cols[MAX_INDEX_COLUMNS];
+    for (uint32_t i = 0; i < stmt->index_include_count; i++) {
+        int col = find_column(schema, stmt->index_include_columns[i]);
+        if (col < 0) {
+            result->error_message = SAFE_MALLOC(char, 100);
+            snprintf(result->error_message, 100, "Column '%s' not found", stmt->index_include_columns[i]);
+            SAFE_FREE(schema);
+            return result;
+        }
+        bool repeated = false;
+        for (uint32_t j = 0; j < stmt->index_column_count; j++) {
+            repeated = repeated || key_cols[j] == (uint32_t)col;
+        }
+        for (uint32_t j = 0; j < i; j++) {
+            repeated = repeated || include_cols[j] == (uint32_t)col;
+        }
+        if (repeated) {
+            result->error_message = SAFE_MALLOC(char, 100);
+            snprintf(result->error_message, 100, "Column '%s' appears twice in index",
+                     stmt->index_include_columns[i]);
+            SAFE_FREE(schema);
+            return result;
+        }
+        include_cols[i] = (uint32_t)col;
+        key_size += btree_key_width(&schema->columns[col]);
+    }
+
+    if (key_size > BTREE_MAX_KEY_SIZE) {
+        result->error_message = SAFE_MALLOC(char, 100);
+        snprintf(result->error_message, 100, "Index entry too large (%u bytes, maximum %d)",
+                 key_size, BTREE_MAX_KEY_SIZE);
+        SAFE_FREE(schema);
+        return result;
+    }
+
+    IndexDef def;
+    if (index_catalog_load(sm, stmt->index_name, &def)) {
+        result->error_message = SAFE_MALLOC(char, 128);
+        snprintf(result->error_message, 128, "Index '%s' already exists", stmt->index_name);
+        SAFE_FREE(schema);
+        return result;
+    }
+
+    IndexDef existing[MAX_TABLE_INDEXES];
+    if (index_catalog_list(sm, schema->name, existing, MAX_TABLE_INDEXES) >= MAX_TABLE_INDEXES) {
+        result->error_message = SAFE_STRDUP("Too many indexes on table");
+        SAFE_FREE(schema);
+        return result;
+    }
+
+    memset(&def, 0, sizeof(IndexDef));
+    strncpy(def.name, stmt->index_name, MAX_INDEX_NAME - 1);
+    strncpy(def.table_name, schema->name, MAX_TABLE_NAME - 1);
+    memcpy(def.key_columns, key_cols, sizeof(uint32_t) * stmt->index_column_count);
+    def.key_column_count = stmt->index_column_count;
+    memcpy(def.include_columns, include_cols, sizeof(uint32_t) * stmt->index_include_count);
+    def.include_column_count = stmt->index_include_count;
+    def.is_unique = stmt->index_unique;
+    def.fill_factor = stmt->index_fill_factor ? stmt->index_fill_factor : BTREE_DEFAULT_FILL_FACTOR;
+    def.method = stmt->index_method;
+
+    if (def.method != INDEX_BTREE) {
+        // Hash and bitmap indexes start with their meta page
+        def.root_page = def.method == INDEX_HASH ? hash_create_storage(sm) : bitmap_create_storage(sm);
+        if (def.root_page == 0) {
+            result->error_message = SAFE_STRDUP("Failed to allocate index");
+            SAFE_FREE(schema);
+            return result;
+        }
+    }
+
+    if (!index_catalog_save(sm, &def)) {
+        result->error_message = SAFE_STRDUP("Failed to save index");
+        SAFE_FREE(schema);
+        return result;
+    }
+
+    // Build the index from the rows already in the table
+    uint32_t row_count = 0;
+    bool built;
+    if (def.method == INDEX_HASH) {
+        HashIndex* index = hash_open_index(sm, schema, def.name);
+        built = build_hash_index(sm, schema, index, &row_count);
+        hash_free_index(index);
+    } else if (def.method == INDEX_BITMAP) {
+        BitmapIndex* index = bitmap_open_index(sm, schema, def.name);
+        built = build_bitmap_index(sm, schema, index, &row_count);
+        if (!built) {
+            result->error_message = SAFE_MALLOC(char, 512);
+            snprintf(result->error_message, 512, "Failed to build bitmap index '%s' on (%s)",
+                     def.name, column_list);
+            index_catalog_delete(sm, def.name);
         }
+        bitmap_free_index(index);
+    } else {
+        BTreeIndex* index = btree_create_index(sm, schema, def.name);
+        built = bulk_build_index(sm, schema, index, &row_count);
+        // Unique indexes get a Bloom filter to skip most duplicate checks
+        if (built && def.is_unique) rebuild_bloom(sm, index, row_count);
+        btree_free_index(index);
     }
-    
-    result->row_count = rows_found;
+    if (!built && !result->error_message) {
+        result->error_message = SAFE_MALLOC(char, 512);
+        snprintf(result->error_message, 512,
+                 "Cannot create unique index '%s' - duplicate values in (%s)",
+                 def.name, column_list);
+        // Pages already written to the index are not reclaimed
+        index_catalog_delete(sm, def.name);
+    }
+
+    if (result->error_message) {
+        SAFE_FREE(schema);
+        return result;
+    }
+
+    result->column_count = 1;
+    strcpy(result->column_names[0], "status");
+
+    const char* method_suffix = def.method == INDEX_HASH ? " using hash" :
+                                def.method == INDEX_BITMAP ? " using bitmap" : "";
+    char* msg = SAFE_MALLOC(char, 512);
+    snprintf(msg, 512, "Index '%s' created on %s(%s)%s (%u rows)",
+             def.name, schema->name, column_list, method_suffix, row_count);
+    result->success_message = msg;
+    result_add_row(result, (const char*[]){ msg });
+
     SAFE_FREE(schema);
     return result;
 }
 
-QueryResult* execute_join(StorageManager* sm, SQLStatement* stmt) {
+QueryResult* execute_drop_index(StorageManager* sm, SQLStatement* stmt) {
     QueryResult* result = SAFE_CALLOC(QueryResult, 1);
 
-    if (!stmt->has_join) {
-        result->error_message = SAFE_STRDUP("No JOIN clause found");
+    IndexDef def;
+    if (!index_catalog_load(sm, stmt->index_name, &def)) {
+        result->error_message = SAFE_MALLOC(char, 128);
+        snprintf(result->error_message, 128, "Index '%s' does not exist", stmt->index_name);
         return result;
     }
 
-    // Load schemas for both tables
-    TableSchema* left_schema = load_schema(sm, stmt->join_clause.left_table);
-    TableSchema* right_schema = load_schema(sm, stmt->join_clause.right_table);
-
-    if (!left_schema || !right_schema) {
-        result->error_message = SAFE_STRDUP("One or both tables not found");
-        if (left_schema) SAFE_FREE(left_schema);
-        if (right_schema) SAFE_FREE(right_schema);
+    if (def.is_primary) {
+        result->error_message = SAFE_STRDUP("Cannot drop a primary key index");
         return result;
     }
 
-    // Find join column indices
-    int left_join_col = -1, right_join_col = -1;
-
-    for (uint32_t i = 0; i < left_schema->column_count; i++) {
-        if (strcmp(left_schema->columns[i].name, stmt->join_clause.on_left) == 0) {
-            left_join_col = i;
-            break;
-        }
-    }
-
-    for (uint32_t i = 0; i < right_schema->column_count; i++) {
-        if (strcmp(right_schema->columns[i].name, stmt->join_clause.on_right) == 0) {
-            right_join_col = i;
-            break;
-        }
+    if (def.is_constraint) {
+        result->error_message = SAFE_MALLOC(char, 512);
+        snprintf(result->error_message, 512, "Cannot drop index '%s' - it enforces a UNIQUE column of %s",
+                 def.name, def.table_name);
+        return result;
     }
 
-    if (left_join_col == -1 || right_join_col == -1) {
-        result->error_message = SAFE_STRDUP("Join columns not found");
-        SAFE_FREE(left_schema);
-        SAFE_FREE(right_schema);
+    // Only the catalog entry goes away; the tree's pages stay allocated
+    // until the storage manager can reuse free pages
+    if (!index_catalog_delete(sm, def.name)) {
+        result->error_message = SAFE_STRDUP("Failed to drop index");
         return result;
     }
 
-    // Setup result columns
-    result->column_count = left_schema->column_count + right_schema->column_count;
+    result->column_count = 1;
+    strcpy(result->column_names[0], "status");
+
+    char* msg = SAFE_MALLOC(char, 128);
+    snprintf(msg, 128, "Index '%s' dropped successfully", def.name);
+    result->success_message = msg;
+    result_add_row(result, (const char*[]){ msg });
+
+    return result;
+}
+
+#define STAT_CELL_SIZE 48
 
-    // Name columns as table.column
-    uint32_t col_idx = 0;
-    for (uint32_t i = 0; i < left_schema->column_count; i++) {
-        snprintf(result->column_names[col_idx++], MAX_COLUMN_NAME,
-                "%s.%s", stmt->join_clause.left_table, left_schema->columns[i].name);
+// Formats a/b as a percentage, "-" when b is 0
+static const char* format_percent(char* text, uint64_t a, uint64_t b) {
+    if (b == 0) {
+        strcpy(text, "-");
+    } else {
+        snprintf(text, STAT_CELL_SIZE, "%.1f%%", 100.0 * (double)a / (double)b);
     }
-    for (uint32_t i = 0; i < right_schema->column_count; i++) {
-        snprintf(result->column_names[col_idx++], MAX_COLUMN_NAME,
-                "%s.%s", stmt->join_clause.right_table, right_schema->columns[i].name);
+    return text;
+}
+
+static const char* format_count(char* text, uint64_t value) {
+    snprintf(text, STAT_CELL_SIZE, "%llu", (unsigned long long)value);
+    return text;
+}
+
+// One row per B-tree index of the table: shape, fill, leaf fragmentation
+// and how the keys are distributed
+QueryResult* execute_index_stats(StorageManager* sm, const char* table_name) {
+    QueryResult* result = SAFE_CALLOC(QueryResult, 1);
+
+    TableSchema* schema = load_schema(sm, table_name);
+    if (!schema) {
+        result->error_message = SAFE_MALLOC(char, 128);
+        snprintf(result->error_message, 128, "Table '%s' not found", table_name);
+        return result;
     }
 
-    // Simple nested loop join (for small datasets)
-    // Build hash table from right table (for INNER JOIN)
-    typedef struct {
-        void* key;
-        void** row_data;  // Entire row from right table
-    } HashEntry;
+    static const char* columns[] = {
+        "index", "height", "leaf_pages", "inner_pages", "entries", "distinct_keys", "max_dups",
+        "leaf_fill", "inner_fill", "fragmentation", "empty_leaves", "leaf_entries", "key_bytes"
+    };
+    result->column_count = sizeof(columns) / sizeof(columns[0]);
+    for (uint32_t i = 0; i < result->column_count; i++) {
+        strcpy(result->column_names[i], columns[i]);
+    }
 
-    HashEntry* hash_table[1000] = {0};  // Simple fixed-size hash table
+    IndexDef defs[MAX_TABLE_INDEXES];
+    uint32_t index_count = index_catalog_list(sm, schema->name, defs, MAX_TABLE_INDEXES);
 
-    // First pass: Build hash from right table
-    uint32_t right_page = sm->header.root_page;
-    while (right_page != 0) {
-        Page* page = sm_get_page(sm, right_page);
-        if (!page) break;
+    for (uint32_t i = 0; i < index_count; i++) {
+        if (defs[i].method != INDEX_BTREE) continue;
 
-        uint32_t row_offset = 0;
-        while (row_offset + right_schema->row_size <= PAGE_SIZE) {
-            bool deleted = *(bool*)(page->data + row_offset);
-
-            if (!deleted) {
-                // Get join key from right table
-                void* key = get_column_value(right_schema, page, row_offset, right_join_col);
-                if (key) {
-                    // Simple hash function
-                    uint32_t hash = (*(int*)key) % 1000;  // Assuming INT keys
-
-                    // Store entire row
-                    void** row_data = SAFE_MALLOC(void*, right_schema->column_count);
-                    for (uint32_t i = 0; i < right_schema->column_count; i++) {
-                        uint32_t col_offset = get_column_offset(right_schema, i);
-                        uint32_t col_size = get_column_size(&right_schema->columns[i]);
-                        // row_data[i] = malloc(col_size);
-                        row_data[i] = SAFE_MALLOC(void*, col_size);
-                        memcpy(row_data[i], page->data + row_offset + col_offset, col_size);
-                    }
+        BTreeIndex* index = btree_create_index(sm, schema, defs[i].name);
+        BTreeStats stats;
+        bool ok = index && btree_stats(sm, index, &stats);
+        uint32_t key_size = index ? index->key_size : 0;
+        btree_free_index(index);
+        if (!ok) continue;
 
-                    // HashEntry* entry = malloc(sizeof(HashEntry));
-                    HashEntry* entry = SAFE_MALLOC(HashEntry, 1);
-                    entry->key = key;
-                    entry->row_data = row_data;
-                    hash_table[hash] = entry;
-                }
-            }
+        char cells[sizeof(columns) / sizeof(columns[0])][STAT_CELL_SIZE];
+        const char* row[sizeof(columns) / sizeof(columns[0])];
+        row[0] = defs[i].name;
+        row[1] = format_count(cells[1], stats.height);
+        row[2] = format_count(cells[2], stats.leaf_pages);
+        row[3] = format_count(cells[3], stats.internal_pages);
+        row[4] = format_count(cells[4], stats.entries);
+        row[5] = format_count(cells[5], stats.distinct_keys);
+        row[6] = format_count(cells[6], stats.max_duplicates);
+        row[7] = format_percent(cells[7], stats.leaf_bytes, (uint64_t)stats.leaf_pages * PAGE_SIZE);
+        row[8] = format_percent(cells[8], stats.internal_bytes, (uint64_t)stats.internal_pages * PAGE_SIZE);
+        // Share of leaf-to-leaf steps a range scan cannot take sequentially
+        row[9] = format_percent(cells[9], stats.leaf_jumps, stats.leaf_pages > 1 ? stats.leaf_pages - 1 : 0);
+        row[10] = format_count(cells[10], stats.empty_leaves);
 
-            row_offset += right_schema->row_size;
+        if (stats.leaf_pages == 0) {
+            strcpy(cells[11], "-");
+        } else {
+            snprintf(cells[11], STAT_CELL_SIZE, "%u/%.0f/%u", stats.min_leaf_entries,
+                     (double)stats.entries / stats.leaf_pages, stats.max_leaf_entries);
         }
+        row[11] = cells[11];
 
-        // Get next page
-        if (PAGE_SIZE >= sizeof(uint32_t)) {
-            right_page = *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
+        if (stats.entries == 0) {
+            strcpy(cells[12], "-");
         } else {
-            right_page = 0;
+            // Stored bytes per key against the encoded key width
+            snprintf(cells[12], STAT_CELL_SIZE, "%.1f of %u", (double)stats.key_bytes / stats.entries, key_size);
         }
+        row[12] = cells[12];
+
+        result_add_row(result, row);
     }
 
-    // Second pass: Probe with left table
-    uint32_t max_rows = 1000;
-    result->rows = SAFE_MALLOC(void**, max_rows);
-    uint32_t rows_found = 0;
+    if (result->row_count == 0) {
+        result->error_message = SAFE_MALLOC(char, 128);
+        snprintf(result->error_message, 128, "Table '%s' has no B-tree indexes", schema->name);
+    }
 
-    uint32_t left_page = sm->header.root_page;
-    while (left_page != 0 && rows_found < max_rows) {
-        Page* page = sm_get_page(sm, left_page);
-        if (!page) break;
+    SAFE_FREE(schema);
+    return result;
+}
 
-        uint32_t row_offset = 0;
-        while (row_offset + left_schema->row_size <= PAGE_SIZE && rows_found < max_rows) {
-            bool deleted = *(bool*)(page->data + row_offset);
-
-            if (!deleted) {
-                // Get join key from left table
-                void* key = get_column_value(left_schema, page, row_offset, left_join_col);
-                if (key) {
-                    // Find matching entry in hash table
-                    uint32_t hash = (*(int*)key) % 1000;
-                    HashEntry* entry = hash_table[hash];
-
-                    if (entry) {
-                        // Compare keys (simple integer comparison for now)
-                        if (memcmp(key, entry->key, sizeof(int)) == 0) {
-                            // Create joined row
-                            void** joined_row = SAFE_MALLOC(void*, result->column_count);
-
-                            // Copy left table columns
-                            for (uint32_t i = 0; i < left_schema->column_count; i++) {
-                                uint32_t col_offset = get_column_offset(left_schema, i);
-                                uint32_t col_size = get_column_size(&left_schema->columns[i]);
-                                // joined_row[i] = malloc(col_size + 1); // +1 for strings
-                                joined_row[i] = SAFE_MALLOC(void*, col_size);
-                                memcpy(joined_row[i], page->data + row_offset + col_offset, col_size);
-                                if (left_schema->columns[i].type == DT_STRING) {
-                                    ((char*)joined_row[i])[col_size] = '\0';
-                                }
-                            }
-
-                            // Copy right table columns
-                            for (uint32_t i = 0; i < right_schema->column_count; i++) {
-                                uint32_t col_idx = left_schema->column_count + i;
-                                uint32_t col_size = get_column_size(&right_schema->columns[i]);
-                                joined_row[col_idx] = malloc(col_size + 1);
-                                memcpy(joined_row[col_idx], entry->row_data[i], col_size);
-                                if (right_schema->columns[i].type == DT_STRING) {
-                                    ((char*)joined_row[col_idx])[col_size] = '\0';
-                                }
-                            }
-
-                            result->rows[rows_found++] = joined_row;
-                        }
-                    }
+// Feeds every live row of the table to a statistics sample
+static void analyze_table(StorageManager* sm, TableSchema* schema, TableStats* stats) {
+    StatsSample* sample = stats_sample_create(schema->column_count);
+    uint32_t slots = rows_per_page(schema);
+    uint8_t values[MAX_COLUMNS * STATS_VALUE_SIZE];
+    uint64_t hashes[MAX_COLUMNS];
+    uint8_t encoded[BTREE_MAX_KEY_SIZE];
 
-                    free(key);
-                }
-            }
+    memset(stats, 0, sizeof(TableStats));
+    snprintf(stats->table_name, MAX_TABLE_NAME, "%s", schema->name);
 
-            row_offset += left_schema->row_size;
-        }
+    ZoneBounds bounds;
+    ZoneScan zones;
+    memset(&bounds, 0, sizeof(ZoneBounds));
+    zone_scan_begin(&zones, sm, schema, &bounds);
 
-        // Get next page
-        if (PAGE_SIZE >= sizeof(uint32_t)) {
-            left_page = *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
-        } else {
-            left_page = 0;
-        }
-    }
+    uint32_t page_id;
+    while ((page_id = zone_scan_next(&zones)) != 0) {
+        Page* page = sm_get_page(sm, page_id);
+        if (!page) break;
 
-    result->row_count = rows_found;
+        bool has_rows = false;
+        for (uint32_t slot = 0; slot < slots; slot++) {
+            uint32_t row_offset = slot * schema->row_size;
+            if (slot_is_empty(page, row_offset) || *(bool*)(page->data + row_offset)) continue;
 
-    // Cleanup hash table
-    for (int i = 0; i < 1000; i++) {
-        if (hash_table[i]) {
-            SAFE_FREE(hash_table[i]->key);
-            for (uint32_t j = 0; j < right_schema->column_count; j++) {
-                SAFE_FREE(hash_table[i]->row_data[j]);
+            uint8_t* row = page->data + row_offset;
+            for (uint32_t c = 0; c < schema->column_count; c++) {
+                uint32_t width = btree_encode_value(&schema->columns[c], row + schema->column_offsets[c], encoded);
+                memset(values + c * STATS_VALUE_SIZE, 0, STATS_VALUE_SIZE);
+                memcpy(values + c * STATS_VALUE_SIZE, encoded, width < STATS_VALUE_SIZE ? width : STATS_VALUE_SIZE);
+                hashes[c] = value_hash(encoded, width);
             }
-            SAFE_FREE(hash_table[i]->row_data);
-            SAFE_FREE(hash_table[i]);
+            stats_sample_add(sample, values, hashes);
+            has_rows = true;
         }
+        stats->page_count += has_rows;
     }
+    stats_sample_finish(sample, stats);
+}
 
-    SAFE_FREE(left_schema);
-    SAFE_FREE(right_schema);
-
-    return result;
+// Renders a histogram bound; strings show their first STATS_VALUE_SIZE bytes
+static void format_bound(ColumnDef* column, const uint8_t* bound, char* out) {
+    uint8_t encoded[BTREE_MAX_KEY_SIZE] = { 0 };
+    uint8_t value[MAX_STRING_LEN + 1] = { 0 };
+    memcpy(encoded, bound, STATS_VALUE_SIZE);
+    btree_decode_value(column, encoded, value);
+    format_value(column, value, out);
 }
 
-QueryResult* execute_insert(StorageManager* sm, SQLStatement* stmt) {
-    QueryResult* result = SAFE_MALLOC(QueryResult, 1);
-    memset(result, 0, sizeof(QueryResult));
-    
-    // Load schema to validate
-    TableSchema* schema = load_schema(sm, stmt->insert_table);
-    if (!schema) {
-        result->error_message = SAFE_STRDUP("Table not found");
-        return result;
+// ANALYZE [table]: collects the planner statistics of a table, or of every
+// table, and shows them one row per column
+QueryResult* execute_analyze(StorageManager* sm, SQLStatement* stmt) {
+    QueryResult* result = SAFE_CALLOC(QueryResult, 1);
+
+    static const char* columns[] = { "table", "column", "rows", "pages", "distinct", "histogram" };
+    result->column_count = sizeof(columns) / sizeof(columns[0]);
+    for (uint32_t i = 0; i < result->column_count; i++) {
+        strcpy(result->column_names[i], columns[i]);
     }
-    
-    // Validate value count matches column count
-    if (stmt->insert_value_count != schema->column_count) {
-        result->error_message = SAFE_STRDUP("Value count doesn't match column count");
-        SAFE_FREE(schema);
-        return result;
+
+    char tables[100][MAX_TABLE_NAME];
+    uint32_t table_count;
+    if (stmt->table_name[0] != '\0') {
+        snprintf(tables[0], MAX_TABLE_NAME, "%s", stmt->table_name);
+        table_count = 1;
+    } else {
+        table_count = get_all_tables(sm, tables, 100);
     }
-    
-    // Find primary key column
-    int pk_index = -1;
-    for (uint32_t i = 0; i < schema->column_count; i++) {
-        if (schema->columns[i].is_primary) {
-            pk_index = i;
-            break;
+
+    for (uint32_t t = 0; t < table_count; t++) {
+        TableSchema* schema = load_schema(sm, tables[t]);
+        if (!schema) {
+            result->error_message = SAFE_MALLOC(char, 128);
+            snprintf(result->error_message, 128, "Table '%s' not found", tables[t]);
+            return result;
         }
-    }
-    
-    // If primary key exists, check for duplicates
-    if (pk_index >= 0) {
-        BTreeIndex* pk_index_ptr = btree_create_index(schema, pk_index);
-        if (btree_search(sm, pk_index_ptr, stmt->insert_values[pk_index]) != 0) {
-            result->error_message = SAFE_STRDUP("Primary key violation - duplicate value");
-            btree_free_index(pk_index_ptr);
+
+        TableStats stats;
+        analyze_table(sm, schema, &stats);
+        if (!stats_save(sm, &stats)) {
+            result->error_message = SAFE_MALLOC(char, 128);
+            snprintf(result->error_message, 128, "Cannot save the statistics of '%s'", schema->name);
             SAFE_FREE(schema);
             return result;
         }
-        btree_free_index(pk_index_ptr);
-    }
-    
-    // Allocate new page if needed
-    if (sm->header.root_page == 0) {
-        sm->header.root_page = sm_allocate_page(sm);
-    }
-    
-    // Find page with free space
-    uint32_t current_page = sm->header.root_page;
-    Page* page = sm_get_page(sm, current_page);
-    
-    // Find free space in page
-    uint32_t free_offset = 0;
-    bool found_space = false;
-    
-    while (free_offset + schema->row_size <= PAGE_SIZE) {
-        bool slot_used = *(bool*)(page->data + free_offset);
-        if (!slot_used) {
-            found_space = true;
-            break;
+
+        for (uint32_t c = 0; c < schema->column_count; c++) {
+            ColumnStats* column = &stats.columns[c];
+            char cells[3][STAT_CELL_SIZE];
+            char histogram[EXPLAIN_LINE_SIZE] = "-";
+            size_t length = 0;
+            for (uint32_t b = 0; b < column->bucket_count + (column->bucket_count > 0); b++) {
+                char bound[MAX_STRING_LEN + 1];
+                format_bound(&schema->columns[c], column->bounds[b], bound);
+                length += (size_t)snprintf(histogram + length, sizeof(histogram) - length, "%s%s",
+                                           b > 0 ? " | " : "", bound);
+                if (length >= sizeof(histogram)) break;
+            }
+
+            const char* row[] = {
+                schema->name, schema->columns[c].name, format_count(cells[0], stats.row_count),
+                format_count(cells[1], stats.page_count), format_count(cells[2], column->distinct), histogram
+            };
+            result_add_row(result, row);
         }
-        free_offset += schema->row_size;
-    }
-    
-    if (!found_space) {
-        // Allocate new page
-        uint32_t new_page = sm_allocate_page(sm);
-        // Link pages (simplified)
-        *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t)) = new_page;
-        page->is_dirty = true;
-        
-        current_page = new_page;
-        page = sm_get_page(sm, current_page);
-        free_offset = 0;
+        SAFE_FREE(schema);
     }
-    
-    // Serialize and insert row
-    void* row_data = serialize_row(schema, stmt->insert_values);
-    memcpy(page->data + free_offset, row_data, schema->row_size);
-    page->is_dirty = true;
-    
-    // Update B-Tree index if primary key exists
-    if (pk_index >= 0) {
-        BTreeIndex* pk_index_ptr = btree_create_index(schema, pk_index);
-        btree_insert(sm, pk_index_ptr, stmt->insert_values[pk_index], current_page);
-        btree_free_index(pk_index_ptr);
+
+    if (table_count == 0) {
+        result->error_message = SAFE_STRDUP("No tables to analyze");
     }
-    
-    SAFE_FREE(row_data);
-    SAFE_FREE(schema);
-    
-    result->column_count = 1;
-    strcpy(result->column_names[0], "rows_affected");
-    result->row_count = 1;
-    result->rows = SAFE_MALLOC(void**, 1);
-    result->rows[0] = SAFE_MALLOC(void*, 1);
-    result->rows[0][0] = SAFE_STRDUP("1");
-    
     return result;
 }
 
-// Add to executor.c
-QueryResult* execute_update(StorageManager* sm, SQLStatement* stmt) {
+// Rebuilds a B-tree index (or every B-tree index of a table) compactly
+QueryResult* execute_reindex(StorageManager* sm, SQLStatement* stmt) {
     QueryResult* result = SAFE_CALLOC(QueryResult, 1);
-    
-    // Load schema
-    TableSchema* schema = load_schema(sm, stmt->update_table);
-    if (!schema) {
-        result->error_message = SAFE_STRDUP("Table not found");
-        return result;
-    }
-    
-    // Validate that all columns exist
-    for (uint32_t i = 0; i < stmt->update_column_count; i++) {
-        bool column_found = false;
-        for (uint32_t j = 0; j < schema->column_count; j++) {
-            if (strcmp(stmt->update_columns[i], schema->columns[j].name) == 0) {
-                column_found = true;
-                break;
-            }
-        }
-        if (!column_found) {
-            result->error_message = SAFE_MALLOC(char, 100);
-            snprintf(result->error_message, 100, "Column '%s' not found", stmt->update_columns[i]);
-            SAFE_FREE(schema);
+
+    IndexDef defs[MAX_TABLE_INDEXES];
+    uint32_t index_count = 0;
+    if (stmt->index_table[0] != '\0') {
+        index_count = index_catalog_list(sm, stmt->index_table, defs, MAX_TABLE_INDEXES);
+        if (index_count == 0) {
+            result->error_message = SAFE_MALLOC(char, 128);
+            snprintf(result->error_message, 128, "Table '%s' has no indexes", stmt->index_table);
             return result;
         }
-    }
-    
-    // Simple table scan to find rows to update
-    uint32_t current_page = sm->header.root_page;
-    uint32_t rows_updated = 0;
-    
-    while (current_page != 0) {
-        Page* page = sm_get_page(sm, current_page);
-        if (!page) break;
-        
-        uint32_t row_offset = 0;
-        
-        while (row_offset + schema->row_size <= PAGE_SIZE) {
-            // Check if this is a valid row
-            bool all_zeros = true;
-            for (uint32_t i = 0; i < 8 && row_offset + i < PAGE_SIZE; i++) {
-                if (page->data[row_offset + i] != 0) {
-                    all_zeros = false;
-                    break;
-                }
-            }
-            
-            if (all_zeros) {
-                row_offset += schema->row_size;
-                continue;
-            }
-            
-            bool deleted = *(bool*)(page->data + row_offset);
-            // uint32_t row_id = *(uint32_t*)(page->data + row_offset + sizeof(bool));
-            
-            if (!deleted) {
-                // Check WHERE condition if present
-                bool should_update = true;
-                
-                if (stmt->where_value && stmt->where_column[0] != '\0') {
-                    should_update = false;
-                    
-                    // Find the column to filter
-                    for (uint32_t i = 0; i < schema->column_count; i++) {
-                        if (strcmp(schema->columns[i].name, stmt->where_column) == 0) {
-                            uint32_t col_offset = get_column_offset(schema, i);
-                            uint32_t col_size = get_column_size(&schema->columns[i]);
-                            
-                            if (col_size == sizeof(int)) {
-                                int row_value;
-                                memcpy(&row_value, page->data + row_offset + col_offset, sizeof(int));
-                                int filter_value = *(int*)stmt->where_value;
-                                
-                                // Simple equality check for now
-                                if (row_value == filter_value) {
-                                    should_update = true;
-                                }
-                            }
-                            break;
-                        }
-                    }
-                }
-                
-                // Update the row if it matches WHERE condition
-                if (should_update) {
-                    // For each column to update
-                    for (uint32_t i = 0; i < stmt->update_column_count; i++) {
-                        // Find column index in schema
-                        for (uint32_t j = 0; j < schema->column_count; j++) {
-                            if (strcmp(stmt->update_columns[i], schema->columns[j].name) == 0) {
-                                uint32_t col_offset = get_column_offset(schema, j);
-                                uint32_t col_size = get_column_size(&schema->columns[j]);
-                                
-                                // Update the value
-                                if (stmt->update_values[i]) {
-                                    memcpy(page->data + row_offset + col_offset, 
-                                           stmt->update_values[i], col_size);
-                                }
-                                break;
-                            }
-                        }
-                    }
-                    
-                    page->is_dirty = true;
-                    rows_updated++;
-                }
-            }
-            
-            row_offset += schema->row_size;
-        }
-        
-        // Get next page
-        if (PAGE_SIZE >= sizeof(uint32_t)) {
-            current_page = *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
-        } else {
-            current_page = 0;
+    } else {
+        if (!index_catalog_load(sm, stmt->index_name, &defs[0])) {
+            result->error_message = SAFE_MALLOC(char, 128);
+            snprintf(result->error_message, 128, "Index '%s' does not exist", stmt->index_name);
+            return result;
         }
-    }
-    
-    SAFE_FREE(schema);
-    
-    // Return result
-    result->column_count = 1;
-    strcpy(result->column_names[0], "rows_updated");
-    result->row_count = 1;
-    result->rows = SAFE_MALLOC(void**, 1);
-    result->rows[0] = SAFE_MALLOC(void*, 1);
-    
-    char* msg = SAFE_MALLOC(char, 20);
-    snprintf(msg, 20, "%u", rows_updated);
-    result->rows[0][0] = msg;
-    
-    return result;
-}
-
-QueryResult* execute_delete(StorageManager* sm, SQLStatement* stmt) {
-    QueryResult* result = SAFE_MALLOC(QueryResult, 1);
-    memset(result, 0, sizeof(QueryResult));
-    
-    result->column_count = 1;
-    strcpy(result->column_names[0], "rows_affected");
-    result->row_count = 1;
-    result->rows = SAFE_MALLOC(void**, 1);
-    result->rows[0] = SAFE_MALLOC(void*, 1);
-    
-    // Simple implementation: mark as deleted
-    if (stmt->where_value && stmt->table_name[0] != '\0') {
-        TableSchema* schema = load_schema(sm, stmt->table_name);
-        if (schema) {
-            // Scan and mark matching rows as deleted
-            uint32_t current_page = sm->header.root_page;
-            uint32_t deleted_count = 0;
-            
-            while (current_page != 0) {
-                Page* page = sm_get_page(sm, current_page);
-                uint32_t row_offset = 0;
-                
-                while (row_offset + schema->row_size <= PAGE_SIZE) {
-                    bool deleted = *(bool*)(page->data + row_offset);
-                    
-                    if (!deleted) {
-                        // Check if this row matches WHERE condition
-                        bool match = true;
-                        if (stmt->where_column[0] != '\0') {
-                            for (uint32_t i = 0; i < schema->column_count; i++) {
-                                if (strcmp(schema->columns[i].name, stmt->where_column) == 0) {
-                                    uint32_t col_offset = get_column_offset(schema, i);
-                                    uint32_t col_size = get_column_size(&schema->columns[i]);
-                                    
-                                    if (col_size == sizeof(int)) {
-                                        int row_value;
-                                        memcpy(&row_value, page->data + row_offset + col_offset, sizeof(int));
-                                        int filter_value = *(int*)stmt->where_value;
-                                        if (row_value != filter_value) {
-                                            match = false;
-                                        }
-                                    }
-                                    break;
-                                }
-                            }
-                        }
-                        
-                        if (match) {
-                            // Mark as deleted
-                            *(bool*)(page->data + row_offset) = true;
-                            page->is_dirty = true;
-                            deleted_count++;
-                        }
-                    }
-                    
-                    row_offset += schema->row_size;
-                }
-                
-                current_page = *(uint32_t*)(page->data + PAGE_SIZE - sizeof(uint32_t));
-            }
-            
-            SAFE_FREE(schema);
-            
-            char* msg = SAFE_MALLOC(char, 20);
-            snprintf(msg, 20, "%u", deleted_count);
-            result->rows[0][0] = msg;
+        if (defs[0].method != INDEX_BTREE) {
+            result->error_message = SAFE_MALLOC(char, 128);
+            snprintf(result->error_message, 128, "Only B-tree indexes can be rebuilt");
             return result;
         }
+        index_count = 1;
     }
-    
-    result->rows[0][0] = SAFE_STRDUP("0");
-    return result;
-}
 
-QueryResult* execute_drop_table(StorageManager* sm, SQLStatement* stmt) {
-    QueryResult* result = SAFE_CALLOC(QueryResult, 1);
+    TableSchema* schema = load_schema(sm, defs[0].table_name);
+    if (!schema) {
+        result->error_message = SAFE_STRDUP("Table not found");
+        return result;
+    }
 
     result->column_count = 1;
     strcpy(result->column_names[0], "status");
-    result->row_count = 1;
-    result->rows = SAFE_MALLOC(void**, 1);
-    result->rows[0] = SAFE_MALLOC(void*, 1);
 
-    // Check if table exists
-    TableSchema* schema = load_schema(sm, stmt->drop_table);
-    if (!schema) {
-        result->rows[0][0] = strdup("Table does not exist");
-        return result;
+    char msg[256];
+
+    for (uint32_t i = 0; i < index_count; i++) {
+        if (defs[i].method != INDEX_BTREE) continue;
+
+        BTreeIndex* index = btree_create_index(sm, schema, defs[i].name);
+        BTreeStats before, after;
+        bool ok = index && btree_stats(sm, index, &before) && btree_rebuild(sm, index) &&
+                  btree_stats(sm, index, &after);
+        btree_free_index(index);
+
+        if (ok) {
+            snprintf(msg, sizeof(msg), "Index '%s' rebuilt: %u -> %u pages, height %u -> %u",
+                     defs[i].name, before.leaf_pages + before.internal_pages,
+                     after.leaf_pages + after.internal_pages, before.height, after.height);
+        } else {
+            snprintf(msg, sizeof(msg), "Index '%s' could not be rebuilt", defs[i].name);
+        }
+        result_add_row(result, (const char*[]){ msg });
     }
-    SAFE_FREE(schema);
 
-    // Delete the schema
-    // if (delete_schema(sm, stmt->drop_table)) {
-    //     // TODO: Also delete all data pages associated with this table
-    //     // For now, we'll just delete the schema
-    //
-    //     result->rows[0][0] = malloc(100);
-    //     snprintf((char*)result->rows[0][0], 100,
-    //             "Table '%s' dropped successfully", stmt->drop_table);
-    // } else {
-    //     result->rows[0][0] = SAFE_STRDUP("Failed to drop table");
-    // }
+    if (result->row_count > 0) {
+        result->success_message = SAFE_STRDUP(msg);
+    }
 
+    SAFE_FREE(schema);
     return result;
 }
 
@@ -759,17 +5096,12 @@ bool save_schema(StorageManager* sm, TableSchema* schema) {
     // Use the schema page from header
     uint32_t schema_page_id = sm->header.schema_page;
     if (schema_page_id == 0) {
-        // Allocate first schema page (page 1)
-        // schema_page_id = sm_allocate_page(sm);
-        schema_page_id = 1; // Schema always starts at page 1
+        // Allocate the schema page on first use; heap and index pages are
+        // allocated from the same file, so it cannot assume a fixed page id
+        schema_page_id = sm_allocate_page(sm);
         sm->header.schema_page = schema_page_id;
 
         printf("DEBUG: Allocated schema page %u\n", schema_page_id);
-
-        // Make sure page 1 exists
-        if (schema_page_id >= sm->header.page_count) {
-            sm_allocate_page(sm); // This will create page 1
-        }
     }
     
     Page* schema_page = sm_get_page(sm, schema_page_id);
@@ -785,7 +5117,7 @@ bool save_schema(StorageManager* sm, TableSchema* schema) {
 
     printf("DEBUG: Searching for slot in schema page...\n");
     
-    while (offset + sizeof(TableSchema) <= PAGE_SIZE) {
+    while (offset + TABLE_SCHEMA_DISK_SIZE <= SCHEMA_PAGE_STATS_OFFSET) {
         // Read table name
         memcpy(stored_name, schema_page->data + offset, MAX_TABLE_NAME);
 
@@ -798,7 +5130,7 @@ bool save_schema(StorageManager* sm, TableSchema* schema) {
             break;
         }
         
-        offset += sizeof(TableSchema);
+        offset += TABLE_SCHEMA_DISK_SIZE;
     }
 
     if (!found_slot) {
@@ -806,15 +5138,15 @@ bool save_schema(StorageManager* sm, TableSchema* schema) {
         return false;
     }
     
-    if (offset + sizeof(TableSchema) > PAGE_SIZE) {
+    if (offset + TABLE_SCHEMA_DISK_SIZE > SCHEMA_PAGE_STATS_OFFSET) {
         // Page full - need to handle in real implementation
         printf("DEBUG: Page full at offset %u\n", offset);
         return false;
     }
     
     // Save the schema at the calculated offset
-    printf("DEBUG: Saving schema at offset %u (size: %lu)\n", offset, sizeof(TableSchema));
-    memcpy(schema_page->data + offset, schema, sizeof(TableSchema));
+    printf("DEBUG: Saving schema at offset %u (size: %lu)\n", offset, TABLE_SCHEMA_DISK_SIZE);
+    memcpy(schema_page->data + offset, schema, TABLE_SCHEMA_DISK_SIZE);
     schema_page->is_dirty = true;
     
     return true;
@@ -831,7 +5163,7 @@ TableSchema* load_schema(StorageManager* sm, const char* table_name) {
     uint32_t offset = 0;
     char stored_name[MAX_TABLE_NAME];
     
-    while (offset + sizeof(TableSchema) <= PAGE_SIZE) {
+    while (offset + TABLE_SCHEMA_DISK_SIZE <= SCHEMA_PAGE_STATS_OFFSET) {
         memcpy(stored_name, schema_page->data + offset, MAX_TABLE_NAME);
         
         if (stored_name[0] == '\0') {
@@ -841,17 +5173,35 @@ TableSchema* load_schema(StorageManager* sm, const char* table_name) {
         
         if (strcmp(stored_name, table_name) == 0) {
             // Found the schema
-            TableSchema* schema = SAFE_MALLOC(TableSchema, 1);
-            memcpy(schema, schema_page->data + offset, sizeof(TableSchema));
+            TableSchema* schema = SAFE_CALLOC(TableSchema, 1);
+            memcpy(schema, schema_page->data + offset, TABLE_SCHEMA_DISK_SIZE);
+            compute_column_layout(schema);
             return schema;
         }
         
-        offset += sizeof(TableSchema);
+        offset += TABLE_SCHEMA_DISK_SIZE;
     }
     
     return NULL;
 }
 
+// Jumps straight to the row an index entry points at. Returns NULL for
+// slots that are empty, deleted or out of range. The pointer refers to the
+// cached page and is only valid until the next page fetch.
+uint8_t* fetch_row(StorageManager* sm, TableSchema* schema, RID rid) {
+    if (rid.page_id == 0 || rid.slot >= rows_per_page(schema)) return NULL;
+
+    Page* page = sm_get_page(sm, rid.page_id);
+    if (!page) return NULL;
+
+    uint32_t row_offset = rid.slot * schema->row_size;
+    if (slot_is_empty(page, row_offset) || *(bool*)(page->data + row_offset)) {
+        return NULL;
+    }
+
+    return page->data + row_offset;
+}
+
 uint32_t calculate_row_size(TableSchema* schema) {
     uint32_t row_size = 0;
     
@@ -888,11 +5238,15 @@ void* serialize_row(TableSchema* schema, void** values) {
 
     // Serialize column values
     for (uint32_t i = 0; i < schema->column_count; i++) {
-        uint32_t col_size = get_column_size(&schema->columns[i]);
+        uint32_t col_size = schema->column_sizes[i];
         
         if (!values[i]) {
             // NULL value handling
             memset(row_data + offset, 0, col_size);
+        } else if (schema->columns[i].type == DT_STRING) {
+            // Strings are zero padded up to the column length
+            memset(row_data + offset, 0, col_size);
+            strncpy((char*)(row_data + offset), (char*)values[i], col_size);
         } else {
             memcpy(row_data + offset, values[i], col_size);
         }
@@ -909,7 +5263,7 @@ void** deserialize_row(TableSchema* schema, void* row_data) {
     void** values = SAFE_MALLOC(void*, schema->column_count);
     
     for (uint32_t i = 0; i < schema->column_count; i++) {
-        uint32_t col_size = get_column_size(&schema->columns[i]);
+        uint32_t col_size = schema->column_sizes[i];
         values[i] = SAFE_MALLOC(void, col_size + 1);
         memcpy(values[i], data + offset, col_size);
         
@@ -934,7 +5288,7 @@ uint32_t count_tables(StorageManager* sm) {
     uint32_t offset = 0;
     char table_name[MAX_TABLE_NAME];
 
-    while (offset + sizeof(TableSchema) <= PAGE_SIZE) {
+    while (offset + TABLE_SCHEMA_DISK_SIZE <= SCHEMA_PAGE_STATS_OFFSET) {
         memcpy(table_name, schema_page->data + offset, MAX_TABLE_NAME);
 
         if (table_name[0] == '\0') {
@@ -942,7 +5296,7 @@ uint32_t count_tables(StorageManager* sm) {
         }
 
         table_count++;
-        offset += sizeof(TableSchema);
+        offset += TABLE_SCHEMA_DISK_SIZE;
     }
 
     return table_count;
@@ -958,7 +5312,7 @@ uint32_t get_all_tables(StorageManager* sm, char table_names[][MAX_TABLE_NAME],
     uint32_t count = 0;
     uint32_t offset = 0;
     
-    while (offset + sizeof(TableSchema) <= PAGE_SIZE && count < max_tables) {
+    while (offset + TABLE_SCHEMA_DISK_SIZE <= SCHEMA_PAGE_STATS_OFFSET && count < max_tables) {
         char table_name[MAX_TABLE_NAME];
         memcpy(table_name, schema_page->data + offset, MAX_TABLE_NAME);
         
@@ -968,7 +5322,7 @@ uint32_t get_all_tables(StorageManager* sm, char table_names[][MAX_TABLE_NAME],
         
         strcpy(table_names[count], table_name);
         count++;
-        offset += sizeof(TableSchema);
+        offset += TABLE_SCHEMA_DISK_SIZE;
     }
     
     return count;
@@ -986,38 +5340,58 @@ QueryResult* execute_show_tables(StorageManager* sm) {
     uint32_t table_count = get_all_tables(sm, table_names, 100);
     
     if (table_count == 0) {
-        result->row_count = 1;
-        result->rows = SAFE_MALLOC(void**, 1);
-        result->rows[0] = SAFE_MALLOC(void*, 1);
-        result->rows[0][0] = SAFE_STRDUP("No tables found");
+        result_add_row(result, (const char*[]){ "No tables found" });
         return result;
     }
     
-    result->row_count = table_count;
-    result->rows = SAFE_MALLOC(void**, table_count);
-    
     for (uint32_t i = 0; i < table_count; i++) {
-        result->rows[i] = SAFE_MALLOC(void*, 1);
-        result->rows[i][0] = SAFE_STRDUP(table_names[i]);
+        result_add_row(result, (const char*[]){ table_names[i] });
     }
     
     return result;
 }
 
 
+void result_add_row(QueryResult* result, const char* const* values) {
+    size_t lengths[MAX_COLUMNS];
+    size_t size = result->column_count * sizeof(uint32_t);
+    for (uint32_t i = 0; i < result->column_count; i++) {
+        lengths[i] = values[i] ? strlen(values[i]) + 1 : 0;
+        size += lengths[i];
+    }
+
+    size_t start = arena_alloc(&result->rows, size);
+    uint8_t* row = arena_at(&result->rows, start);
+    uint32_t* offsets = (uint32_t*)row;
+    uint32_t end = result->column_count * sizeof(uint32_t);
+    for (uint32_t i = 0; i < result->column_count; i++) {
+        if (!values[i]) {
+            offsets[i] = 0;
+            continue;
+        }
+        offsets[i] = end;
+        memcpy(row + end, values[i], lengths[i]);
+        end += lengths[i];
+    }
+
+    size_t slot = arena_alloc(&result->row_index, sizeof(size_t));
+    *(size_t*)arena_at(&result->row_index, slot) = start;
+    result->row_count++;
+}
+
+const char* result_value(const QueryResult* result, uint32_t row, uint32_t column) {
+    size_t start = ((const size_t*)result->row_index.data)[row];
+    const uint8_t* data = arena_at(&result->rows, start);
+    uint32_t offset = ((const uint32_t*)data)[column];
+    return offset ? (const char*)data + offset : NULL;
+}
+
 // Free query result memory
 void free_result(QueryResult* result) {
     if (!result) return;
     
-    for (uint32_t i = 0; i < result->row_count; i++) {
-        if (result->rows[i]) {
-            for (uint32_t j = 0; j < result->column_count; j++) {
-                SAFE_FREE(result->rows[i][j]);
-            }
-            SAFE_FREE(result->rows[i]);
-        }
-    }
-    SAFE_FREE(result->rows);
+    arena_release(&result->rows);
+    arena_release(&result->row_index);
     SAFE_FREE(result->success_message);
     SAFE_FREE(result->error_message);
     SAFE_FREE(result);
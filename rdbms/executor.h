@@ -3,20 +3,49 @@
 
 #include "storage.h"
 #include "parser.h"
+#include "arena.h"
 
+// A fully materialised result. Rows are kept back to back in one arena:
+// each row starts with the offsets of its cells (0 for SQL NULL),
+// relative to the row, followed by the cells' NUL terminated text.
+// row_index holds where every row starts. Read cells with result_value.
 typedef struct QueryResult
 {
     uint32_t column_count;
     char column_names[MAX_COLUMNS][MAX_COLUMN_NAME];
-    void*** rows; // Array of pointers to rows
+    Arena rows;
+    Arena row_index; // size_t offset of each row in `rows`
     uint32_t row_count;
     char* success_message;
     char* error_message;
 } QueryResult;
 
+typedef struct QueryPlan QueryPlan;
+
+// What each sort and hash join of a query may buffer in memory before it
+// spills to disk; taken by queries opened afterwards
+#define DEFAULT_QUERY_MEMORY (4 * 1024 * 1024)
+void query_set_memory_budget(size_t bytes);
+size_t query_memory_budget(void);
+
+// A SELECT being executed. query_next produces one row per call, so a
+// result of any size is read in constant memory; execute_select collects
+// a whole stream into a QueryResult. The statement must outlive the stream.
+typedef struct {
+    uint32_t column_count;
+    char column_names[MAX_COLUMNS][MAX_COLUMN_NAME];
+    const char* values[MAX_COLUMNS]; // current row as text, NULL for SQL NULL; valid until the next call
+    uint64_t row_count;              // rows returned so far
+    char* error_message;             // set when the query fails, before or while running
+    QueryPlan* plan;
+} QueryStream;
+
 QueryResult* execute_create_table(StorageManager* sm, SQLStatement* stmt);
 QueryResult* execute_insert(StorageManager* sm, SQLStatement* stmt);
 QueryResult* execute_select(StorageManager* sm, SQLStatement* stmt);
+QueryStream* query_open(StorageManager* sm, SQLStatement* stmt);
+bool query_next(QueryStream* stream);
+void query_close(QueryStream* stream);
 QueryResult* execute_update(StorageManager* sm, SQLStatement* stmt);
 QueryResult* execute_delete(StorageManager* sm, SQLStatement* stmt);
 uint32_t count_tables(StorageManager* sm);
@@ -24,15 +53,27 @@ uint32_t get_all_tables(StorageManager* sm, char table_names[][MAX_TABLE_NAME],
 QueryResult* execute_show_tables(StorageManager* sm);
 QueryResult* execute_join(StorageManager* sm, SQLStatement* stmt);
 QueryResult* execute_drop_table(StorageManager* sm, SQLStatement* stmt);
+QueryResult* execute_create_index(StorageManager* sm, SQLStatement* stmt);
+QueryResult* execute_drop_index(StorageManager* sm, SQLStatement* stmt);
+QueryResult* execute_reindex(StorageManager* sm, SQLStatement* stmt);
+QueryResult* execute_index_stats(StorageManager* sm, const char* table_name);
+QueryResult* execute_analyze(StorageManager* sm, SQLStatement* stmt);
 bool delete_schema(StorageManager* sm, const char* table_name);
 
 // Helper functions
 TableSchema* load_schema(StorageManager* sm, const char* table_name);
 bool save_schema(StorageManager* sm, TableSchema* schema);
 uint32_t calculate_row_size(TableSchema* schema);
+// Fills column_offsets, column_sizes and row_size from the columns
+void compute_column_layout(TableSchema* schema);
 void* serialize_row(TableSchema* schema, void** values);
 void** deserialize_row(TableSchema* schema, void* row_data);
+uint8_t* fetch_row(StorageManager* sm, TableSchema* schema, RID rid);
 void free_result(QueryResult* result);
+// Appends a row of column_count values; a NULL value is SQL NULL
+void result_add_row(QueryResult* result, const char* const* values);
+// The text of a cell, NULL for SQL NULL; valid until the next row is added
+const char* result_value(const QueryResult* result, uint32_t row, uint32_t column);
 
 
 #endif // EXECUTOR_H
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include "extsort.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+
+typedef struct {
+    long offset;        // file offset of the next unread record
+    size_t remaining;   // records not yet read from the file
+    uint8_t* buffer;
+    size_t buffer_count;
+    size_t buffer_pos;
+} SortRun;
+
+struct ExternalSort {
+    size_t record_size;
+    ExtSortCompare compare;
+    void* context;
+    size_t memory_limit;
+
+    uint8_t* buffer;    // in-memory run being filled
+    uint8_t* scratch;   // merge space, same size as buffer
+    size_t capacity;    // records that fit in the buffer
+    size_t buffered;
+    size_t total;
+
+    FILE* spill;        // sorted runs, written back to back
+    SortRun* runs;
+    size_t run_count;
+    size_t run_capacity;
+
+    bool finished;
+    size_t next_record; // read position when nothing was spilled
+};
+
+ExternalSort* extsort_create(size_t record_size, ExtSortCompare compare, void* context,
+                             size_t memory_limit) {
+    if (record_size == 0 || !compare) return NULL;
+
+    ExternalSort* sort = SAFE_CALLOC(ExternalSort, 1);
+    sort->record_size = record_size;
+    sort->compare = compare;
+    sort->context = context;
+    sort->memory_limit = memory_limit ? memory_limit : EXTSORT_DEFAULT_MEMORY;
+
+    // Half of the budget is merge space for the in-memory sort
+    sort->capacity = sort->memory_limit / 2 / record_size;
+    if (sort->capacity == 0) sort->capacity = 1;
+    sort->buffer = SAFE_MALLOC(uint8_t, sort->capacity * record_size);
+    sort->scratch = SAFE_MALLOC(uint8_t, sort->capacity * record_size);
+
+    return sort;
+}
+
+// Bottom-up merge sort of the buffered records. qsort has no way to pass
+// the comparison context, and merge sort keeps equal records in order.
+static void sort_buffer(ExternalSort* sort) {
+    size_t size = sort->record_size;
+    uint8_t* src = sort->buffer;
+    uint8_t* dst = sort->scratch;
+
+    for (size_t width = 1; width < sort->buffered; width *= 2) {
+        for (size_t lo = 0; lo < sort->buffered; lo += 2 * width) {
+            size_t mid = lo + width < sort->buffered ? lo + width : sort->buffered;
+            size_t hi = lo + 2 * width < sort->buffered ? lo + 2 * width : sort->buffered;
+            size_t i = lo, j = mid, k = lo;
+
+            while (i < mid && j < hi) {
+                if (sort->compare(src + j * size, src + i * size, sort->context) < 0) {
+                    memcpy(dst + k++ * size, src + j++ * size, size);
+                } else {
+                    memcpy(dst + k++ * size, src + i++ * size, size);
+                }
+            }
+            memcpy(dst + k * size, src + i * size, (mid - i) * size);
+            k += mid - i;
+            memcpy(dst + k * size, src + j * size, (hi - j) * size);
+        }
+
+        uint8_t* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    // Keep the sorted records in sort->buffer
+    sort->buffer = src;
+    sort->scratch = dst;
+}
+
+// Sorts the buffered records and appends them to the spill file as a run
+static bool spill_run(ExternalSort* sort) {
+    if (sort->buffered == 0) return true;
+
+    if (!sort->spill) {
+        sort->spill = tmpfile();
+        if (!sort->spill) return false;
+    }
+
+    sort_buffer(sort);
+
+    if (fseek(sort->spill, 0, SEEK_END) != 0) return false;
+    long offset = ftell(sort->spill);
+
+    if (fwrite(sort->buffer, sort->record_size, sort->buffered, sort->spill) != sort->buffered) {
+        return false;
+    }
+
+    if (sort->run_count == sort->run_capacity) {
+        sort->run_capacity = sort->run_capacity ? sort->run_capacity * 2 : 8;
+        sort->runs = SAFE_REALLOC(sort->runs, SortRun, sort->run_capacity);
+    }
+
+    SortRun* run = &sort->runs[sort->run_count++];
+    memset(run, 0, sizeof(SortRun));
+    run->offset = offset;
+    run->remaining = sort->buffered;
+
+    sort->buffered = 0;
+    return true;
+}
+
+bool extsort_add(ExternalSort* sort, const void* record) {
+    if (!sort || sort->finished) return false;
+
+    if (sort->buffered == sort->capacity && !spill_run(sort)) {
+        return false;
+    }
+
+    memcpy(sort->buffer + sort->buffered * sort->record_size, record, sort->record_size);
+    sort->buffered++;
+    sort->total++;
+    return true;
+}
+
+static bool refill_run(ExternalSort* sort, SortRun* run, size_t buffer_records) {
+    if (run->remaining == 0) {
+        run->buffer_count = run->buffer_pos = 0;
+        return true;
+    }
+
+    size_t count = run->remaining < buffer_records ? run->remaining : buffer_records;
+    if (fseek(sort->spill, run->offset, SEEK_SET) != 0) return false;
+    if (fread(run->buffer, sort->record_size, count, sort->spill) != count) return false;
+
+    run->offset += (long)(count * sort->record_size);
+    run->remaining -= count;
+    run->buffer_count = count;
+    run->buffer_pos = 0;
+    return true;
+}
+
+bool extsort_finish(ExternalSort* sort) {
+    if (!sort || sort->finished) return false;
+    sort->finished = true;
+
+    if (sort->run_count == 0) {
+        // Everything fit in memory
+        sort_buffer(sort);
+        return true;
+    }
+
+    if (!spill_run(sort)) return false;
+    SAFE_FREE(sort->buffer);
+    SAFE_FREE(sort->scratch);
+
+    // Split the memory budget between the runs' read buffers
+    size_t buffer_records = sort->memory_limit / sort->record_size / sort->run_count;
+    if (buffer_records == 0) buffer_records = 1;
+
+    for (size_t i = 0; i < sort->run_count; i++) {
+        sort->runs[i].buffer = SAFE_MALLOC(uint8_t, buffer_records * sort->record_size);
+        if (!refill_run(sort, &sort->runs[i], buffer_records)) return false;
+    }
+    sort->capacity = buffer_records;
+    return true;
+}
+
+bool extsort_next(ExternalSort* sort, void* record) {
+    if (!sort || !sort->finished) return false;
+
+    if (sort->run_count == 0) {
+        if (sort->next_record >= sort->buffered) return false;
+        memcpy(record, sort->buffer + sort->next_record * sort->record_size, sort->record_size);
+        sort->next_record++;
+        return true;
+    }
+
+    // Pick the smallest head; runs are few (one per memory_limit of input)
+    SortRun* best = NULL;
+    for (size_t i = 0; i < sort->run_count; i++) {
+        SortRun* run = &sort->runs[i];
+        if (run->buffer_pos == run->buffer_count) continue;
+
+        if (!best || sort->compare(run->buffer + run->buffer_pos * sort->record_size,
+                                   best->buffer + best->buffer_pos * sort->record_size,
+                                   sort->context) < 0) {
+            best = run;
+        }
+    }
+    if (!best) return false;
+
+    memcpy(record, best->buffer + best->buffer_pos * sort->record_size, sort->record_size);
+    best->buffer_pos++;
+
+    if (best->buffer_pos == best->buffer_count) {
+        refill_run(sort, best, sort->capacity);
+    }
+    return true;
+}
+
+size_t extsort_count(ExternalSort* sort) {
+    return sort ? sort->total : 0;
+}
+
+size_t extsort_run_count(ExternalSort* sort) {
+    return sort ? sort->run_count : 0;
+}
+
+void extsort_free(ExternalSort* sort) {
+    if (!sort) return;
+
+    for (size_t i = 0; i < sort->run_count; i++) {
+        SAFE_FREE(sort->runs[i].buffer);
+    }
+    SAFE_FREE(sort->runs);
+    SAFE_FREE(sort->buffer);
+    SAFE_FREE(sort->scratch);
+    if (sort->spill) fclose(sort->spill);
+    SAFE_FREE(sort);
+}
@@ -0,0 +1,27 @@
+// extsort.h
+
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define EXTSORT_DEFAULT_MEMORY (4 * 1024 * 1024)
+
+typedef int (*ExtSortCompare)(const void* a, const void* b, void* context);
+
+// External merge sort of fixed-size records. Records are buffered in
+// memory up to the memory limit; each full buffer is sorted and spilled to
+// a temporary file as a run, and the runs are merged when reading back.
+typedef struct ExternalSort ExternalSort;
+
+ExternalSort* extsort_create(size_t record_size, ExtSortCompare compare, void* context,
+                             size_t memory_limit);
+bool extsort_add(ExternalSort* sort, const void* record);
+bool extsort_finish(ExternalSort* sort); // call once, after the last add
+bool extsort_next(ExternalSort* sort, void* record);
+size_t extsort_count(ExternalSort* sort);
+size_t extsort_run_count(ExternalSort* sort);
+void extsort_free(ExternalSort* sort);
+
+#endif // EXTSORT_H
@@ -0,0 +1,445 @@
+#include "hashindex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+
+// Meta page: split state followed by the directory pages. Each directory
+// page lists the primary page of BUCKETS_PER_DIR_PAGE consecutive buckets.
+#define HASH_DIR_SLOTS ((PAGE_SIZE - 4 * sizeof(uint32_t)) / sizeof(uint32_t))
+#define BUCKETS_PER_DIR_PAGE (PAGE_SIZE / sizeof(uint32_t))
+#define HASH_MAX_BUCKETS (HASH_DIR_SLOTS * BUCKETS_PER_DIR_PAGE)
+
+typedef struct {
+    uint32_t level;        // round of doubling: HASH_INITIAL_BUCKETS << level
+    uint32_t next_split;   // next bucket to split in this round
+    uint32_t bucket_count;
+    uint32_t entry_count;
+    uint32_t dir_pages[HASH_DIR_SLOTS];
+} HashMeta;
+
+// Bucket page layout: header | (hash, key, RID) * count
+typedef struct {
+    uint32_t count;
+    uint32_t overflow; // next page of the bucket chain, 0 at the end
+} BucketHeader;
+
+typedef struct {
+    uint32_t page_id;
+    uint8_t data[PAGE_SIZE];
+} HashPage;
+
+#define BUCKET_HEADER(page) ((BucketHeader*)(page)->data)
+
+static bool read_page(StorageManager* sm, uint32_t page_id, HashPage* page) {
+    Page* cached = sm_get_page(sm, page_id);
+    if (!cached) return false;
+
+    page->page_id = page_id;
+    memcpy(page->data, cached->data, PAGE_SIZE);
+    return true;
+}
+
+static void write_page(StorageManager* sm, HashPage* page) {
+    Page* cached = sm_get_page(sm, page->page_id);
+    if (!cached) return;
+
+    memcpy(cached->data, page->data, PAGE_SIZE);
+    cached->is_dirty = true;
+}
+
+static bool load_meta(StorageManager* sm, HashIndex* index, HashMeta* meta) {
+    Page* page = sm_get_page(sm, index->meta_page);
+    if (!page) return false;
+
+    memcpy(meta, page->data, sizeof(HashMeta));
+    return true;
+}
+
+static void save_meta(StorageManager* sm, HashIndex* index, HashMeta* meta) {
+    Page* page = sm_get_page(sm, index->meta_page);
+    if (!page) return;
+
+    memcpy(page->data, meta, sizeof(HashMeta));
+    page->is_dirty = true;
+}
+
+static uint32_t slot_size(HashIndex* index) {
+    return sizeof(uint32_t) + index->key_size + sizeof(RID);
+}
+
+static uint8_t* bucket_slot(HashIndex* index, HashPage* page, uint32_t i) {
+    return page->data + sizeof(BucketHeader) + i * slot_size(index);
+}
+
+static uint32_t slot_hash(uint8_t* slot) {
+    uint32_t hash;
+    memcpy(&hash, slot, sizeof(uint32_t));
+    return hash;
+}
+
+static RID slot_rid(HashIndex* index, uint8_t* slot) {
+    RID rid;
+    memcpy(&rid, slot + sizeof(uint32_t) + index->key_size, sizeof(RID));
+    return rid;
+}
+
+// FNV-1a with a final avalanche so that the low bits used to pick a
+// bucket depend on every key byte
+static uint32_t hash_key(const uint8_t* key, uint32_t len) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= key[i];
+        hash *= 16777619u;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// Linear hashing address: buckets before the split pointer have already
+// been split this round and use one more hash bit
+static uint32_t bucket_for(HashMeta* meta, uint32_t hash) {
+    uint32_t round_size = HASH_INITIAL_BUCKETS << meta->level;
+    uint32_t bucket = hash & (round_size - 1);
+    if (bucket < meta->next_split) {
+        bucket = hash & (2 * round_size - 1);
+    }
+    return bucket;
+}
+
+static uint32_t bucket_page(StorageManager* sm, HashMeta* meta, uint32_t bucket) {
+    uint32_t dir_page = meta->dir_pages[bucket / BUCKETS_PER_DIR_PAGE];
+    if (dir_page == 0) return 0;
+
+    Page* page = sm_get_page(sm, dir_page);
+    if (!page) return 0;
+
+    uint32_t page_id;
+    memcpy(&page_id, page->data + (bucket % BUCKETS_PER_DIR_PAGE) * sizeof(uint32_t), sizeof(uint32_t));
+    return page_id;
+}
+
+// Allocates the primary page of a new bucket and registers it in the
+// directory. Updates meta but does not save it.
+static uint32_t add_bucket(StorageManager* sm, HashMeta* meta, uint32_t bucket) {
+    uint32_t dir_slot = bucket / BUCKETS_PER_DIR_PAGE;
+    if (meta->dir_pages[dir_slot] == 0) {
+        meta->dir_pages[dir_slot] = sm_allocate_page(sm);
+    }
+
+    uint32_t page_id = sm_allocate_page(sm);
+
+    // Allocation may have evicted the directory page
+    Page* dir = sm_get_page(sm, meta->dir_pages[dir_slot]);
+    if (!dir) return 0;
+    memcpy(dir->data + (bucket % BUCKETS_PER_DIR_PAGE) * sizeof(uint32_t), &page_id, sizeof(uint32_t));
+    dir->is_dirty = true;
+
+    return page_id;
+}
+
+uint32_t hash_create_storage(StorageManager* sm) {
+    uint32_t meta_page = sm_allocate_page(sm);
+
+    HashMeta* meta = SAFE_CALLOC(HashMeta, 1);
+    for (uint32_t bucket = 0; bucket < HASH_INITIAL_BUCKETS; bucket++) {
+        add_bucket(sm, meta, bucket);
+    }
+    meta->bucket_count = HASH_INITIAL_BUCKETS;
+
+    Page* page = sm_get_page(sm, meta_page);
+    if (page) {
+        memcpy(page->data, meta, sizeof(HashMeta));
+        page->is_dirty = true;
+    }
+    SAFE_FREE(meta);
+
+    return page ? meta_page : 0;
+}
+
+HashIndex* hash_open_index(StorageManager* sm, TableSchema* schema, const char* index_name) {
+    IndexDef def;
+    if (!index_catalog_load(sm, index_name, &def)) return NULL;
+    if (def.method != INDEX_HASH || def.root_page == 0) return NULL;
+
+    uint32_t key_size = 0;
+    for (uint32_t i = 0; i < def.key_column_count; i++) {
+        key_size += btree_key_width(&schema->columns[def.key_columns[i]]);
+    }
+    if (key_size == 0 || key_size > BTREE_MAX_KEY_SIZE) return NULL;
+
+    HashIndex* index = SAFE_CALLOC(HashIndex, 1);
+    strncpy(index->name, def.name, MAX_INDEX_NAME - 1);
+    index->meta_page = def.root_page;
+    index->schema = schema;
+    memcpy(index->key_columns, def.key_columns, sizeof(def.key_columns));
+    index->key_column_count = def.key_column_count;
+    index->key_size = key_size;
+    index->bucket_capacity = (PAGE_SIZE - sizeof(BucketHeader)) / slot_size(index);
+    index->is_unique = def.is_unique;
+
+    return index;
+}
+
+// Appends slots to a bucket chain, reusing the chain's existing pages
+// before allocating overflow pages
+typedef struct {
+    StorageManager* sm;
+    HashIndex* index;
+    HashPage page;
+} BucketWriter;
+
+static bool writer_add(BucketWriter* writer, const uint8_t* slot) {
+    HashIndex* index = writer->index;
+    BucketHeader* header = BUCKET_HEADER(&writer->page);
+
+    while (header->count >= index->bucket_capacity) {
+        uint32_t next = header->overflow;
+        if (next == 0) {
+            next = sm_allocate_page(writer->sm);
+            header->overflow = next;
+        }
+        write_page(writer->sm, &writer->page);
+        if (!read_page(writer->sm, next, &writer->page)) return false;
+        header = BUCKET_HEADER(&writer->page);
+    }
+
+    memcpy(bucket_slot(index, &writer->page, header->count), slot, slot_size(index));
+    header->count++;
+    return true;
+}
+
+// Splits the bucket at the split pointer into itself and its buddy one
+// round size above it, moving the entries whose next hash bit is set
+static bool split_bucket(StorageManager* sm, HashIndex* index, HashMeta* meta) {
+    uint32_t round_size = HASH_INITIAL_BUCKETS << meta->level;
+    uint32_t old_bucket = meta->next_split;
+    uint32_t new_bucket = old_bucket + round_size;
+
+    uint32_t new_page = add_bucket(sm, meta, new_bucket);
+    uint32_t old_page = bucket_page(sm, meta, old_bucket);
+    if (new_page == 0 || old_page == 0) return false;
+
+    // Collect the old chain's entries and empty its pages
+    uint32_t size = slot_size(index);
+    uint8_t* slots = NULL;
+    uint32_t count = 0, capacity = 0;
+    HashPage page;
+
+    for (uint32_t page_id = old_page; page_id != 0; page_id = BUCKET_HEADER(&page)->overflow) {
+        if (!read_page(sm, page_id, &page)) break;
+        BucketHeader* header = BUCKET_HEADER(&page);
+
+        if (count + header->count > capacity) {
+            capacity = (count + header->count) * 2;
+            slots = SAFE_REALLOC(slots, uint8_t, capacity * size);
+        }
+        memcpy(slots + count * size, bucket_slot(index, &page, 0), header->count * size);
+        count += header->count;
+
+        header->count = 0;
+        write_page(sm, &page);
+    }
+
+    BucketWriter* stay = SAFE_MALLOC(BucketWriter, 1);
+    BucketWriter* move = SAFE_MALLOC(BucketWriter, 1);
+    stay->sm = move->sm = sm;
+    stay->index = move->index = index;
+    bool ok = read_page(sm, old_page, &stay->page) && read_page(sm, new_page, &move->page);
+
+    for (uint32_t i = 0; i < count && ok; i++) {
+        uint8_t* slot = slots + i * size;
+        bool moves = (slot_hash(slot) & (2 * round_size - 1)) == new_bucket;
+        ok = writer_add(moves ? move : stay, slot);
+    }
+    write_page(sm, &stay->page);
+    write_page(sm, &move->page);
+
+    SAFE_FREE(stay);
+    SAFE_FREE(move);
+    SAFE_FREE(slots);
+
+    meta->bucket_count++;
+    meta->next_split++;
+    if (meta->next_split == round_size) {
+        meta->level++;
+        meta->next_split = 0;
+    }
+    return ok;
+}
+
+bool hash_insert(StorageManager* sm, HashIndex* index, const uint8_t* key, RID rid) {
+    if (!sm || !index || !key) return false;
+
+    HashMeta* meta = SAFE_MALLOC(HashMeta, 1);
+    if (!load_meta(sm, index, meta)) {
+        SAFE_FREE(meta);
+        return false;
+    }
+
+    uint8_t slot[sizeof(uint32_t) + BTREE_MAX_KEY_SIZE + sizeof(RID)];
+    uint32_t hash = hash_key(key, index->key_size);
+    memcpy(slot, &hash, sizeof(uint32_t));
+    memcpy(slot + sizeof(uint32_t), key, index->key_size);
+    memcpy(slot + sizeof(uint32_t) + index->key_size, &rid, sizeof(RID));
+
+    BucketWriter* writer = SAFE_MALLOC(BucketWriter, 1);
+    writer->sm = sm;
+    writer->index = index;
+    bool ok = read_page(sm, bucket_page(sm, meta, bucket_for(meta, hash)), &writer->page) &&
+              writer_add(writer, slot);
+    if (ok) write_page(sm, &writer->page);
+    SAFE_FREE(writer);
+
+    if (ok) {
+        meta->entry_count++;
+
+        // Grow by one bucket once the average bucket passes the load factor
+        uint64_t limit = (uint64_t)meta->bucket_count * index->bucket_capacity * HASH_MAX_LOAD / 100;
+        if (meta->entry_count > limit && meta->bucket_count < HASH_MAX_BUCKETS) {
+            ok = split_bucket(sm, index, meta);
+        }
+        save_meta(sm, index, meta);
+    }
+
+    SAFE_FREE(meta);
+    return ok;
+}
+
+HashCursor* hash_seek(StorageManager* sm, HashIndex* index, const uint8_t* key) {
+    if (!sm || !index || !key) return NULL;
+
+    HashCursor* cursor = SAFE_CALLOC(HashCursor, 1);
+    cursor->sm = sm;
+    cursor->index = index;
+    memcpy(cursor->key, key, index->key_size);
+    cursor->hash = hash_key(key, index->key_size);
+
+    HashMeta* meta = SAFE_MALLOC(HashMeta, 1);
+    if (load_meta(sm, index, meta)) {
+        cursor->page_id = bucket_page(sm, meta, bucket_for(meta, cursor->hash));
+    }
+    SAFE_FREE(meta);
+
+    return cursor;
+}
+
+bool hash_next(HashCursor* cursor, RID* rid) {
+    if (!cursor) return false;
+
+    HashIndex* index = cursor->index;
+    HashPage page;
+    while (cursor->page_id != 0) {
+        if (!read_page(cursor->sm, cursor->page_id, &page)) return false;
+        BucketHeader* header = BUCKET_HEADER(&page);
+
+        while (cursor->position < header->count) {
+            uint8_t* slot = bucket_slot(index, &page, cursor->position++);
+            if (slot_hash(slot) == cursor->hash &&
+                memcmp(slot + sizeof(uint32_t), cursor->key, index->key_size) == 0) {
+                if (rid) *rid = slot_rid(index, slot);
+                return true;
+            }
+        }
+
+        cursor->page_id = header->overflow;
+        cursor->position = 0;
+    }
+
+    return false;
+}
+
+void hash_close(HashCursor* cursor) {
+    SAFE_FREE(cursor);
+}
+
+bool hash_search(StorageManager* sm, HashIndex* index, const uint8_t* key, RID* rid) {
+    HashCursor* cursor = hash_seek(sm, index, key);
+    bool found = hash_next(cursor, rid);
+    hash_close(cursor);
+    return found;
+}
+
+// Removes the entry for `key` pointing at `rid` (or the first entry for
+// `key` when rid is NULL). The bucket's last slot fills the hole; buckets
+// never merge.
+bool hash_delete(StorageManager* sm, HashIndex* index, const uint8_t* key, const RID* rid) {
+    if (!sm || !index || !key) return false;
+
+    HashMeta* meta = SAFE_MALLOC(HashMeta, 1);
+    if (!load_meta(sm, index, meta)) {
+        SAFE_FREE(meta);
+        return false;
+    }
+
+    uint32_t hash = hash_key(key, index->key_size);
+    uint32_t page_id = bucket_page(sm, meta, bucket_for(meta, hash));
+    bool found = false;
+    HashPage page;
+
+    while (page_id != 0 && !found && read_page(sm, page_id, &page)) {
+        BucketHeader* header = BUCKET_HEADER(&page);
+
+        for (uint32_t i = 0; i < header->count; i++) {
+            uint8_t* slot = bucket_slot(index, &page, i);
+            if (slot_hash(slot) != hash || memcmp(slot + sizeof(uint32_t), key, index->key_size) != 0) {
+                continue;
+            }
+
+            RID found_rid = slot_rid(index, slot);
+            if (!rid || (found_rid.page_id == rid->page_id && found_rid.slot == rid->slot)) {
+                header->count--;
+                memcpy(slot, bucket_slot(index, &page, header->count), slot_size(index));
+                write_page(sm, &page);
+                found = true;
+                break;
+            }
+        }
+
+        page_id = header->overflow;
+    }
+
+    if (found) {
+        meta->entry_count--;
+        save_meta(sm, index, meta);
+    }
+    SAFE_FREE(meta);
+    return found;
+}
+
+bool hash_stats(StorageManager* sm, HashIndex* index, HashStats* stats) {
+    if (!sm || !index || !stats) return false;
+
+    HashMeta* meta = SAFE_MALLOC(HashMeta, 1);
+    if (!load_meta(sm, index, meta)) {
+        SAFE_FREE(meta);
+        return false;
+    }
+
+    memset(stats, 0, sizeof(HashStats));
+    stats->bucket_count = meta->bucket_count;
+    stats->level = meta->level;
+    stats->next_split = meta->next_split;
+    stats->entry_count = meta->entry_count;
+
+    HashPage page;
+    for (uint32_t bucket = 0; bucket < meta->bucket_count; bucket++) {
+        uint32_t page_id = bucket_page(sm, meta, bucket);
+        while (page_id != 0 && read_page(sm, page_id, &page)) {
+            stats->page_count++;
+            page_id = BUCKET_HEADER(&page)->overflow;
+        }
+    }
+
+    SAFE_FREE(meta);
+    return true;
+}
+
+void hash_free_index(HashIndex* index) {
+    SAFE_FREE(index);
+}
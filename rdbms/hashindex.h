@@ -0,0 +1,65 @@
+// hashindex.h
+
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include "storage.h"
+#include "btree.h"
+
+#define HASH_INITIAL_BUCKETS 4
+#define HASH_MAX_LOAD 75 // percent of bucket capacity before a split
+
+// On-disk linear hash index for equality lookups. The index's catalog
+// root page is a meta page holding the split state and a two-level
+// directory of bucket pages, so finding a key's bucket costs a fixed
+// number of page reads however large the index grows. Each bucket is a
+// primary page plus an overflow chain. When the index passes its load
+// factor the bucket at the split pointer is split in two, one bucket per
+// insert, so the table grows incrementally instead of rehashing at once.
+//
+// Keys are encoded exactly like B+tree keys (btree_encode_value), so the
+// executor builds them the same way for both access methods.
+typedef struct {
+    char name[MAX_INDEX_NAME];
+    uint32_t meta_page;
+    TableSchema* schema;
+    uint32_t key_columns[MAX_INDEX_COLUMNS];
+    uint32_t key_column_count;
+    uint32_t key_size;
+    uint32_t bucket_capacity; // entries per bucket page
+    bool is_unique;
+} HashIndex;
+
+// Iterates the entries equal to one key
+typedef struct {
+    StorageManager* sm;
+    HashIndex* index;
+    uint8_t key[BTREE_MAX_KEY_SIZE];
+    uint32_t hash;
+    uint32_t page_id; // 0 once the bucket chain is exhausted
+    uint32_t position;
+} HashCursor;
+
+typedef struct {
+    uint32_t bucket_count;
+    uint32_t level;
+    uint32_t next_split;
+    uint32_t entry_count;
+    uint32_t page_count; // bucket and overflow pages
+} HashStats;
+
+// Allocates the meta page and initial buckets; returns the meta page
+uint32_t hash_create_storage(StorageManager* sm);
+
+HashIndex* hash_open_index(StorageManager* sm, TableSchema* schema, const char* index_name);
+bool hash_insert(StorageManager* sm, HashIndex* index, const uint8_t* key, RID rid);
+bool hash_search(StorageManager* sm, HashIndex* index, const uint8_t* key, RID* rid);
+bool hash_delete(StorageManager* sm, HashIndex* index, const uint8_t* key, const RID* rid);
+bool hash_stats(StorageManager* sm, HashIndex* index, HashStats* stats);
+void hash_free_index(HashIndex* index);
+
+HashCursor* hash_seek(StorageManager* sm, HashIndex* index, const uint8_t* key);
+bool hash_next(HashCursor* cursor, RID* rid);
+void hash_close(HashCursor* cursor);
+
+#endif // HASHINDEX_H
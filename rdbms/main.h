@@ -11,6 +11,7 @@ char* safe_strdup(const char* str);
 void** safe_malloc_2d(size_t rows, size_t cols, size_t element_size);
 void safe_free_2d(void*** array_ref, size_t rows);
 int check_pointer(const void* ptr, const char* name);
+size_t safe_allocation_count(void);
 
 
 #define SAFE_MALLOC(type, count) (type*)safe_malloc((count) * sizeof(type))
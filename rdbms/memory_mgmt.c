@@ -12,6 +12,16 @@ static int will_overflow(size_t a, size_t b) {
     return 0;
 }
 
+static size_t allocation_count = 0;
+
+/**
+ * @brief Number of allocator calls (malloc, calloc, realloc) made so far.
+ * Only meant for benchmarks; updates are atomic but not ordered.
+ */
+size_t safe_allocation_count(void) {
+    return __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+}
+
 /**
  * @brief Safely allocates memory. Aborts program if allocation fails.
  * @param size Number of bytes to allocate.
@@ -23,6 +33,7 @@ void* safe_malloc(size_t size) {
         return NULL;
     }
 
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
     void* ptr = malloc(size);
     if (ptr == NULL && size != 0) {
         fprintf(stderr, "Error: Memory allocation failed for %zu bytes.\n", size);
@@ -37,6 +48,7 @@ void* safe_calloc(size_t num, size_t size) {
         return NULL;
     }
 
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
     void* ptr = calloc(num, size);
     if (ptr == NULL) {
         fprintf(stderr, "Fatal Error: Memory allocation failed for %zu elements of size %zu.\n", num, size);
@@ -73,6 +85,7 @@ void* safe_realloc(void* ptr, size_t new_size) {
         return NULL;
     }
     
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
     void* new_ptr = realloc(ptr, new_size);
     if (new_ptr == NULL) {
         fprintf(stderr, "Fatal Error: Memory reallocation failed for %zu bytes.\n", new_size);
@@ -12,9 +12,16 @@ static bool parse_update(Tokenizer *t, SQLStatement *stmt);
 static bool parse_delete(Tokenizer *t, SQLStatement *stmt);
 static bool parse_where_clause(Tokenizer *t, SQLStatement *stmt);
 static bool parse_value_list(Tokenizer *t, SQLStatement *stmt, bool for_insert);
+static void *parse_literal(const char *value_str, DataType *type);
 static bool expect_token(Tokenizer *t, SQLStatement *stmt, const char *expected, const char *error_msg);
 static bool parse_join_clause(Tokenizer *t, SQLStatement *stmt);
 static bool parse_drop_table(Tokenizer* t, SQLStatement* stmt);
+static bool parse_create_index(Tokenizer *t, SQLStatement *stmt);
+static bool parse_reindex(Tokenizer *t, SQLStatement *stmt);
+static bool parse_analyze(Tokenizer *t, SQLStatement *stmt);
+static bool parse_select_item(Tokenizer *t, SQLStatement *stmt, const char *token,
+                              AggregateType *aggregate, char *column);
+static bool parse_select_tail(Tokenizer *t, SQLStatement *stmt);
 
 SQLStatement *parse_sql(const char *sql)
 {
@@ -37,13 +44,36 @@ SQLStatement *parse_sql(const char *sql)
     {
         parse_success = parse_select(t, stmt);
     }
+    else if (strcasecmp(token, "EXPLAIN") == 0)
+    {
+        char *select = tokenizer_next(t);
+        if (select && strcasecmp(select, "SELECT") == 0)
+        {
+            parse_success = parse_select(t, stmt);
+            stmt->explain = true;
+        }
+        else
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "EXPLAIN expects a SELECT");
+        }
+        SAFE_FREE(select);
+    }
     else if (strcasecmp(token, "INSERT") == 0)
     {
         parse_success = parse_insert(t, stmt);
     }
     else if (strcasecmp(token, "CREATE") == 0)
     {
-        parse_success = parse_create_table(t, stmt);
+        char *peek = tokenizer_peek(t);
+        if (peek && (strcasecmp(peek, "INDEX") == 0 || strcasecmp(peek, "UNIQUE") == 0))
+        {
+            parse_success = parse_create_index(t, stmt);
+        }
+        else
+        {
+            parse_success = parse_create_table(t, stmt);
+        }
+        SAFE_FREE(peek);
     }
     else if (strcasecmp(token, "DELETE") == 0)
     {
@@ -57,6 +87,14 @@ SQLStatement *parse_sql(const char *sql)
     {
         parse_success = parse_drop_table(t, stmt);
     }
+    else if (strcasecmp(token, "REINDEX") == 0)
+    {
+        parse_success = parse_reindex(t, stmt);
+    }
+    else if (strcasecmp(token, "ANALYZE") == 0)
+    {
+        parse_success = parse_analyze(t, stmt);
+    }
     else if (strcasecmp(token, "SHOW") == 0)
     {
         token = tokenizer_next(t);
@@ -75,6 +113,15 @@ SQLStatement *parse_sql(const char *sql)
 
     SAFE_FREE(token);
 
+    if (!parse_success && !stmt->has_error)
+    {
+        if (stmt->error_message[0] == '\0')
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "Syntax error");
+        }
+        stmt->has_error = true;
+    }
+
     // Check for trailing semicolon (optional but good practice)
     if (parse_success)
     {
@@ -293,7 +340,12 @@ static bool parse_select(Tokenizer *t, SQLStatement *stmt)
                     SAFE_FREE(token);
                     return false;
                 }
-                strncpy(stmt->select_columns[col_idx], token, MAX_COLUMN_NAME - 1);
+                if (!parse_select_item(t, stmt, token, &stmt->select_aggregates[col_idx],
+                                       stmt->select_columns[col_idx]))
+                {
+                    SAFE_FREE(token);
+                    return false;
+                }
                 col_idx++;
             }
             SAFE_FREE(token);
@@ -322,11 +374,13 @@ static bool parse_select(Tokenizer *t, SQLStatement *stmt)
 
     // Check for JOIN keyword
     char *next = tokenizer_peek(t);
-    if (next && (strcasecmp(next, "JOIN") == 0 ||
-                 strcasecmp(next, "INNER") == 0 ||
-                 strcasecmp(next, "LEFT") == 0 ||
-                 strcasecmp(next, "RIGHT") == 0 ||
-                 strcasecmp(next, "FULL") == 0))
+    bool has_join = next && (strcasecmp(next, "JOIN") == 0 ||
+                             strcasecmp(next, "INNER") == 0 ||
+                             strcasecmp(next, "LEFT") == 0 ||
+                             strcasecmp(next, "RIGHT") == 0 ||
+                             strcasecmp(next, "FULL") == 0);
+    SAFE_FREE(next);
+    if (has_join)
     {
         // Store left table name
         strncpy(stmt->join_clause.left_table, table_name, MAX_TABLE_NAME - 1);
@@ -344,11 +398,198 @@ static bool parse_select(Tokenizer *t, SQLStatement *stmt)
 
     // Check for WHERE clause
     char *where_token = tokenizer_peek(t);
-    if (where_token && strcasecmp(where_token, "WHERE") == 0)
+    bool has_where = where_token && strcasecmp(where_token, "WHERE") == 0;
+    SAFE_FREE(where_token);
+    if (has_where)
     {
         char *where_token = tokenizer_next(t);
         SAFE_FREE(where_token); // Consume WHERE
-        return parse_where_clause(t, stmt);
+        if (!parse_where_clause(t, stmt))
+        {
+            return false;
+        }
+    }
+
+    return parse_select_tail(t, stmt);
+}
+
+static AggregateType parse_aggregate(const char *name)
+{
+    if (strcasecmp(name, "COUNT") == 0)
+        return AGG_COUNT;
+    if (strcasecmp(name, "SUM") == 0)
+        return AGG_SUM;
+    if (strcasecmp(name, "MIN") == 0)
+        return AGG_MIN;
+    if (strcasecmp(name, "MAX") == 0)
+        return AGG_MAX;
+    if (strcasecmp(name, "AVG") == 0)
+        return AGG_AVG;
+    return AGG_NONE;
+}
+
+// A SELECT list or ORDER BY item: a column, or FUNC(column) where FUNC is
+// an aggregate; COUNT also takes *. `token` is the item's first token.
+static bool parse_select_item(Tokenizer *t, SQLStatement *stmt, const char *token,
+                              AggregateType *aggregate, char *column)
+{
+    *aggregate = parse_aggregate(token);
+    char *paren = tokenizer_peek(t);
+    bool call = *aggregate != AGG_NONE && paren && strcmp(paren, "(") == 0;
+    SAFE_FREE(paren);
+
+    if (!call)
+    {
+        *aggregate = AGG_NONE;
+        strncpy(column, token, MAX_COLUMN_NAME - 1);
+        return true;
+    }
+
+    paren = tokenizer_next(t);
+    SAFE_FREE(paren); // Consume "("
+
+    char *argument = tokenizer_next(t);
+    if (!argument || strcmp(argument, ")") == 0 || strcmp(argument, ",") == 0)
+    {
+        snprintf(stmt->error_message, sizeof(stmt->error_message),
+                 "Expected column in %s()", aggregate_to_string(*aggregate));
+        SAFE_FREE(argument);
+        return false;
+    }
+    if (strcmp(argument, "*") == 0 && *aggregate != AGG_COUNT)
+    {
+        snprintf(stmt->error_message, sizeof(stmt->error_message),
+                 "%s(*) is not supported", aggregate_to_string(*aggregate));
+        SAFE_FREE(argument);
+        return false;
+    }
+    strncpy(column, argument, MAX_COLUMN_NAME - 1);
+    SAFE_FREE(argument);
+
+    return expect_token(t, stmt, ")", "Expected ) after aggregate argument");
+}
+
+static bool next_is(Tokenizer *t, const char *keyword)
+{
+    char *peek = tokenizer_peek(t);
+    bool match = peek && strcasecmp(peek, keyword) == 0;
+    SAFE_FREE(peek);
+    return match;
+}
+
+static void skip_token(Tokenizer *t)
+{
+    char *token = tokenizer_next(t);
+    SAFE_FREE(token);
+}
+
+// [GROUP BY col, ...] [ORDER BY item [ASC|DESC], ...] [LIMIT n]
+static bool parse_select_tail(Tokenizer *t, SQLStatement *stmt)
+{
+    if (next_is(t, "GROUP"))
+    {
+        skip_token(t);
+        if (!expect_token(t, stmt, "BY", "Expected BY after GROUP"))
+        {
+            return false;
+        }
+        while (true)
+        {
+            char *column = tokenizer_next(t);
+            if (!column || strchr(",;()", column[0]))
+            {
+                snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected column in GROUP BY");
+                SAFE_FREE(column);
+                return false;
+            }
+            if (stmt->group_by_count >= MAX_SORT_COLUMNS)
+            {
+                snprintf(stmt->error_message, sizeof(stmt->error_message), "Too many GROUP BY columns");
+                SAFE_FREE(column);
+                return false;
+            }
+            strncpy(stmt->group_by[stmt->group_by_count++], column, MAX_COLUMN_NAME - 1);
+            SAFE_FREE(column);
+
+            if (!next_is(t, ","))
+            {
+                break;
+            }
+            skip_token(t);
+        }
+    }
+
+    if (next_is(t, "ORDER"))
+    {
+        skip_token(t);
+        if (!expect_token(t, stmt, "BY", "Expected BY after ORDER"))
+        {
+            return false;
+        }
+        while (true)
+        {
+            char *token = tokenizer_next(t);
+            if (!token || strchr(",;()", token[0]))
+            {
+                snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected column in ORDER BY");
+                SAFE_FREE(token);
+                return false;
+            }
+            if (stmt->order_by_count >= MAX_SORT_COLUMNS)
+            {
+                snprintf(stmt->error_message, sizeof(stmt->error_message), "Too many ORDER BY columns");
+                SAFE_FREE(token);
+                return false;
+            }
+
+            // Aggregates are referred to by the name of their result column
+            OrderByClause *order = &stmt->order_by[stmt->order_by_count++];
+            AggregateType aggregate;
+            char column[MAX_COLUMN_NAME] = {0};
+            bool ok = parse_select_item(t, stmt, token, &aggregate, column);
+            SAFE_FREE(token);
+            if (!ok)
+            {
+                return false;
+            }
+            if (aggregate == AGG_NONE)
+            {
+                strncpy(order->column, column, MAX_COLUMN_NAME - 1);
+            }
+            else
+            {
+                char name[MAX_COLUMN_NAME + 8];
+                snprintf(name, sizeof(name), "%s(%s)", aggregate_to_string(aggregate), column);
+                strncpy(order->column, name, MAX_COLUMN_NAME - 1);
+            }
+
+            if (next_is(t, "ASC") || next_is(t, "DESC"))
+            {
+                order->descending = next_is(t, "DESC");
+                skip_token(t);
+            }
+
+            if (!next_is(t, ","))
+            {
+                break;
+            }
+            skip_token(t);
+        }
+    }
+
+    if (next_is(t, "LIMIT"))
+    {
+        skip_token(t);
+        char *count = tokenizer_next(t);
+        if (!count || count[0] == '\0' || strspn(count, "0123456789") != strlen(count))
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected row count after LIMIT");
+            SAFE_FREE(count);
+            return false;
+        }
+        stmt->has_limit = true;
+        stmt->limit = (uint32_t)strtoul(count, NULL, 10);
+        SAFE_FREE(count);
     }
 
     return true;
@@ -459,36 +700,15 @@ static bool parse_update(Tokenizer *t, SQLStatement *stmt)
         if (col_idx == 0)
         {
             stmt->update_values = SAFE_MALLOC(void *, MAX_COLUMNS);
-            if (!stmt->update_values)
+            stmt->update_value_types = SAFE_MALLOC(DataType, MAX_COLUMNS);
+            if (!stmt->update_values || !stmt->update_value_types)
             {
                 SAFE_FREE(value_str);
                 return false;
             }
         }
 
-        // Parse value based on type (simplified - we'll need schema to know actual type)
-        // For now, handle integers and strings
-        if (value_str[0] == '\'' || value_str[0] == '"')
-        {
-            // String value
-            char *str_val = SAFE_MALLOC(char, strlen(value_str) - 1);
-            if (str_val)
-            {
-                strncpy(str_val, value_str + 1, strlen(value_str) - 2);
-                str_val[strlen(value_str) - 2] = '\0';
-                stmt->update_values[col_idx] = str_val;
-            }
-        }
-        else
-        {
-            // Try integer
-            int *int_val = SAFE_MALLOC(int, 1);
-            if (int_val)
-            {
-                *int_val = atoi(value_str);
-                stmt->update_values[col_idx] = int_val;
-            }
-        }
+        stmt->update_values[col_idx] = parse_literal(value_str, &stmt->update_value_types[col_idx]);
         SAFE_FREE(value_str);
 
         col_idx++;
@@ -500,17 +720,12 @@ static bool parse_update(Tokenizer *t, SQLStatement *stmt)
             char *comma = tokenizer_next(t);
             SAFE_FREE(comma); // Consume comma
         }
-        else if (next && strcasecmp(next, "WHERE") == 0)
+        else
         {
-            char *where_token = tokenizer_next(t);
-            SAFE_FREE(where_token); // Consume WHERE
+            // WHERE (consumed below), ';' or end of input
             parsing_set = false;
         }
-        else if (!next)
-        {
-            snprintf(stmt->error_message, sizeof(stmt->error_message), "Unexpected end of SET clause");
-            return false;
-        }
+        SAFE_FREE(next);
     }
 
     stmt->update_column_count = col_idx;
@@ -559,47 +774,169 @@ static bool parse_delete(Tokenizer *t, SQLStatement *stmt)
     return true;
 }
 
-static bool parse_where_clause(Tokenizer *t, SQLStatement *stmt)
+// True when a WHERE operand is a literal rather than a column name
+static bool is_literal_token(const char *token)
 {
-    stmt->has_where = true;
+    return token[0] == '\'' || token[0] == '"' || isdigit((unsigned char)token[0]) ||
+           ((token[0] == '-' || token[0] == '.') && isdigit((unsigned char)token[1])) ||
+           strcasecmp(token, "TRUE") == 0 || strcasecmp(token, "FALSE") == 0;
+}
 
-    // Parse column name
-    char *column = tokenizer_next(t);
-    if (!column)
+// The literal's type comes from its spelling; the executor converts it to
+// the column type
+static void parse_where_literal(const char *value_str, WhereClause *cond)
+{
+    if (value_str[0] == '\'' || value_str[0] == '"')
     {
-        snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected column name in WHERE clause");
-        return false;
+        char *str_val = SAFE_MALLOC(char, strlen(value_str) - 1);
+        strncpy(str_val, value_str + 1, strlen(value_str) - 2);
+        str_val[strlen(value_str) - 2] = '\0';
+        cond->value = str_val;
+        cond->value_type = DT_STRING;
+    }
+    else if (strcasecmp(value_str, "TRUE") == 0 || strcasecmp(value_str, "FALSE") == 0)
+    {
+        bool *bool_val = SAFE_MALLOC(bool, 1);
+        *bool_val = strcasecmp(value_str, "TRUE") == 0;
+        cond->value = bool_val;
+        cond->value_type = DT_BOOL;
     }
-    strncpy(stmt->where_column, column, MAX_COLUMN_NAME - 1);
-    SAFE_FREE(column);
+    else if (strchr(value_str, '.') != NULL)
+    {
+        float *float_val = SAFE_MALLOC(float, 1);
+        *float_val = (float)atof(value_str);
+        cond->value = float_val;
+        cond->value_type = DT_FLOAT;
+    }
+    else
+    {
+        int *int_val = SAFE_MALLOC(int, 1);
+        *int_val = atoi(value_str);
+        cond->value = int_val;
+        cond->value_type = DT_INT;
+    }
+}
 
-    // Parse operator
-    char *op_str = tokenizer_next(t);
-    if (!op_str)
+// The operator that holds with its operands swapped: 5 < id is id > 5
+static OperatorType mirror_operator(OperatorType op)
+{
+    switch (op)
     {
-        snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected operator in WHERE clause");
-        return false;
+    case OP_GREATER:
+        return OP_LESS;
+    case OP_LESS:
+        return OP_GREATER;
+    case OP_GREATER_EQUAL:
+        return OP_LESS_EQUAL;
+    case OP_LESS_EQUAL:
+        return OP_GREATER_EQUAL;
+    default:
+        return op;
     }
-    stmt->where_operator = parse_operator(op_str);
-    SAFE_FREE(op_str);
+}
 
-    // Parse value
-    char *value_str = tokenizer_next(t);
-    if (!value_str)
+static bool parse_where_clause(Tokenizer *t, SQLStatement *stmt)
+{
+    stmt->has_where = true;
+
+    while (true)
     {
-        snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected value in WHERE clause");
-        return false;
+        if (stmt->where_condition_count >= MAX_WHERE_CONDITIONS)
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "Too many WHERE conditions");
+            return false;
+        }
+        WhereClause *cond = &stmt->where_conditions[stmt->where_condition_count];
+
+        // Parse column name
+        char *column = tokenizer_next(t);
+        if (!column)
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected column name in WHERE clause");
+            return false;
+        }
+
+        // Parse operator
+        char *op_str = tokenizer_next(t);
+        if (!op_str)
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected operator in WHERE clause");
+            return false;
+        }
+        cond->op = parse_operator(op_str);
+        SAFE_FREE(op_str);
+
+        // Parse value
+        char *value_str = tokenizer_next(t);
+        if (!value_str)
+        {
+            SAFE_FREE(column);
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected value in WHERE clause");
+            return false;
+        }
+
+        // Written the other way round (5 = id), the condition is turned
+        // into column-op-literal form so the executor can match it to an
+        // index
+        if (is_literal_token(column) && !is_literal_token(value_str) && cond->op != OP_LIKE)
+        {
+            char *swap = column;
+            column = value_str;
+            value_str = swap;
+            cond->op = mirror_operator(cond->op);
+        }
+
+        strncpy(cond->column, column, MAX_COLUMN_NAME - 1);
+        parse_where_literal(value_str, cond);
+        SAFE_FREE(column);
+        SAFE_FREE(value_str);
+        stmt->where_condition_count++;
+
+        // Conditions are joined with AND
+        char *next = tokenizer_peek(t);
+        bool more = next && strcasecmp(next, "AND") == 0;
+        SAFE_FREE(next);
+        if (!more)
+        {
+            return true;
+        }
+
+        char *and_token = tokenizer_next(t);
+        SAFE_FREE(and_token); // Consume AND
     }
+}
 
-    // For now, assume integer values
-    // In a real parser, you'd determine the type from schema
-    stmt->where_value_type = DT_INT;
+// Parses an INSERT or SET literal into a newly allocated value of the
+// type it is written as; the executor converts it to its column's type
+static void *parse_literal(const char *value_str, DataType *type)
+{
+    // Strings are quoted, floats have a decimal point
+    if (value_str[0] == '\'' || value_str[0] == '"')
+    {
+        char *str_val = SAFE_MALLOC(char, strlen(value_str) - 1);
+        strncpy(str_val, value_str + 1, strlen(value_str) - 2);
+        str_val[strlen(value_str) - 2] = '\0';
+        *type = DT_STRING;
+        return str_val;
+    }
+    if (strcasecmp(value_str, "TRUE") == 0 || strcasecmp(value_str, "FALSE") == 0)
+    {
+        bool *bool_val = SAFE_MALLOC(bool, 1);
+        *bool_val = strcasecmp(value_str, "TRUE") == 0;
+        *type = DT_BOOL;
+        return bool_val;
+    }
+    if (strchr(value_str, '.') != NULL)
+    {
+        float *float_val = SAFE_MALLOC(float, 1);
+        *float_val = (float)atof(value_str);
+        *type = DT_FLOAT;
+        return float_val;
+    }
     int *int_val = SAFE_MALLOC(int, 1);
     *int_val = atoi(value_str);
-    stmt->where_value = int_val;
-
-    SAFE_FREE(value_str);
-    return true;
+    *type = DT_INT;
+    return int_val;
 }
 
 static bool parse_value_list(Tokenizer *t, SQLStatement *stmt, bool for_insert)
@@ -625,25 +962,8 @@ static bool parse_value_list(Tokenizer *t, SQLStatement *stmt, bool for_insert)
                 stmt->insert_value_types = SAFE_MALLOC(DataType, MAX_COLUMNS);
             }
 
-            // Try to parse as different types
-            // For now, assume strings are quoted and integers are not
-            if (value_str[0] == '\'' || value_str[0] == '"')
-            {
-                // String value
-                char *str_val = SAFE_MALLOC(char, strlen(value_str) - 1);
-                strncpy(str_val, value_str + 1, strlen(value_str) - 2);
-                str_val[strlen(value_str) - 2] = '\0';
-                stmt->insert_values[value_count] = str_val;
-                stmt->insert_value_types[value_count] = DT_STRING;
-            }
-            else
-            {
-                // Try integer
-                int *int_val = SAFE_MALLOC(int, 1);
-                *int_val = atoi(value_str);
-                stmt->insert_values[value_count] = int_val;
-                stmt->insert_value_types[value_count] = DT_INT;
-            }
+            stmt->insert_values[value_count] =
+                parse_literal(value_str, &stmt->insert_value_types[value_count]);
         }
 
         SAFE_FREE(value_str);
@@ -787,25 +1107,301 @@ static bool parse_join_clause(Tokenizer *t, SQLStatement *stmt)
     }
     SAFE_FREE(right_column);
 
+    // Optional USING LOOP | HASH | MERGE | INDEX
+    char *peek = tokenizer_peek(t);
+    bool has_using = peek && strcasecmp(peek, "USING") == 0;
+    SAFE_FREE(peek);
+    if (has_using)
+    {
+        char *using = tokenizer_next(t);
+        SAFE_FREE(using); // Consume USING
+
+        char *method = tokenizer_next(t);
+        if (method && strcasecmp(method, "LOOP") == 0)
+        {
+            stmt->join_clause.method = JOIN_METHOD_LOOP;
+        }
+        else if (method && strcasecmp(method, "HASH") == 0)
+        {
+            stmt->join_clause.method = JOIN_METHOD_HASH;
+        }
+        else if (method && strcasecmp(method, "MERGE") == 0)
+        {
+            stmt->join_clause.method = JOIN_METHOD_MERGE;
+        }
+        else if (method && strcasecmp(method, "INDEX") == 0)
+        {
+            stmt->join_clause.method = JOIN_METHOD_INDEX;
+        }
+        else
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message),
+                     "Expected LOOP, HASH, MERGE or INDEX after USING");
+            SAFE_FREE(method);
+            return false;
+        }
+        SAFE_FREE(method);
+    }
+
     return true;
 }
 
 static bool parse_drop_table(Tokenizer* t, SQLStatement* stmt) {
     stmt->type = STMT_DROP_TABLE;
 
-    // Parse table name
+    // DROP TABLE name | DROP INDEX name
+    char* kind = tokenizer_peek(t);
+    if (kind && (strcasecmp(kind, "TABLE") == 0 || strcasecmp(kind, "INDEX") == 0)) {
+        if (strcasecmp(kind, "INDEX") == 0) {
+            stmt->type = STMT_DROP_INDEX;
+        }
+        char* consumed = tokenizer_next(t);
+        SAFE_FREE(consumed);
+    }
+    SAFE_FREE(kind);
+
+    // Parse table (or index) name
     char* table_name = tokenizer_next(t);
     if (!table_name) {
         snprintf(stmt->error_message, sizeof(stmt->error_message),
-                "Expected table name");
+                stmt->type == STMT_DROP_INDEX ? "Expected index name" : "Expected table name");
         return false;
     }
-    strncpy(stmt->drop_table, table_name, MAX_TABLE_NAME - 1);
+    if (stmt->type == STMT_DROP_INDEX) {
+        strncpy(stmt->index_name, table_name, MAX_INDEX_NAME - 1);
+    } else {
+        strncpy(stmt->drop_table, table_name, MAX_TABLE_NAME - 1);
+    }
     SAFE_FREE(table_name);
     
     return true;
 }
 
+// REINDEX [INDEX] name | REINDEX TABLE name
+static bool parse_reindex(Tokenizer *t, SQLStatement *stmt)
+{
+    stmt->type = STMT_REINDEX;
+
+    bool table = false;
+    char *kind = tokenizer_peek(t);
+    if (kind && (strcasecmp(kind, "INDEX") == 0 || strcasecmp(kind, "TABLE") == 0))
+    {
+        table = strcasecmp(kind, "TABLE") == 0;
+        char *consumed = tokenizer_next(t);
+        SAFE_FREE(consumed);
+    }
+    SAFE_FREE(kind);
+
+    char *name = tokenizer_next(t);
+    if (!name || strcmp(name, ";") == 0)
+    {
+        snprintf(stmt->error_message, sizeof(stmt->error_message),
+                 table ? "Expected table name" : "Expected index name");
+        SAFE_FREE(name);
+        return false;
+    }
+    if (table)
+    {
+        strncpy(stmt->index_table, name, MAX_TABLE_NAME - 1);
+    }
+    else
+    {
+        strncpy(stmt->index_name, name, MAX_INDEX_NAME - 1);
+    }
+    SAFE_FREE(name);
+    return true;
+}
+
+// ANALYZE [table]
+static bool parse_analyze(Tokenizer *t, SQLStatement *stmt)
+{
+    stmt->type = STMT_ANALYZE;
+
+    char *peek = tokenizer_peek(t);
+    if (peek && strcmp(peek, ";") != 0)
+    {
+        char *name = tokenizer_next(t);
+        strncpy(stmt->table_name, name, MAX_TABLE_NAME - 1);
+        SAFE_FREE(name);
+    }
+    SAFE_FREE(peek);
+    return true;
+}
+
+// CREATE [UNIQUE] INDEX name ON table (column [, column ...])
+// Parses "col, col, ...)" after the opening parenthesis of an index
+// column list
+static bool parse_index_column_list(Tokenizer *t, SQLStatement *stmt,
+                                    char columns[][MAX_COLUMN_NAME], uint32_t *count)
+{
+    while (true)
+    {
+        char *column = tokenizer_next(t);
+        if (!column || strcmp(column, ")") == 0 || strcmp(column, ",") == 0)
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected column name in index");
+            SAFE_FREE(column);
+            return false;
+        }
+        if (*count >= MAX_INDEX_COLUMNS)
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "Too many index columns");
+            SAFE_FREE(column);
+            return false;
+        }
+        strncpy(columns[(*count)++], column, MAX_COLUMN_NAME - 1);
+        SAFE_FREE(column);
+
+        char *next = tokenizer_next(t);
+        if (next && strcmp(next, ",") == 0)
+        {
+            SAFE_FREE(next); // Consume comma
+            continue;
+        }
+        if (next && strcmp(next, ")") == 0)
+        {
+            SAFE_FREE(next); // Consume ")"
+            return true;
+        }
+        snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected ',' or ')' in index column list");
+        SAFE_FREE(next);
+        return false;
+    }
+}
+
+static bool parse_create_index(Tokenizer *t, SQLStatement *stmt)
+{
+    stmt->type = STMT_CREATE_INDEX;
+
+    char *peek = tokenizer_peek(t);
+    if (peek && strcasecmp(peek, "UNIQUE") == 0)
+    {
+        char *unique = tokenizer_next(t);
+        SAFE_FREE(unique); // Consume UNIQUE
+        stmt->index_unique = true;
+    }
+    SAFE_FREE(peek);
+
+    if (!expect_token(t, stmt, "INDEX", "Expected INDEX after CREATE"))
+    {
+        return false;
+    }
+
+    char *index_name = tokenizer_next(t);
+    if (!index_name)
+    {
+        snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected index name");
+        return false;
+    }
+    strncpy(stmt->index_name, index_name, MAX_INDEX_NAME - 1);
+    SAFE_FREE(index_name);
+
+    if (!expect_token(t, stmt, "ON", "Expected ON after index name"))
+    {
+        return false;
+    }
+
+    char *table_name = tokenizer_next(t);
+    if (!table_name)
+    {
+        snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected table name");
+        return false;
+    }
+    strncpy(stmt->index_table, table_name, MAX_TABLE_NAME - 1);
+    SAFE_FREE(table_name);
+
+    // Optional USING BTREE | HASH | BITMAP
+    peek = tokenizer_peek(t);
+    bool has_using = peek && strcasecmp(peek, "USING") == 0;
+    SAFE_FREE(peek);
+    if (has_using)
+    {
+        char *using = tokenizer_next(t);
+        SAFE_FREE(using); // Consume USING
+
+        char *method = tokenizer_next(t);
+        if (method && strcasecmp(method, "HASH") == 0)
+        {
+            stmt->index_method = INDEX_HASH;
+        }
+        else if (method && strcasecmp(method, "BITMAP") == 0)
+        {
+            stmt->index_method = INDEX_BITMAP;
+        }
+        else if (method && strcasecmp(method, "BTREE") == 0)
+        {
+            stmt->index_method = INDEX_BTREE;
+        }
+        else
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "Expected BTREE, HASH or BITMAP after USING");
+            SAFE_FREE(method);
+            return false;
+        }
+        SAFE_FREE(method);
+    }
+
+    if (!expect_token(t, stmt, "(", "Expected '(' after table name"))
+    {
+        return false;
+    }
+
+    if (!parse_index_column_list(t, stmt, stmt->index_columns, &stmt->index_column_count))
+    {
+        return false;
+    }
+
+    // Optional INCLUDE (col, ...): values stored in the leaves only
+    peek = tokenizer_peek(t);
+    bool has_include = peek && strcasecmp(peek, "INCLUDE") == 0;
+    SAFE_FREE(peek);
+    if (has_include)
+    {
+        char *include = tokenizer_next(t);
+        SAFE_FREE(include); // Consume INCLUDE
+
+        if (!expect_token(t, stmt, "(", "Expected '(' after INCLUDE") ||
+            !parse_index_column_list(t, stmt, stmt->index_include_columns, &stmt->index_include_count))
+        {
+            return false;
+        }
+    }
+
+    // Optional WITH (FILLFACTOR = n)
+    peek = tokenizer_peek(t);
+    bool has_with = peek && strcasecmp(peek, "WITH") == 0;
+    SAFE_FREE(peek);
+    if (has_with)
+    {
+        char *with = tokenizer_next(t);
+        SAFE_FREE(with); // Consume WITH
+
+        if (!expect_token(t, stmt, "(", "Expected '(' after WITH") ||
+            !expect_token(t, stmt, "FILLFACTOR", "Expected FILLFACTOR") ||
+            !expect_token(t, stmt, "=", "Expected = after FILLFACTOR"))
+        {
+            return false;
+        }
+
+        char *value = tokenizer_next(t);
+        int fill_factor = value ? atoi(value) : 0;
+        SAFE_FREE(value);
+        if (fill_factor < 10 || fill_factor > 100)
+        {
+            snprintf(stmt->error_message, sizeof(stmt->error_message), "FILLFACTOR must be between 10 and 100");
+            return false;
+        }
+        stmt->index_fill_factor = (uint32_t)fill_factor;
+
+        if (!expect_token(t, stmt, ")", "Expected ')' after FILLFACTOR value"))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static bool expect_token(Tokenizer *t, SQLStatement *stmt, const char *expected, const char *error_msg)
 {
     char *token = tokenizer_next(t);
@@ -862,6 +1458,29 @@ OperatorType parse_operator(const char *op_str)
     return OP_EQUALS; // Default
 }
 
+const char *operator_to_string(OperatorType op)
+{
+    switch (op)
+    {
+    case OP_EQUALS:
+        return "=";
+    case OP_NOT_EQUALS:
+        return "!=";
+    case OP_GREATER:
+        return ">";
+    case OP_LESS:
+        return "<";
+    case OP_GREATER_EQUAL:
+        return ">=";
+    case OP_LESS_EQUAL:
+        return "<=";
+    case OP_LIKE:
+        return "LIKE";
+    default:
+        return "";
+    }
+}
+
 Tokenizer *tokenizer_create(const char *sql)
 {
     Tokenizer *t = SAFE_MALLOC(Tokenizer, 1);
@@ -918,15 +1537,16 @@ char *tokenizer_next(Tokenizer *t)
     }
 
     // Handle special characters
-    if (strchr(",()=*><;", c) != NULL)
+    if (strchr(",()=*><;!", c) != NULL)
     {
         // Check for two-character operators
-        if ((c == '!' || c == '<' || c == '>') && t->position + 1 < t->length &&
-            t->buffer[t->position + 1] == '=')
+        if (((c == '!' || c == '<' || c == '>') && t->position + 1 < t->length &&
+             t->buffer[t->position + 1] == '=') ||
+            (c == '<' && t->position + 1 < t->length && t->buffer[t->position + 1] == '>'))
         {
             char *token = SAFE_MALLOC(char, 3);
             token[0] = c;
-            token[1] = '=';
+            token[1] = t->buffer[t->position + 1];
             token[2] = '\0';
             t->position += 2;
             return token;
@@ -942,7 +1562,7 @@ char *tokenizer_next(Tokenizer *t)
     // Parse identifier or keyword
     size_t start = t->position;
     while (t->position < t->length && !isspace(t->buffer[t->position]) &&
-           strchr(",()=*><;", t->buffer[t->position]) == NULL)
+           strchr(",()=*><;!", t->buffer[t->position]) == NULL)
     {
         t->position++;
     }
@@ -988,10 +1608,10 @@ void free_sql_statement(SQLStatement *statement)
     if (!statement)
         return;
 
-    // Free WHERE value
-    if (statement->where_value)
+    // Free WHERE values
+    for (uint32_t i = 0; i < statement->where_condition_count; i++)
     {
-        SAFE_FREE(statement->where_value);
+        SAFE_FREE(statement->where_conditions[i].value);
     }
 
     // Free INSERT values
@@ -1025,9 +1645,33 @@ void free_sql_statement(SQLStatement *statement)
         SAFE_FREE(statement->update_values);
     }
 
+    if (statement->update_value_types)
+    {
+        SAFE_FREE(statement->update_value_types);
+    }
+
     SAFE_FREE(statement);
 }
 
+const char *aggregate_to_string(AggregateType type)
+{
+    switch (type)
+    {
+    case AGG_COUNT:
+        return "COUNT";
+    case AGG_SUM:
+        return "SUM";
+    case AGG_MIN:
+        return "MIN";
+    case AGG_MAX:
+        return "MAX";
+    case AGG_AVG:
+        return "AVG";
+    default:
+        return "";
+    }
+}
+
 const char *statement_type_to_string(StatementType type)
 {
     switch (type)
@@ -1046,8 +1690,14 @@ const char *statement_type_to_string(StatementType type)
         return "DROP TABLE";
     case STMT_CREATE_INDEX:
         return "CREATE INDEX";
+    case STMT_DROP_INDEX:
+        return "DROP INDEX";
     case STMT_SHOW_TABLES:
         return "SHOW TABLES";
+    case STMT_REINDEX:
+        return "REINDEX";
+    case STMT_ANALYZE:
+        return "ANALYZE";
     case STMT_UNKNOWN:
         return "UNKNOWN";
     default:
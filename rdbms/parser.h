@@ -4,6 +4,9 @@
 #include <stddef.h>
 #include "storage.h"
 
+#define MAX_WHERE_CONDITIONS 8
+#define MAX_SORT_COLUMNS 8 // GROUP BY and ORDER BY lists
+
 typedef enum {
     STMT_SELECT,
     STMT_INSERT,
@@ -12,7 +15,10 @@ typedef enum {
     STMT_CREATE_TABLE,
     STMT_DROP_TABLE,
     STMT_CREATE_INDEX,
+    STMT_DROP_INDEX,
     STMT_SHOW_TABLES,
+    STMT_REINDEX,
+    STMT_ANALYZE,
     STMT_UNKNOWN
 } StatementType;
 
@@ -40,6 +46,31 @@ typedef enum {
     JOIN_FULL
 } JoinType;
 
+// Join strategy asked for with USING after the ON clause; the planner
+// picks one by cost otherwise
+typedef enum {
+    JOIN_METHOD_AUTO,
+    JOIN_METHOD_LOOP,  // nested loop
+    JOIN_METHOD_HASH,
+    JOIN_METHOD_MERGE, // sort-merge
+    JOIN_METHOD_INDEX  // index nested loop
+} JoinMethod;
+
+// Aggregate function of a SELECT list item
+typedef enum {
+    AGG_NONE,
+    AGG_COUNT, // COUNT(*) counts rows, COUNT(col) non-NULL values
+    AGG_SUM,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_AVG
+} AggregateType;
+
+typedef struct {
+    char column[MAX_COLUMN_NAME]; // a column, or an aggregate as it is printed: "COUNT(*)"
+    bool descending;
+} OrderByClause;
+
 typedef struct
 {
     char left_table[MAX_TABLE_NAME];
@@ -47,6 +78,7 @@ typedef struct
     JoinType type;
     char on_left[MAX_COLUMN_NAME];
     char on_right[MAX_COLUMN_NAME];
+    JoinMethod method;
 } JoinClause;
 
 typedef struct {
@@ -59,10 +91,17 @@ typedef struct {
     char select_table[MAX_TABLE_NAME];
     char select_columns[MAX_COLUMNS][MAX_COLUMN_NAME];
     uint32_t select_column_count;
-    WhereClause where_clause;
+    AggregateType select_aggregates[MAX_COLUMNS]; // AGG_NONE for plain columns
+    char group_by[MAX_SORT_COLUMNS][MAX_COLUMN_NAME];
+    uint32_t group_by_count;
+    OrderByClause order_by[MAX_SORT_COLUMNS];
+    uint32_t order_by_count;
+    bool has_limit;
+    uint32_t limit;
     bool has_where;
     JoinClause join_clause;
     bool has_join;
+    bool explain; // EXPLAIN SELECT: return the plan instead of the rows
 
     // For INSERT
     char insert_table[MAX_TABLE_NAME];
@@ -70,23 +109,33 @@ typedef struct {
     DataType* insert_value_types;
     uint32_t insert_value_count;
 
-    // For DELETE/UPDATE
+    // For DELETE/UPDATE, and ANALYZE of one table (empty: every table)
     char table_name[MAX_TABLE_NAME];
     
-    // For multiple WHERE conditions (simplified to single for now)
-    char where_column[MAX_COLUMN_NAME];
-    OperatorType where_operator;
-    void* where_value;
-    DataType where_value_type;
+    // WHERE conditions, all of which must hold (AND)
+    WhereClause where_conditions[MAX_WHERE_CONDITIONS];
+    uint32_t where_condition_count;
     
     // For UPDATE
     char update_table[MAX_TABLE_NAME];
     char update_columns[MAX_COLUMNS][MAX_COLUMN_NAME];
     void** update_values;
+    DataType* update_value_types;
     uint32_t update_column_count;
 
     // For DROP TABLE
     char drop_table[MAX_TABLE_NAME];
+
+    // For CREATE INDEX / DROP INDEX / REINDEX
+    char index_name[MAX_INDEX_NAME];
+    char index_table[MAX_TABLE_NAME]; // REINDEX TABLE: every index of the table
+    char index_columns[MAX_INDEX_COLUMNS][MAX_COLUMN_NAME];
+    uint32_t index_column_count;
+    char index_include_columns[MAX_INDEX_COLUMNS][MAX_COLUMN_NAME];
+    uint32_t index_include_count;
+    bool index_unique;
+    uint32_t index_method; // IndexMethod: INDEX_BTREE unless USING HASH
+    uint32_t index_fill_factor; // 0 when not given
     
     // Error information
     char error_message[256];
@@ -114,6 +163,8 @@ bool tokenizer_has_more(Tokenizer* t);
 // Helper functions
 DataType parse_data_type(const char* type_str);
 OperatorType parse_operator(const char* op_str);
+const char* operator_to_string(OperatorType op);
+const char* aggregate_to_string(AggregateType type);
 void* parse_value(const char* value_str, DataType type);
 
 #endif // PARSER_H
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "storage.h"
 #include "parser.h"
 #include "executor.h"
+#include "btree.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -16,7 +17,9 @@
 static char* sql_keywords[] = {
     "SELECT", "FROM", "WHERE", "INSERT", "INTO", "VALUES", 
     "UPDATE", "SET", "DELETE", "CREATE", "TABLE", "DROP", 
-    "INTEGER", "TEXT", "PRIMARY", "KEY", "NULL", "JOIN", NULL
+    "INTEGER", "TEXT", "PRIMARY", "KEY", "NULL", "JOIN", "INDEX",
+    "UNIQUE", "ON", "INCLUDE", "USING", "HASH", "BITMAP", "LOOP", "MERGE", "GROUP", "ORDER",
+    "BY", "LIMIT", "ASC", "DESC", "COUNT", "SUM", "MIN", "MAX", "AVG", NULL
 };
 
 // Autocomplete generator
@@ -96,8 +99,9 @@ void print_result(QueryResult* result) {
     
     for (uint32_t row = 0; row < result->row_count; row++) {
         for (uint32_t col = 0; col < result->column_count; col++) {
-            if (result->rows[row][col]) {
-                int len = strlen((char*)result->rows[row][col]);
+            const char* value = result_value(result, row, col);
+            if (value) {
+                int len = strlen(value);
                 if (len > col_widths[col]) {
                     col_widths[col] = len;
                 }
@@ -130,8 +134,9 @@ void print_result(QueryResult* result) {
     for (uint32_t row = 0; row < result->row_count; row++) {
         printf("|");
         for (uint32_t col = 0; col < result->column_count; col++) {
-            if (result->rows[row][col]) {
-                printf(" %-*s |", col_widths[col], (char*)result->rows[row][col]);
+            const char* value = result_value(result, row, col);
+            if (value) {
+                printf(" %-*s |", col_widths[col], value);
             } else {
                 printf(" %-*s |", col_widths[col], "NULL");
             }
@@ -149,6 +154,79 @@ void print_result(QueryResult* result) {
     printf("%u row(s) in set\n\n", result->row_count);
 }
 
+#define PRINT_SIZING_ROWS 1000 // rows read ahead to size the table's columns
+
+static void print_border(const int* widths, uint32_t column_count) {
+    printf("+");
+    for (uint32_t i = 0; i < column_count; i++) {
+        for (int j = 0; j < widths[i] + 2; j++) printf("-");
+        printf("+");
+    }
+    printf("\n");
+}
+
+static void print_row(const char* const* values, const int* widths, uint32_t column_count) {
+    printf("|");
+    for (uint32_t col = 0; col < column_count; col++) {
+        printf(" %-*s |", widths[col], values[col] ? values[col] : "NULL");
+    }
+    printf("\n");
+}
+
+// Prints a SELECT while it runs. Column widths come from the first
+// PRINT_SIZING_ROWS rows; later rows are printed as they arrive, so a
+// longer value among them only widens its own line.
+void print_stream(QueryStream* stream) {
+    uint32_t columns = stream->column_count;
+    char** buffered = SAFE_MALLOC(char*, (size_t)PRINT_SIZING_ROWS * (columns ? columns : 1));
+    uint32_t buffered_rows = 0;
+
+    while (buffered_rows < PRINT_SIZING_ROWS && query_next(stream)) {
+        for (uint32_t col = 0; col < columns; col++) {
+            const char* value = stream->values[col];
+            buffered[buffered_rows * columns + col] = value ? SAFE_STRDUP(value) : NULL;
+        }
+        buffered_rows++;
+    }
+
+    if (buffered_rows == 0) {
+        if (stream->error_message) printf("ERROR: %s\n", stream->error_message);
+        else printf("Empty result set\n");
+        SAFE_FREE(buffered);
+        return;
+    }
+
+    int widths[MAX_COLUMNS];
+    for (uint32_t col = 0; col < columns; col++) {
+        widths[col] = strlen(stream->column_names[col]);
+        for (uint32_t row = 0; row < buffered_rows; row++) {
+            const char* value = buffered[row * columns + col];
+            int len = value ? (int)strlen(value) : 4;
+            if (len > widths[col]) widths[col] = len;
+        }
+    }
+
+    const char* names[MAX_COLUMNS];
+    for (uint32_t col = 0; col < columns; col++) names[col] = stream->column_names[col];
+    print_border(widths, columns);
+    print_row(names, widths, columns);
+    print_border(widths, columns);
+
+    for (uint32_t row = 0; row < buffered_rows; row++) {
+        print_row((const char* const*)&buffered[row * columns], widths, columns);
+        for (uint32_t col = 0; col < columns; col++) SAFE_FREE(buffered[row * columns + col]);
+    }
+    SAFE_FREE(buffered);
+
+    while (query_next(stream)) {
+        print_row(stream->values, widths, columns);
+    }
+    print_border(widths, columns);
+
+    if (stream->error_message) printf("ERROR: %s\n", stream->error_message);
+    printf("%llu row(s) in set\n\n", (unsigned long long)stream->row_count);
+}
+
 void print_welcome() {
     printf("╔══════════════════════════════════════╗\n");
     printf("║         NyotaDB v0.1 - REPL          ║\n");
@@ -173,13 +251,26 @@ void print_help() {
     
     printf("  INSERT INTO table_name VALUES (value1, value2, ...);\n\n");
     
-    printf("  SELECT column1, column2 FROM table_name\n");
-    printf("      [WHERE condition];\n\n");
+    printf("  SELECT column1, AGG(column2), ... FROM table_name\n");
+    printf("      [[INNER|LEFT|RIGHT|FULL] JOIN other ON col = other_col\n");
+    printf("          [USING LOOP|HASH|MERGE|INDEX]]\n");
+    printf("      [WHERE condition] [GROUP BY column, ...]\n");
+    printf("      [ORDER BY column [ASC|DESC], ...] [LIMIT n];\n");
+    printf("      AGG is COUNT, SUM, MIN, MAX or AVG\n");
+    printf("  EXPLAIN SELECT ...; - Show the plan instead of running it\n\n");
     
     printf("  DELETE FROM table_name [WHERE condition];\n\n");
     
     printf("  DROP TABLE table_name;\n\n");
     
+    printf("  CREATE [UNIQUE] INDEX index_name ON table_name [USING HASH|BITMAP] (column, ...) [INCLUDE (column, ...)];\n\n");
+    
+    printf("  DROP INDEX index_name;\n\n");
+    
+    printf("  REINDEX [INDEX] index_name;  REINDEX TABLE table_name;\n\n");
+    
+    printf("  ANALYZE [table_name]; - Collect planner statistics\n\n");
+    
     printf("  SHOW TABLES;\n\n");
     
     printf("Utility commands:\n");
@@ -189,6 +280,8 @@ void print_help() {
     printf("  CLEAR;    - Clear screen\n");
     printf("  .tables   - List tables (alternative)\n");
     printf("  .schema table_name - Show table schema\n");
+    printf("  .indexstats table_name - Show B-tree index statistics\n");
+    printf("  .memory [bytes] - Show or set the per-query memory budget\n");
     printf("\n");
 }
 
@@ -223,29 +316,67 @@ void handle_dot_command(StorageManager* sm, const char* command) {
                 if (schema->columns[i].is_unique) printf(" UNIQUE");
                 printf("\n");
             }
+
+            IndexDef defs[MAX_TABLE_INDEXES];
+            uint32_t index_count = index_catalog_list(sm, schema->name, defs, MAX_TABLE_INDEXES);
+            if (index_count > 0) {
+                printf("Indexes:\n");
+                for (uint32_t i = 0; i < index_count; i++) {
+                    printf("  %s (", defs[i].name);
+                    for (uint32_t k = 0; k < defs[i].key_column_count; k++) {
+                        printf("%s%s", k > 0 ? ", " : "", schema->columns[defs[i].key_columns[k]].name);
+                    }
+                    printf(")");
+                    if (defs[i].include_column_count > 0) {
+                        printf(" INCLUDE (");
+                        for (uint32_t k = 0; k < defs[i].include_column_count; k++) {
+                            printf("%s%s", k > 0 ? ", " : "", schema->columns[defs[i].include_columns[k]].name);
+                        }
+                        printf(")");
+                    }
+                    if (defs[i].method == INDEX_HASH) printf(" HASH");
+                    if (defs[i].method == INDEX_BITMAP) printf(" BITMAP");
+                    if (defs[i].is_primary) printf(" PRIMARY");
+                    else if (defs[i].is_unique) printf(" UNIQUE");
+                    printf("\n");
+                }
+            }
             SAFE_FREE(schema);
         } else {
             printf("Table '%s' not found\n", table_name);
         }
     }
+    else if (strncmp(command, ".indexstats ", 12) == 0) {
+        QueryResult* result = execute_index_stats(sm, command + 12);
+        print_result(result);
+        free_result(result);
+    }
     else if (strcmp(command, ".clear") == 0 || strcasecmp(command, "CLEAR;") == 0) {
         printf("\033[2J\033[H"); // Clear screen
         print_welcome();
     }
+    else if (strcmp(command, ".memory") == 0 || strncmp(command, ".memory ", 8) == 0) {
+        if (command[7] == ' ') query_set_memory_budget((size_t)strtoull(command + 8, NULL, 10));
+        printf("Query memory budget: %zu bytes\n", query_memory_budget());
+    }
     else if (strcmp(command, ".stats") == 0) {
         // Show database statistics
         printf("Database Statistics:\n");
         printf("  Total pages: %u\n", sm->header.page_count);
         printf("  Schema page: %u\n", sm->header.schema_page);
-        printf("  Root page: %u\n", sm->header.root_page);
+        printf("  Index catalog page: %u\n", sm->header.index_page);
         printf("  Cache size: %u pages\n", sm->cache_size);
+        printf("  Page requests: %llu (%llu read from disk)\n",
+               (unsigned long long)sm->page_requests, (unsigned long long)sm->page_reads);
     }
     else {
         printf("Unknown dot command: %s\n", command);
         printf("Available dot commands:\n");
         printf("  .tables          - List all tables\n");
         printf("  .schema <table>  - Show table schema\n");
+        printf("  .indexstats <table> - Show B-tree index statistics\n");
         printf("  .stats           - Show database statistics\n");
+        printf("  .memory [bytes]  - Show or set what a sort or hash join may buffer\n");
         printf("  .clear           - Clear screen\n");
     }
 }
@@ -332,9 +463,12 @@ void run_repl() {
             case STMT_CREATE_TABLE:
                 result = execute_create_table(sm, stmt);
                 break;
-            case STMT_SELECT:
-                result = execute_select(sm, stmt);
+            case STMT_SELECT: {
+                QueryStream* stream = query_open(sm, stmt);
+                print_stream(stream);
+                query_close(stream);
                 break;
+            }
             case STMT_INSERT:
                 result = execute_insert(sm, stmt);
                 break;
@@ -347,6 +481,18 @@ void run_repl() {
             case STMT_DROP_TABLE:
                 printf("DROP TABLE not yet implemented\n");
                 break;
+            case STMT_CREATE_INDEX:
+                result = execute_create_index(sm, stmt);
+                break;
+            case STMT_DROP_INDEX:
+                result = execute_drop_index(sm, stmt);
+                break;
+            case STMT_REINDEX:
+                result = execute_reindex(sm, stmt);
+                break;
+            case STMT_ANALYZE:
+                result = execute_analyze(sm, stmt);
+                break;
             case STMT_SHOW_TABLES:
                 handle_dot_command(sm, ".tables");
                 break;
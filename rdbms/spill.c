@@ -0,0 +1,102 @@
+#include "spill.h"
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+
+struct SpillFile {
+    StorageManager* sm;
+    uint32_t* pages; // in write order; page i holds bytes [i * PAGE_SIZE, (i + 1) * PAGE_SIZE)
+    uint32_t page_count;
+    uint32_t page_capacity;
+    uint64_t size;     // bytes written
+    uint64_t position; // next byte to read
+    bool reading;
+    uint32_t loaded; // page whose bytes are in `buffer` while reading, page_count if none
+    uint8_t buffer[PAGE_SIZE];
+};
+
+SpillFile* spill_create(StorageManager* sm) {
+    SpillFile* spill = SAFE_CALLOC(SpillFile, 1);
+    spill->sm = sm;
+    return spill;
+}
+
+// Hands the buffer to a new page
+static bool flush_buffer(SpillFile* spill) {
+    uint32_t page_id = sm_allocate_page(spill->sm);
+    Page* page = sm_get_page(spill->sm, page_id);
+    if (!page) return false;
+    memcpy(page->data, spill->buffer, PAGE_SIZE);
+    page->is_dirty = true;
+
+    if (spill->page_count == spill->page_capacity) {
+        spill->page_capacity = spill->page_capacity ? spill->page_capacity * 2 : 16;
+        spill->pages = SAFE_REALLOC(spill->pages, uint32_t, spill->page_capacity);
+    }
+    spill->pages[spill->page_count++] = page_id;
+    return true;
+}
+
+bool spill_write(SpillFile* spill, const void* bytes, size_t length) {
+    if (spill->reading) return false;
+
+    const uint8_t* from = bytes;
+    while (length > 0) {
+        uint32_t used = (uint32_t)(spill->size % PAGE_SIZE);
+        size_t n = PAGE_SIZE - used < length ? PAGE_SIZE - used : length;
+        memcpy(spill->buffer + used, from, n);
+        spill->size += n;
+        from += n;
+        length -= n;
+        if (spill->size % PAGE_SIZE == 0 && !flush_buffer(spill)) return false;
+    }
+    return true;
+}
+
+bool spill_rewind(SpillFile* spill) {
+    if (!spill->reading) {
+        if (spill->size % PAGE_SIZE != 0 && !flush_buffer(spill)) return false;
+        spill->reading = true;
+    }
+    spill->position = 0;
+    spill->loaded = spill->page_count;
+    return true;
+}
+
+bool spill_read(SpillFile* spill, void* bytes, size_t length) {
+    if (!spill->reading || spill->position + length > spill->size) return false;
+
+    uint8_t* to = bytes;
+    while (length > 0) {
+        uint32_t index = (uint32_t)(spill->position / PAGE_SIZE);
+        uint32_t offset = (uint32_t)(spill->position % PAGE_SIZE);
+        if (spill->loaded != index) {
+            Page* page = sm_get_page(spill->sm, spill->pages[index]);
+            if (!page) return false;
+            memcpy(spill->buffer, page->data, PAGE_SIZE);
+            spill->loaded = index;
+        }
+
+        size_t n = PAGE_SIZE - offset < length ? PAGE_SIZE - offset : length;
+        memcpy(to, spill->buffer + offset, n);
+        spill->position += n;
+        to += n;
+        length -= n;
+    }
+    return true;
+}
+
+uint32_t spill_page_count(SpillFile* spill) {
+    return spill ? spill->page_count : 0;
+}
+
+// Last page first, so the free list hands the pages out again in the
+// order they were written
+void spill_free(SpillFile* spill) {
+    if (!spill) return;
+    for (uint32_t i = spill->page_count; i-- > 0;) {
+        sm_free_page(spill->sm, spill->pages[i]);
+    }
+    SAFE_FREE(spill->pages);
+    SAFE_FREE(spill);
+}
@@ -0,0 +1,29 @@
+// spill.h
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "storage.h"
+
+// Temporary byte stream kept in database pages, for operators whose state
+// outgrows the query's memory budget. It is written once from the start,
+// then read back from the start. Writes fill a one-page buffer and hand
+// full pages to the storage manager, whose cache writes them out as it
+// evicts; reads go through the cache a page at a time, in the order the
+// pages were written. The pages return to the free list when the stream
+// is freed, so the space is reused by the next spill.
+typedef struct SpillFile SpillFile;
+
+SpillFile* spill_create(StorageManager* sm);
+bool spill_write(SpillFile* spill, const void* bytes, size_t length);
+// Ends writing and moves to the first byte
+bool spill_rewind(SpillFile* spill);
+// False at the end of the stream
+bool spill_read(SpillFile* spill, void* bytes, size_t length);
+uint32_t spill_page_count(SpillFile* spill);
+void spill_free(SpillFile* spill);
+
+#endif // SPILL_H
@@ -0,0 +1,220 @@
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+
+// Selectivities assumed when a literal cannot be placed in a histogram
+#define DEFAULT_EQUAL_SELECTIVITY 0.005
+#define DEFAULT_RANGE_SELECTIVITY (1.0 / 3.0)
+#define DEFAULT_LIKE_SELECTIVITY 0.1
+
+// Catalog pages hold one TableStats and end with the next-page link
+#define STATS_NEXT_OFFSET (PAGE_SIZE - sizeof(uint32_t))
+
+struct StatsSample {
+    uint32_t column_count;
+    uint32_t rows_seen;
+    uint32_t kept;
+    uint64_t random;
+    uint64_t* values; // column c of sampled row r at [c * STATS_SAMPLE_ROWS + r]
+    uint64_t* hashes;
+};
+
+// Histogram values as numbers, so buckets can be interpolated
+static uint64_t load_value(const uint8_t* bytes) {
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < STATS_VALUE_SIZE; i++) value = (value << 8) | bytes[i];
+    return value;
+}
+
+static void store_value(uint8_t* bytes, uint64_t value) {
+    for (int i = STATS_VALUE_SIZE - 1; i >= 0; i--) {
+        bytes[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+StatsSample* stats_sample_create(uint32_t column_count) {
+    StatsSample* sample = SAFE_CALLOC(StatsSample, 1);
+    sample->column_count = column_count;
+    sample->random = 0x9E3779B97F4A7C15ull; // fixed seed: ANALYZE is repeatable
+    sample->values = SAFE_MALLOC(uint64_t, (size_t)column_count * STATS_SAMPLE_ROWS);
+    sample->hashes = SAFE_MALLOC(uint64_t, (size_t)column_count * STATS_SAMPLE_ROWS);
+    return sample;
+}
+
+// Reservoir sampling (Vitter's algorithm R): after n rows every row has
+// been kept with the same probability STATS_SAMPLE_ROWS / n
+void stats_sample_add(StatsSample* sample, const uint8_t* values, const uint64_t* hashes) {
+    uint32_t slot = sample->rows_seen++;
+    if (slot >= STATS_SAMPLE_ROWS) {
+        sample->random ^= sample->random << 13;
+        sample->random ^= sample->random >> 7;
+        sample->random ^= sample->random << 17;
+        slot = (uint32_t)(sample->random % sample->rows_seen);
+        if (slot >= STATS_SAMPLE_ROWS) return;
+    } else {
+        sample->kept++;
+    }
+
+    for (uint32_t c = 0; c < sample->column_count; c++) {
+        sample->values[c * STATS_SAMPLE_ROWS + slot] = load_value(values + c * STATS_VALUE_SIZE);
+        sample->hashes[c * STATS_SAMPLE_ROWS + slot] = hashes[c];
+    }
+}
+
+// Estimates the distinct values of the table from those of the sample
+// with the Duj1 estimator of Haas and Stokes: n * d / (n - f1 + f1 * n / N),
+// where the sample of n rows out of N has d distinct values, f1 of which
+// occur only once. A sample of the whole table gives d itself.
+static uint32_t estimate_distinct(uint64_t* hashes, uint32_t n, uint32_t total) {
+    if (n == 0) return 0;
+    qsort(hashes, n, sizeof(uint64_t), compare_u64);
+
+    uint32_t distinct = 0, singles = 0;
+    for (uint32_t i = 0; i < n;) {
+        uint32_t j = i + 1;
+        while (j < n && hashes[j] == hashes[i]) j++;
+        distinct++;
+        singles += j - i == 1;
+        i = j;
+    }
+
+    double estimate = (double)n * distinct / ((double)(n - singles) + (double)singles * n / total);
+    if (estimate < distinct) estimate = distinct;
+    if (estimate > total) estimate = total;
+    return (uint32_t)(estimate + 0.5);
+}
+
+void stats_sample_finish(StatsSample* sample, TableStats* stats) {
+    uint32_t n = sample->kept;
+    stats->row_count = sample->rows_seen;
+    stats->column_count = sample->column_count;
+
+    for (uint32_t c = 0; c < sample->column_count; c++) {
+        ColumnStats* column = &stats->columns[c];
+        memset(column, 0, sizeof(ColumnStats));
+        column->distinct = estimate_distinct(sample->hashes + c * STATS_SAMPLE_ROWS, n, sample->rows_seen);
+        if (n == 0) continue;
+
+        uint64_t* values = sample->values + c * STATS_SAMPLE_ROWS;
+        qsort(values, n, sizeof(uint64_t), compare_u64);
+        column->bucket_count = STATS_BUCKETS;
+        for (uint32_t b = 0; b <= STATS_BUCKETS; b++) {
+            store_value(column->bounds[b], values[(uint64_t)b * (n - 1) / STATS_BUCKETS]);
+        }
+    }
+
+    SAFE_FREE(sample->values);
+    SAFE_FREE(sample->hashes);
+    SAFE_FREE(sample);
+}
+
+static uint32_t catalog_head(StorageManager* sm) {
+    if (sm->header.schema_page == 0) return 0;
+    Page* page = sm_get_page(sm, sm->header.schema_page);
+    if (!page) return 0;
+
+    uint32_t head;
+    memcpy(&head, page->data + SCHEMA_PAGE_STATS_OFFSET, sizeof(uint32_t));
+    return head;
+}
+
+static uint32_t next_page(Page* page) {
+    uint32_t next;
+    memcpy(&next, page->data + STATS_NEXT_OFFSET, sizeof(uint32_t));
+    return next;
+}
+
+bool stats_save(StorageManager* sm, const TableStats* stats) {
+    if (sm->header.schema_page == 0) return false;
+
+    for (uint32_t page_id = catalog_head(sm); page_id != 0;) {
+        Page* page = sm_get_page(sm, page_id);
+        if (!page) return false;
+        if (strncmp((const char*)page->data, stats->table_name, MAX_TABLE_NAME) == 0) {
+            memcpy(page->data, stats, sizeof(TableStats));
+            page->is_dirty = true;
+            return true;
+        }
+        page_id = next_page(page);
+    }
+
+    // First ANALYZE of the table: put its page at the head of the chain
+    uint32_t head = catalog_head(sm);
+    uint32_t page_id = sm_allocate_page(sm);
+    Page* page = sm_get_page(sm, page_id);
+    if (!page) return false;
+    memcpy(page->data, stats, sizeof(TableStats));
+    memcpy(page->data + STATS_NEXT_OFFSET, &head, sizeof(uint32_t));
+    page->is_dirty = true;
+
+    Page* schema_page = sm_get_page(sm, sm->header.schema_page);
+    if (!schema_page) return false;
+    memcpy(schema_page->data + SCHEMA_PAGE_STATS_OFFSET, &page_id, sizeof(uint32_t));
+    schema_page->is_dirty = true;
+    return true;
+}
+
+bool stats_load(StorageManager* sm, const char* table_name, TableStats* stats) {
+    for (uint32_t page_id = catalog_head(sm); page_id != 0;) {
+        Page* page = sm_get_page(sm, page_id);
+        if (!page) return false;
+        if (strncmp((const char*)page->data, table_name, MAX_TABLE_NAME) == 0) {
+            memcpy(stats, page->data, sizeof(TableStats));
+            return true;
+        }
+        page_id = next_page(page);
+    }
+    return false;
+}
+
+// Fraction of the rows with a value below `value`: whole buckets below it,
+// plus the part of its bucket under it assuming values spread evenly
+static double fraction_below(const ColumnStats* column, uint64_t value) {
+    if (value <= load_value(column->bounds[0])) return 0.0;
+    for (uint32_t b = 0; b < column->bucket_count; b++) {
+        uint64_t low = load_value(column->bounds[b]);
+        uint64_t high = load_value(column->bounds[b + 1]);
+        if (value <= high) {
+            return (b + (double)(value - low) / (double)(high - low)) / column->bucket_count;
+        }
+    }
+    return 1.0;
+}
+
+static double clamp_fraction(double fraction) {
+    return fraction < 0.0 ? 0.0 : (fraction > 1.0 ? 1.0 : fraction);
+}
+
+double stats_selectivity(const TableStats* stats, uint32_t column, OperatorType op, const uint8_t* value) {
+    if (op == OP_LIKE) return DEFAULT_LIKE_SELECTIVITY;
+    if (!stats || !value) {
+        if (op == OP_EQUALS) return DEFAULT_EQUAL_SELECTIVITY;
+        if (op == OP_NOT_EQUALS) return 1.0 - DEFAULT_EQUAL_SELECTIVITY;
+        return DEFAULT_RANGE_SELECTIVITY;
+    }
+
+    const ColumnStats* col = &stats->columns[column];
+    if (col->bucket_count == 0) return 0.0; // empty when analyzed
+
+    uint64_t v = load_value(value);
+    bool in_range = v >= load_value(col->bounds[0]) && v <= load_value(col->bounds[col->bucket_count]);
+    double equal = in_range && col->distinct > 0 ? 1.0 / col->distinct : 0.0;
+    double below = fraction_below(col, v);
+
+    switch (op) {
+        case OP_EQUALS: return equal;
+        case OP_NOT_EQUALS: return 1.0 - equal;
+        case OP_LESS: return clamp_fraction(below);
+        case OP_LESS_EQUAL: return clamp_fraction(below + equal);
+        case OP_GREATER: return clamp_fraction(1.0 - below - equal);
+        case OP_GREATER_EQUAL: return clamp_fraction(1.0 - below);
+        default: return DEFAULT_RANGE_SELECTIVITY;
+    }
+}
@@ -0,0 +1,55 @@
+// stats.h
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "storage.h"
+#include "parser.h"
+
+#define STATS_BUCKETS 10         // equi-depth histogram buckets per column
+#define STATS_VALUE_SIZE 8       // leading bytes of each encoded value kept in a histogram
+#define STATS_SAMPLE_ROWS 10000  // rows ANALYZE samples for histograms and distinct counts
+
+// Planner statistics of a table, collected by ANALYZE and kept until the
+// next ANALYZE; they are not maintained by writes in between.
+//
+// Values are handled in their memcmp-comparable key encoding
+// (btree_encode_value) cut to STATS_VALUE_SIZE bytes, like zone map
+// bounds. A column's histogram is equi-depth: bounds[0] is the smallest
+// sampled value, bounds[bucket_count] the largest, and every bucket in
+// between holds the same share of the rows.
+typedef struct {
+    uint32_t distinct;     // estimated distinct values in the whole table
+    uint32_t bucket_count; // 0 when the table was empty
+    uint8_t bounds[STATS_BUCKETS + 1][STATS_VALUE_SIZE];
+} ColumnStats;
+
+typedef struct {
+    char table_name[MAX_TABLE_NAME];
+    uint32_t column_count;
+    uint32_t row_count;
+    uint32_t page_count; // heap pages holding live rows
+    ColumnStats columns[MAX_COLUMNS];
+} TableStats;
+
+// Reservoir sample of a table's rows, fed one row at a time
+typedef struct StatsSample StatsSample;
+
+StatsSample* stats_sample_create(uint32_t column_count);
+// `values` holds STATS_VALUE_SIZE bytes per column, `hashes` a hash of
+// each column's whole encoded value
+void stats_sample_add(StatsSample* sample, const uint8_t* values, const uint64_t* hashes);
+// Fills row_count, column_count and the column statistics; frees the sample
+void stats_sample_finish(StatsSample* sample, TableStats* stats);
+
+// The statistics catalog: one page per analyzed table, chained from the
+// schema page trailer (SCHEMA_PAGE_STATS_OFFSET)
+bool stats_save(StorageManager* sm, const TableStats* stats);
+bool stats_load(StorageManager* sm, const char* table_name, TableStats* stats);
+
+// Estimated fraction of the rows whose column value satisfies `op`
+// against the literal, given as STATS_VALUE_SIZE encoded bytes. Without
+// statistics or an encoded literal (NULL) it falls back to fixed guesses.
+double stats_selectivity(const TableStats* stats, uint32_t column, OperatorType op, const uint8_t* value);
+
+#endif // STATS_H
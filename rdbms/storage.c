@@ -1,5 +1,6 @@
 #include "storage.h"
 #include "btree.h"
+#include "bloom.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,7 +11,7 @@
 static void lru_remove(StorageManager* sm, Page* page);
 static void lru_insert_front(StorageManager* sm, Page* page);
 static void lru_touch(StorageManager* sm, Page* page);
-static void evict_lru_page(StorageManager* sm);
+static bool evict_lru_page(StorageManager* sm);
 
 StorageManager* sm_open(const char* filename) {
     StorageManager* sm = SAFE_MALLOC(StorageManager, 1);
@@ -19,11 +20,15 @@ StorageManager* sm_open(const char* filename) {
     sm->cache_size = 0;
     sm->lru_head = sm->lru_tail = NULL;
     memset(sm->pages, 0, sizeof(sm->pages));
-
+    memset(sm->page_table, 0, sizeof(sm->page_table));
+    sm->page_requests = sm->page_reads = 0;
+    sm->bloom_filters = NULL;
+    pthread_mutex_init(&sm->latch, NULL);
 
     // Open or create file
     sm->fd = open(filename, O_RDWR | O_CREAT, 0644);
     if (sm->fd < 0) {
+        pthread_mutex_destroy(&sm->latch);
         free(sm);
         return NULL;
     }
@@ -32,9 +37,9 @@ StorageManager* sm_open(const char* filename) {
     off_t file_size = lseek(sm->fd, 0, SEEK_END);
     if (file_size == 0) {
         // Initialize new database
-        sm->header.magic_number = 0x0042444D;
+        sm->header.magic_number = DB_MAGIC;
         sm->header.page_count = 1;
-        sm->header.root_page = 0;
+        sm->header.index_page = 0;
         sm->header.first_free_page = 0;
         sm->header.schema_page = 0;
 
@@ -49,61 +54,148 @@ StorageManager* sm_open(const char* filename) {
     } else {
         // Read existing header
         lseek(sm->fd, 0, SEEK_SET);
-        read(sm->fd, &sm->header, sizeof(DBHeader));
-    
-        if (sm->header.magic_number != 0x0042444D) {
+        if (read(sm->fd, &sm->header, sizeof(DBHeader)) != (ssize_t)sizeof(DBHeader))
+            sm->header.magic_number = 0;
+
+        if (sm->header.magic_number != DB_MAGIC) {
+            if ((sm->header.magic_number & 0x00FFFFFF) == DB_MAGIC_BASE)
+                fprintf(stderr, "'%s' has file format version %u, this build reads version %u\n",
+                        filename, sm->header.magic_number >> 24, DB_FORMAT_VERSION);
+            else
+                fprintf(stderr, "'%s' is not a database file\n", filename);
             close(sm->fd);
+            pthread_mutex_destroy(&sm->latch);
             SAFE_FREE(sm);
             return NULL;
         }
     }
 
+    for (uint32_t i = 0; i < PAGE_TABLE_BUCKETS; i++) {
+        pthread_rwlock_init(&sm->bucket_locks[i], NULL);
+    }
     return sm;
 }
 
-Page* sm_get_page(StorageManager* sm, uint32_t page_id) {
-    // cache lookup
-    for (uint32_t i = 0; i < sm->cache_size; i++) {
-        Page* page = sm->pages[i];
-        if (page && page->page_id == page_id) {
-            lru_touch(sm, page);
-            return page;
-        }
+static uint32_t page_bucket(uint32_t page_id) {
+    return page_id % PAGE_TABLE_BUCKETS;
+}
+
+// The latch or the page's bucket lock must be held
+static Page* find_cached_page(StorageManager* sm, uint32_t page_id) {
+    for (Page* page = sm->page_table[page_bucket(page_id)]; page; page = page->hash_next) {
+        if (page->page_id == page_id) return page;
     }
+    return NULL;
+}
 
-    // Evict if cache is full
-    if (sm->cache_size >= MAX_CACHE_PAGES) {
-        evict_lru_page(sm);
+// Adds a page to the cache. The latch must be held.
+static void cache_add_page(StorageManager* sm, Page* page) {
+    uint32_t bucket = page_bucket(page->page_id);
+    pthread_rwlock_wrlock(&sm->bucket_locks[bucket]);
+    page->hash_next = sm->page_table[bucket];
+    sm->page_table[bucket] = page;
+    pthread_rwlock_unlock(&sm->bucket_locks[bucket]);
+
+    sm->pages[sm->cache_size++] = page;
+    lru_insert_front(sm, page);
+}
+
+// Caches a zeroed, dirty image of the page without reading it; NULL when
+// every cached page is pinned. The latch must be held.
+static Page* cache_new_page(StorageManager* sm, uint32_t page_id) {
+    if (sm->cache_size >= MAX_CACHE_PAGES && !evict_lru_page(sm)) {
+        return NULL;
     }
 
+    Page* page = SAFE_MALLOC(Page, 1);
+    memset(page->data, 0, PAGE_SIZE);
+    page->page_id = page_id;
+    page->is_dirty = true;
+    page->pin_count = 0;
+    page->referenced = false;
+    page->prev = page->next = NULL;
+
+    cache_add_page(sm, page);
+    return page;
+}
+
+// Looks the page up in the cache, loading it on a miss. The latch must be held.
+static Page* fetch_page(StorageManager* sm, uint32_t page_id) {
+    __atomic_add_fetch(&sm->page_requests, 1, __ATOMIC_RELAXED);
+
+    Page* cached = find_cached_page(sm, page_id);
+    if (cached) {
+        lru_touch(sm, cached);
+        return cached;
+    }
+
+    // Evict if cache is full
+    if (sm->cache_size >= MAX_CACHE_PAGES && !evict_lru_page(sm)) {
+        return NULL;
+    }
 
     // Read from disk
+    sm->page_reads++;
     off_t offset = page_id * PAGE_SIZE + sizeof(DBHeader);
-    lseek(sm->fd, offset, SEEK_SET);
 
     Page* page = SAFE_MALLOC(Page, 1);
     page->page_id = page_id;
     page->is_dirty = false;
+    page->pin_count = 0;
+    page->referenced = false;
     page->prev = page->next = NULL;
 
-    ssize_t bytes_read = read(sm->fd, page->data, PAGE_SIZE);
+    ssize_t bytes_read = pread(sm->fd, page->data, PAGE_SIZE, offset);
     if (bytes_read != PAGE_SIZE) {
         SAFE_FREE(page);
         return NULL;
     }
 
-    sm->pages[sm->cache_size++] = page;
-    lru_insert_front(sm, page);
+    cache_add_page(sm, page);
+    return page;
+}
+
+Page* sm_get_page(StorageManager* sm, uint32_t page_id) {
+    pthread_mutex_lock(&sm->latch);
+    Page* page = fetch_page(sm, page_id);
+    pthread_mutex_unlock(&sm->latch);
+    return page;
+}
+
+// A cache hit is pinned under its bucket's read lock, leaving the LRU list
+// alone and marking the page referenced instead; only a miss takes the latch
+Page* sm_pin_page(StorageManager* sm, uint32_t page_id) {
+    pthread_rwlock_t* bucket_lock = &sm->bucket_locks[page_bucket(page_id)];
+    pthread_rwlock_rdlock(bucket_lock);
+    Page* page = find_cached_page(sm, page_id);
+    if (page) {
+        __atomic_add_fetch(&page->pin_count, 1, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&page->referenced, true, __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(bucket_lock);
+
+    if (page) {
+        __atomic_add_fetch(&sm->page_requests, 1, __ATOMIC_RELAXED);
+        return page;
+    }
 
+    pthread_mutex_lock(&sm->latch);
+    page = fetch_page(sm, page_id);
+    if (page) __atomic_add_fetch(&page->pin_count, 1, __ATOMIC_ACQUIRE);
+    pthread_mutex_unlock(&sm->latch);
     return page;
 }
 
+void sm_unpin_page(StorageManager* sm, Page* page) {
+    (void)sm;
+    __atomic_sub_fetch(&page->pin_count, 1, __ATOMIC_RELEASE);
+}
+
 void sm_persist_page(StorageManager* sm, Page* page) {
     if (!page->is_dirty) return;
 
     off_t offset = page->page_id * PAGE_SIZE + sizeof(DBHeader);
-    lseek(sm->fd, offset, SEEK_SET);
-    write(sm->fd, page->data, PAGE_SIZE);
+    pwrite(sm->fd, page->data, PAGE_SIZE, offset);
     page->is_dirty = false;
 }
 
@@ -121,31 +213,108 @@ void sm_close(StorageManager* sm) {
     write(sm->fd, &sm->header, sizeof(DBHeader));
 
     close(sm->fd);
+    bloom_release_all(sm);
+    for (uint32_t i = 0; i < PAGE_TABLE_BUCKETS; i++) {
+        pthread_rwlock_destroy(&sm->bucket_locks[i]);
+    }
+    pthread_mutex_destroy(&sm->latch);
     SAFE_FREE(sm);
 }
 
+// Free list trunk page: the next trunk, a count, then that many free page
+// ids. Freeing or reusing a page only touches the trunk, never the page.
+#define FREE_TRUNK_CAPACITY ((PAGE_SIZE - 2 * sizeof(uint32_t)) / sizeof(uint32_t))
+
+typedef struct {
+    uint32_t next;
+    uint32_t count;
+    uint32_t ids[FREE_TRUNK_CAPACITY];
+} FreeTrunk;
+
+// Makes the page's content all zeroes without reading it. The latch must be held.
+static void zero_page(StorageManager* sm, uint32_t page_id) {
+    Page* page = find_cached_page(sm, page_id);
+    if (page) {
+        memset(page->data, 0, PAGE_SIZE);
+        page->is_dirty = true;
+        lru_touch(sm, page);
+    } else if (!cache_new_page(sm, page_id)) {
+        // Every cached page is pinned: write the zeroes out directly
+        uint8_t zeros[PAGE_SIZE] = {0};
+        pwrite(sm->fd, zeros, PAGE_SIZE, sizeof(DBHeader) + (off_t)page_id * PAGE_SIZE);
+    }
+}
+
+// Pops a page off the free list, 0 if there is none. The latch must be held.
+static uint32_t reuse_free_page(StorageManager* sm) {
+    if (sm->header.first_free_page == 0) return 0;
+    Page* trunk_page = fetch_page(sm, sm->header.first_free_page);
+    if (!trunk_page) return 0;
+
+    FreeTrunk* trunk = (FreeTrunk*)trunk_page->data;
+    uint32_t page_id;
+    if (trunk->count > 0) {
+        page_id = trunk->ids[--trunk->count];
+        trunk_page->is_dirty = true;
+    } else {
+        // An empty trunk is itself the last free page it stands for
+        page_id = trunk_page->page_id;
+        sm->header.first_free_page = trunk->next;
+    }
+    zero_page(sm, page_id);
+    return page_id;
+}
+
 uint32_t sm_allocate_page(StorageManager* sm) {
-    uint32_t new_page_id = sm->header.page_count;
+    pthread_mutex_lock(&sm->latch);
+    uint32_t new_page_id = reuse_free_page(sm);
+    if (new_page_id != 0) {
+        pthread_mutex_unlock(&sm->latch);
+        return new_page_id;
+    }
 
+    new_page_id = sm->header.page_count;
+
+    // Extend the file by a whole zeroed page so the page can be re-read
+    // after it has been evicted
     off_t offset = sizeof(DBHeader) + new_page_id * PAGE_SIZE;
-    lseek(sm->fd, offset - 1, SEEK_SET);
-    write(sm->fd, "\0", 1);
+    uint8_t zeros[PAGE_SIZE] = {0};
+    pwrite(sm->fd, zeros, PAGE_SIZE, offset);
 
     sm->header.page_count++;
 
-    // Initialize new page
-    Page* page = SAFE_MALLOC(Page, 1);
-    memset(page->data, 0, PAGE_SIZE);
-    page->page_id = new_page_id;
-    page->is_dirty = true;
-    
-    // Add to cache
-    if (sm->cache_size < 100) {
-        sm->pages[sm->cache_size++] = page;
-    }
-    
+    // With every page pinned the new page is simply left on disk
+    cache_new_page(sm, new_page_id);
+
+    pthread_mutex_unlock(&sm->latch);
     return new_page_id;
+}
 
+// Pages are handed out again last freed first. When every page is pinned
+// the page cannot be recorded and stays unused.
+void sm_free_page(StorageManager* sm, uint32_t page_id) {
+    pthread_mutex_lock(&sm->latch);
+    Page* trunk_page = NULL;
+    if (sm->header.first_free_page != 0) trunk_page = fetch_page(sm, sm->header.first_free_page);
+
+    if (trunk_page && ((FreeTrunk*)trunk_page->data)->count < FREE_TRUNK_CAPACITY) {
+        FreeTrunk* trunk = (FreeTrunk*)trunk_page->data;
+        trunk->ids[trunk->count++] = page_id;
+        trunk_page->is_dirty = true;
+    } else {
+        // The trunk is full (or there is none): the page becomes the new
+        // trunk, from a fresh image rather than its old content
+        Page* page = find_cached_page(sm, page_id);
+        if (!page) page = cache_new_page(sm, page_id);
+        if (page) {
+            FreeTrunk* trunk = (FreeTrunk*)page->data;
+            memset(page->data, 0, PAGE_SIZE);
+            trunk->next = sm->header.first_free_page;
+            page->is_dirty = true;
+            sm->header.first_free_page = page_id;
+        }
+    }
+    pthread_mutex_unlock(&sm->latch);
 }
 
 static void lru_remove(StorageManager* sm, Page* page) {
@@ -180,10 +349,38 @@ static void lru_touch(StorageManager* sm, Page* page) {
     lru_insert_front(sm, page);
 }
 
-static void evict_lru_page(StorageManager* sm) {
-    Page* victim = sm->lru_tail;
-    if (!victim) return;
-    
+// Unlinks the page from the page table unless it is pinned. The latch
+// must be held; the bucket lock keeps sm_pin_page from pinning it meanwhile.
+static bool page_table_remove(StorageManager* sm, Page* page) {
+    uint32_t bucket = page_bucket(page->page_id);
+    pthread_rwlock_wrlock(&sm->bucket_locks[bucket]);
+    bool removable = __atomic_load_n(&page->pin_count, __ATOMIC_ACQUIRE) == 0;
+    if (removable) {
+        Page** link = &sm->page_table[bucket];
+        while (*link != page) link = &(*link)->hash_next;
+        *link = page->hash_next;
+    }
+    pthread_rwlock_unlock(&sm->bucket_locks[bucket]);
+    return removable;
+}
+
+// Drops the least recently used unpinned page; false if every page is
+// pinned. Pages pinned without the latch since the last eviction get a
+// second chance, as they never moved up the LRU list.
+static bool evict_lru_page(StorageManager* sm) {
+    Page* victim = NULL;
+    for (int pass = 0; pass < 2 && !victim; pass++) {
+        for (Page* page = sm->lru_tail; page; page = page->prev) {
+            if (__atomic_load_n(&page->pin_count, __ATOMIC_ACQUIRE) > 0) continue;
+            if (pass == 0 && __atomic_exchange_n(&page->referenced, false, __ATOMIC_RELAXED)) continue;
+            if (page_table_remove(sm, page)) {
+                victim = page;
+                break;
+            }
+        }
+    }
+    if (!victim) return false;
+
     if (victim->is_dirty) sm_persist_page(sm, victim);
     
     for (uint32_t i = 0; i < sm->cache_size; i++) {
@@ -195,5 +392,5 @@ static void evict_lru_page(StorageManager* sm) {
 
     lru_remove(sm, victim);
     SAFE_FREE(victim);
-
+    return true;
 }
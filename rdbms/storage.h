@@ -4,16 +4,22 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
 
 #define MAX_CACHE_PAGES 100
+#define PAGE_TABLE_BUCKETS 128 // hash buckets of the page cache, see StorageManager
 
 #define PAGE_SIZE 4096
 #define MAX_TABLE_NAME 64
 #define MAX_COLUMN_NAME 32
 #define MAX_COLUMNS 32
 #define MAX_STRING_LEN 255
+#define MAX_INDEX_NAME 64
+#define MAX_INDEX_COLUMNS 8
 
 typedef struct PageStruct PageStruct;
+typedef struct BloomFilter BloomFilter;
 
 // Data types supported
 typedef enum {
@@ -23,6 +29,13 @@ typedef enum {
     DT_BOOL
 } DataType;
 
+// Index access methods
+typedef enum {
+    INDEX_BTREE,
+    INDEX_HASH,  // equality only, see hashindex.h
+    INDEX_BITMAP // low-cardinality columns, see bitmapindex.h
+} IndexMethod;
+
 // Column definition
 typedef struct {
     char name[MAX_COLUMN_NAME];
@@ -40,8 +53,23 @@ typedef struct {
     ColumnDef columns[MAX_COLUMNS];
     uint32_t primary_key_index;
     uint32_t row_size; // Size of a single row in bytes
+    uint32_t first_page; // Head of this table's heap page chain
+    uint32_t zone_map_page; // Head of the zone map chain, see zonemap.h
+    uint32_t insert_page; // First heap page that may still have a never-used slot
+
+    // Row layout, derived from the columns by compute_column_layout when a
+    // schema is created or loaded; not stored in the schema page
+    uint32_t column_offsets[MAX_COLUMNS]; // from the start of the row, header included
+    uint32_t column_sizes[MAX_COLUMNS];
 } TableSchema;
 
+// Bytes of a TableSchema kept in the schema page: everything up to the layout
+#define TABLE_SCHEMA_DISK_SIZE offsetof(TableSchema, column_offsets)
+
+// The schema page holds table slots up to its trailer, the first page of
+// the statistics catalog (stats.h)
+#define SCHEMA_PAGE_STATS_OFFSET (PAGE_SIZE - sizeof(uint32_t))
+
 // Page structure
 // typedef struct
 // {
@@ -57,10 +85,14 @@ struct PageStruct {
     uint8_t data[PAGE_SIZE];
     uint32_t page_id;
     bool is_dirty;
-    
+    uint32_t pin_count; // pinned pages are never evicted; changed atomically
+    bool referenced;    // pinned without the latch since eviction last passed it
+
     // LRU pointers
     PageStruct* prev;
     PageStruct* next;
+
+    PageStruct* hash_next; // next page in its page table bucket
 };
 
 typedef struct PageStruct Page;
@@ -72,11 +104,24 @@ typedef struct {
     bool deleted;
 } Record;
 
+// Row identifier: the heap page holding a row and its slot within it
+typedef struct {
+    uint32_t page_id;
+    uint32_t slot;
+} RID;
+
+// Database file magic ("MDB") with the file format version in its top
+// byte. Bump the version whenever the header, schema page or any page
+// layout changes; files of another version are refused, not misread.
+#define DB_MAGIC_BASE 0x0042444D
+#define DB_FORMAT_VERSION 2
+#define DB_MAGIC (DB_MAGIC_BASE | ((uint32_t)DB_FORMAT_VERSION << 24))
+
 // Database file header
 typedef struct {
     uint32_t magic_number;
     uint32_t page_count;
-    uint32_t root_page;
+    uint32_t index_page; // First page of the index catalog
     uint32_t first_free_page;
     uint32_t schema_page;
 } DBHeader;
@@ -89,16 +134,40 @@ typedef struct
     Page* pages[100];
     uint32_t cache_size;
 
+    // Guards the cache, its LRU list and page allocation. Only
+    // sm_pin_page/sm_unpin_page make a page safe to use while other threads
+    // fetch pages; sm_get_page is for single-threaded callers.
+    pthread_mutex_t latch;
+
+    // Cached pages hashed by id. A bucket's chain only changes with both
+    // the latch and the bucket's lock held, so sm_pin_page can find and pin
+    // a cached page under the bucket lock alone.
+    Page* page_table[PAGE_TABLE_BUCKETS];
+    pthread_rwlock_t bucket_locks[PAGE_TABLE_BUCKETS];
+
     // LRU list
     Page* lru_head; // Most recent
     Page* lru_tail; // Least recent
+
+    // Cache counters since open
+    uint64_t page_requests; // sm_get_page/sm_pin_page calls, counted atomically
+    uint64_t page_reads;    // requests that missed the cache and hit the file
+
+    BloomFilter* bloom_filters; // index Bloom filters loaded so far, see bloom.h
 } StorageManager;
 
 StorageManager* sm_open(const char* filename);
 Page* sm_get_page(StorageManager* sm, uint32_t page_id);
+// Like sm_get_page, but the page stays cached until it is unpinned
+Page* sm_pin_page(StorageManager* sm, uint32_t page_id);
+void sm_unpin_page(StorageManager* sm, Page* page);
 void sm_persist_page(StorageManager* sm, Page* page);
 void sm_close(StorageManager* sm);
+// Takes a page off the free list, or extends the file; the page is zeroed
 uint32_t sm_allocate_page(StorageManager* sm);
+// Puts a page nobody references any more on the free list: trunk pages of
+// free page ids, chained from header.first_free_page
+void sm_free_page(StorageManager* sm, uint32_t page_id);
 void print_schema(TableSchema* schema);
 
 void run_repl();
@@ -0,0 +1,165 @@
+#include "vectorfilter.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define VECTOR_X86
+#endif
+
+static int current_level = -1;
+
+static VectorLevel supported_level(void) {
+#ifdef VECTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return VECTOR_AVX2;
+    return VECTOR_SSE2; // every x86-64 CPU has it
+#else
+    return VECTOR_SCALAR;
+#endif
+}
+
+VectorLevel vector_level(void) {
+    if (current_level < 0) current_level = supported_level();
+    return (VectorLevel)current_level;
+}
+
+void vector_set_level(VectorLevel level) {
+    VectorLevel supported = supported_level();
+    current_level = level < supported ? level : supported;
+}
+
+const char* vector_level_name(VectorLevel level) {
+    switch (level) {
+        case VECTOR_SCALAR: return "scalar";
+        case VECTOR_SSE2: return "sse2";
+        case VECTOR_AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+// Turns the lanes that compared smaller and larger than the literal into
+// the lanes `op` keeps. `lanes` has a bit set for every lane.
+static inline uint32_t keep_mask(OperatorType op, uint32_t lt, uint32_t gt, uint32_t lanes) {
+    switch (op) {
+        case OP_EQUALS: return ~(lt | gt) & lanes;
+        case OP_NOT_EQUALS: return lt | gt;
+        case OP_LESS: return lt;
+        case OP_GREATER: return gt;
+        case OP_LESS_EQUAL: return ~gt & lanes;
+        case OP_GREATER_EQUAL: return ~lt & lanes;
+        default: return 0;
+    }
+}
+
+// Appends the rows of the kept lanes to `out`. Every lane is written and
+// only the kept ones advance, so there is no branch to mispredict; the
+// writes never pass the lane being read, which lets `out` alias the input.
+static inline uint32_t compact(uint32_t mask, uint32_t lanes, const uint16_t* selection, uint16_t* out,
+                               uint32_t kept) {
+    for (uint32_t i = 0; i < lanes; i++) {
+        out[kept] = selection[i];
+        kept += (mask >> i) & 1;
+    }
+    return kept;
+}
+
+static uint32_t select_int_scalar(const int32_t* values, const uint16_t* selection, uint32_t count,
+                                  OperatorType op, int32_t literal, uint16_t* out) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t mask = keep_mask(op, values[i] < literal, values[i] > literal, 1);
+        kept = compact(mask, 1, selection + i, out, kept);
+    }
+    return kept;
+}
+
+static uint32_t select_float_scalar(const float* values, const uint16_t* selection, uint32_t count,
+                                    OperatorType op, float literal, uint16_t* out) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t mask = keep_mask(op, values[i] < literal, values[i] > literal, 1);
+        kept = compact(mask, 1, selection + i, out, kept);
+    }
+    return kept;
+}
+
+#ifdef VECTOR_X86
+static uint32_t select_int_sse2(const int32_t* values, const uint16_t* selection, uint32_t count,
+                                OperatorType op, int32_t literal, uint16_t* out) {
+    __m128i lit = _mm_set1_epi32(literal);
+    uint32_t kept = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+        uint32_t lt = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, lit)));
+        uint32_t gt = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, lit)));
+        kept = compact(keep_mask(op, lt, gt, 0xF), 4, selection + i, out, kept);
+    }
+    return kept + select_int_scalar(values + i, selection + i, count - i, op, literal, out + kept);
+}
+
+static uint32_t select_float_sse2(const float* values, const uint16_t* selection, uint32_t count,
+                                  OperatorType op, float literal, uint16_t* out) {
+    __m128 lit = _mm_set1_ps(literal);
+    uint32_t kept = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(values + i);
+        uint32_t lt = (uint32_t)_mm_movemask_ps(_mm_cmplt_ps(v, lit));
+        uint32_t gt = (uint32_t)_mm_movemask_ps(_mm_cmpgt_ps(v, lit));
+        kept = compact(keep_mask(op, lt, gt, 0xF), 4, selection + i, out, kept);
+    }
+    return kept + select_float_scalar(values + i, selection + i, count - i, op, literal, out + kept);
+}
+
+__attribute__((target("avx2")))
+static uint32_t select_int_avx2(const int32_t* values, const uint16_t* selection, uint32_t count,
+                                OperatorType op, int32_t literal, uint16_t* out) {
+    __m256i lit = _mm256_set1_epi32(literal);
+    uint32_t kept = 0;
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+        uint32_t lt = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lit, v)));
+        uint32_t gt = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, lit)));
+        kept = compact(keep_mask(op, lt, gt, 0xFF), 8, selection + i, out, kept);
+    }
+    return kept + select_int_scalar(values + i, selection + i, count - i, op, literal, out + kept);
+}
+
+__attribute__((target("avx2")))
+static uint32_t select_float_avx2(const float* values, const uint16_t* selection, uint32_t count,
+                                  OperatorType op, float literal, uint16_t* out) {
+    __m256 lit = _mm256_set1_ps(literal);
+    uint32_t kept = 0;
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(values + i);
+        uint32_t lt = (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(v, lit, _CMP_LT_OQ));
+        uint32_t gt = (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(v, lit, _CMP_GT_OQ));
+        kept = compact(keep_mask(op, lt, gt, 0xFF), 8, selection + i, out, kept);
+    }
+    return kept + select_float_scalar(values + i, selection + i, count - i, op, literal, out + kept);
+}
+#endif
+
+uint32_t vector_select_int(const int32_t* values, const uint16_t* selection, uint32_t count,
+                           OperatorType op, int32_t literal, uint16_t* out) {
+    switch (vector_level()) {
+#ifdef VECTOR_X86
+        case VECTOR_AVX2: return select_int_avx2(values, selection, count, op, literal, out);
+        case VECTOR_SSE2: return select_int_sse2(values, selection, count, op, literal, out);
+#endif
+        default: return select_int_scalar(values, selection, count, op, literal, out);
+    }
+}
+
+uint32_t vector_select_float(const float* values, const uint16_t* selection, uint32_t count,
+                             OperatorType op, float literal, uint16_t* out) {
+    switch (vector_level()) {
+#ifdef VECTOR_X86
+        case VECTOR_AVX2: return select_float_avx2(values, selection, count, op, literal, out);
+        case VECTOR_SSE2: return select_float_sse2(values, selection, count, op, literal, out);
+#endif
+        default: return select_float_scalar(values, selection, count, op, literal, out);
+    }
+}
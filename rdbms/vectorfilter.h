@@ -0,0 +1,37 @@
+// vectorfilter.h
+
+#ifndef VECTORFILTER_H
+#define VECTORFILTER_H
+
+#include <stdint.h>
+#include "parser.h"
+
+#define VECTOR_SIZE 1024 // rows per batch, see Batch in executor.c
+
+// Comparison kernels of vectorized filters. A kernel compares a column
+// vector of `count` values with a literal and keeps the entries of
+// `selection` (the row each value came from) whose value satisfies `op`,
+// writing them to `out` in order; returns how many it kept. `out` may be
+// `selection` itself.
+//
+// Values order like compare_doubles in the executor: a NaN is neither
+// smaller nor larger than the literal, so it counts as equal. OP_LIKE keeps
+// nothing.
+typedef enum {
+    VECTOR_SCALAR,
+    VECTOR_SSE2,
+    VECTOR_AVX2
+} VectorLevel;
+
+// Widest instruction set the kernels use, picked from the CPU on first use
+VectorLevel vector_level(void);
+// Caps the level, e.g. to compare kernels; never goes above what the CPU has
+void vector_set_level(VectorLevel level);
+const char* vector_level_name(VectorLevel level);
+
+uint32_t vector_select_int(const int32_t* values, const uint16_t* selection, uint32_t count,
+                           OperatorType op, int32_t literal, uint16_t* out);
+uint32_t vector_select_float(const float* values, const uint16_t* selection, uint32_t count,
+                             OperatorType op, float literal, uint16_t* out);
+
+#endif // VECTORFILTER_H
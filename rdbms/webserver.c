@@ -237,14 +237,14 @@ char* result_to_json(QueryResult* result) {
         pos += snprintf(json + pos, buffer_size - pos, "[");
         
         for (uint32_t col = 0; col < result->column_count; col++) {
-            if (result->rows[row][col]) {
+            const char* value = result_value(result, row, col);
+            if (value) {
                 // Escape quotes in string values
-                char* value = (char*)result->rows[row][col];
                 char* escaped = SAFE_MALLOC(char, strlen(value) * 2 + 3);
                 if (escaped) {
                     char* dest = escaped;
                     *dest++ = '"';
-                    for (char* src = value; *src; src++) {
+                    for (const char* src = value; *src; src++) {
                         if (*src == '"' || *src == '\\') {
                             *dest++ = '\\';
                         }
@@ -283,6 +283,125 @@ char* result_to_json(QueryResult* result) {
     return json;
 }
 
+static void send_json(int client_fd, const char* json) {
+    char response_header[256];
+    snprintf(response_header, sizeof(response_header),
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: %lu\r\n"
+            "Access-Control-Allow-Origin: *\r\n\r\n",
+            strlen(json));
+
+    write(client_fd, response_header, strlen(response_header));
+    write(client_fd, json, strlen(json));
+}
+
+// Buffers a response body and sends it as HTTP/1.1 chunks
+typedef struct {
+    int fd;
+    size_t length;
+    char buffer[BUFFER_SIZE];
+} ChunkWriter;
+
+static void chunk_flush(ChunkWriter* writer) {
+    if (writer->length == 0) return;
+
+    char size_line[32];
+    int size_length = snprintf(size_line, sizeof(size_line), "%zx\r\n", writer->length);
+    write(writer->fd, size_line, size_length);
+    write(writer->fd, writer->buffer, writer->length);
+    write(writer->fd, "\r\n", 2);
+    writer->length = 0;
+}
+
+static void chunk_write(ChunkWriter* writer, const char* data, size_t length) {
+    while (length > 0) {
+        if (writer->length == BUFFER_SIZE) chunk_flush(writer);
+
+        size_t room = BUFFER_SIZE - writer->length;
+        size_t n = length < room ? length : room;
+        memcpy(writer->buffer + writer->length, data, n);
+        writer->length += n;
+        data += n;
+        length -= n;
+    }
+}
+
+static void chunk_puts(ChunkWriter* writer, const char* text) {
+    chunk_write(writer, text, strlen(text));
+}
+
+// Writes a JSON string literal
+static void chunk_json_string(ChunkWriter* writer, const char* text) {
+    chunk_write(writer, "\"", 1);
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            chunk_write(writer, "\\", 1);
+            chunk_write(writer, c, 1);
+        } else if ((unsigned char)*c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+            chunk_puts(writer, escaped);
+        } else {
+            chunk_write(writer, c, 1);
+        }
+    }
+    chunk_write(writer, "\"", 1);
+}
+
+// Sends a SELECT as it runs, in the same JSON shape as result_to_json.
+// The body is chunked, so its length need not be known up front; an
+// error after the first rows is reported in an "error" member.
+static void send_query_stream(int client_fd, QueryStream* stream) {
+    if (stream->error_message) {
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer), "{\"error\":\"%s\"}", stream->error_message);
+        send_json(client_fd, buffer);
+        return;
+    }
+
+    const char* header =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Access-Control-Allow-Origin: *\r\n\r\n";
+    write(client_fd, header, strlen(header));
+
+    ChunkWriter* writer = SAFE_MALLOC(ChunkWriter, 1);
+    writer->fd = client_fd;
+    writer->length = 0;
+
+    chunk_puts(writer, "{\"columns\":[");
+    for (uint32_t i = 0; i < stream->column_count; i++) {
+        if (i > 0) chunk_puts(writer, ",");
+        chunk_json_string(writer, stream->column_names[i]);
+    }
+    chunk_puts(writer, "],\"rows\":[");
+
+    while (query_next(stream)) {
+        chunk_puts(writer, stream->row_count > 1 ? ",[" : "[");
+        for (uint32_t col = 0; col < stream->column_count; col++) {
+            if (col > 0) chunk_puts(writer, ",");
+            if (stream->values[col]) chunk_json_string(writer, stream->values[col]);
+            else chunk_puts(writer, "null");
+        }
+        chunk_puts(writer, "]");
+    }
+
+    char tail[64];
+    snprintf(tail, sizeof(tail), "],\"rowCount\":%llu", (unsigned long long)stream->row_count);
+    chunk_puts(writer, tail);
+    if (stream->error_message) {
+        chunk_puts(writer, ",\"error\":");
+        chunk_json_string(writer, stream->error_message);
+    }
+    chunk_puts(writer, "}");
+
+    chunk_flush(writer);
+    write(client_fd, "0\r\n\r\n", 5);
+    SAFE_FREE(writer);
+}
+
 // Handle HTTP request
 void handle_request(int client_fd, StorageManager* sm) {
     char buffer[BUFFER_SIZE] = {0};
@@ -415,6 +534,16 @@ void handle_request(int client_fd, StorageManager* sm) {
         SQLStatement* stmt = parse_sql(query);
         char* json_response = NULL;
         
+        if (stmt && !stmt->has_error && stmt->type == STMT_SELECT) {
+            // Rows go out as they are produced
+            QueryStream* stream = query_open(sm, stmt);
+            send_query_stream(client_fd, stream);
+            query_close(stream);
+            free_sql_statement(stmt);
+            close(client_fd);
+            return;
+        }
+
         if (!stmt || stmt->has_error) {
             json_response = SAFE_MALLOC(char, 256);
             if (json_response) {
@@ -429,15 +558,24 @@ void handle_request(int client_fd, StorageManager* sm) {
                 case STMT_CREATE_TABLE:
                     result = execute_create_table(sm, stmt);
                     break;
-                case STMT_SELECT:
-                    result = execute_select(sm, stmt);
-                    break;
                 case STMT_INSERT:
                     result = execute_insert(sm, stmt);
                     break;
                 case STMT_DELETE:
                     result = execute_delete(sm, stmt);
                     break;
+                case STMT_CREATE_INDEX:
+                    result = execute_create_index(sm, stmt);
+                    break;
+                case STMT_DROP_INDEX:
+                    result = execute_drop_index(sm, stmt);
+                    break;
+                case STMT_REINDEX:
+                    result = execute_reindex(sm, stmt);
+                    break;
+                case STMT_ANALYZE:
+                    result = execute_analyze(sm, stmt);
+                    break;
                 default:
                     json_response = SAFE_STRDUP("{\"error\":\"Unsupported statement type\"}");
                     break;
@@ -458,17 +596,16 @@ void handle_request(int client_fd, StorageManager* sm) {
         }
         
         // Send response
-        char response_header[256];
-        snprintf(response_header, sizeof(response_header),
-                "HTTP/1.1 200 OK\r\n"
-                "Content-Type: application/json\r\n"
-                "Content-Length: %lu\r\n"
-                "Access-Control-Allow-Origin: *\r\n\r\n",
-                strlen(json_response));
-        
-        write(client_fd, response_header, strlen(response_header));
-        write(client_fd, json_response, strlen(json_response));
-        
+        send_json(client_fd, json_response);
+        SAFE_FREE(json_response);
+    }
+    else if (strncmp(path, "/api/indexstats?table=", 22) == 0 && strcmp(method, "GET") == 0) {
+        // B-tree statistics for every index of a table, as .indexstats shows them
+        QueryResult* result = execute_index_stats(sm, path + 22);
+        char* json_response = result_to_json(result);
+        free_result(result);
+
+        send_json(client_fd, json_response ? json_response : "{\"error\":\"Internal server error\"}");
         SAFE_FREE(json_response);
     }
     else {
@@ -0,0 +1,220 @@
+#include "zonemap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+
+// Zone page layout: header | entries. An entry is the heap page id, its
+// live row count, then min and max of every column.
+typedef struct {
+    uint32_t count;
+    uint32_t next; // next zone page, 0 at the end of the chain
+} ZonePageHeader;
+
+#define ZONE_HEADER(page) ((ZonePageHeader*)(page)->data)
+#define HEAP_ZONE_PAGE_OFFSET (PAGE_SIZE - HEAP_TRAILER_SIZE)
+#define HEAP_ZONE_SLOT_OFFSET (PAGE_SIZE - 2 * sizeof(uint32_t))
+
+static uint32_t entry_size(TableSchema* schema) {
+    return 2 * sizeof(uint32_t) + schema->column_count * 2 * ZONE_VALUE_SIZE;
+}
+
+static uint32_t entries_per_page(TableSchema* schema) {
+    return (PAGE_SIZE - sizeof(ZonePageHeader)) / entry_size(schema);
+}
+
+static uint8_t* entry_at(TableSchema* schema, Page* page, uint32_t slot) {
+    return page->data + sizeof(ZonePageHeader) + slot * entry_size(schema);
+}
+
+static void read_entry(TableSchema* schema, const uint8_t* entry, ZoneSummary* summary) {
+    memcpy(&summary->row_count, entry + sizeof(uint32_t), sizeof(uint32_t));
+    const uint8_t* bounds = entry + 2 * sizeof(uint32_t);
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        memcpy(summary->min[i], bounds, ZONE_VALUE_SIZE);
+        memcpy(summary->max[i], bounds + ZONE_VALUE_SIZE, ZONE_VALUE_SIZE);
+        bounds += 2 * ZONE_VALUE_SIZE;
+    }
+}
+
+static void write_entry(TableSchema* schema, uint8_t* entry, const ZoneSummary* summary) {
+    memcpy(entry + sizeof(uint32_t), &summary->row_count, sizeof(uint32_t));
+    uint8_t* bounds = entry + 2 * sizeof(uint32_t);
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        memcpy(bounds, summary->min[i], ZONE_VALUE_SIZE);
+        memcpy(bounds + ZONE_VALUE_SIZE, summary->max[i], ZONE_VALUE_SIZE);
+        bounds += 2 * ZONE_VALUE_SIZE;
+    }
+}
+
+// Records where a heap page's zone entry lives in the page's trailer
+static bool set_locator(StorageManager* sm, uint32_t heap_page, uint32_t zone_page, uint32_t slot) {
+    Page* page = sm_get_page(sm, heap_page);
+    if (!page) return false;
+
+    memcpy(page->data + HEAP_ZONE_PAGE_OFFSET, &zone_page, sizeof(uint32_t));
+    memcpy(page->data + HEAP_ZONE_SLOT_OFFSET, &slot, sizeof(uint32_t));
+    page->is_dirty = true;
+    return true;
+}
+
+// Returns the zone page holding the heap page's entry, 0 if it has none
+static uint32_t locate(StorageManager* sm, uint32_t heap_page, uint32_t* slot) {
+    Page* page = sm_get_page(sm, heap_page);
+    if (!page) return 0;
+
+    uint32_t zone_page;
+    memcpy(&zone_page, page->data + HEAP_ZONE_PAGE_OFFSET, sizeof(uint32_t));
+    memcpy(slot, page->data + HEAP_ZONE_SLOT_OFFSET, sizeof(uint32_t));
+    return zone_page;
+}
+
+// Appends an empty entry to the given zone page, which must be the tail
+// of the chain; chains a new zone page when it is full
+static bool append_entry(StorageManager* sm, TableSchema* schema, uint32_t zone_page, uint32_t heap_page) {
+    Page* page = sm_get_page(sm, zone_page);
+    if (!page) return false;
+
+    if (ZONE_HEADER(page)->count >= entries_per_page(schema)) {
+        uint32_t next = sm_allocate_page(sm);
+        page = sm_get_page(sm, zone_page);
+        ZONE_HEADER(page)->next = next;
+        page->is_dirty = true;
+
+        zone_page = next;
+        page = sm_get_page(sm, zone_page);
+        if (!page) return false;
+    }
+
+    uint32_t slot = ZONE_HEADER(page)->count++;
+    uint8_t* entry = entry_at(schema, page, slot);
+    memset(entry, 0, entry_size(schema));
+    memcpy(entry, &heap_page, sizeof(uint32_t));
+    page->is_dirty = true;
+
+    return set_locator(sm, heap_page, zone_page, slot);
+}
+
+uint32_t zone_map_create(StorageManager* sm, TableSchema* schema, uint32_t heap_page) {
+    if (!sm || !schema) return 0;
+
+    uint32_t zone_page = sm_allocate_page(sm);
+    if (!append_entry(sm, schema, zone_page, heap_page)) return 0;
+    return zone_page;
+}
+
+bool zone_map_attach(StorageManager* sm, TableSchema* schema, uint32_t heap_page) {
+    if (!sm || !schema || schema->zone_map_page == 0) return false;
+
+    uint32_t zone_page = schema->zone_map_page;
+    while (true) {
+        Page* page = sm_get_page(sm, zone_page);
+        if (!page) return false;
+        if (ZONE_HEADER(page)->next == 0) break;
+        zone_page = ZONE_HEADER(page)->next;
+    }
+    return append_entry(sm, schema, zone_page, heap_page);
+}
+
+void zone_summary_add(ZoneSummary* summary, uint32_t column_count, const uint8_t* values) {
+    for (uint32_t i = 0; i < column_count; i++) {
+        const uint8_t* value = values + i * ZONE_VALUE_SIZE;
+        if (summary->row_count == 0 || memcmp(value, summary->min[i], ZONE_VALUE_SIZE) < 0) {
+            memcpy(summary->min[i], value, ZONE_VALUE_SIZE);
+        }
+        if (summary->row_count == 0 || memcmp(value, summary->max[i], ZONE_VALUE_SIZE) > 0) {
+            memcpy(summary->max[i], value, ZONE_VALUE_SIZE);
+        }
+    }
+    summary->row_count++;
+}
+
+// Folds a row into the heap page's entry; an update keeps the row count
+static void include_row(StorageManager* sm, TableSchema* schema, uint32_t heap_page,
+                        const uint8_t* values, bool new_row) {
+    uint32_t slot;
+    uint32_t zone_page = locate(sm, heap_page, &slot);
+    if (zone_page == 0) return;
+
+    Page* page = sm_get_page(sm, zone_page);
+    if (!page || slot >= ZONE_HEADER(page)->count) return;
+
+    ZoneSummary summary;
+    uint8_t* entry = entry_at(schema, page, slot);
+    read_entry(schema, entry, &summary);
+
+    uint32_t row_count = summary.row_count;
+    zone_summary_add(&summary, schema->column_count, values);
+    if (!new_row && row_count > 0) summary.row_count = row_count;
+
+    write_entry(schema, entry, &summary);
+    page->is_dirty = true;
+}
+
+void zone_map_add_row(StorageManager* sm, TableSchema* schema, uint32_t heap_page, const uint8_t* values) {
+    include_row(sm, schema, heap_page, values, true);
+}
+
+void zone_map_widen(StorageManager* sm, TableSchema* schema, uint32_t heap_page, const uint8_t* values) {
+    include_row(sm, schema, heap_page, values, false);
+}
+
+void zone_map_store(StorageManager* sm, TableSchema* schema, uint32_t heap_page, const ZoneSummary* summary) {
+    uint32_t slot;
+    uint32_t zone_page = locate(sm, heap_page, &slot);
+    if (zone_page == 0) return;
+
+    Page* page = sm_get_page(sm, zone_page);
+    if (!page || slot >= ZONE_HEADER(page)->count) return;
+
+    write_entry(schema, entry_at(schema, page, slot), summary);
+    page->is_dirty = true;
+}
+
+void zone_scan_begin(ZoneScan* scan, StorageManager* sm, TableSchema* schema, const ZoneBounds* bounds) {
+    scan->sm = sm;
+    scan->schema = schema;
+    scan->bounds = bounds;
+    scan->zone_page = schema->zone_map_page;
+    scan->slot = 0;
+    scan->pages_skipped = 0;
+}
+
+static bool may_match(TableSchema* schema, const ZoneSummary* summary, const ZoneBounds* bounds) {
+    if (summary->row_count == 0) return false;
+    if (!bounds) return true;
+
+    for (uint32_t i = 0; i < schema->column_count; i++) {
+        if (bounds->has_low[i] && memcmp(summary->max[i], bounds->low[i], ZONE_VALUE_SIZE) < 0) {
+            return false;
+        }
+        if (bounds->has_high[i] && memcmp(summary->min[i], bounds->high[i], ZONE_VALUE_SIZE) > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t zone_scan_next(ZoneScan* scan) {
+    while (scan->zone_page != 0) {
+        Page* page = sm_get_page(scan->sm, scan->zone_page);
+        if (!page) break;
+
+        while (scan->slot < ZONE_HEADER(page)->count) {
+            uint8_t* entry = entry_at(scan->schema, page, scan->slot++);
+            ZoneSummary summary;
+            read_entry(scan->schema, entry, &summary);
+
+            if (may_match(scan->schema, &summary, scan->bounds)) {
+                uint32_t heap_page;
+                memcpy(&heap_page, entry, sizeof(uint32_t));
+                return heap_page;
+            }
+            scan->pages_skipped++;
+        }
+
+        scan->zone_page = ZONE_HEADER(page)->next;
+        scan->slot = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+// zonemap.h
+
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include "storage.h"
+
+#define ZONE_VALUE_SIZE 8 // leading bytes of each encoded column value kept as min/max
+
+// Heap pages end with a trailer: the zone page and slot holding the page's
+// zone map entry, then the next-page link in the last 4 bytes
+#define HEAP_TRAILER_SIZE (3 * sizeof(uint32_t))
+
+// Per heap page summary of a table: the number of live rows and, for
+// every column, the smallest and largest value on the page. Values are
+// compared as the first ZONE_VALUE_SIZE bytes of their memcmp-comparable
+// encoding (btree_encode_value, zero padded), so longer strings are only
+// summarised by their prefix; bounds stay correct, just less sharp.
+//
+// A table's entries live in a page chain starting at
+// TableSchema.zone_map_page, in the same order as its heap chain, so a
+// scan can walk the zone map instead of the heap and only read the heap
+// pages whose summary admits a match. Bounds only ever widen on insert and
+// update; a delete recomputes the page's entry from its live rows.
+typedef struct {
+    uint32_t row_count;
+    uint8_t min[MAX_COLUMNS][ZONE_VALUE_SIZE];
+    uint8_t max[MAX_COLUMNS][ZONE_VALUE_SIZE];
+} ZoneSummary;
+
+// Inclusive bounds a scan is looking for, per column, in the same encoding
+typedef struct {
+    bool has_low[MAX_COLUMNS];
+    bool has_high[MAX_COLUMNS];
+    uint8_t low[MAX_COLUMNS][ZONE_VALUE_SIZE];
+    uint8_t high[MAX_COLUMNS][ZONE_VALUE_SIZE];
+} ZoneBounds;
+
+// Walks the heap pages that may hold rows inside the bounds
+typedef struct {
+    StorageManager* sm;
+    TableSchema* schema;
+    const ZoneBounds* bounds; // NULL: every page with live rows
+    uint32_t zone_page;       // 0 once the zone map is exhausted
+    uint32_t slot;
+    uint32_t pages_skipped;
+} ZoneScan;
+
+// Starts the zone map of a new table with an entry for its first heap page;
+// returns the first zone page
+uint32_t zone_map_create(StorageManager* sm, TableSchema* schema, uint32_t heap_page);
+// Adds an empty entry for a heap page just linked at the end of the chain
+bool zone_map_attach(StorageManager* sm, TableSchema* schema, uint32_t heap_page);
+
+// `values` holds ZONE_VALUE_SIZE bytes per column of one row, in column order
+void zone_summary_add(ZoneSummary* summary, uint32_t column_count, const uint8_t* values);
+void zone_map_add_row(StorageManager* sm, TableSchema* schema, uint32_t heap_page, const uint8_t* values);
+void zone_map_widen(StorageManager* sm, TableSchema* schema, uint32_t heap_page, const uint8_t* values);
+void zone_map_store(StorageManager* sm, TableSchema* schema, uint32_t heap_page, const ZoneSummary* summary);
+
+void zone_scan_begin(ZoneScan* scan, StorageManager* sm, TableSchema* schema, const ZoneBounds* bounds);
+uint32_t zone_scan_next(ZoneScan* scan); // next heap page, 0 at the end
+
+#endif // ZONEMAP_H